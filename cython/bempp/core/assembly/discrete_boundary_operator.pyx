@@ -68,8 +68,13 @@ cdef class RealDiscreteBoundaryOperator:
 
     def matvec(self,np.ndarray x):
 
-        if np.iscomplexobj(x):
-            return self.matvec(np.real(x))+1j*self.matvec(np.imag(x))
+        if np.iscomplexobj(x) and x.ndim <= 2:
+            # Real and imaginary parts as the columns of one block.
+            x_mat = x.reshape((x.shape[0], -1), order='F')
+            n = x_mat.shape[1]
+            y_mat = self.matvec(np.hstack([np.real(x_mat), np.imag(x_mat)]))
+            y_mat = y_mat[:, :n] + 1j * y_mat[:, n:]
+            return y_mat.ravel() if x.ndim == 1 else y_mat
 
         cdef np.ndarray x_in
         cdef np.ndarray y
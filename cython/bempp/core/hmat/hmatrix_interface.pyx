@@ -11,12 +11,20 @@ from bempp.core.hmat.hmatrix_data cimport down_cast_to_low_rank_data
 from bempp.core.utils cimport shared_ptr
 from bempp.core.utils cimport catch_exception
 from bempp.core.utils cimport complex_double
+from libcpp.string cimport string
+from libcpp.vector cimport vector
+from libcpp cimport bool as cbool
 from bempp.core.assembly.discrete_boundary_operator cimport c_DiscreteBoundaryOperator
 from bempp.core.assembly.discrete_boundary_operator cimport RealDiscreteBoundaryOperator
 from bempp.core.assembly.discrete_boundary_operator cimport ComplexDiscreteBoundaryOperator
 from cython.operator cimport dereference as deref
+import numpy as np
 
 
+cdef extern from "bempp/hmat/hmatrix_statistics.hpp":
+    cdef cppclass c_HMatrixStatistics "hmat::HMatrixStatistics":
+        string toJson() const
+
 cdef extern from "bempp/hmat/hmatrix.hpp":
     cdef cppclass c_HMatrix "hmat::DefaultHMatrixType"[T]:
         shared_ptr[const c_BlockClusterTree] blockClusterTree() const
@@ -26,10 +34,38 @@ cdef extern from "bempp/hmat/hmatrix.hpp":
         int numberOfLowRankBlocks() const
         int numberOfBlocks() const
         double memSizeKb();
+        double predictedImbalance() const
+        double actualImbalance() const
+        c_HMatrixStatistics statistics() const
+
+cdef extern from "bempp/core/hmat/py_hmat_support.hpp" namespace "hmat":
+    cdef cppclass c_SparseMatrix "Eigen::SparseMatrix<double>":
+        pass
+    cdef c_SparseMatrix py_sparse_matrix_from_csc(
+            int, int, const vector[int]&, const vector[int]&, const vector[double]&)
 
 cdef extern from "bempp/assembly/discrete_hmat_boundary_operator.hpp" namespace "Bempp":
     cdef shared_ptr[const c_HMatrix[T]] castToHMatrix[T](
             const shared_ptr[const c_DiscreteBoundaryOperator[T]]&) except+catch_exception
+    cdef shared_ptr[const c_DiscreteBoundaryOperator[T]] hMatrixLuInverse[T](
+            const shared_ptr[const c_DiscreteBoundaryOperator[T]]&, double) except+catch_exception
+    cdef shared_ptr[const c_DiscreteBoundaryOperator[T]] hMatrixToH2Matrix[T](
+            const shared_ptr[const c_DiscreteBoundaryOperator[T]]&, double) except+catch_exception
+    cdef shared_ptr[const c_DiscreteBoundaryOperator[T]] hMatrixScale[T](
+            const shared_ptr[const c_DiscreteBoundaryOperator[T]]&, T) except+catch_exception
+    cdef shared_ptr[const c_DiscreteBoundaryOperator[T]] hMatrixAdd[T](
+            const shared_ptr[const c_DiscreteBoundaryOperator[T]]&,
+            const shared_ptr[const c_DiscreteBoundaryOperator[T]]&, T, double) except+catch_exception
+    cdef shared_ptr[const c_DiscreteBoundaryOperator[T]] hMatrixMultiply[T](
+            const shared_ptr[const c_DiscreteBoundaryOperator[T]]&,
+            const shared_ptr[const c_DiscreteBoundaryOperator[T]]&, double) except+catch_exception
+    cdef shared_ptr[const c_DiscreteBoundaryOperator[T]] hMatrixSparseMultiply[T](
+            const shared_ptr[const c_DiscreteBoundaryOperator[T]]&,
+            const c_SparseMatrix&, cbool, double) except+catch_exception
+    cdef void saveHMatrix[T](
+            const shared_ptr[const c_DiscreteBoundaryOperator[T]]&, const string&) except+catch_exception
+    cdef shared_ptr[const c_DiscreteBoundaryOperator[T]] loadHMatrix[T](
+            const string&) except+catch_exception
 
 
 def block_cluster_tree_ext(discrete_operator):
@@ -100,6 +136,36 @@ def mem_size_ext(discrete_operator):
     except:
         raise ValueError("discrete_operator does not seem to be a valid HMatrix.")
 
+def load_imbalance_ext(discrete_operator):
+    """Return the predicted and the actual load imbalance of the assembly."""
+
+    try:
+        if discrete_operator.dtype == 'float64':
+            return (deref(castToHMatrix[double]((
+                <RealDiscreteBoundaryOperator>discrete_operator).impl_)).predictedImbalance(),
+                    deref(castToHMatrix[double]((
+                <RealDiscreteBoundaryOperator>discrete_operator).impl_)).actualImbalance())
+        else:
+            return (deref(castToHMatrix[complex_double]((
+                <ComplexDiscreteBoundaryOperator>discrete_operator).impl_)).predictedImbalance(),
+                    deref(castToHMatrix[complex_double]((
+                <ComplexDiscreteBoundaryOperator>discrete_operator).impl_)).actualImbalance())
+    except:
+        raise ValueError("discrete_operator does not seem to be a valid HMatrix.")
+
+def statistics_ext(discrete_operator):
+    """Return the assembly and matvec statistics as JSON string."""
+
+    try:
+        if discrete_operator.dtype == 'float64':
+            return deref(castToHMatrix[double]((
+                <RealDiscreteBoundaryOperator>discrete_operator).impl_)).statistics().toJson().decode('UTF-8')
+        else:
+            return deref(castToHMatrix[complex_double]((
+                <ComplexDiscreteBoundaryOperator>discrete_operator).impl_)).statistics().toJson().decode('UTF-8')
+    except:
+        raise ValueError("discrete_operator does not seem to be a valid HMatrix.")
+
 def data_block_ext(discrete_operator, block_cluster_tree_node):
     """Return a data block for a block cluster tree node."""
 
@@ -130,6 +196,132 @@ def data_block_ext(discrete_operator, block_cluster_tree_node):
     except:
         raise ValueError("discrete_operator does not seem to be a valid HMatrix.")
 
+def lu_inverse_ext(discrete_operator, double eps):
+    """Return the inverse of a discrete operator via an H-LU factorization."""
+
+    cdef RealDiscreteBoundaryOperator real_discrete_operator = RealDiscreteBoundaryOperator()
+    cdef ComplexDiscreteBoundaryOperator complex_discrete_operator = ComplexDiscreteBoundaryOperator()
+
+    if discrete_operator.dtype == 'float64':
+        real_discrete_operator.impl_ = hMatrixLuInverse[double](
+            (<RealDiscreteBoundaryOperator>discrete_operator).impl_, eps)
+        return real_discrete_operator
+    else:
+        complex_discrete_operator.impl_ = hMatrixLuInverse[complex_double](
+            (<ComplexDiscreteBoundaryOperator>discrete_operator).impl_, eps)
+        return complex_discrete_operator
+
+def h2matrix_ext(discrete_operator, double eps):
+    """Return a discrete operator recompressed into an H2-Matrix."""
+
+    cdef RealDiscreteBoundaryOperator real_discrete_operator = RealDiscreteBoundaryOperator()
+    cdef ComplexDiscreteBoundaryOperator complex_discrete_operator = ComplexDiscreteBoundaryOperator()
+
+    if discrete_operator.dtype == 'float64':
+        real_discrete_operator.impl_ = hMatrixToH2Matrix[double](
+            (<RealDiscreteBoundaryOperator>discrete_operator).impl_, eps)
+        return real_discrete_operator
+    else:
+        complex_discrete_operator.impl_ = hMatrixToH2Matrix[complex_double](
+            (<ComplexDiscreteBoundaryOperator>discrete_operator).impl_, eps)
+        return complex_discrete_operator
+
+def scale_ext(discrete_operator, alpha):
+    """Return a copy of an H-Matrix operator scaled by alpha."""
+
+    cdef RealDiscreteBoundaryOperator real_discrete_operator = RealDiscreteBoundaryOperator()
+    cdef ComplexDiscreteBoundaryOperator complex_discrete_operator = ComplexDiscreteBoundaryOperator()
+
+    if discrete_operator.dtype == 'float64':
+        real_discrete_operator.impl_ = hMatrixScale[double](
+            (<RealDiscreteBoundaryOperator>discrete_operator).impl_, alpha)
+        return real_discrete_operator
+    else:
+        complex_discrete_operator.impl_ = hMatrixScale[complex_double](
+            (<ComplexDiscreteBoundaryOperator>discrete_operator).impl_,
+            complex_double(np.real(alpha), np.imag(alpha)))
+        return complex_discrete_operator
+
+def add_ext(op1, op2, alpha, double eps):
+    """Return op1 + alpha * op2 for two H-Matrix operators."""
+
+    cdef RealDiscreteBoundaryOperator real_discrete_operator = RealDiscreteBoundaryOperator()
+    cdef ComplexDiscreteBoundaryOperator complex_discrete_operator = ComplexDiscreteBoundaryOperator()
+
+    if op1.dtype == 'float64':
+        real_discrete_operator.impl_ = hMatrixAdd[double](
+            (<RealDiscreteBoundaryOperator>op1).impl_,
+            (<RealDiscreteBoundaryOperator>op2).impl_, alpha, eps)
+        return real_discrete_operator
+    else:
+        complex_discrete_operator.impl_ = hMatrixAdd[complex_double](
+            (<ComplexDiscreteBoundaryOperator>op1).impl_,
+            (<ComplexDiscreteBoundaryOperator>op2).impl_,
+            complex_double(np.real(alpha), np.imag(alpha)), eps)
+        return complex_discrete_operator
+
+def multiply_ext(op1, op2, double eps):
+    """Return the product of two H-Matrix operators."""
+
+    cdef RealDiscreteBoundaryOperator real_discrete_operator = RealDiscreteBoundaryOperator()
+    cdef ComplexDiscreteBoundaryOperator complex_discrete_operator = ComplexDiscreteBoundaryOperator()
+
+    if op1.dtype == 'float64':
+        real_discrete_operator.impl_ = hMatrixMultiply[double](
+            (<RealDiscreteBoundaryOperator>op1).impl_,
+            (<RealDiscreteBoundaryOperator>op2).impl_, eps)
+        return real_discrete_operator
+    else:
+        complex_discrete_operator.impl_ = hMatrixMultiply[complex_double](
+            (<ComplexDiscreteBoundaryOperator>op1).impl_,
+            (<ComplexDiscreteBoundaryOperator>op2).impl_, eps)
+        return complex_discrete_operator
+
+def sparse_multiply_ext(discrete_operator, sparse_matrix, cbool sparse_on_left, double eps):
+    """Return the product of an H-Matrix operator with a real scipy sparse matrix."""
+
+    cdef RealDiscreteBoundaryOperator real_discrete_operator = RealDiscreteBoundaryOperator()
+    cdef ComplexDiscreteBoundaryOperator complex_discrete_operator = ComplexDiscreteBoundaryOperator()
+    cdef c_SparseMatrix c_sparse_matrix
+
+    csc = sparse_matrix.tocsc()
+    csc.sort_indices()
+    c_sparse_matrix = py_sparse_matrix_from_csc(
+        csc.shape[0], csc.shape[1], csc.indptr, csc.indices, csc.data)
+
+    if discrete_operator.dtype == 'float64':
+        real_discrete_operator.impl_ = hMatrixSparseMultiply[double](
+            (<RealDiscreteBoundaryOperator>discrete_operator).impl_,
+            c_sparse_matrix, sparse_on_left, eps)
+        return real_discrete_operator
+    else:
+        complex_discrete_operator.impl_ = hMatrixSparseMultiply[complex_double](
+            (<ComplexDiscreteBoundaryOperator>discrete_operator).impl_,
+            c_sparse_matrix, sparse_on_left, eps)
+        return complex_discrete_operator
+
+def save_ext(discrete_operator, file_name):
+    """Write an H-Matrix operator to a file."""
+
+    cdef string c_file_name = file_name.encode('UTF-8')
+
+    if discrete_operator.dtype == 'float64':
+        saveHMatrix[double](
+            (<RealDiscreteBoundaryOperator>discrete_operator).impl_, c_file_name)
+    else:
+        saveHMatrix[complex_double](
+            (<ComplexDiscreteBoundaryOperator>discrete_operator).impl_, c_file_name)
 
+def load_ext(file_name, dtype):
+    """Read an H-Matrix operator written by save_ext."""
 
+    cdef string c_file_name = file_name.encode('UTF-8')
+    cdef RealDiscreteBoundaryOperator real_discrete_operator = RealDiscreteBoundaryOperator()
+    cdef ComplexDiscreteBoundaryOperator complex_discrete_operator = ComplexDiscreteBoundaryOperator()
 
+    if dtype == 'float64':
+        real_discrete_operator.impl_ = loadHMatrix[double](c_file_name)
+        return real_discrete_operator
+    else:
+        complex_discrete_operator.impl_ = loadHMatrix[complex_double](c_file_name)
+        return complex_discrete_operator
@@ -5,6 +5,9 @@
 #include "bempp/hmat/hmatrix_low_rank_data.hpp"
 #include "bempp/hmat/hmatrix_dense_data.hpp"
 
+#include <Eigen/Sparse>
+#include <vector>
+
 namespace hmat {
 
 
@@ -26,6 +29,17 @@ namespace hmat {
                 data);
     }
 
+    // Sparse matrix from the arrays of a scipy.sparse.csc_matrix.
+    inline Eigen::SparseMatrix<double>
+    py_sparse_matrix_from_csc(
+            int rows, int cols, const std::vector<int>& indptr,
+            const std::vector<int>& indices, const std::vector<double>& data)
+    {
+        return Eigen::Map<const Eigen::SparseMatrix<double>>(
+                rows, cols, data.size(), indptr.data(), indices.data(),
+                data.data());
+    }
+
 
 }
 
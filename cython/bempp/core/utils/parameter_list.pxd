@@ -46,6 +46,10 @@ cdef class _HMatParameterList:
     cdef c_ParameterList* impl_
     cdef ParameterList base
 
+cdef class _FmmParameterList:
+    cdef c_ParameterList* impl_
+    cdef ParameterList base
+
 cdef class _VerbosityParameterList:
     cdef cbool _extended_verbosity
 
@@ -57,5 +61,6 @@ cdef class ParameterList:
     cdef _AssemblyParameterList _assembly
     cdef _QuadratureParameterList _quadrature
     cdef _HMatParameterList _hmat
+    cdef _FmmParameterList _fmm
     cdef _VerbosityParameterList _verbosity
     cdef _OutputParameterList _output
@@ -318,6 +318,78 @@ cdef class _HMatParameterList:
             cdef char* s = b"options.hmat.cutoff"
             deref(self.impl_).put_double(s,value)
 
+    property matvec_strategy:
+        def __get__(self):
+            cdef char* s = b"options.hmat.matVecStrategy"
+            return deref(self.impl_).get_string(s).decode("UTF-8")
+        def __set__(self,object value):
+            cdef char* s = b"options.hmat.matVecStrategy"
+            deref(self.impl_).put_string(s,_convert_to_bytes(value))
+
+    property compact_storage:
+        def __get__(self):
+            cdef char* s = b"options.hmat.compactStorage"
+            return deref(self.impl_).get_bool(s)
+        def __set__(self,cbool value):
+            cdef char* s = b"options.hmat.compactStorage"
+            deref(self.impl_).put_bool(s,value)
+
+    property storage_precision:
+        def __get__(self):
+            cdef char* s = b"options.hmat.storagePrecision"
+            return deref(self.impl_).get_string(s).decode("UTF-8")
+        def __set__(self,object value):
+            cdef char* s = b"options.hmat.storagePrecision"
+            deref(self.impl_).put_string(s,_convert_to_bytes(value))
+
+    property matvec_profiling:
+        def __get__(self):
+            cdef char* s = b"options.hmat.matVecProfiling"
+            return deref(self.impl_).get_bool(s)
+        def __set__(self,cbool value):
+            cdef char* s = b"options.hmat.matVecProfiling"
+            deref(self.impl_).put_bool(s,value)
+
+    property coarsening:
+        def __get__(self):
+            cdef char* s = b"options.hmat.coarsening"
+            return deref(self.impl_).get_bool(s)
+        def __set__(self,cbool value):
+            cdef char* s = b"options.hmat.coarsening"
+            deref(self.impl_).put_bool(s,value)
+
+    property recompress:
+        def __get__(self):
+            cdef char* s = b"options.hmat.recompress"
+            return deref(self.impl_).get_bool(s)
+        def __set__(self,cbool value):
+            cdef char* s = b"options.hmat.recompress"
+            deref(self.impl_).put_bool(s,value)
+
+cdef class _FmmParameterList:
+
+    def __cinit__(self, ParameterList base):
+        self.base = base
+
+    def __init__(self, ParameterList base):
+        pass
+
+    property expansion_order:
+        def __get__(self):
+            cdef char* s = b"options.fmm.expansionOrder"
+            return deref(self.impl_).get_int(s)
+        def __set__(self,int value):
+            cdef char* s = b"options.fmm.expansionOrder"
+            deref(self.impl_).put_int(s,value)
+
+    property levels:
+        def __get__(self):
+            cdef char* s = b"options.fmm.levels"
+            return deref(self.impl_).get_int(s)
+        def __set__(self,int value):
+            cdef char* s = b"options.fmm.levels"
+            deref(self.impl_).put_int(s,value)
+
 cdef class ParameterList:
 
     def __cinit__(self):
@@ -325,6 +397,7 @@ cdef class ParameterList:
         self._assembly = _AssemblyParameterList(self)
         self._quadrature = _QuadratureParameterList(self)
         self._hmat = _HMatParameterList(self)
+        self._fmm = _FmmParameterList(self)
         self._verbosity = _VerbosityParameterList()
         self._output = _OutputParameterList()
         (<_AssemblyParameterList>self._assembly).impl_ = self.impl_
@@ -333,6 +406,7 @@ cdef class ParameterList:
         (<_MediumField>self.quadrature.medium).impl_ = self.impl_
         (<_FarField>self.quadrature.far).impl_ = self.impl_
         (<_HMatParameterList>self._hmat).impl_ = self.impl_
+        (<_FmmParameterList>self._fmm).impl_ = self.impl_
 
     def __init__(self):
         pass
@@ -355,6 +429,11 @@ cdef class ParameterList:
         def __get__(self):
             return self._hmat
 
+    property fmm:
+
+        def __get__(self):
+            return self._fmm
+
     property verbosity:
 
         def __get__(self):
@@ -52,7 +52,9 @@ public:
     /** \brief Assemble dense matrices. */
     DENSE,
     /** \brief Assemble hierarchical matrices using the HMat library. */
-    HMAT
+    HMAT,
+    /** \brief Assemble a fast multipole representation. */
+    FMM
   };
 
   /** \brief Use dense-matrix representations of weak forms of boundary integral
@@ -64,6 +66,9 @@ public:
   /** \brief Assemble using the HMat hierarchical matrix library. */
   void switchToHMatMode();
 
+  /** \brief Assemble using the fast multipole method. */
+  void switchToFmmMode();
+
   /** \brief Use dense-matrix representations of weak forms of boundary integral
    *operators.
    *
@@ -43,6 +43,7 @@
 
 #include "../common/complex_aux.hpp"
 #include "../common/eigen_support.hpp"
+#include <algorithm>
 #include <stdexcept>
 #include <iostream>
 
@@ -70,16 +71,16 @@ public:
       const std::vector<std::vector<BasisFunctionType>> &testLocalDofWeights,
       const std::vector<std::vector<BasisFunctionType>> &trialLocalDofWeights,
       Fiber::LocalAssemblerForIntegralOperators<ResultType> &assembler,
-      Matrix<ResultType> &result, MutexType &mutex)
+      Matrix<ResultType> &result, MutexType &mutex, int symmetry)
       : m_testIndices(testIndices), m_testGlobalDofs(testGlobalDofs),
         m_trialGlobalDofs(trialGlobalDofs),
         m_testLocalDofWeights(testLocalDofWeights),
         m_trialLocalDofWeights(trialLocalDofWeights), m_assembler(assembler),
-        m_result(result), m_mutex(mutex) {}
+        m_result(result), m_mutex(mutex), m_symmetry(symmetry) {}
 
   void operator()(const tbb::blocked_range<int> &r) const {
-    const int testElementCount = m_testIndices.size();
     std::vector<Matrix<ResultType>> localResult;
+    std::vector<int> lowerTestIndices;
     for (int trialIndex = r.begin(); trialIndex != r.end(); ++trialIndex) {
       // Handle this trial element only if it contributes to any global DOFs.
       bool skipTrialElement = true;
@@ -94,9 +95,21 @@ public:
       if (skipTrialElement)
         continue;
 
+      // For a symmetric weak form only the test elements from the trial
+      // element onwards are needed, the other pairs are mirrored.
+      const std::vector<int> *testIndices = &m_testIndices;
+      if (m_symmetry != NO_SYMMETRY) {
+        lowerTestIndices.assign(std::lower_bound(m_testIndices.begin(),
+                                                 m_testIndices.end(),
+                                                 trialIndex),
+                                m_testIndices.end());
+        testIndices = &lowerTestIndices;
+      }
+      const int testElementCount = testIndices->size();
+
       // Evaluate integrals over pairs of the current trial element and
       // all the test elements
-      m_assembler.evaluateLocalWeakForms(TEST_TRIAL, m_testIndices, trialIndex,
+      m_assembler.evaluateLocalWeakForms(TEST_TRIAL, *testIndices, trialIndex,
                                          ALL_DOFS, localResult);
 
       // Global assembly
@@ -104,7 +117,9 @@ public:
         MutexType::scoped_lock lock(m_mutex);
         // Loop over test indices
         for (int row = 0; row < testElementCount; ++row) {
-          const int testIndex = m_testIndices[row];
+          const int testIndex = (*testIndices)[row];
+          const bool mirrored =
+              (m_symmetry != NO_SYMMETRY && testIndex != trialIndex);
           const int testDofCount = m_testGlobalDofs[testIndex].size();
           // Add the integrals to appropriate entries in the operator's matrix
           for (int trialDof = 0; trialDof < trialDofCount; ++trialDof) {
@@ -118,10 +133,14 @@ public:
               assert(std::abs(m_testLocalDofWeights[testIndex][testDof]) > 0.);
               assert(std::abs(m_trialLocalDofWeights[trialIndex][trialDof]) >
                      0.);
-              m_result(testGlobalDof, trialGlobalDof) +=
+              const ResultType value =
                   conj(m_testLocalDofWeights[testIndex][testDof]) *
                   m_trialLocalDofWeights[trialIndex][trialDof] *
                   localResult[row](testDof, trialDof);
+              m_result(testGlobalDof, trialGlobalDof) += value;
+              if (mirrored)
+                m_result(trialGlobalDof, testGlobalDof) +=
+                    (m_symmetry == HERMITIAN) ? conj(value) : value;
             }
           }
         }
@@ -144,6 +163,9 @@ private:
 
   // mutex must be mutable because we need to lock and unlock it
   MutexType &m_mutex;
+  // SYMMETRIC or HERMITIAN if the pairs with the test element before the
+  // trial element are mirrored, NO_SYMMETRY otherwise
+  int m_symmetry;
 };
 
 template <typename BasisFunctionType, typename ResultType>
@@ -266,7 +288,7 @@ DenseGlobalAssembler<BasisFunctionType, ResultType>::assembleDetachedWeakForm(
     const Space<BasisFunctionType> &testSpace,
     const Space<BasisFunctionType> &trialSpace,
     LocalAssemblerForIntegralOperators &assembler,
-    const Context<BasisFunctionType, ResultType> &context) {
+    const Context<BasisFunctionType, ResultType> &context, int symmetry) {
 
   // Global DOF indices corresponding to local DOFs on elements
   std::vector<std::vector<GlobalDofIndex>> testGlobalDofs, trialGlobalDofs;
@@ -300,6 +322,16 @@ DenseGlobalAssembler<BasisFunctionType, ResultType>::assembleDetachedWeakForm(
                             trialSpace.globalDofCount());
   result.setZero();
 
+  // Mirroring pairs of elements needs the same global dofs for rows and
+  // columns. Complex symmetric takes precedence over Hermitian.
+  int mirrorSymmetry = NO_SYMMETRY;
+  if (&testSpace == &trialSpace) {
+    if (symmetry & SYMMETRIC)
+      mirrorSymmetry = SYMMETRIC;
+    else if (symmetry & HERMITIAN)
+      mirrorSymmetry = HERMITIAN;
+  }
+
   typedef DenseWeakFormAssemblerLoopBody<BasisFunctionType, ResultType> Body;
   typename Body::MutexType mutex;
 
@@ -308,7 +340,7 @@ DenseGlobalAssembler<BasisFunctionType, ResultType>::assembleDetachedWeakForm(
     tbb::parallel_for(tbb::blocked_range<int>(0, trialElementCount),
                       Body(testIndices, testGlobalDofs, trialGlobalDofs,
                            testLocalDofWeights, trialLocalDofWeights, assembler,
-                           result, mutex));
+                           result, mutex, mirrorSymmetry));
   }
 
   //// Old serial code (TODO: decide whether to keep it behind e.g. #ifndef
@@ -4,6 +4,7 @@
 #include "../common/common.hpp"
 #include "../common/eigen_support.hpp"
 #include "../common/scalar_traits.hpp"
+#include "symmetry.hpp"
 
 #include <memory>
 
@@ -33,12 +34,18 @@ public:
       LocalAssemblerForIntegralOperators;
   typedef Fiber::LocalAssemblerForPotentialOperators<ResultType>
       LocalAssemblerForPotentialOperators;
+  /** \brief Assemble the weak form of an operator as a dense matrix.
+   *
+   *  If the operator is symmetric or Hermitian and \p testSpace and
+   *  \p trialSpace are the same object, only the pairs of elements with the
+   *  test element not preceding the trial element are integrated. */
   static std::unique_ptr<DiscreteBoundaryOperator<ResultType>>
   assembleDetachedWeakForm(
       const Space<BasisFunctionType> &testSpace,
       const Space<BasisFunctionType> &trialSpace,
       LocalAssemblerForIntegralOperators &assembler,
-      const Context<BasisFunctionType, ResultType> &context);
+      const Context<BasisFunctionType, ResultType> &context,
+      int symmetry = NO_SYMMETRY);
   static std::unique_ptr<DiscreteBoundaryOperator<ResultType>>
   assemblePotentialOperator(const Matrix<CoordinateType> &points,
                             const Space<BasisFunctionType> &trialSpace,
@@ -72,14 +72,23 @@ void DiscreteBoundaryOperator<ValueType>::apply(const TranspositionMode trans,
                                 "vectors x_in and y_inout must have "
                                 "the same number of columns");
 
-  for (size_t i = 0; i < x_in.cols(); ++i) {
+  applyBuiltInImplToColumns(
+      trans,
+      Eigen::Ref<Matrix<ValueType>>(const_cast<Matrix<ValueType> &>(x_in)),
+      y_inout, alpha, beta);
+}
 
-    applyBuiltInImpl(trans, Eigen::Ref<Vector<ValueType>>(
-                                const_cast<Matrix<ValueType> &>(x_in).col(i)),
-                     Eigen::Ref<Vector<ValueType>>(
-                         const_cast<Matrix<ValueType> &>(y_inout).col(i)),
-                     alpha, beta);
-  }
+template <typename ValueType>
+void DiscreteBoundaryOperator<ValueType>::applyBuiltInImplToColumns(
+    const TranspositionMode trans, const Eigen::Ref<Matrix<ValueType>> &x_in,
+    Eigen::Ref<Matrix<ValueType>> y_inout, const ValueType alpha,
+    const ValueType beta) const {
+
+  auto &x_inNoConst = const_cast<Eigen::Ref<Matrix<ValueType>> &>(x_in);
+  for (size_t i = 0; i < x_in.cols(); ++i)
+    applyBuiltInImpl(trans, Eigen::Ref<Vector<ValueType>>(x_inNoConst.col(i)),
+                     Eigen::Ref<Vector<ValueType>>(y_inout.col(i)), alpha,
+                     beta);
 }
 
 template <typename ValueType>
@@ -153,6 +153,17 @@ private:
                                 Eigen::Ref<Vector<ValueType>> y_inout,
                                 const ValueType alpha,
                                 const ValueType beta) const = 0;
+
+  /** \brief Apply the operator to all columns of \p x_in.
+   *
+   *  The default implementation calls applyBuiltInImpl() for each column.
+   *  Subclasses that multiply with a block of vectors faster than with the
+   *  vectors one by one override it. */
+  virtual void
+  applyBuiltInImplToColumns(const TranspositionMode trans,
+                            const Eigen::Ref<Matrix<ValueType>> &x_in,
+                            Eigen::Ref<Matrix<ValueType>> y_inout,
+                            const ValueType alpha, const ValueType beta) const;
 };
 
 } // namespace Bempp
@@ -76,6 +76,17 @@ void DiscreteDenseBoundaryOperator<ValueType>::applyBuiltInImpl(
     const TranspositionMode trans, const Eigen::Ref<Vector<ValueType>> &x_in,
     Eigen::Ref<Vector<ValueType>> y_inout, const ValueType alpha,
     const ValueType beta) const {
+  Eigen::Ref<Matrix<ValueType>> x_inMat = x_in;
+  Eigen::Ref<Matrix<ValueType>> y_inoutMat = y_inout;
+  applyBuiltInImplToColumns(trans, x_inMat, y_inoutMat, alpha, beta);
+}
+
+template <typename ValueType>
+void DiscreteDenseBoundaryOperator<ValueType>::applyBuiltInImplToColumns(
+    const TranspositionMode trans, const Eigen::Ref<Matrix<ValueType>> &x_in,
+    Eigen::Ref<Matrix<ValueType>> y_inout, const ValueType alpha,
+    const ValueType beta) const {
+
   if (beta == static_cast<ValueType>(0.))
     y_inout.fill(static_cast<ValueType>(0.));
   else
@@ -96,7 +107,7 @@ void DiscreteDenseBoundaryOperator<ValueType>::applyBuiltInImpl(
     break;
   default:
     throw std::invalid_argument(
-        "DiscreteDenseBoundaryOperator::applyBuiltInImpl(): "
+        "DiscreteDenseBoundaryOperator::applyBuiltInImplToColumns(): "
         "invalid transposition mode");
   }
 }
@@ -62,6 +62,12 @@ private:
                                 const ValueType alpha,
                                 const ValueType beta) const;
 
+  virtual void
+  applyBuiltInImplToColumns(const TranspositionMode trans,
+                            const Eigen::Ref<Matrix<ValueType>> &x_in,
+                            Eigen::Ref<Matrix<ValueType>> y_inout,
+                            const ValueType alpha, const ValueType beta) const;
+
 private:
   /** \cond PRIVATE */
   Matrix<ValueType> m_mat;
@@ -0,0 +1,96 @@
+// Copyright (C) 2011-2014 by the BEM++ Authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "../common/common.hpp"
+#include "../common/eigen_support.hpp"
+
+#include "discrete_h2mat_boundary_operator.hpp"
+#include "../common/shared_ptr.hpp"
+#include "../fiber/explicit_instantiation.hpp"
+#include <boost/numeric/conversion/converter.hpp>
+
+namespace Bempp {
+
+template <typename ValueType>
+DiscreteH2MatBoundaryOperator<ValueType>::DiscreteH2MatBoundaryOperator(
+    const shared_ptr<const hmat::DefaultH2MatrixType<ValueType>> &h2Matrix)
+    : m_h2Matrix(h2Matrix) {}
+
+template <typename ValueType>
+unsigned int DiscreteH2MatBoundaryOperator<ValueType>::rowCount() const {
+
+  return boost::numeric::converter<unsigned int, std::size_t>::convert(
+      m_h2Matrix->rows());
+}
+
+template <typename ValueType>
+unsigned int DiscreteH2MatBoundaryOperator<ValueType>::columnCount() const {
+
+  return boost::numeric::converter<unsigned int, std::size_t>::convert(
+      m_h2Matrix->columns());
+}
+
+template <typename ValueType>
+shared_ptr<const hmat::DefaultH2MatrixType<ValueType>>
+DiscreteH2MatBoundaryOperator<ValueType>::h2Matrix() const {
+  return m_h2Matrix;
+}
+
+template <typename ValueType>
+void DiscreteH2MatBoundaryOperator<ValueType>::addBlock(
+    const std::vector<int> &rows, const std::vector<int> &cols,
+    const ValueType alpha, Matrix<ValueType> &block) const {
+
+  throw std::runtime_error(
+      "DiscreteH2MatBoundaryOperator::addBlock(): not implemented.");
+}
+
+template <typename ValueType>
+void DiscreteH2MatBoundaryOperator<ValueType>::applyBuiltInImpl(
+    const TranspositionMode trans, const Eigen::Ref<Vector<ValueType>> &x_in,
+    Eigen::Ref<Vector<ValueType>> y_inout, const ValueType alpha,
+    const ValueType beta) const {
+
+  Eigen::Ref<Matrix<ValueType>> x_inMat = x_in;
+  Eigen::Ref<Matrix<ValueType>> y_inoutMat = y_inout;
+  applyBuiltInImplToColumns(trans, x_inMat, y_inoutMat, alpha, beta);
+}
+
+template <typename ValueType>
+void DiscreteH2MatBoundaryOperator<ValueType>::applyBuiltInImplToColumns(
+    const TranspositionMode trans, const Eigen::Ref<Matrix<ValueType>> &x_in,
+    Eigen::Ref<Matrix<ValueType>> y_inout, const ValueType alpha,
+    const ValueType beta) const {
+
+  hmat::TransposeMode hmatTrans;
+  if (trans == TranspositionMode::NO_TRANSPOSE)
+    hmatTrans = hmat::NOTRANS;
+  else if (trans == TranspositionMode::TRANSPOSE)
+    hmatTrans = hmat::TRANS;
+  else if (trans == TranspositionMode::CONJUGATE)
+    hmatTrans = hmat::CONJ;
+  else
+    hmatTrans = hmat::CONJTRANS;
+
+  m_h2Matrix->apply(x_in, y_inout, hmatTrans, alpha, beta);
+}
+
+FIBER_INSTANTIATE_CLASS_TEMPLATED_ON_RESULT(DiscreteH2MatBoundaryOperator);
+}
@@ -22,18 +22,22 @@
 #include "../common/eigen_support.hpp"
 
 #include "discrete_hmat_boundary_operator.hpp"
+#include "discrete_h2mat_boundary_operator.hpp"
+#include "discrete_hmat_lu_inverse_operator.hpp"
 #include "../common/shared_ptr.hpp"
 #include "../fiber/explicit_instantiation.hpp"
 #include <boost/numeric/conversion/converter.hpp>
 #include "../hmat/compressed_matrix.hpp"
 #include "../hmat/hmatrix.hpp"
+#include "../hmat/hmatrix_lu.hpp"
+#include "../hmat/hmatrix_sparse_compressor.hpp"
 
 namespace Bempp {
 
 template <typename ValueType>
 DiscreteHMatBoundaryOperator<ValueType>::DiscreteHMatBoundaryOperator(
     const shared_ptr<hmat::DefaultHMatrixType<ValueType>> &hMatrix)
-    : m_hMatrix(hMatrix) {}
+    : m_hMatrix(hMatrix), m_hMatDofOrdering(false) {}
 
 template <typename ValueType>
 unsigned int DiscreteHMatBoundaryOperator<ValueType>::rowCount() const {
@@ -55,6 +59,48 @@ DiscreteHMatBoundaryOperator<ValueType>::hMatrix() const {
   return m_hMatrix;
 }
 
+template <typename ValueType>
+void DiscreteHMatBoundaryOperator<ValueType>::setHMatDofOrdering(bool value) {
+  m_hMatDofOrdering = value;
+}
+
+template <typename ValueType>
+bool DiscreteHMatBoundaryOperator<ValueType>::hMatDofOrdering() const {
+  return m_hMatDofOrdering;
+}
+
+template <typename ValueType>
+shared_ptr<const DiscreteBoundaryOperator<ValueType>>
+DiscreteHMatBoundaryOperator<ValueType>::luInverse(double eps) const {
+
+  auto lu = boost::make_shared<hmat::DefaultHMatrixLuType<ValueType>>(
+      *m_hMatrix, eps);
+  return boost::make_shared<DiscreteHMatLuInverseOperator<ValueType>>(lu);
+}
+
+template <typename ValueType>
+shared_ptr<const DiscreteBoundaryOperator<ValueType>>
+DiscreteHMatBoundaryOperator<ValueType>::h2Matrix(double eps) const {
+
+  auto h2Matrix = boost::make_shared<hmat::DefaultH2MatrixType<ValueType>>(
+      *m_hMatrix, eps);
+  return boost::make_shared<DiscreteH2MatBoundaryOperator<ValueType>>(
+      h2Matrix);
+}
+
+template <typename ValueType>
+void DiscreteHMatBoundaryOperator<ValueType>::save(
+    const std::string &fileName) const {
+  m_hMatrix->save(fileName);
+}
+
+template <typename ValueType>
+shared_ptr<DiscreteHMatBoundaryOperator<ValueType>>
+DiscreteHMatBoundaryOperator<ValueType>::load(const std::string &fileName) {
+  return boost::make_shared<DiscreteHMatBoundaryOperator<ValueType>>(
+      hmat::DefaultHMatrixType<ValueType>::load(fileName));
+}
+
 template <typename ValueType>
 void DiscreteHMatBoundaryOperator<ValueType>::addBlock(
     const std::vector<int> &rows, const std::vector<int> &cols,
@@ -66,6 +112,17 @@ void DiscreteHMatBoundaryOperator<ValueType>::applyBuiltInImpl(
     Eigen::Ref<Vector<ValueType>> y_inout, const ValueType alpha,
     const ValueType beta) const {
 
+  Eigen::Ref<Matrix<ValueType>> x_inMat = x_in;
+  Eigen::Ref<Matrix<ValueType>> y_inoutMat = y_inout;
+  applyBuiltInImplToColumns(trans, x_inMat, y_inoutMat, alpha, beta);
+}
+
+template <typename ValueType>
+void DiscreteHMatBoundaryOperator<ValueType>::applyBuiltInImplToColumns(
+    const TranspositionMode trans, const Eigen::Ref<Matrix<ValueType>> &x_in,
+    Eigen::Ref<Matrix<ValueType>> y_inout, const ValueType alpha,
+    const ValueType beta) const {
+
   hmat::TransposeMode hmatTrans;
   if (trans == TranspositionMode::NO_TRANSPOSE)
     hmatTrans = hmat::NOTRANS;
@@ -75,12 +132,12 @@ void DiscreteHMatBoundaryOperator<ValueType>::applyBuiltInImpl(
     hmatTrans = hmat::CONJ;
   else
     hmatTrans = hmat::CONJTRANS;
-  Eigen::Ref<Matrix<ValueType>> x_inMat = x_in;
-  Eigen::Ref<Matrix<ValueType>> y_inoutMat = y_inout;
-
-  m_hMatrix->apply(x_inMat, y_inoutMat, hmatTrans, alpha, beta);
 
-  // y_inout = y_inoutMat.col(0);
+  // All columns in one pass over the leafs.
+  if (m_hMatDofOrdering)
+    m_hMatrix->applyPermuted(x_in, y_inout, hmatTrans, alpha, beta);
+  else
+    m_hMatrix->apply(x_in, y_inout, hmatTrans, alpha, beta);
 }
 
 template <typename ValueType>
@@ -96,9 +153,144 @@ castToHMatrix(const shared_ptr<const DiscreteBoundaryOperator<ValueType>> &op) {
   return discreteHMatOperator->hMatrix();
 }
 
+template <typename ValueType>
+shared_ptr<const DiscreteBoundaryOperator<ValueType>> hMatrixLuInverse(
+    const shared_ptr<const DiscreteBoundaryOperator<ValueType>> &op,
+    double eps) {
+  shared_ptr<const DiscreteHMatBoundaryOperator<ValueType>>
+      discreteHMatOperator;
+  discreteHMatOperator =
+      dynamic_pointer_cast<const DiscreteHMatBoundaryOperator<ValueType>>(op);
+  if (!discreteHMatOperator.get())
+    throw std::runtime_error("hMatrixLuInverse(): Conversion to "
+                             "DiscreteHMatBoundaryOperator failed.");
+  return discreteHMatOperator->luInverse(eps);
+}
+
+template <typename ValueType>
+shared_ptr<const DiscreteBoundaryOperator<ValueType>> hMatrixToH2Matrix(
+    const shared_ptr<const DiscreteBoundaryOperator<ValueType>> &op,
+    double eps) {
+  shared_ptr<const DiscreteHMatBoundaryOperator<ValueType>>
+      discreteHMatOperator;
+  discreteHMatOperator =
+      dynamic_pointer_cast<const DiscreteHMatBoundaryOperator<ValueType>>(op);
+  if (!discreteHMatOperator.get())
+    throw std::runtime_error("hMatrixToH2Matrix(): Conversion to "
+                             "DiscreteHMatBoundaryOperator failed.");
+  return discreteHMatOperator->h2Matrix(eps);
+}
+
+template <typename ValueType>
+shared_ptr<const DiscreteBoundaryOperator<ValueType>> hMatrixScale(
+    const shared_ptr<const DiscreteBoundaryOperator<ValueType>> &op,
+    ValueType alpha) {
+  auto result = castToHMatrix(op)->copy();
+  result->scale(alpha);
+  return boost::make_shared<DiscreteHMatBoundaryOperator<ValueType>>(result);
+}
+
+template <typename ValueType>
+shared_ptr<const DiscreteBoundaryOperator<ValueType>> hMatrixAdd(
+    const shared_ptr<const DiscreteBoundaryOperator<ValueType>> &op1,
+    const shared_ptr<const DiscreteBoundaryOperator<ValueType>> &op2,
+    ValueType alpha, double eps) {
+  auto result = castToHMatrix(op1)->copy();
+  result->add(alpha, *castToHMatrix(op2), eps);
+  return boost::make_shared<DiscreteHMatBoundaryOperator<ValueType>>(result);
+}
+
+template <typename ValueType>
+shared_ptr<const DiscreteBoundaryOperator<ValueType>> hMatrixMultiply(
+    const shared_ptr<const DiscreteBoundaryOperator<ValueType>> &op1,
+    const shared_ptr<const DiscreteBoundaryOperator<ValueType>> &op2,
+    double eps) {
+  auto result = hmat::DefaultHMatrixType<ValueType>::multiply(
+      1, *castToHMatrix(op1), *castToHMatrix(op2), eps);
+  return boost::make_shared<DiscreteHMatBoundaryOperator<ValueType>>(result);
+}
+
+template <typename ValueType>
+shared_ptr<const DiscreteBoundaryOperator<ValueType>> hMatrixSparseMultiply(
+    const shared_ptr<const DiscreteBoundaryOperator<ValueType>> &op,
+    const RealSparseMatrix &sparseMatrix, bool sparseOnLeft, double eps) {
+
+  auto hMatrix = castToHMatrix(op);
+  auto clusterTree =
+      sparseOnLeft ? hMatrix->blockClusterTree()->rowClusterTree()
+                   : hMatrix->blockClusterTree()->columnClusterTree();
+  const std::size_t size = clusterTree->numberOfDofs();
+  if (sparseMatrix.rows() != size || sparseMatrix.cols() != size)
+    throw std::runtime_error("hMatrixSparseMultiply(): Sparse matrix has "
+                             "wrong dimensions.");
+
+  // Blocks of clusters with disjoint bounding boxes of a matrix with local
+  // support are zero, so weak admissibility gives rank zero blocks.
+  shared_ptr<hmat::DefaultBlockClusterTreeType> blockClusterTree(
+      new hmat::DefaultBlockClusterTreeType(clusterTree, clusterTree, size,
+                                            hmat::WeakAdmissibility()));
+  Eigen::SparseMatrix<ValueType> matrix =
+      sparseMatrix.template cast<ValueType>();
+  hmat::HMatrixSparseCompressor<ValueType, 2> compressor(
+      matrix, *blockClusterTree, eps);
+  hmat::DefaultHMatrixType<ValueType> sparseHMatrix(blockClusterTree,
+                                                    compressor);
+
+  auto result =
+      sparseOnLeft
+          ? hmat::DefaultHMatrixType<ValueType>::multiply(1, sparseHMatrix,
+                                                          *hMatrix, eps)
+          : hmat::DefaultHMatrixType<ValueType>::multiply(1, *hMatrix,
+                                                          sparseHMatrix, eps);
+  return boost::make_shared<DiscreteHMatBoundaryOperator<ValueType>>(result);
+}
+
+template <typename ValueType>
+void saveHMatrix(
+    const shared_ptr<const DiscreteBoundaryOperator<ValueType>> &op,
+    const std::string &fileName) {
+  shared_ptr<const DiscreteHMatBoundaryOperator<ValueType>>
+      discreteHMatOperator;
+  discreteHMatOperator =
+      dynamic_pointer_cast<const DiscreteHMatBoundaryOperator<ValueType>>(op);
+  if (!discreteHMatOperator.get())
+    throw std::runtime_error("saveHMatrix(): Conversion to "
+                             "DiscreteHMatBoundaryOperator failed.");
+  discreteHMatOperator->save(fileName);
+}
+
+template <typename ValueType>
+shared_ptr<const DiscreteBoundaryOperator<ValueType>>
+loadHMatrix(const std::string &fileName) {
+  return DiscreteHMatBoundaryOperator<ValueType>::load(fileName);
+}
+
 #define INSTANTIATE_NONMEMBER_FUNCTION(VALUE)                                  \
   template shared_ptr<const hmat::DefaultHMatrixType<VALUE>> castToHMatrix(    \
-      const shared_ptr<const DiscreteBoundaryOperator<VALUE>> &)
+      const shared_ptr<const DiscreteBoundaryOperator<VALUE>> &);              \
+  template shared_ptr<const DiscreteBoundaryOperator<VALUE>> hMatrixLuInverse( \
+      const shared_ptr<const DiscreteBoundaryOperator<VALUE>> &, double);      \
+  template shared_ptr<const DiscreteBoundaryOperator<VALUE>>                   \
+  hMatrixToH2Matrix(const shared_ptr<const DiscreteBoundaryOperator<VALUE>> &, \
+                    double);                                                   \
+  template shared_ptr<const DiscreteBoundaryOperator<VALUE>> hMatrixScale(     \
+      const shared_ptr<const DiscreteBoundaryOperator<VALUE>> &, VALUE);       \
+  template shared_ptr<const DiscreteBoundaryOperator<VALUE>> hMatrixAdd(       \
+      const shared_ptr<const DiscreteBoundaryOperator<VALUE>> &,               \
+      const shared_ptr<const DiscreteBoundaryOperator<VALUE>> &, VALUE,        \
+      double);                                                                 \
+  template shared_ptr<const DiscreteBoundaryOperator<VALUE>> hMatrixMultiply(  \
+      const shared_ptr<const DiscreteBoundaryOperator<VALUE>> &,               \
+      const shared_ptr<const DiscreteBoundaryOperator<VALUE>> &, double);      \
+  template shared_ptr<const DiscreteBoundaryOperator<VALUE>>                   \
+  hMatrixSparseMultiply(                                                       \
+      const shared_ptr<const DiscreteBoundaryOperator<VALUE>> &,               \
+      const RealSparseMatrix &, bool, double);                                 \
+  template void saveHMatrix(                                                   \
+      const shared_ptr<const DiscreteBoundaryOperator<VALUE>> &,               \
+      const std::string &);                                                    \
+  template shared_ptr<const DiscreteBoundaryOperator<VALUE>>                   \
+  loadHMatrix<VALUE>(const std::string &)
 FIBER_ITERATE_OVER_VALUE_TYPES(INSTANTIATE_NONMEMBER_FUNCTION);
 
 FIBER_INSTANTIATE_CLASS_TEMPLATED_ON_RESULT(DiscreteHMatBoundaryOperator);
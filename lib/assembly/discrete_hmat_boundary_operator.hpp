@@ -27,6 +27,8 @@
 #include "discrete_boundary_operator.hpp"
 #include "../hmat/hmatrix.hpp"
 
+#include <string>
+
 namespace Bempp {
 
 template <typename ValueType>
@@ -42,6 +44,32 @@ public:
 
   shared_ptr<const hmat::DefaultHMatrixType<ValueType>> hMatrix() const;
 
+  // If enabled, vectors passed to apply() are interpreted in H-matrix dof
+  // ordering and no permutations are performed. Right-hand sides and
+  // solutions of iterative solves can be converted once with
+  // hMatrix()->permuteMatToHMatDofs() and permuteMatToOriginalDofs().
+  void setHMatDofOrdering(bool value);
+  bool hMatDofOrdering() const;
+
+  // Return an operator applying the inverse of this operator through a
+  // hierarchical LU factorization with relative accuracy eps. A coarse eps
+  // gives a cheap preconditioner, a fine eps a direct solver.
+  shared_ptr<const DiscreteBoundaryOperator<ValueType>>
+  luInverse(double eps) const;
+
+  // Return the operator recompressed into an H2-matrix with nested cluster
+  // bases of relative accuracy eps. Only vectors in original dof ordering
+  // are supported by the result.
+  shared_ptr<const DiscreteBoundaryOperator<ValueType>>
+  h2Matrix(double eps) const;
+
+  // Write the H-matrix to a file, see hmat::HMatrix::save.
+  void save(const std::string &fileName) const;
+
+  // Read an operator written by save. The leaf data is memory mapped.
+  static shared_ptr<DiscreteHMatBoundaryOperator<ValueType>>
+  load(const std::string &fileName);
+
   void addBlock(const std::vector<int> &rows, const std::vector<int> &cols,
                 const ValueType alpha, Matrix<ValueType> &block) const override;
 
@@ -52,12 +80,68 @@ private:
                         const ValueType alpha,
                         const ValueType beta) const override;
 
+  void applyBuiltInImplToColumns(const TranspositionMode trans,
+                                 const Eigen::Ref<Matrix<ValueType>> &x_in,
+                                 Eigen::Ref<Matrix<ValueType>> y_inout,
+                                 const ValueType alpha,
+                                 const ValueType beta) const override;
+
   shared_ptr<hmat::DefaultHMatrixType<ValueType>> m_hMatrix;
+  bool m_hMatDofOrdering;
 };
 
 template <typename ValueType>
 shared_ptr<const hmat::DefaultHMatrixType<ValueType>>
 castToHMatrix(const shared_ptr<const DiscreteBoundaryOperator<ValueType>> &op);
+
+template <typename ValueType>
+shared_ptr<const DiscreteBoundaryOperator<ValueType>> hMatrixLuInverse(
+    const shared_ptr<const DiscreteBoundaryOperator<ValueType>> &op,
+    double eps);
+
+template <typename ValueType>
+shared_ptr<const DiscreteBoundaryOperator<ValueType>> hMatrixToH2Matrix(
+    const shared_ptr<const DiscreteBoundaryOperator<ValueType>> &op,
+    double eps);
+
+// Return a copy of the operator scaled by alpha.
+template <typename ValueType>
+shared_ptr<const DiscreteBoundaryOperator<ValueType>> hMatrixScale(
+    const shared_ptr<const DiscreteBoundaryOperator<ValueType>> &op,
+    ValueType alpha);
+
+// Return op1 + alpha * op2 as one H-matrix with relative accuracy eps. Both
+// operators must have the same cluster trees.
+template <typename ValueType>
+shared_ptr<const DiscreteBoundaryOperator<ValueType>> hMatrixAdd(
+    const shared_ptr<const DiscreteBoundaryOperator<ValueType>> &op1,
+    const shared_ptr<const DiscreteBoundaryOperator<ValueType>> &op2,
+    ValueType alpha, double eps);
+
+// Return op1 * op2 as one H-matrix with relative accuracy eps.
+template <typename ValueType>
+shared_ptr<const DiscreteBoundaryOperator<ValueType>> hMatrixMultiply(
+    const shared_ptr<const DiscreteBoundaryOperator<ValueType>> &op1,
+    const shared_ptr<const DiscreteBoundaryOperator<ValueType>> &op2,
+    double eps);
+
+// Return sparseMatrix * op if sparseOnLeft is set and op * sparseMatrix
+// otherwise as one H-matrix with relative accuracy eps. The sparse matrix,
+// e.g. an inverse mass matrix, must be square and is compressed on the row
+// or column cluster tree of op respectively.
+template <typename ValueType>
+shared_ptr<const DiscreteBoundaryOperator<ValueType>> hMatrixSparseMultiply(
+    const shared_ptr<const DiscreteBoundaryOperator<ValueType>> &op,
+    const RealSparseMatrix &sparseMatrix, bool sparseOnLeft, double eps);
+
+template <typename ValueType>
+void saveHMatrix(
+    const shared_ptr<const DiscreteBoundaryOperator<ValueType>> &op,
+    const std::string &fileName);
+
+template <typename ValueType>
+shared_ptr<const DiscreteBoundaryOperator<ValueType>>
+loadHMatrix(const std::string &fileName);
 }
 
 #endif
@@ -0,0 +1,104 @@
+// Copyright (C) 2011-2014 by the BEM++ Authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+
+#include "../common/common.hpp"
+#include "../common/eigen_support.hpp"
+
+#include "discrete_hmat_lu_inverse_operator.hpp"
+#include "../common/shared_ptr.hpp"
+#include "../fiber/explicit_instantiation.hpp"
+#include <boost/numeric/conversion/converter.hpp>
+
+namespace Bempp {
+
+template <typename ValueType>
+DiscreteHMatLuInverseOperator<ValueType>::DiscreteHMatLuInverseOperator(
+    const shared_ptr<const hmat::DefaultHMatrixLuType<ValueType>> &lu)
+    : m_lu(lu) {}
+
+template <typename ValueType>
+unsigned int DiscreteHMatLuInverseOperator<ValueType>::rowCount() const {
+
+  return boost::numeric::converter<unsigned int, std::size_t>::convert(
+      m_lu->rows());
+}
+
+template <typename ValueType>
+unsigned int DiscreteHMatLuInverseOperator<ValueType>::columnCount() const {
+
+  return boost::numeric::converter<unsigned int, std::size_t>::convert(
+      m_lu->rows());
+}
+
+template <typename ValueType>
+shared_ptr<const hmat::DefaultHMatrixLuType<ValueType>>
+DiscreteHMatLuInverseOperator<ValueType>::lu() const {
+  return m_lu;
+}
+
+template <typename ValueType>
+void DiscreteHMatLuInverseOperator<ValueType>::addBlock(
+    const std::vector<int> &rows, const std::vector<int> &cols,
+    const ValueType alpha, Matrix<ValueType> &block) const {
+
+  throw std::runtime_error(
+      "DiscreteHMatLuInverseOperator::addBlock(): not implemented.");
+}
+
+template <typename ValueType>
+void DiscreteHMatLuInverseOperator<ValueType>::applyBuiltInImpl(
+    const TranspositionMode trans, const Eigen::Ref<Vector<ValueType>> &x_in,
+    Eigen::Ref<Vector<ValueType>> y_inout, const ValueType alpha,
+    const ValueType beta) const {
+
+  Eigen::Ref<Matrix<ValueType>> x_inMat = x_in;
+  Eigen::Ref<Matrix<ValueType>> y_inoutMat = y_inout;
+  applyBuiltInImplToColumns(trans, x_inMat, y_inoutMat, alpha, beta);
+}
+
+template <typename ValueType>
+void DiscreteHMatLuInverseOperator<ValueType>::applyBuiltInImplToColumns(
+    const TranspositionMode trans, const Eigen::Ref<Matrix<ValueType>> &x_in,
+    Eigen::Ref<Matrix<ValueType>> y_inout, const ValueType alpha,
+    const ValueType beta) const {
+
+  if (trans == TranspositionMode::TRANSPOSE ||
+      trans == TranspositionMode::CONJUGATE_TRANSPOSE)
+    throw std::runtime_error("DiscreteHMatLuInverseOperator::"
+                             "applyBuiltInImplToColumns(): Transposed solves "
+                             "are not supported.");
+
+  // conj(A)^{-1} * x = conj(A^{-1} * conj(x))
+  Matrix<ValueType> solution = x_in;
+  if (trans == TranspositionMode::CONJUGATE)
+    solution = solution.conjugate();
+  m_lu->solve(solution);
+  if (trans == TranspositionMode::CONJUGATE)
+    solution = solution.conjugate();
+
+  if (beta == ValueType(0))
+    y_inout = alpha * solution;
+  else
+    y_inout = alpha * solution + beta * y_inout;
+}
+
+FIBER_INSTANTIATE_CLASS_TEMPLATED_ON_RESULT(DiscreteHMatLuInverseOperator);
+}
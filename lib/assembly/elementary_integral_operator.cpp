@@ -24,6 +24,7 @@
 #include "dense_global_assembler.hpp"
 #include "discrete_boundary_operator.hpp"
 #include "context.hpp"
+#include "fmm_global_assembler.hpp"
 #include "local_assembler_construction_helper.hpp"
 #include "hmat_global_assembler.hpp"
 
@@ -47,7 +48,8 @@ ElementaryIntegralOperator<BasisFunctionType, KernelType, ResultType>::
         const shared_ptr<const Space<BasisFunctionType>> &range,
         const shared_ptr<const Space<BasisFunctionType>> &dualToRange,
         const std::string &label, int symmetry)
-    : Base(domain, range, dualToRange, label, symmetry) {}
+    : Base(domain, range, dualToRange, label, symmetry),
+      m_fmmTrialNormalDerivative(false) {}
 
 template <typename BasisFunctionType, typename KernelType, typename ResultType>
 bool ElementaryIntegralOperator<BasisFunctionType, KernelType,
@@ -55,6 +57,14 @@ bool ElementaryIntegralOperator<BasisFunctionType, KernelType,
   return false;
 }
 
+template <typename BasisFunctionType, typename KernelType, typename ResultType>
+void ElementaryIntegralOperator<BasisFunctionType, KernelType, ResultType>::
+    setFmmKernel(const shared_ptr<const Fmm::FmmKernel<ResultType>> &kernel,
+                 bool trialNormalDerivative) {
+  m_fmmKernel = kernel;
+  m_fmmTrialNormalDerivative = trialNormalDerivative;
+}
+
 template <typename BasisFunctionType, typename KernelType, typename ResultType>
 std::unique_ptr<typename ElementaryIntegralOperator<
     BasisFunctionType, KernelType, ResultType>::LocalAssembler>
@@ -110,6 +120,9 @@ ElementaryIntegralOperator<BasisFunctionType, KernelType, ResultType>::
   case AssemblyOptions::HMAT:
     return shared_ptr<DiscreteBoundaryOperator<ResultType>>(
         assembleWeakFormInHMatMode(assembler, context).release());
+  case AssemblyOptions::FMM:
+    return shared_ptr<DiscreteBoundaryOperator<ResultType>>(
+        assembleWeakFormInFmmMode(assembler, context).release());
   default:
     throw std::runtime_error(
         "ElementaryIntegralOperator::assembleWeakFormInternalImpl2(): "
@@ -130,11 +143,9 @@ ElementaryIntegralOperator<BasisFunctionType, KernelType, ResultType>::
   const Space<BasisFunctionType> &testSpace = *this->dualToRange();
   const Space<BasisFunctionType> &trialSpace = *this->domain();
 
-  return DenseGlobalAssembler<BasisFunctionType,
-                              ResultType>::assembleDetachedWeakForm(testSpace,
-                                                                    trialSpace,
-                                                                    assembler,
-                                                                    context);
+  return DenseGlobalAssembler<BasisFunctionType, ResultType>::
+      assembleDetachedWeakForm(testSpace, trialSpace, assembler, context,
+                               this->symmetry());
 }
 
 template <typename BasisFunctionType, typename KernelType, typename ResultType>
@@ -147,7 +158,24 @@ ElementaryIntegralOperator<BasisFunctionType, KernelType, ResultType>::
   const Space<BasisFunctionType> &trialSpace = *this->domain();
   return HMatGlobalAssembler<BasisFunctionType, ResultType>::
       assembleDetachedWeakForm(testSpace, trialSpace, assembler, assembler,
-                               context, this->symmetry() & SYMMETRIC);
+                               context, this->symmetry());
+}
+
+template <typename BasisFunctionType, typename KernelType, typename ResultType>
+std::unique_ptr<DiscreteBoundaryOperator<ResultType>>
+ElementaryIntegralOperator<BasisFunctionType, KernelType, ResultType>::
+    assembleWeakFormInFmmMode(
+        LocalAssembler &assembler,
+        const Context<BasisFunctionType, ResultType> &context) const {
+  if (!m_fmmKernel)
+    throw std::runtime_error(
+        "ElementaryIntegralOperator::assembleWeakFormInFmmMode(): "
+        "operator does not support FMM assembly");
+  const Space<BasisFunctionType> &testSpace = *this->dualToRange();
+  const Space<BasisFunctionType> &trialSpace = *this->domain();
+  return FmmGlobalAssembler<BasisFunctionType, ResultType>::
+      assembleDetachedWeakForm(testSpace, trialSpace, assembler, m_fmmKernel,
+                               m_fmmTrialNormalDerivative, context);
 }
 
 /** \endcond */
@@ -42,6 +42,14 @@ template <typename ResultType> class LocalAssemblerForOperators;
 
 } // namespace Fiber
 
+namespace Fmm {
+
+/** \cond FORWARD_DECL */
+template <typename ValueType> class FmmKernel;
+/** \endcond */
+
+} // namespace Fmm
+
 namespace Bempp {
 
 /** \cond FORWARD_DECL */
@@ -144,6 +152,14 @@ public:
    *  yields a regular integral. */
   virtual bool isRegular() const = 0;
 
+  /** \brief Enable assembly in FMM mode.
+   *
+   *  The kernel of the weak form must be \p kernel, or its derivative in
+   *  the direction of the trial normal if \p trialNormalDerivative is true.
+   *  Operators without an FMM kernel cannot be assembled in FMM mode. */
+  void setFmmKernel(const shared_ptr<const Fmm::FmmKernel<ResultType>> &kernel,
+                    bool trialNormalDerivative = false);
+
 protected:
   virtual shared_ptr<DiscreteBoundaryOperator<ResultType_>>
   assembleWeakFormImpl(
@@ -205,8 +221,15 @@ private:
   assembleWeakFormInHMatMode(
       LocalAssembler &assembler,
       const Context<BasisFunctionType, ResultType> &context) const;
+  std::unique_ptr<DiscreteBoundaryOperator<ResultType_>>
+  assembleWeakFormInFmmMode(
+      LocalAssembler &assembler,
+      const Context<BasisFunctionType, ResultType> &context) const;
 
   /** \endcond */
+
+  shared_ptr<const Fmm::FmmKernel<ResultType>> m_fmmKernel;
+  bool m_fmmTrialNormalDerivative;
 };
 
 } // namespace Bempp
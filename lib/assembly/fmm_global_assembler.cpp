@@ -0,0 +1,198 @@
+// Copyright (C) 2011-2012 by the BEM++ Authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "fmm_global_assembler.hpp"
+
+#include "context.hpp"
+#include "discrete_fmm_boundary_operator.hpp"
+#include "global_dof_helpers.hpp"
+#include "near_field_assembler.hpp"
+
+#include "../common/eigen_support.hpp"
+#include "../fiber/basis_data.hpp"
+#include "../fiber/explicit_instantiation.hpp"
+#include "../fiber/geometrical_data.hpp"
+#include "../fiber/local_assembler_for_integral_operators.hpp"
+#include "../fiber/numerical_quadrature.hpp"
+#include "../fiber/serial_blas_region.hpp"
+#include "../fiber/shapeset.hpp"
+#include "../fmm/chebychev_fmm.hpp"
+#include "../fmm/fmm_kernel.hpp"
+#include "../fmm/octree.hpp"
+#include "../grid/entity.hpp"
+#include "../grid/entity_iterator.hpp"
+#include "../grid/entity_pointer.hpp"
+#include "../grid/geometry.hpp"
+#include "../grid/grid.hpp"
+#include "../grid/grid_view.hpp"
+#include "../grid/mapper.hpp"
+#include "../grid/reverse_element_mapper.hpp"
+#include "../space/space.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <tbb/parallel_for.h>
+
+namespace Bempp {
+
+namespace {
+
+// Integrals of the basis functions of the elements of a leaf against the
+// interpolation polynomials of its nodes, or against their normal
+// derivatives. Column k belongs to the global dof dofs[k].
+template <typename BasisFunctionType, typename ResultType>
+void leafProjection(
+    const Fmm::ChebychevFmm<ResultType> &fmm, unsigned long leaf,
+    const Space<BasisFunctionType> &space,
+    const std::vector<std::vector<GlobalDofIndex>> &globalDofs,
+    const std::vector<std::vector<BasisFunctionType>> &localDofWeights,
+    const Matrix<double> &localPoints,
+    const std::vector<double> &quadratureWeights, bool normalDerivative,
+    std::vector<std::size_t> &dofs, Matrix<ResultType> &projection) {
+
+  std::vector<unsigned int> elements;
+  fmm.octree().getLeafCubeEntities(elements, leaf);
+  const ReverseElementMapper &reverseMapper =
+      space.gridView().reverseElementMapper();
+
+  dofs = uniqueDofs(elements, globalDofs);
+  projection.setZero(fmm.nodeCount(), dofs.size());
+
+  Fiber::GeometricalData<double> geomData;
+  Fiber::BasisData<BasisFunctionType> basisData;
+  Matrix<double> values;
+  for (auto elementIndex : elements) {
+    const Entity<0> &element =
+        reverseMapper.entityPointer(elementIndex).entity();
+    element.geometry().getData(Fiber::GLOBALS | Fiber::INTEGRATION_ELEMENTS |
+                                   Fiber::NORMALS,
+                               localPoints, geomData);
+    if (normalDerivative)
+      fmm.interpolationDerivatives(leaf, geomData.globals, geomData.normals,
+                                   values);
+    else
+      fmm.interpolationValues(leaf, geomData.globals, values);
+    space.shapeset(element).evaluate(Fiber::VALUES, localPoints,
+                                     Fiber::ALL_DOFS, basisData);
+
+    const auto &elementDofs = globalDofs[elementIndex];
+    for (std::size_t i = 0; i < elementDofs.size(); ++i) {
+      if (elementDofs[i] < 0)
+        continue;
+      auto column = dofPosition(dofs, elementDofs[i]);
+      for (std::size_t q = 0; q < quadratureWeights.size(); ++q) {
+        ResultType factor = quadratureWeights[q] *
+                            geomData.integrationElements(q) *
+                            localDofWeights[elementIndex][i] *
+                            basisData.values(0, i, q);
+        projection.col(column) +=
+            factor * values.col(q).template cast<ResultType>();
+      }
+    }
+  }
+}
+}
+
+template <typename BasisFunctionType, typename ResultType>
+std::unique_ptr<DiscreteBoundaryOperator<ResultType>>
+FmmGlobalAssembler<BasisFunctionType, ResultType>::assembleDetachedWeakForm(
+    const Space<BasisFunctionType> &testSpace,
+    const Space<BasisFunctionType> &trialSpace,
+    LocalAssemblerForIntegralOperators &localAssembler,
+    const shared_ptr<const Fmm::FmmKernel<ResultType>> &kernel,
+    bool trialNormalDerivative,
+    const Context<BasisFunctionType, ResultType> &context) {
+
+  if (!testSpace.gridIsIdentical(trialSpace))
+    throw std::runtime_error(
+        "FmmGlobalAssembler::assembleDetachedWeakForm(): "
+        "test and trial space must be defined on the same grid");
+  if (testSpace.codomainDimension() != 1 ||
+      trialSpace.codomainDimension() != 1)
+    throw std::runtime_error(
+        "FmmGlobalAssembler::assembleDetachedWeakForm(): "
+        "only scalar spaces are supported");
+
+  const auto parameterList = context.globalParameterList();
+  auto order = parameterList.template get<int>("options.fmm.expansionOrder");
+  auto levels = parameterList.template get<int>("options.fmm.levels");
+  auto quadratureOrder = parameterList.template get<int>(
+      "options.quadrature.medium.singleOrder");
+
+  shared_ptr<const Fmm::Octree> octree(
+      new Fmm::Octree(testSpace.grid(), levels));
+  shared_ptr<Fmm::ChebychevFmm<ResultType>> fmm(
+      new Fmm::ChebychevFmm<ResultType>(octree, kernel, order,
+                                        testSpace.globalDofCount(),
+                                        trialSpace.globalDofCount()));
+
+  std::vector<std::vector<GlobalDofIndex>> testGlobalDofs, trialGlobalDofs;
+  std::vector<std::vector<BasisFunctionType>> testLocalDofWeights,
+      trialLocalDofWeights;
+  gatherGlobalDofs(testSpace, testGlobalDofs, testLocalDofWeights);
+  gatherGlobalDofs(trialSpace, trialGlobalDofs, trialLocalDofWeights);
+
+  Matrix<double> localPoints;
+  std::vector<double> quadratureWeights;
+  Fiber::fillSingleQuadraturePointsAndWeights(3, quadratureOrder, localPoints,
+                                              quadratureWeights);
+
+  const auto &leafs = fmm->leafs();
+
+  {
+    Fiber::SerialBlasRegion region;
+    tbb::parallel_for(
+        tbb::blocked_range<std::size_t>(0, leafs.size()),
+        [&](const tbb::blocked_range<std::size_t> &r) {
+          for (std::size_t index = r.begin(); index != r.end(); ++index) {
+            auto leaf = leafs[index];
+
+            // P2M and L2P matrices.
+            std::vector<std::size_t> trialDofs, testDofs;
+            Matrix<ResultType> trialProjection, testProjection;
+            leafProjection(*fmm, leaf, trialSpace, trialGlobalDofs,
+                           trialLocalDofWeights, localPoints,
+                           quadratureWeights, trialNormalDerivative,
+                           trialDofs, trialProjection);
+            leafProjection(*fmm, leaf, testSpace, testGlobalDofs,
+                           testLocalDofWeights, localPoints,
+                           quadratureWeights, false, testDofs,
+                           testProjection);
+            fmm->setLeafMatrices(leaf, std::move(trialDofs),
+                                 std::move(trialProjection),
+                                 std::move(testDofs),
+                                 testProjection.adjoint());
+          }
+        });
+  }
+
+  fmm->setNearField(
+      NearFieldAssembler<BasisFunctionType, ResultType>::assembleNearField(
+          testSpace, trialSpace, *octree, localAssembler));
+
+  return std::unique_ptr<DiscreteBoundaryOperator<ResultType>>(
+      static_cast<DiscreteBoundaryOperator<ResultType> *>(
+          new DiscreteFmmBoundaryOperator<ResultType>(fmm)));
+}
+
+FIBER_INSTANTIATE_CLASS_TEMPLATED_ON_BASIS_AND_RESULT(FmmGlobalAssembler);
+
+} // namespace Bempp
@@ -0,0 +1,83 @@
+// Copyright (C) 2011-2012 by the BEM++ Authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef bempp_fmm_global_assembler_hpp
+#define bempp_fmm_global_assembler_hpp
+
+#include "../common/common.hpp"
+
+#include "../common/shared_ptr.hpp"
+#include "../fiber/scalar_traits.hpp"
+
+#include <memory>
+
+namespace Fiber {
+
+/** \cond FORWARD_DECL */
+template <typename ResultType> class LocalAssemblerForIntegralOperators;
+/** \endcond */
+
+} // namespace Fiber
+
+namespace Fmm {
+
+/** \cond FORWARD_DECL */
+template <typename ValueType> class FmmKernel;
+/** \endcond */
+
+} // namespace Fmm
+
+namespace Bempp {
+
+/** \cond FORWARD_DECL */
+template <typename ValueType> class DiscreteBoundaryOperator;
+template <typename BasisFunctionType> class Space;
+template <typename BasisFunctionType, typename ResultType> class Context;
+/** \endcond */
+
+/** \ingroup weak_form_assembly_internal
+ *  \brief FMM-mode assembler.
+ *
+ *  The interactions of elements in neighbouring octree leafs are assembled
+ *  by the local assembler into a sparse near-field matrix. All other
+ *  interactions are approximated by the fast multipole method with the
+ *  given kernel, or with its normal derivative in the trial point if
+ *  trialNormalDerivative is true. Test and trial space must be scalar
+ *  spaces on the same grid.
+ */
+template <typename BasisFunctionType, typename ResultType>
+class FmmGlobalAssembler {
+public:
+  typedef DiscreteBoundaryOperator<ResultType> DiscreteBndOp;
+  typedef Fiber::LocalAssemblerForIntegralOperators<ResultType>
+      LocalAssemblerForIntegralOperators;
+
+  static std::unique_ptr<DiscreteBndOp> assembleDetachedWeakForm(
+      const Space<BasisFunctionType> &testSpace,
+      const Space<BasisFunctionType> &trialSpace,
+      LocalAssemblerForIntegralOperators &localAssembler,
+      const shared_ptr<const Fmm::FmmKernel<ResultType>> &kernel,
+      bool trialNormalDerivative,
+      const Context<BasisFunctionType, ResultType> &context);
+};
+
+} // namespace Bempp
+
+#endif
@@ -0,0 +1,93 @@
+// Copyright (C) 2011-2012 by the BEM++ Authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef bempp_global_dof_helpers_hpp
+#define bempp_global_dof_helpers_hpp
+
+#include "../common/common.hpp"
+
+#include "../common/types.hpp"
+#include "../grid/entity.hpp"
+#include "../grid/entity_iterator.hpp"
+#include "../grid/grid_view.hpp"
+#include "../grid/mapper.hpp"
+#include "../space/space.hpp"
+
+#include <algorithm>
+#include <vector>
+
+namespace Bempp {
+
+/** \ingroup weak_form_assembly_internal
+ *  \brief Global dofs and local dof weights of each element of the grid
+ *  view of a space, indexed by the element index. */
+template <typename BasisFunctionType>
+inline void
+gatherGlobalDofs(const Space<BasisFunctionType> &space,
+                 std::vector<std::vector<GlobalDofIndex>> &globalDofs,
+                 std::vector<std::vector<BasisFunctionType>> &localDofWeights) {
+
+  const GridView &view = space.gridView();
+  const int elementCount = view.entityCount(0);
+
+  globalDofs.clear();
+  globalDofs.resize(elementCount);
+  localDofWeights.clear();
+  localDofWeights.resize(elementCount);
+
+  const Mapper &mapper = view.elementMapper();
+  std::unique_ptr<EntityIterator<0>> it = view.entityIterator<0>();
+  while (!it->finished()) {
+    const Entity<0> &element = it->entity();
+    const int elementIndex = mapper.entityIndex(element);
+    space.getGlobalDofs(element, globalDofs[elementIndex],
+                        localDofWeights[elementIndex]);
+    it->next();
+  }
+}
+
+/** \ingroup weak_form_assembly_internal
+ *  \brief Sorted global dofs of a set of elements. */
+inline std::vector<std::size_t>
+uniqueDofs(const std::vector<unsigned int> &elements,
+           const std::vector<std::vector<GlobalDofIndex>> &globalDofs) {
+
+  std::vector<std::size_t> dofs;
+  for (auto element : elements)
+    for (auto dof : globalDofs[element])
+      if (dof >= 0)
+        dofs.push_back(dof);
+  std::sort(dofs.begin(), dofs.end());
+  dofs.erase(std::unique(dofs.begin(), dofs.end()), dofs.end());
+  return dofs;
+}
+
+/** \ingroup weak_form_assembly_internal
+ *  \brief Position of a global dof in a list returned by uniqueDofs(). */
+inline std::size_t dofPosition(const std::vector<std::size_t> &dofs,
+                               GlobalDofIndex dof) {
+  return std::lower_bound(dofs.begin(), dofs.end(),
+                          static_cast<std::size_t>(dof)) -
+         dofs.begin();
+}
+
+} // namespace Bempp
+
+#endif
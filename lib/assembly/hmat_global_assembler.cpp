@@ -27,6 +27,7 @@
 #include "evaluation_options.hpp"
 #include "hmat_interface.hpp"
 #include "potential_operator_hmat_assembly_helper.hpp"
+#include "symmetry.hpp"
 #include "weak_form_hmat_assembly_helper.hpp"
 
 #include "../common/auto_timer.hpp"
@@ -48,6 +49,8 @@
 #include "../hmat/hmatrix.hpp"
 #include "../hmat/hmatrix_aca_compressor.hpp"
 #include "../hmat/hmatrix_dense_compressor.hpp"
+#include "../hmat/hmatrix_hca_compressor.hpp"
+#include "../hmat/hmatrix_randomized_compressor.hpp"
 
 #include <fstream>
 #include <iostream>
@@ -110,6 +113,51 @@ private:
   const Matrix<CoordinateType> &m_points;
   int m_componentCount;
 };
+
+hmat::MatVecStrategy matVecStrategy(const ParameterList &parameterList) {
+
+  auto strategy =
+      parameterList.get<std::string>("options.hmat.matVecStrategy");
+
+  if (strategy == "ownerComputes")
+    return hmat::OWNER_COMPUTES;
+  else if (strategy == "threadLocal")
+    return hmat::THREAD_LOCAL;
+  else
+    throw std::runtime_error("HMatGlobalAssembler: Unknown matvec strategy");
+}
+
+hmat::StoragePrecision storagePrecision(const ParameterList &parameterList) {
+
+  auto precision =
+      parameterList.get<std::string>("options.hmat.storagePrecision");
+
+  if (precision == "double")
+    return hmat::NATIVE_PRECISION;
+  else if (precision == "single")
+    return hmat::SINGLE_PRECISION;
+  else
+    throw std::runtime_error("HMatGlobalAssembler: Unknown storage precision");
+}
+
+// Apply the options that do not influence the compression of the blocks.
+template <typename ValueType>
+void finalizeHMatrix(hmat::DefaultHMatrixType<ValueType> &hMatrix,
+                     const ParameterList &parameterList) {
+
+  hMatrix.setMatVecStrategy(matVecStrategy(parameterList));
+  hMatrix.setMatVecProfiling(
+      parameterList.get<bool>("options.hmat.matVecProfiling"));
+
+  if (parameterList.get<bool>("options.hmat.coarsening"))
+    hMatrix.coarsen(parameterList.get<double>("options.hmat.eps"));
+
+  // Single precision blocks are only supported in packed storage.
+  auto precision = storagePrecision(parameterList);
+  if (parameterList.get<bool>("options.hmat.compactStorage") ||
+      precision == hmat::SINGLE_PRECISION)
+    hMatrix.packLeafData(precision);
+}
 }
 
 template <typename BasisFunctionType, typename ResultType>
@@ -154,24 +202,50 @@ HMatGlobalAssembler<BasisFunctionType, ResultType>::assembleDetachedWeakForm(
 
   auto maxRank = parameterList.template get<int>("options.hmat.maxRank");
   auto eps = parameterList.template get<double>("options.hmat.eps");
+  auto recompress =
+      parameterList.template get<bool>("options.hmat.recompress");
 
   shared_ptr<hmat::DefaultHMatrixType<ResultType>> hMatrix;
 
   double cutoff = parameterList.template get<double>("options.hmat.cutoff");
 
+  // With identical test and trial spaces the blocks above the diagonal of
+  // a symmetric operator are not assembled. Complex symmetric operators
+  // such as the Helmholtz single layer take precedence over Hermitian ones.
+  auto hMatrixSymmetry = hmat::UNSYMMETRIC;
+  if (&testSpace == &trialSpace) {
+    if (symmetry & SYMMETRIC)
+      hMatrixSymmetry = hmat::SYMMETRIC;
+    else if (symmetry & HERMITIAN)
+      hMatrixSymmetry = hmat::HERMITIAN;
+  }
+
   if (compressionAlgorithm == "aca") {
 
     hmat::HMatrixAcaCompressor<ResultType, 2> compressor(helper, eps, maxRank,
+                                                         cutoff, recompress);
+    hMatrix.reset(new hmat::DefaultHMatrixType<ResultType>(
+        blockClusterTree, compressor, hMatrixSymmetry));
+  } else if (compressionAlgorithm == "randomized") {
+    hmat::HMatrixRandomizedCompressor<ResultType, 2> compressor(
+        helper, eps, maxRank, cutoff);
+    hMatrix.reset(new hmat::DefaultHMatrixType<ResultType>(
+        blockClusterTree, compressor, hMatrixSymmetry));
+  } else if (compressionAlgorithm == "hca") {
+    hmat::HMatrixHcaCompressor<ResultType, 2> compressor(helper, eps, maxRank,
                                                          cutoff);
-    hMatrix.reset(
-        new hmat::DefaultHMatrixType<ResultType>(blockClusterTree, compressor));
+    hMatrix.reset(new hmat::DefaultHMatrixType<ResultType>(
+        blockClusterTree, compressor, hMatrixSymmetry));
   } else if (compressionAlgorithm == "dense") {
     hmat::HMatrixDenseCompressor<ResultType, 2> compressor(helper, cutoff);
-    hMatrix.reset(
-        new hmat::DefaultHMatrixType<ResultType>(blockClusterTree, compressor));
+    hMatrix.reset(new hmat::DefaultHMatrixType<ResultType>(
+        blockClusterTree, compressor, hMatrixSymmetry));
   } else
     throw std::runtime_error("HMatGlobalAssember::assembleDetachedWeakForm: "
                              "Unknown compression algorithm");
+
+  finalizeHMatrix(*hMatrix, parameterList);
+
   return std::unique_ptr<DiscreteBoundaryOperator<ResultType>>(
       static_cast<DiscreteBoundaryOperator<ResultType> *>(
           new DiscreteHMatBoundaryOperator<ResultType>(hMatrix)));
@@ -235,6 +309,8 @@ HMatGlobalAssembler<BasisFunctionType, ResultType>::assemblePotentialOperator(
 
   auto maxRank = parameterList.template get<int>("options.hmat.maxRank");
   auto eps = parameterList.template get<double>("options.hmat.eps");
+  auto recompress =
+      parameterList.template get<bool>("options.hmat.recompress");
 
   shared_ptr<hmat::DefaultHMatrixType<ResultType>> hMatrix;
 
@@ -242,6 +318,16 @@ HMatGlobalAssembler<BasisFunctionType, ResultType>::assemblePotentialOperator(
   if (compressionAlgorithm == "aca") {
 
     hmat::HMatrixAcaCompressor<ResultType, 2> compressor(helper, eps, maxRank,
+                                                         cutoff, recompress);
+    hMatrix.reset(
+        new hmat::DefaultHMatrixType<ResultType>(blockClusterTree, compressor));
+  } else if (compressionAlgorithm == "randomized") {
+    hmat::HMatrixRandomizedCompressor<ResultType, 2> compressor(
+        helper, eps, maxRank, cutoff);
+    hMatrix.reset(
+        new hmat::DefaultHMatrixType<ResultType>(blockClusterTree, compressor));
+  } else if (compressionAlgorithm == "hca") {
+    hmat::HMatrixHcaCompressor<ResultType, 2> compressor(helper, eps, maxRank,
                                                          cutoff);
     hMatrix.reset(
         new hmat::DefaultHMatrixType<ResultType>(blockClusterTree, compressor));
@@ -252,6 +338,9 @@ HMatGlobalAssembler<BasisFunctionType, ResultType>::assemblePotentialOperator(
   } else
     throw std::runtime_error("HMatGlobalAssember::assembleDetachedWeakForm: "
                              "Unknown compression algorithm");
+
+  finalizeHMatrix(*hMatrix, parameterList);
+
   return std::unique_ptr<DiscreteBoundaryOperator<ResultType>>(
       static_cast<DiscreteBoundaryOperator<ResultType> *>(
           new DiscreteHMatBoundaryOperator<ResultType>(hMatrix)));
@@ -80,6 +80,9 @@ generateBlockClusterTree(const hmat::Geometry &testGeometry,
   if (admissibility == "strong") {
     auto eta = parameterList.template get<double>("options.hmat.eta");
     admissibilityFunction = hmat::StrongAdmissibility(eta);
+  } else if (admissibility == "oriented") {
+    auto eta = parameterList.template get<double>("options.hmat.eta");
+    admissibilityFunction = hmat::OrientedAdmissibility(eta);
   } else if (admissibility == "weak") {
     admissibilityFunction = hmat::WeakAdmissibility();
   } else
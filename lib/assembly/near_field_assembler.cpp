@@ -0,0 +1,274 @@
+// Copyright (C) 2011-2012 by the BEM++ Authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "near_field_assembler.hpp"
+
+#include "context.hpp"
+#include "discrete_sparse_boundary_operator.hpp"
+#include "global_dof_helpers.hpp"
+
+#include "../common/eigen_support.hpp"
+#include "../fiber/basis_data.hpp"
+#include "../fiber/conjugate.hpp"
+#include "../fiber/explicit_instantiation.hpp"
+#include "../fiber/geometrical_data.hpp"
+#include "../fiber/local_assembler_for_integral_operators.hpp"
+#include "../fiber/numerical_quadrature.hpp"
+#include "../fiber/serial_blas_region.hpp"
+#include "../fiber/shapeset.hpp"
+#include "../fmm/adaptive_interaction_list.hpp"
+#include "../fmm/fmm_kernel.hpp"
+#include "../fmm/octree.hpp"
+#include "../grid/entity.hpp"
+#include "../grid/entity_iterator.hpp"
+#include "../grid/geometry.hpp"
+#include "../grid/grid.hpp"
+#include "../grid/grid_view.hpp"
+#include "../grid/mapper.hpp"
+#include "../space/space.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <stdexcept>
+#include <utility>
+
+#include <tbb/parallel_for.h>
+
+namespace Bempp {
+
+namespace {
+
+// Regular quadrature data of an element. values(i, q) is the i-th shape
+// function at point q times the quadrature weight and integration element.
+template <typename BasisFunctionType> struct ElementQuadrature {
+  Matrix<double> points;
+  Matrix<double> normals;
+  Matrix<BasisFunctionType> values;
+};
+
+template <typename BasisFunctionType>
+void gatherElementQuadrature(
+    const Space<BasisFunctionType> &space, const Matrix<double> &localPoints,
+    const std::vector<double> &quadratureWeights,
+    std::vector<ElementQuadrature<BasisFunctionType>> &quadrature) {
+
+  const GridView &view = space.gridView();
+  quadrature.clear();
+  quadrature.resize(view.entityCount(0));
+
+  Fiber::GeometricalData<double> geomData;
+  Fiber::BasisData<BasisFunctionType> basisData;
+  const Mapper &mapper = view.elementMapper();
+  std::unique_ptr<EntityIterator<0>> it = view.entityIterator<0>();
+  while (!it->finished()) {
+    const Entity<0> &element = it->entity();
+    auto &data = quadrature[mapper.entityIndex(element)];
+    element.geometry().getData(Fiber::GLOBALS | Fiber::INTEGRATION_ELEMENTS |
+                                   Fiber::NORMALS,
+                               localPoints, geomData);
+    space.shapeset(element).evaluate(Fiber::VALUES, localPoints,
+                                     Fiber::ALL_DOFS, basisData);
+    data.points = geomData.globals;
+    data.normals = geomData.normals;
+    data.values.resize(basisData.functionCount(), quadratureWeights.size());
+    for (std::size_t q = 0; q < quadratureWeights.size(); ++q)
+      for (int i = 0; i < basisData.functionCount(); ++i)
+        data.values(i, q) = quadratureWeights[q] *
+                            geomData.integrationElements(q) *
+                            basisData.values(0, i, q);
+    it->next();
+  }
+}
+}
+
+template <typename BasisFunctionType, typename ResultType>
+typename NearFieldAssembler<BasisFunctionType, ResultType>::SparseMatrix
+NearFieldAssembler<BasisFunctionType, ResultType>::assembleNearField(
+    const Space<BasisFunctionType> &testSpace,
+    const Space<BasisFunctionType> &trialSpace, const Fmm::Octree &octree,
+    LocalAssemblerForIntegralOperators &localAssembler,
+    const shared_ptr<const Fmm::FmmKernel<ResultType>> &subtractedKernel,
+    bool trialNormalDerivative, int quadratureOrder) {
+
+  if (!testSpace.gridIsIdentical(trialSpace))
+    throw std::runtime_error(
+        "NearFieldAssembler::assembleNearField(): "
+        "test and trial space must be defined on the same grid");
+  if (testSpace.codomainDimension() != 1 ||
+      trialSpace.codomainDimension() != 1)
+    throw std::runtime_error("NearFieldAssembler::assembleNearField(): "
+                             "only scalar spaces are supported");
+
+  std::vector<std::vector<GlobalDofIndex>> testGlobalDofs, trialGlobalDofs;
+  std::vector<std::vector<BasisFunctionType>> testLocalDofWeights,
+      trialLocalDofWeights;
+  gatherGlobalDofs(testSpace, testGlobalDofs, testLocalDofWeights);
+  gatherGlobalDofs(trialSpace, trialGlobalDofs, trialLocalDofWeights);
+
+  std::vector<ElementQuadrature<BasisFunctionType>> testQuadrature,
+      trialQuadrature;
+  if (subtractedKernel) {
+    Matrix<double> localPoints;
+    std::vector<double> quadratureWeights;
+    Fiber::fillSingleQuadraturePointsAndWeights(3, quadratureOrder,
+                                                localPoints, quadratureWeights);
+    gatherElementQuadrature(testSpace, localPoints, quadratureWeights,
+                            testQuadrature);
+    gatherElementQuadrature(trialSpace, localPoints, quadratureWeights,
+                            trialQuadrature);
+  }
+
+  std::vector<std::pair<unsigned long, unsigned int>> leafs;
+  for (unsigned int level = 1; level <= octree.levels(); ++level)
+    for (auto node : octree.getNonEmptyNodes(level))
+      if (octree.isLeaf(node, level))
+        leafs.push_back({node, level});
+  std::vector<std::vector<Eigen::Triplet<ResultType>>> triplets(leafs.size());
+
+  {
+    Fiber::SerialBlasRegion region;
+    tbb::parallel_for(
+        tbb::blocked_range<std::size_t>(0, leafs.size()),
+        [&](const tbb::blocked_range<std::size_t> &r) {
+          for (std::size_t index = r.begin(); index != r.end(); ++index) {
+            auto leaf = leafs[index];
+
+            std::vector<unsigned int> testElements;
+            octree.getCubeEntities(testElements, leaf.first, leaf.second);
+            std::vector<unsigned int> trialElements;
+            for (Fmm::AdaptiveInteractionList list(
+                     octree, leaf.first, leaf.second,
+                     Fmm::AdaptiveInteractionList::U_LIST);
+                 !list.finished(); list.next())
+              octree.getCubeEntities(trialElements, *list, list.level());
+
+            Fiber::_2dArray<Matrix<ResultType>> localResult;
+            localAssembler.evaluateLocalWeakForms(
+                std::vector<int>(testElements.begin(), testElements.end()),
+                std::vector<int>(trialElements.begin(), trialElements.end()),
+                localResult);
+
+            if (subtractedKernel) {
+              Matrix<ResultType> kernelValues;
+              for (std::size_t j = 0; j < trialElements.size(); ++j)
+                for (std::size_t i = 0; i < testElements.size(); ++i) {
+                  const auto &test = testQuadrature[testElements[i]];
+                  const auto &trial = trialQuadrature[trialElements[j]];
+                  if (trialNormalDerivative)
+                    subtractedKernel->evaluateTrialNormalDerivatives(
+                        test.points, trial.points, trial.normals,
+                        kernelValues);
+                  else
+                    subtractedKernel->evaluate(test.points, trial.points,
+                                               kernelValues);
+                  // Coincident points are skipped by the far field.
+                  for (int l = 0; l < kernelValues.cols(); ++l)
+                    for (int k = 0; k < kernelValues.rows(); ++k)
+                      if (!std::isfinite(std::abs(kernelValues(k, l))))
+                        kernelValues(k, l) = 0;
+                  localResult(i, j) -=
+                      test.values.conjugate().template cast<ResultType>() *
+                      kernelValues *
+                      trial.values.transpose().template cast<ResultType>();
+                }
+            }
+
+            auto rows = uniqueDofs(testElements, testGlobalDofs);
+            auto columns = uniqueDofs(trialElements, trialGlobalDofs);
+            Matrix<ResultType> block =
+                Matrix<ResultType>::Zero(rows.size(), columns.size());
+            for (std::size_t j = 0; j < trialElements.size(); ++j) {
+              const auto &trialDofs = trialGlobalDofs[trialElements[j]];
+              for (std::size_t i = 0; i < testElements.size(); ++i) {
+                const auto &testDofs = testGlobalDofs[testElements[i]];
+                for (std::size_t l = 0; l < trialDofs.size(); ++l) {
+                  if (trialDofs[l] < 0)
+                    continue;
+                  auto column = dofPosition(columns, trialDofs[l]);
+                  for (std::size_t k = 0; k < testDofs.size(); ++k) {
+                    if (testDofs[k] < 0)
+                      continue;
+                    block(dofPosition(rows, testDofs[k]), column) +=
+                        Fiber::conjugate(
+                            testLocalDofWeights[testElements[i]][k]) *
+                        trialLocalDofWeights[trialElements[j]][l] *
+                        localResult(i, j)(k, l);
+                  }
+                }
+              }
+            }
+
+            triplets[index].reserve(block.size());
+            for (std::size_t j = 0; j < columns.size(); ++j)
+              for (std::size_t i = 0; i < rows.size(); ++i)
+                triplets[index].emplace_back(rows[i], columns[j], block(i, j));
+          }
+        });
+  }
+
+  std::vector<Eigen::Triplet<ResultType>> allTriplets;
+  for (auto &leafTriplets : triplets) {
+    allTriplets.insert(allTriplets.end(), leafTriplets.begin(),
+                       leafTriplets.end());
+    std::vector<Eigen::Triplet<ResultType>>().swap(leafTriplets);
+  }
+  SparseMatrix nearField(testSpace.globalDofCount(),
+                         trialSpace.globalDofCount());
+  nearField.setFromTriplets(allTriplets.begin(), allTriplets.end());
+  return nearField;
+}
+
+template <typename BasisFunctionType, typename ResultType>
+std::unique_ptr<DiscreteBoundaryOperator<ResultType>>
+NearFieldAssembler<BasisFunctionType, ResultType>::assembleDetachedWeakForm(
+    const Space<BasisFunctionType> &testSpace,
+    const Space<BasisFunctionType> &trialSpace,
+    LocalAssemblerForIntegralOperators &localAssembler,
+    const Context<BasisFunctionType, ResultType> &context,
+    const shared_ptr<const Fmm::FmmKernel<ResultType>> &subtractedKernel,
+    bool trialNormalDerivative) {
+
+  const auto parameterList = context.globalParameterList();
+  auto levels = parameterList.template get<int>("options.fmm.levels");
+  auto quadratureOrder = parameterList.template get<int>(
+      "options.quadrature.medium.singleOrder");
+
+  Fmm::Octree octree(testSpace.grid(), levels);
+  SparseMatrix nearField =
+      assembleNearField(testSpace, trialSpace, octree, localAssembler,
+                        subtractedKernel, trialNormalDerivative,
+                        quadratureOrder);
+
+  for (int k = 0; k < nearField.nonZeros(); ++k)
+    if (std::imag(nearField.valuePtr()[k]) != 0)
+      throw std::runtime_error(
+          "NearFieldAssembler::assembleDetachedWeakForm(): "
+          "sparse operators with complex entries are not supported");
+
+  shared_ptr<RealSparseMatrix> result(new RealSparseMatrix(nearField.real()));
+  return std::unique_ptr<DiscreteBoundaryOperator<ResultType>>(
+      static_cast<DiscreteBoundaryOperator<ResultType> *>(
+          new DiscreteSparseBoundaryOperator<ResultType>(result)));
+}
+
+FIBER_INSTANTIATE_CLASS_TEMPLATED_ON_BASIS_AND_RESULT(NearFieldAssembler);
+
+} // namespace Bempp
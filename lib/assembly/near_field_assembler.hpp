@@ -0,0 +1,110 @@
+// Copyright (C) 2011-2012 by the BEM++ Authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef bempp_near_field_assembler_hpp
+#define bempp_near_field_assembler_hpp
+
+#include "../common/common.hpp"
+
+#include "../common/shared_ptr.hpp"
+#include "../fiber/scalar_traits.hpp"
+
+#include <Eigen/Sparse>
+
+#include <memory>
+
+namespace Fiber {
+
+/** \cond FORWARD_DECL */
+template <typename ResultType> class LocalAssemblerForIntegralOperators;
+/** \endcond */
+
+} // namespace Fiber
+
+namespace Fmm {
+
+/** \cond FORWARD_DECL */
+class Octree;
+template <typename ValueType> class FmmKernel;
+/** \endcond */
+
+} // namespace Fmm
+
+namespace Bempp {
+
+/** \cond FORWARD_DECL */
+template <typename ValueType> class DiscreteBoundaryOperator;
+template <typename BasisFunctionType> class Space;
+template <typename BasisFunctionType, typename ResultType> class Context;
+/** \endcond */
+
+/** \ingroup weak_form_assembly_internal
+ *  \brief Assembler of the near field of an octree.
+ *
+ *  The near field consists of the interactions of the elements of each
+ *  octree leaf with the elements of the adjacent leafs, including the leaf
+ *  itself, i.e. of its U list. The octree can be adaptive.
+ *  They are integrated by the local assembler, i.e. with the singular and
+ *  near-singular quadrature rules, and stored in a sparse matrix.
+ *
+ *  If a kernel is given, the regular quadrature of the kernel with
+ *  quadratureOrder points on each element is subtracted from every pair,
+ *  so that the near field can be added to a far-field approximation that
+ *  is computed with this quadrature over all element pairs. Coincident
+ *  quadrature points contribute nothing. If trialNormalDerivative is true,
+ *  the derivative of the kernel in the direction of the trial normal is
+ *  subtracted instead. Test and trial space must be scalar spaces on the
+ *  same grid.
+ */
+template <typename BasisFunctionType, typename ResultType>
+class NearFieldAssembler {
+public:
+  typedef DiscreteBoundaryOperator<ResultType> DiscreteBndOp;
+  typedef Fiber::LocalAssemblerForIntegralOperators<ResultType>
+      LocalAssemblerForIntegralOperators;
+  typedef Eigen::SparseMatrix<ResultType, Eigen::RowMajor> SparseMatrix;
+
+  static SparseMatrix assembleNearField(
+      const Space<BasisFunctionType> &testSpace,
+      const Space<BasisFunctionType> &trialSpace, const Fmm::Octree &octree,
+      LocalAssemblerForIntegralOperators &localAssembler,
+      const shared_ptr<const Fmm::FmmKernel<ResultType>> &subtractedKernel =
+          shared_ptr<const Fmm::FmmKernel<ResultType>>(),
+      bool trialNormalDerivative = false, int quadratureOrder = 3);
+
+  /** \brief Assemble the near field of the octree given by the FMM options
+   *  as a sparse discrete operator.
+   *
+   *  The regular quadrature uses options.quadrature.medium.singleOrder.
+   *  Since sparse discrete operators are real, an exception is thrown if
+   *  the near field has complex entries. */
+  static std::unique_ptr<DiscreteBndOp> assembleDetachedWeakForm(
+      const Space<BasisFunctionType> &testSpace,
+      const Space<BasisFunctionType> &trialSpace,
+      LocalAssemblerForIntegralOperators &localAssembler,
+      const Context<BasisFunctionType, ResultType> &context,
+      const shared_ptr<const Fmm::FmmKernel<ResultType>> &subtractedKernel =
+          shared_ptr<const Fmm::FmmKernel<ResultType>>(),
+      bool trialNormalDerivative = false);
+};
+
+} // namespace Bempp
+
+#endif
@@ -67,6 +67,28 @@ void PotentialOperatorHMatAssemblyHelper<BasisFunctionType, ResultType>::
                 trialMapper.entityPointer(trialElementIndices[nTrialElem]).entity().geometry().volume());
 }
 
+template <typename BasisFunctionType, typename ResultType>
+bool PotentialOperatorHMatAssemblyHelper<BasisFunctionType, ResultType>::
+    dofPositions(Matrix<double>& testPositions, Matrix<double>& trialPositions) const
+{
+    const auto& testDofMap = m_blockClusterTree->rowClusterTree()->hMatDofToOriginalDofMap();
+    const auto& trialDofMap = m_blockClusterTree->columnClusterTree()->hMatDofToOriginalDofMap();
+
+    // All components of the potential at a point share its position.
+    testPositions.resize(3, testDofMap.size());
+    for (size_t i = 0; i < testDofMap.size(); ++i)
+        testPositions.col(i) = m_points.col(testDofMap[i] / m_componentCount).template cast<double>();
+
+    std::vector<Point3D<CoordinateType> > trialPoints;
+    m_trialSpace.getGlobalDofPositions(trialPoints);
+    trialPositions.resize(3, trialDofMap.size());
+    for (size_t j = 0; j < trialDofMap.size(); ++j) {
+        const auto& point = trialPoints[trialDofMap[j]];
+        trialPositions.col(j) << point.x, point.y, point.z;
+    }
+    return true;
+}
+
 template <typename BasisFunctionType, typename ResultType>
 typename PotentialOperatorHMatAssemblyHelper<BasisFunctionType,
     ResultType>::MagnitudeType
@@ -82,6 +82,11 @@ public:
 
     void dofVolumes(Vector<double>& testVolumes, Vector<double>& trialVolumes) const override;
 
+    /** \brief Return the positions of the evaluation points and of the trial
+     *  dofs in H-matrix ordering. */
+    bool dofPositions(Matrix<double>& testPositions,
+        Matrix<double>& trialPositions) const override;
+
 private:
     MagnitudeType estimateMinimumDistance(
         const hmat::DefaultBlockClusterTreeNodeType& blockClusterTreeNode) const;
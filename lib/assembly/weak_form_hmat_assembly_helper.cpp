@@ -155,6 +155,32 @@ void WeakFormHMatAssemblyHelper<BasisFunctionType, ResultType>::dofVolumes(
                 trialMapper.entityPointer(trialElementIndices[nTrialElem]).entity().geometry().volume());
 }
 
+template <typename BasisFunctionType, typename ResultType>
+bool WeakFormHMatAssemblyHelper<BasisFunctionType, ResultType>::dofPositions(
+    Matrix<double>& testPositions, Matrix<double>& trialPositions) const
+{
+    const auto& testDofMap = m_blockClusterTree->rowClusterTree()->hMatDofToOriginalDofMap();
+    const auto& trialDofMap = m_blockClusterTree->columnClusterTree()->hMatDofToOriginalDofMap();
+
+    std::vector<Point3D<CoordinateType> > testPoints;
+    std::vector<Point3D<CoordinateType> > trialPoints;
+    m_testSpace.getGlobalDofPositions(testPoints);
+    m_trialSpace.getGlobalDofPositions(trialPoints);
+
+    testPositions.resize(3, testDofMap.size());
+    for (size_t i = 0; i < testDofMap.size(); ++i) {
+        const auto& point = testPoints[testDofMap[i]];
+        testPositions.col(i) << point.x, point.y, point.z;
+    }
+
+    trialPositions.resize(3, trialDofMap.size());
+    for (size_t j = 0; j < trialDofMap.size(); ++j) {
+        const auto& point = trialPoints[trialDofMap[j]];
+        trialPositions.col(j) << point.x, point.y, point.z;
+    }
+    return true;
+}
+
 template <typename BasisFunctionType, typename ResultType>
 void WeakFormHMatAssemblyHelper<BasisFunctionType, ResultType>::
     computeMatrixBlock(
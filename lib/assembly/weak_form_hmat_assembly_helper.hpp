@@ -91,6 +91,11 @@ public:
 
     void dofVolumes(Vector<double>& testVolumes, Vector<double>& trialVolumes) const override;
 
+    /** \brief Return the positions of the test and trial dofs in H-matrix
+     *  ordering. */
+    bool dofPositions(Matrix<double>& testPositions,
+        Matrix<double>& trialPositions) const override;
+
     // /** \brief Return the number of entries in the matrix that have been
     //  *  accessed so far. */
     // size_t accessedEntryCount() const;
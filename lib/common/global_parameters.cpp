@@ -36,7 +36,8 @@ ParameterList GlobalParameters::parameterList() {
   parameters.put("options.global.verbosityLevel", static_cast<int>(5));
 
   // Default assembly type for boundary operators. Allowed values are
-  // "dense" and "hmat".
+  // "dense", "hmat" and "fmm". "fmm" supports the Laplace single and
+  // double layer operators.
   parameters.put("options.assembly.boundaryOperatorAssemblyType",
                  std::string("hmat"));
 
@@ -101,7 +102,9 @@ ParameterList GlobalParameters::parameterList() {
   // Specifies the block separation parameter eta.
   parameters.put("options.hmat.eta", static_cast<double>(1.2));
 
-  // Specifies the type of admissibility function ('strong' or 'weak')
+  // Specifies the type of admissibility function ('strong', 'oriented' or
+  // 'weak'). 'oriented' is the strong condition with the cluster distance
+  // estimated from oriented bounding boxes.
   parameters.put("options.hmat.admissibility", std::string("weak"));
 
   // Specifies the accuracy of low-rank approximations.
@@ -110,13 +113,45 @@ ParameterList GlobalParameters::parameterList() {
   // Maximum rank of a low rank subblock
   parameters.put("options.hmat.maxRank", static_cast<int>(30));
 
-  // Compression algorithm
+  // Recompress the low-rank blocks computed by ACA with a truncated SVD
+  parameters.put("options.hmat.recompress", false);
+
+  // Compression algorithm ('aca', 'hca', 'randomized' or 'dense'). 'hca'
+  // needs an operator whose kernel can be evaluated at arbitrary points and
+  // falls back to 'aca' otherwise.
   parameters.put("options.hmat.compressionAlgorithm", std::string("aca"));
 
   // Specifies distance of clusters beyond which they are not assembled
   parameters.put("options.hmat.cutoff",
                  static_cast<double>(1.797693134862315e+308));
 
+  // Parallelization strategy of the H-matrix matvec ('ownerComputes' or
+  // 'threadLocal')
+  parameters.put("options.hmat.matVecStrategy", std::string("ownerComputes"));
+
+  // Merge sibling blocks into low-rank blocks after assembly if this saves
+  // memory. The merged blocks are approximated to the accuracy eps.
+  parameters.put("options.hmat.coarsening", false);
+
+  // Store all leaf blocks in one contiguous buffer in matvec order. The
+  // block accessors then return copies of the blocks instead of references.
+  parameters.put("options.hmat.compactStorage", false);
+
+  // Precision of the stored blocks ('double' or 'single'). With 'single'
+  // the blocks are packed and stored in float or complex<float>, while
+  // matvecs still accumulate in double precision.
+  parameters.put("options.hmat.storagePrecision", std::string("double"));
+
+  // Measure the time spent in dense and in low-rank blocks during matvecs
+  parameters.put("options.hmat.matVecProfiling", false);
+
+  // Order of the Chebychev interpolation in the fast multipole method
+  parameters.put("options.fmm.expansionOrder", static_cast<int>(5));
+
+  // Number of octree levels of the fast multipole method. -1 chooses the
+  // finest level whose boxes are still wide compared to the elements.
+  parameters.put("options.fmm.levels", static_cast<int>(-1));
+
   return parameters;
 }
 }
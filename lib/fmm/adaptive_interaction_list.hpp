@@ -0,0 +1,60 @@
+#ifndef bempp_fmm_adaptive_interaction_list_hpp
+#define bempp_fmm_adaptive_interaction_list_hpp
+
+#include "fmm_common.hpp"
+#include "octree.hpp"
+#include <utility>
+#include <vector>
+
+namespace Fmm {
+
+/** \brief Interaction lists of a box of an adaptive octree.
+ *
+ *  For a leaf B the U list holds the leafs adjacent to B, including B. The
+ *  V list of a box B holds the children of the neighbours of the parent of
+ *  B that are not adjacent to B, as the InteractionList of a uniform
+ *  octree. For a leaf B the W list holds the descendants of the neighbours
+ *  of B that are not adjacent to B, but whose parents are. The X list of a
+ *  box B holds the leafs C with B in the W list of C. Every pair of leafs
+ *  interacts exactly once through the lists of the leafs and their
+ *  ancestors.
+ *
+ *  Lists of boxes whose type does not apply to them are empty.
+ */
+class AdaptiveInteractionList {
+
+public:
+  enum ListType { U_LIST, V_LIST, W_LIST, X_LIST };
+
+  AdaptiveInteractionList(const Octree &octree, unsigned long index,
+                          unsigned int level, ListType type);
+
+  /** \brief Return the next cube in the interaction list */
+  void next();
+
+  /** True if finished iterating */
+  bool finished() const;
+
+  /** Get reference to current element */
+  const unsigned long &operator*() const;
+
+  /** \brief Return the level of the current element. */
+  unsigned int level() const;
+
+private:
+  // Append the leafs or W list boxes among the descendants of a box that is
+  // adjacent to the box of the list.
+  void addDescendants(unsigned long index, unsigned int level,
+                      ListType type);
+
+  std::vector<std::pair<unsigned long, unsigned int>> m_interaction;
+  const Octree &m_octree;
+  unsigned long m_index;
+  unsigned int m_level;
+  unsigned int m_current;
+};
+}
+
+#include "adaptive_interaction_list_impl.hpp"
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef bempp_fmm_adaptive_interaction_list_impl_hpp
+#define bempp_fmm_adaptive_interaction_list_impl_hpp
+
+#include "adaptive_interaction_list.hpp"
+#include "interaction_list.hpp"
+
+namespace Fmm {
+
+inline AdaptiveInteractionList::AdaptiveInteractionList(const Octree &octree,
+                                                        unsigned long index,
+                                                        unsigned int level,
+                                                        ListType type)
+    : m_octree(octree), m_index(index), m_level(level), m_current(0) {
+
+  bool leaf = m_octree.isLeaf(m_index, m_level);
+  std::vector<unsigned long> neighbors;
+
+  switch (type) {
+  case U_LIST:
+    if (!leaf)
+      break;
+    // Coarser leafs are neighbours of ancestors.
+    for (unsigned int ancestorLevel = 1; ancestorLevel < m_level;
+         ++ancestorLevel) {
+      neighbors.clear();
+      m_octree.getNeighbors(neighbors,
+                            m_index >> 3 * (m_level - ancestorLevel),
+                            ancestorLevel);
+      for (auto neighbor : neighbors)
+        if (m_octree.isLeaf(neighbor, ancestorLevel) &&
+            m_octree.areAdjacent(neighbor, ancestorLevel, m_index, m_level))
+          m_interaction.push_back({neighbor, ancestorLevel});
+    }
+    m_interaction.push_back({m_index, m_level});
+    neighbors.clear();
+    m_octree.getNeighbors(neighbors, m_index, m_level);
+    for (auto neighbor : neighbors)
+      addDescendants(neighbor, m_level, U_LIST);
+    break;
+  case V_LIST:
+    for (InteractionList list(m_octree, m_index, m_level); !list.finished();
+         list.next())
+      m_interaction.push_back({*list, m_level});
+    break;
+  case W_LIST:
+    if (!leaf)
+      break;
+    m_octree.getNeighbors(neighbors, m_index, m_level);
+    for (auto neighbor : neighbors)
+      if (!m_octree.isEmpty(neighbor, m_level) &&
+          !m_octree.isLeaf(neighbor, m_level))
+        for (auto child = m_octree.getFirstChild(neighbor);
+             child <= m_octree.getLastChild(neighbor); ++child)
+          addDescendants(child, m_level + 1, W_LIST);
+    break;
+  case X_LIST:
+    // Leafs that are neighbours of ancestors, not adjacent to the box, but
+    // adjacent to its parent.
+    for (unsigned int ancestorLevel = 1; ancestorLevel < m_level;
+         ++ancestorLevel) {
+      neighbors.clear();
+      m_octree.getNeighbors(neighbors,
+                            m_index >> 3 * (m_level - ancestorLevel),
+                            ancestorLevel);
+      for (auto neighbor : neighbors)
+        if (m_octree.isLeaf(neighbor, ancestorLevel) &&
+            !m_octree.areAdjacent(neighbor, ancestorLevel, m_index,
+                                  m_level) &&
+            m_octree.areAdjacent(neighbor, ancestorLevel,
+                                 m_octree.getParent(m_index), m_level - 1))
+          m_interaction.push_back({neighbor, ancestorLevel});
+    }
+    break;
+  }
+}
+
+inline void AdaptiveInteractionList::addDescendants(unsigned long index,
+                                                    unsigned int level,
+                                                    ListType type) {
+
+  if (m_octree.isEmpty(index, level))
+    return;
+  if (!m_octree.areAdjacent(index, level, m_index, m_level)) {
+    if (type == W_LIST)
+      m_interaction.push_back({index, level});
+    return;
+  }
+  if (m_octree.isLeaf(index, level)) {
+    if (type == U_LIST)
+      m_interaction.push_back({index, level});
+    return;
+  }
+  for (auto child = m_octree.getFirstChild(index);
+       child <= m_octree.getLastChild(index); ++child)
+    addDescendants(child, level + 1, type);
+}
+
+inline bool AdaptiveInteractionList::finished() const {
+  return m_current >= m_interaction.size();
+}
+
+inline void AdaptiveInteractionList::next() { m_current++; }
+
+inline const unsigned long &AdaptiveInteractionList::operator*() const {
+
+  return m_interaction[m_current].first;
+}
+
+inline unsigned int AdaptiveInteractionList::level() const {
+
+  return m_interaction[m_current].second;
+}
+}
+
+#endif
@@ -0,0 +1,204 @@
+#ifndef bempp_fmm_chebychev_fmm_hpp
+#define bempp_fmm_chebychev_fmm_hpp
+
+#include "chebychev_tools.hpp"
+#include "fmm_common.hpp"
+#include "fmm_kernel.hpp"
+#include "octree.hpp"
+
+#include <Eigen/Sparse>
+
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Fmm {
+
+/** \brief Black-box fast multipole method based on Chebychev interpolation.
+ *
+ *  The far field of the kernel is interpolated on tensor Chebychev nodes of
+ *  the octree boxes. Each leaf maps its sources to multipole weights on its
+ *  nodes (P2M) and local expansions on its nodes to its targets (L2P) with
+ *  matrices given by setLeafMatrices(). Weights are interpolated from
+ *  children to parents (M2M), translated between the boxes of the
+ *  interaction lists (M2L) and interpolated back from parents to children
+ *  (L2L). Interactions between neighbouring leafs are given by a sparse
+ *  near-field matrix (P2P).
+ *
+ *  The interpolation box of a node is its octree box extended on each side
+ *  by the same fraction of the box width as the octree extends the leafs.
+ *  All levels therefore share the M2M and L2L operators, and also the M2L
+ *  operators if the kernel is homogeneous. The octree must be uniform.
+ *
+ *  The M2L operators of the 316 offsets between well-separated boxes are
+ *  compressed with a common SVD into K = U * C * W, where U and W do not
+ *  depend on the offset. Multipoles are compressed with W once per box, the
+ *  small matrices C are applied to all boxes of a block with the same offset
+ *  in one product and local expansions are expanded with U once per box.
+ *  The compressed operators are shared between all instances whose kernels
+ *  have the same identifier. If truncateM2l is false, no singular values are
+ *  dropped and the M2L operators are exact up to rounding.
+ */
+template <typename ValueType> class ChebychevFmm {
+
+public:
+  ChebychevFmm(const shared_ptr<const Octree> &octree,
+               const shared_ptr<const FmmKernel<ValueType>> &kernel,
+               int order, std::size_t rows, std::size_t columns,
+               bool truncateM2l = true);
+
+  std::size_t rows() const;
+
+  std::size_t columns() const;
+
+  /** \brief Return the octree. */
+  const Octree &octree() const;
+
+  /** \brief Return the number of interpolation nodes of a box. */
+  int nodeCount() const;
+
+  /** \brief Return the sorted indices of the non-empty leafs. */
+  const std::vector<unsigned long> &leafs() const;
+
+  /** \brief Return the non-empty leafs whose interactions with the given leaf
+   *  belong to the near field, including the leaf itself. */
+  void nearFieldLeafs(unsigned long leaf,
+                      std::vector<unsigned long> &leafs) const;
+
+  /** \brief Evaluate the Lagrange polynomials of the nodes of a leaf at the
+   *  points. Row n of values belongs to node n. */
+  void interpolationValues(unsigned long leaf, const Matrix<double> &points,
+                           Matrix<double> &values) const;
+
+  /** \brief Evaluate the derivatives of the Lagrange polynomials of the nodes
+   *  of a leaf at the points in the directions given for each point. */
+  void interpolationDerivatives(unsigned long leaf,
+                                const Matrix<double> &points,
+                                const Matrix<double> &directions,
+                                Matrix<double> &values) const;
+
+  /** \brief Set the P2M and L2P matrices of a leaf.
+   *
+   *  The source matrix maps the entries of X with the given indices to
+   *  multipole weights on the nodes of the leaf, the target matrix maps local
+   *  expansions on the nodes to the entries of Y with the given indices.
+   *  Different leafs can be set concurrently.
+   */
+  void setLeafMatrices(unsigned long leaf, std::vector<std::size_t> sourceDofs,
+                       Matrix<ValueType> sourceMatrix,
+                       std::vector<std::size_t> targetDofs,
+                       Matrix<ValueType> targetMatrix);
+
+  /** \brief Set the near field, which must vanish outside of the element
+   *  pairs of neighbouring leafs. */
+  void setNearField(Eigen::SparseMatrix<ValueType, Eigen::RowMajor> nearField);
+
+  /** \brief Y := alpha * op(A) * X + beta * Y. */
+  void apply(const Eigen::Ref<Matrix<ValueType>> &X,
+             Eigen::Ref<Matrix<ValueType>> Y, Bempp::TranspositionMode trans,
+             ValueType alpha, ValueType beta) const;
+
+  double memSizeKb() const;
+
+private:
+  struct Leaf {
+    std::vector<std::size_t> sourceDofs;
+    Matrix<ValueType> sourceMatrix;
+    std::vector<std::size_t> targetDofs;
+    Matrix<ValueType> targetMatrix;
+  };
+
+  // Interactions of target nodes with source nodes at the same offset.
+  struct M2lBatch {
+    int offset;
+    // Indices of the target and source nodes on the level.
+    std::vector<std::pair<std::size_t, std::size_t>> pairs;
+  };
+
+  struct Level {
+    std::vector<unsigned long> nodes;
+    std::unordered_map<unsigned long, std::size_t> indices;
+    // Index and octant of the non-empty children of every node.
+    std::vector<std::vector<std::pair<std::size_t, int>>> children;
+    // M2L interactions of blocks of consecutive nodes, grouped by offset.
+    std::vector<std::vector<M2lBatch>> m2lBatches;
+    // The M2L operators of this level are scale * m_m2lOperators[m2l].
+    std::size_t m2l;
+    double scale;
+  };
+
+  // The M2L operator of an offset is expansion * translations[offset] *
+  // compression. Translations of offsets between neighbours are empty.
+  struct M2lOperators {
+    Matrix<ValueType> expansion;
+    Matrix<ValueType> compression;
+    std::vector<Matrix<ValueType>> translations;
+  };
+
+  // Offsets between boxes of an interaction list are at most 3 box widths
+  // in each direction.
+  static const int OFFSET_COUNT = 343;
+
+  // Number of consecutive target nodes whose M2L interactions are batched.
+  static const std::size_t M2L_BLOCK_SIZE = 64;
+
+  static int offsetIndex(const Vector<double> &offset);
+
+  // Coordinates of the nodes of a box of half-width 1 centred at 0.
+  Matrix<double> referenceNodes() const;
+
+  // Centre of a box.
+  Vector<double> boxCenter(unsigned long nodeIndex, unsigned int level) const;
+
+  // Half-width of the interpolation box on a level.
+  double interpolationHalfWidth(unsigned int level) const;
+
+  // Lagrange polynomials of the 1D nodes at the points, one row per node.
+  Matrix<double> lagrangePolynomials(const Vector<double> &points) const;
+
+  // Compressed M2L operators of boxes of the given width, taken from the
+  // cache if the kernel has an identifier.
+  shared_ptr<const M2lOperators> m2lOperators(double width) const;
+
+  // Compress the M2L operators of boxes of the given width.
+  shared_ptr<const M2lOperators> compressM2lOperators(double width) const;
+
+  // Y := Y + op(F) * X for the far field F.
+  void applyFarField(const Matrix<ValueType> &X, Matrix<ValueType> &Y,
+                     bool transposed) const;
+
+  shared_ptr<const Octree> m_octree;
+  shared_ptr<const FmmKernel<ValueType>> m_kernel;
+  ChebychevTools m_chebychevTools;
+  int m_terms;
+  std::size_t m_rows;
+  std::size_t m_columns;
+
+  // Extension of the interpolation boxes relative to the box width.
+  double m_extensionRatio;
+
+  // Relative tolerance for the singular values of the M2L operators, chosen
+  // below the interpolation error, or 0 if they are not truncated.
+  double m_m2lTolerance;
+
+  std::vector<Level> m_levels;
+  std::vector<Leaf> m_leafs;
+
+  // Derivatives of the 1D Lagrange polynomials at the 1D nodes.
+  Matrix<double> m_derivativeMatrix;
+
+  // M2M operator of every octant, mapping the weights of the child to those
+  // of the parent. The L2L operators are their transposes.
+  std::vector<Matrix<double>> m_m2mOperators;
+
+  // Compressed M2L operators, shared by all levels if the kernel is
+  // homogeneous.
+  std::vector<shared_ptr<const M2lOperators>> m_m2lOperators;
+
+  Eigen::SparseMatrix<ValueType, Eigen::RowMajor> m_nearField;
+};
+}
+
+#include "chebychev_fmm_impl.hpp"
+
+#endif
@@ -0,0 +1,621 @@
+#ifndef bempp_fmm_chebychev_fmm_impl_hpp
+#define bempp_fmm_chebychev_fmm_impl_hpp
+
+#include "chebychev_fmm.hpp"
+#include "interaction_list.hpp"
+
+#include <boost/weak_ptr.hpp>
+#include <tbb/enumerable_thread_specific.h>
+#include <tbb/mutex.h>
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+
+namespace Fmm {
+
+template <typename ValueType>
+ChebychevFmm<ValueType>::ChebychevFmm(
+    const shared_ptr<const Octree> &octree,
+    const shared_ptr<const FmmKernel<ValueType>> &kernel, int order,
+    std::size_t rows, std::size_t columns, bool truncateM2l)
+    : m_octree(octree), m_kernel(kernel), m_chebychevTools(order),
+      m_terms(order + 1), m_rows(rows), m_columns(columns),
+      m_m2lTolerance(truncateM2l ? std::pow(10., -m_terms) : 0),
+      m_nearField(rows, columns) {
+
+  if (m_octree->isAdaptive())
+    throw std::runtime_error("ChebychevFmm::ChebychevFmm(): "
+                             "adaptive octrees are not supported");
+
+  unsigned int levels = m_octree->levels();
+  double leafWidth = m_octree->cubeWidth(levels);
+  m_extensionRatio =
+      (m_octree->extendedCubeWidth(levels) - leafWidth) / (2 * leafWidth);
+
+  m_levels.resize(levels);
+  for (unsigned int level = 1; level <= levels; ++level) {
+    auto &data = m_levels[level - 1];
+    data.nodes = m_octree->getNonEmptyNodes(level);
+    for (std::size_t i = 0; i < data.nodes.size(); ++i)
+      data.indices[data.nodes[i]] = i;
+  }
+  m_leafs.resize(m_levels.back().nodes.size());
+
+  for (unsigned int level = 1; level < levels; ++level) {
+    auto &data = m_levels[level - 1];
+    const auto &childData = m_levels[level];
+    data.children.resize(data.nodes.size());
+    for (std::size_t i = 0; i < data.nodes.size(); ++i)
+      for (int octant = 0; octant < 8; ++octant) {
+        auto it = childData.indices.find(
+            m_octree->getFirstChild(data.nodes[i]) + octant);
+        if (it != childData.indices.end())
+          data.children[i].push_back({it->second, octant});
+      }
+  }
+
+  // Interaction lists exist from level 2 on. The interactions of blocks of
+  // consecutive target nodes are grouped by offset.
+  double degree;
+  bool homogeneous = m_kernel->isHomogeneous(degree);
+  std::vector<int> batchIndices(OFFSET_COUNT);
+  for (unsigned int level = 2; level <= levels; ++level) {
+    auto &data = m_levels[level - 1];
+    double width = m_octree->cubeWidth(level);
+    for (std::size_t begin = 0; begin < data.nodes.size();
+         begin += M2L_BLOCK_SIZE) {
+      std::size_t end = std::min(begin + M2L_BLOCK_SIZE, data.nodes.size());
+      data.m2lBatches.emplace_back();
+      auto &batches = data.m2lBatches.back();
+      std::fill(batchIndices.begin(), batchIndices.end(), -1);
+      for (std::size_t i = begin; i < end; ++i) {
+        Vector<double> center = boxCenter(data.nodes[i], level);
+        for (InteractionList list(*m_octree, data.nodes[i], level);
+             !list.finished(); list.next()) {
+          int offset = offsetIndex((boxCenter(*list, level) - center) / width);
+          if (batchIndices[offset] < 0) {
+            batchIndices[offset] = batches.size();
+            batches.push_back(M2lBatch());
+            batches.back().offset = offset;
+          }
+          batches[batchIndices[offset]].pairs.push_back(
+              {i, data.indices.at(*list)});
+        }
+      }
+    }
+
+    // The operators of a homogeneous kernel are scaled from boxes of width 1.
+    if (homogeneous) {
+      if (m_m2lOperators.empty())
+        m_m2lOperators.push_back(m2lOperators(1));
+      data.m2l = 0;
+      data.scale = std::pow(width, degree);
+    } else {
+      m_m2lOperators.push_back(m2lOperators(width));
+      data.m2l = level - 2;
+      data.scale = 1;
+    }
+  }
+
+  // A child box of half-width 1 / 2 relative to its parent is shifted by a
+  // quarter of the box width from the centre of the parent.
+  const auto &nodes = m_chebychevTools.chebychevNodes();
+  double shift = .25 / (.5 + m_extensionRatio);
+  std::array<Matrix<double>, 2> childValues;
+  for (int side = 0; side < 2; ++side)
+    childValues[side] =
+        lagrangePolynomials(nodes / 2 +
+                            Vector<double>::Constant(
+                                m_terms, side == 0 ? -shift : shift));
+  int nodeCount = this->nodeCount();
+  for (int octant = 0; octant < 8; ++octant) {
+    const auto &x = childValues[octant & 1];
+    const auto &y = childValues[(octant >> 1) & 1];
+    const auto &z = childValues[(octant >> 2) & 1];
+    Matrix<double> m2m(nodeCount, nodeCount);
+    for (int i = 0; i < m_terms; ++i)
+      for (int j = 0; j < m_terms; ++j)
+        for (int k = 0; k < m_terms; ++k)
+          for (int l = 0; l < m_terms; ++l)
+            for (int m = 0; m < m_terms; ++m)
+              for (int n = 0; n < m_terms; ++n)
+                m2m(i * m_terms * m_terms + j * m_terms + k,
+                    l * m_terms * m_terms + m * m_terms + n) =
+                    x(i, l) * y(j, m) * z(k, n);
+    m_m2mOperators.push_back(m2m);
+  }
+
+  m_derivativeMatrix.resize(m_terms, m_terms);
+  for (int j = 0; j < m_terms; ++j)
+    m_derivativeMatrix.col(j) =
+        m_chebychevTools.derivativeWeights(Vector<double>::Unit(m_terms, j));
+}
+
+template <typename ValueType>
+std::size_t ChebychevFmm<ValueType>::rows() const {
+  return m_rows;
+}
+
+template <typename ValueType>
+std::size_t ChebychevFmm<ValueType>::columns() const {
+  return m_columns;
+}
+
+template <typename ValueType>
+const Octree &ChebychevFmm<ValueType>::octree() const {
+  return *m_octree;
+}
+
+template <typename ValueType> int ChebychevFmm<ValueType>::nodeCount() const {
+  return m_terms * m_terms * m_terms;
+}
+
+template <typename ValueType>
+const std::vector<unsigned long> &ChebychevFmm<ValueType>::leafs() const {
+  return m_levels.back().nodes;
+}
+
+template <typename ValueType>
+void ChebychevFmm<ValueType>::nearFieldLeafs(
+    unsigned long leaf, std::vector<unsigned long> &leafs) const {
+
+  unsigned int levels = m_octree->levels();
+  std::vector<unsigned long> neighbors;
+  m_octree->getNeighbors(neighbors, leaf, levels);
+
+  leafs.assign(1, leaf);
+  for (auto neighbor : neighbors)
+    if (!m_octree->isEmpty(neighbor, levels))
+      leafs.push_back(neighbor);
+}
+
+template <typename ValueType>
+void ChebychevFmm<ValueType>::interpolationValues(
+    unsigned long leaf, const Matrix<double> &points,
+    Matrix<double> &values) const {
+
+  unsigned int levels = m_octree->levels();
+  Vector<double> center = boxCenter(leaf, levels);
+  double halfWidth = interpolationHalfWidth(levels);
+
+  std::array<Matrix<double>, 3> polynomials;
+  for (int d = 0; d < 3; ++d)
+    polynomials[d] = lagrangePolynomials(
+        ((points.row(d).array() - center(d)) / halfWidth).matrix().transpose());
+
+  values.resize(nodeCount(), points.cols());
+  for (int i = 0; i < m_terms; ++i)
+    for (int j = 0; j < m_terms; ++j)
+      for (int k = 0; k < m_terms; ++k)
+        values.row(i * m_terms * m_terms + j * m_terms + k) =
+            polynomials[0].row(i).cwiseProduct(polynomials[1].row(j))
+                .cwiseProduct(polynomials[2].row(k));
+}
+
+template <typename ValueType>
+void ChebychevFmm<ValueType>::interpolationDerivatives(
+    unsigned long leaf, const Matrix<double> &points,
+    const Matrix<double> &directions, Matrix<double> &values) const {
+
+  unsigned int levels = m_octree->levels();
+  Vector<double> center = boxCenter(leaf, levels);
+  double halfWidth = interpolationHalfWidth(levels);
+
+  std::array<Matrix<double>, 3> polynomials;
+  std::array<Matrix<double>, 3> derivatives;
+  for (int d = 0; d < 3; ++d) {
+    polynomials[d] = lagrangePolynomials(
+        ((points.row(d).array() - center(d)) / halfWidth).matrix().transpose());
+    derivatives[d] =
+        m_derivativeMatrix.transpose() * polynomials[d] / halfWidth;
+  }
+
+  values.resize(nodeCount(), points.cols());
+  for (int i = 0; i < m_terms; ++i)
+    for (int j = 0; j < m_terms; ++j)
+      for (int k = 0; k < m_terms; ++k) {
+        auto x = polynomials[0].row(i).array();
+        auto y = polynomials[1].row(j).array();
+        auto z = polynomials[2].row(k).array();
+        values.row(i * m_terms * m_terms + j * m_terms + k) =
+            directions.row(0).array() * derivatives[0].row(i).array() * y *
+                z +
+            directions.row(1).array() * x * derivatives[1].row(j).array() *
+                z +
+            directions.row(2).array() * x * y * derivatives[2].row(k).array();
+      }
+}
+
+template <typename ValueType>
+void ChebychevFmm<ValueType>::setLeafMatrices(
+    unsigned long leaf, std::vector<std::size_t> sourceDofs,
+    Matrix<ValueType> sourceMatrix, std::vector<std::size_t> targetDofs,
+    Matrix<ValueType> targetMatrix) {
+
+  if (sourceMatrix.rows() != nodeCount() ||
+      sourceMatrix.cols() != sourceDofs.size() ||
+      targetMatrix.rows() != targetDofs.size() ||
+      targetMatrix.cols() != nodeCount())
+    throw std::runtime_error("ChebychevFmm::setLeafMatrices(): "
+                             "matrices have wrong dimensions.");
+
+  auto &data = m_leafs[m_levels.back().indices.at(leaf)];
+  data.sourceDofs = std::move(sourceDofs);
+  data.sourceMatrix = std::move(sourceMatrix);
+  data.targetDofs = std::move(targetDofs);
+  data.targetMatrix = std::move(targetMatrix);
+}
+
+template <typename ValueType>
+void ChebychevFmm<ValueType>::setNearField(
+    Eigen::SparseMatrix<ValueType, Eigen::RowMajor> nearField) {
+
+  if (nearField.rows() != m_rows || nearField.cols() != m_columns)
+    throw std::runtime_error("ChebychevFmm::setNearField(): "
+                             "matrix has wrong dimensions.");
+  m_nearField = std::move(nearField);
+}
+
+template <typename ValueType>
+void ChebychevFmm<ValueType>::apply(const Eigen::Ref<Matrix<ValueType>> &X,
+                                    Eigen::Ref<Matrix<ValueType>> Y,
+                                    Bempp::TranspositionMode trans,
+                                    ValueType alpha, ValueType beta) const {
+
+  bool transposed = (trans == Bempp::TRANSPOSE ||
+                     trans == Bempp::CONJUGATE_TRANSPOSE);
+  bool conjugated =
+      (trans == Bempp::CONJUGATE || trans == Bempp::CONJUGATE_TRANSPOSE);
+
+  if (X.rows() != (transposed ? m_rows : m_columns) ||
+      Y.rows() != (transposed ? m_columns : m_rows) || X.cols() != Y.cols())
+    throw std::runtime_error("ChebychevFmm::apply(): "
+                             "vectors have wrong dimensions.");
+
+  // conj(A) * X = conj(A * conj(X))
+  Matrix<ValueType> x = X;
+  if (conjugated)
+    x = x.conjugate();
+
+  Matrix<ValueType> y;
+  if (transposed)
+    y = m_nearField.transpose() * x;
+  else
+    y = m_nearField * x;
+  applyFarField(x, y, transposed);
+
+  if (conjugated)
+    y = y.conjugate();
+
+  if (beta == ValueType(0))
+    Y = alpha * y;
+  else
+    Y = alpha * y + beta * Y;
+}
+
+template <typename ValueType>
+double ChebychevFmm<ValueType>::memSizeKb() const {
+
+  double size = 0;
+  for (const auto &leaf : m_leafs)
+    size += sizeof(ValueType) *
+                (leaf.sourceMatrix.size() + leaf.targetMatrix.size()) +
+            sizeof(std::size_t) *
+                (leaf.sourceDofs.size() + leaf.targetDofs.size());
+  for (const auto &operators : m_m2lOperators) {
+    size += sizeof(ValueType) *
+            (operators->expansion.size() + operators->compression.size());
+    for (const auto &translation : operators->translations)
+      size += sizeof(ValueType) * translation.size();
+  }
+  size += (sizeof(ValueType) + sizeof(int)) * m_nearField.nonZeros() +
+          sizeof(int) * m_nearField.outerSize();
+  return size / 1024;
+}
+
+template <typename ValueType>
+int ChebychevFmm<ValueType>::offsetIndex(const Vector<double> &offset) {
+
+  int index = 0;
+  for (int d = 0; d < 3; ++d)
+    index = 7 * index + static_cast<int>(std::round(offset(d))) + 3;
+  return index;
+}
+
+template <typename ValueType>
+Matrix<double> ChebychevFmm<ValueType>::referenceNodes() const {
+
+  const auto &nodes = m_chebychevTools.chebychevNodes();
+  Matrix<double> points(3, nodeCount());
+  for (int i = 0; i < m_terms; ++i)
+    for (int j = 0; j < m_terms; ++j)
+      for (int k = 0; k < m_terms; ++k)
+        points.col(i * m_terms * m_terms + j * m_terms + k)
+            << nodes(i), nodes(j), nodes(k);
+  return points;
+}
+
+template <typename ValueType>
+Vector<double> ChebychevFmm<ValueType>::boxCenter(unsigned long nodeIndex,
+                                                  unsigned int level) const {
+
+  Vector<double> lbound;
+  Vector<double> ubound;
+  m_octree->cubeBounds(nodeIndex, level, lbound, ubound);
+  return (lbound + ubound) / 2;
+}
+
+template <typename ValueType>
+double
+ChebychevFmm<ValueType>::interpolationHalfWidth(unsigned int level) const {
+
+  return m_octree->cubeWidth(level) * (.5 + m_extensionRatio);
+}
+
+template <typename ValueType>
+Matrix<double> ChebychevFmm<ValueType>::lagrangePolynomials(
+    const Vector<double> &points) const {
+
+  Matrix<double> values(m_terms, points.size());
+  Vector<double> row;
+  for (int m = 0; m < m_terms; ++m) {
+    m_chebychevTools.evaluateInterpolationPolynomial(
+        Vector<double>::Unit(m_terms, m), points, row);
+    values.row(m) = row.transpose();
+  }
+  return values;
+}
+
+template <typename ValueType>
+shared_ptr<const typename ChebychevFmm<ValueType>::M2lOperators>
+ChebychevFmm<ValueType>::m2lOperators(double width) const {
+
+  std::string identifier = m_kernel->identifier();
+  if (identifier.empty())
+    return compressM2lOperators(width);
+
+  // The operators are compressed outside of the lock. Instances that miss
+  // the cache concurrently compress them independently and the first result
+  // is kept.
+  typedef std::tuple<std::string, int, double, double, double> Key;
+  static tbb::mutex mutex;
+  static std::map<Key, boost::weak_ptr<const M2lOperators>> cache;
+  Key key(identifier, m_terms, m_extensionRatio, m_m2lTolerance, width);
+  {
+    tbb::mutex::scoped_lock lock(mutex);
+    auto it = cache.find(key);
+    if (it != cache.end())
+      if (auto operators = it->second.lock())
+        return operators;
+  }
+
+  shared_ptr<const M2lOperators> operators = compressM2lOperators(width);
+  tbb::mutex::scoped_lock lock(mutex);
+  for (auto it = cache.begin(); it != cache.end();)
+    if (it->second.expired())
+      it = cache.erase(it);
+    else
+      ++it;
+  auto &entry = cache[key];
+  if (auto existing = entry.lock())
+    return existing;
+  entry = operators;
+  return operators;
+}
+
+template <typename ValueType>
+shared_ptr<const typename ChebychevFmm<ValueType>::M2lOperators>
+ChebychevFmm<ValueType>::compressM2lOperators(double width) const {
+
+  int nodeCount = this->nodeCount();
+  Matrix<double> targets = width * (.5 + m_extensionRatio) * referenceNodes();
+  auto evaluate = [&](int offset, Matrix<ValueType> &values) {
+    Vector<double> shift(3);
+    shift << offset / 49 - 3, (offset / 7) % 7 - 3, offset % 7 - 3;
+    Matrix<double> sources = targets.colwise() + width * shift;
+    m_kernel->evaluate(targets, sources, values);
+  };
+
+  // Boxes are well separated if they are at least 2 box widths apart in
+  // some direction.
+  std::vector<int> offsets;
+  for (int offset = 0; offset < OFFSET_COUNT; ++offset)
+    if (std::abs(offset / 49 - 3) >= 2 || std::abs((offset / 7) % 7 - 3) >= 2 ||
+        std::abs(offset % 7 - 3) >= 2)
+      offsets.push_back(offset);
+
+  // The singular vectors of the operators of all offsets stacked next to
+  // and on top of each other are the eigenvectors of the summed Gramians,
+  // of which only the lower triangles are computed. The operators are
+  // evaluated twice so that they are never all stored.
+  typedef std::pair<Matrix<ValueType>, Matrix<ValueType>> Gramians;
+  tbb::enumerable_thread_specific<Gramians> gramians(
+      Gramians(Matrix<ValueType>::Zero(nodeCount, nodeCount),
+               Matrix<ValueType>::Zero(nodeCount, nodeCount)));
+  tbb::parallel_for(std::size_t(0), offsets.size(), [&](std::size_t i) {
+    Matrix<ValueType> values;
+    evaluate(offsets[i], values);
+    auto &local = gramians.local();
+    local.first.template selfadjointView<Eigen::Lower>().rankUpdate(values);
+    local.second.template selfadjointView<Eigen::Lower>().rankUpdate(
+        values.adjoint());
+  });
+  Gramians sum(Matrix<ValueType>::Zero(nodeCount, nodeCount),
+               Matrix<ValueType>::Zero(nodeCount, nodeCount));
+  for (const auto &local : gramians) {
+    sum.first += local.first;
+    sum.second += local.second;
+  }
+
+  // Singular values below the relative tolerance are dropped.
+  double tolerance = m_m2lTolerance * m_m2lTolerance;
+  auto singularVectors = [&](const Matrix<ValueType> &gramian) {
+    Eigen::SelfAdjointEigenSolver<Matrix<ValueType>> solver(gramian);
+    const auto &eigenvalues = solver.eigenvalues();
+    int rank = 1;
+    while (rank < nodeCount &&
+           eigenvalues(nodeCount - 1 - rank) >
+               tolerance * eigenvalues(nodeCount - 1))
+      ++rank;
+    return Matrix<ValueType>(solver.eigenvectors().rightCols(rank));
+  };
+
+  shared_ptr<M2lOperators> operators(new M2lOperators());
+  operators->expansion = singularVectors(sum.first);
+  Matrix<ValueType> columnVectors = singularVectors(sum.second);
+  operators->compression = columnVectors.adjoint();
+  operators->translations.resize(OFFSET_COUNT);
+  tbb::parallel_for(std::size_t(0), offsets.size(), [&](std::size_t i) {
+    Matrix<ValueType> values;
+    evaluate(offsets[i], values);
+    operators->translations[offsets[i]] =
+        operators->expansion.adjoint() * values * columnVectors;
+  });
+  return operators;
+}
+
+template <typename ValueType>
+void ChebychevFmm<ValueType>::applyFarField(const Matrix<ValueType> &X,
+                                            Matrix<ValueType> &Y,
+                                            bool transposed) const {
+
+  unsigned int levels = m_levels.size();
+  if (levels < 2)
+    return;
+
+  int nodeCount = this->nodeCount();
+  auto columns = X.cols();
+
+  std::vector<std::vector<Matrix<ValueType>>> multipoles(levels);
+  std::vector<std::vector<Matrix<ValueType>>> locals(levels);
+  for (unsigned int level = 2; level <= levels; ++level) {
+    multipoles[level - 1].resize(m_levels[level - 1].nodes.size());
+    locals[level - 1].assign(m_levels[level - 1].nodes.size(),
+                             Matrix<ValueType>::Zero(nodeCount, columns));
+  }
+
+  // P2M. The transposed far field swaps the roles of the P2M and L2P
+  // matrices.
+  tbb::parallel_for(std::size_t(0), m_leafs.size(), [&](std::size_t i) {
+    const auto &leaf = m_leafs[i];
+    const auto &dofs = transposed ? leaf.targetDofs : leaf.sourceDofs;
+    Matrix<ValueType> x(dofs.size(), columns);
+    for (std::size_t k = 0; k < dofs.size(); ++k)
+      x.row(k) = X.row(dofs[k]);
+    auto &multipole = multipoles[levels - 1][i];
+    if (dofs.empty())
+      multipole.setZero(nodeCount, columns);
+    else if (transposed)
+      multipole = leaf.targetMatrix.transpose() * x;
+    else
+      multipole = leaf.sourceMatrix * x;
+  });
+
+  // M2M
+  for (unsigned int level = levels - 1; level >= 2; --level) {
+    const auto &data = m_levels[level - 1];
+    tbb::parallel_for(std::size_t(0), data.nodes.size(), [&](std::size_t i) {
+      auto &multipole = multipoles[level - 1][i];
+      multipole.setZero(nodeCount, columns);
+      for (const auto &child : data.children[i])
+        multipole.noalias() +=
+            m_m2mOperators[child.second] * multipoles[level][child.first];
+    });
+  }
+
+  // M2L. Multipoles are compressed and local expansions expanded once per
+  // box, and the translations of a batch are applied in one product. The
+  // transposed far field uses the transposed operators of the opposite
+  // offsets.
+  for (unsigned int level = 2; level <= levels; ++level) {
+    const auto &data = m_levels[level - 1];
+    const auto &operators = *m_m2lOperators[data.m2l];
+    std::size_t count = data.nodes.size();
+    auto sourceRank = transposed ? operators.expansion.cols()
+                                 : operators.compression.rows();
+    auto targetRank = transposed ? operators.compression.rows()
+                                 : operators.expansion.cols();
+
+    std::vector<Matrix<ValueType>> compressed(count);
+    std::vector<Matrix<ValueType>> translated(count);
+    tbb::parallel_for(std::size_t(0), count, [&](std::size_t i) {
+      if (transposed)
+        compressed[i].noalias() =
+            operators.expansion.transpose() * multipoles[level - 1][i];
+      else
+        compressed[i].noalias() =
+            operators.compression * multipoles[level - 1][i];
+      translated[i].setZero(targetRank, columns);
+    });
+
+    tbb::parallel_for(
+        std::size_t(0), data.m2lBatches.size(), [&](std::size_t block) {
+          Matrix<ValueType> sources;
+          Matrix<ValueType> targets;
+          for (const auto &batch : data.m2lBatches[block]) {
+            const auto &pairs = batch.pairs;
+            sources.resize(sourceRank, pairs.size() * columns);
+            for (std::size_t k = 0; k < pairs.size(); ++k)
+              sources.middleCols(k * columns, columns) =
+                  compressed[pairs[k].second];
+            if (transposed)
+              targets.noalias() =
+                  operators.translations[OFFSET_COUNT - 1 - batch.offset]
+                      .transpose() *
+                  sources;
+            else
+              targets.noalias() =
+                  operators.translations[batch.offset] * sources;
+            for (std::size_t k = 0; k < pairs.size(); ++k)
+              translated[pairs[k].first] +=
+                  targets.middleCols(k * columns, columns);
+          }
+        });
+
+    tbb::parallel_for(std::size_t(0), count, [&](std::size_t i) {
+      translated[i] *= data.scale;
+      if (transposed)
+        locals[level - 1][i].noalias() +=
+            operators.compression.transpose() * translated[i];
+      else
+        locals[level - 1][i].noalias() += operators.expansion * translated[i];
+    });
+  }
+
+  // L2L
+  for (unsigned int level = 2; level < levels; ++level) {
+    const auto &data = m_levels[level - 1];
+    tbb::parallel_for(std::size_t(0), data.nodes.size(), [&](std::size_t i) {
+      for (const auto &child : data.children[i])
+        locals[level][child.first].noalias() +=
+            m_m2mOperators[child.second].transpose() * locals[level - 1][i];
+    });
+  }
+
+  // L2P. Leafs share dofs, so the results are added up serially.
+  std::vector<Matrix<ValueType>> results(m_leafs.size());
+  tbb::parallel_for(std::size_t(0), m_leafs.size(), [&](std::size_t i) {
+    const auto &leaf = m_leafs[i];
+    if (transposed ? leaf.sourceDofs.empty() : leaf.targetDofs.empty())
+      return;
+    if (transposed)
+      results[i] = leaf.sourceMatrix.transpose() * locals[levels - 1][i];
+    else
+      results[i] = leaf.targetMatrix * locals[levels - 1][i];
+  });
+  for (std::size_t i = 0; i < m_leafs.size(); ++i) {
+    const auto &dofs = transposed ? m_leafs[i].sourceDofs
+                                  : m_leafs[i].targetDofs;
+    for (std::size_t k = 0; k < dofs.size(); ++k)
+      Y.row(dofs[k]) += results[i].row(k);
+  }
+}
+}
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef bempp_fmm_fmm_kernel_hpp
+#define bempp_fmm_fmm_kernel_hpp
+
+#include "fmm_common.hpp"
+
+#include <string>
+
+namespace Fmm {
+
+/** \brief Kernel function k(x, y) of the fast multipole method.
+ *
+ *  The kernel must be translation invariant, i.e. k(x + z, y + z) = k(x, y).
+ */
+template <typename ValueType> class FmmKernel {
+
+public:
+  virtual ~FmmKernel() {}
+
+  /** \brief Set values(i, j) = k(targets.col(i), sources.col(j)). */
+  virtual void evaluate(const Matrix<double> &targets,
+                        const Matrix<double> &sources,
+                        Matrix<ValueType> &values) const = 0;
+
+  /** \brief Set values(i, j) to the derivative of k(targets.col(i), y) in y
+   *  in the direction sourceNormals.col(j) at y = sources.col(j). */
+  virtual void evaluateTrialNormalDerivatives(
+      const Matrix<double> &targets, const Matrix<double> &sources,
+      const Matrix<double> &sourceNormals, Matrix<ValueType> &values) const {
+    throw NotImplementedError("FmmKernel::evaluateTrialNormalDerivatives(): "
+                              "not implemented for this kernel");
+  }
+
+  /** \brief Return true if k(s * x, s * y) = s^degree * k(x, y) for s > 0.
+   */
+  virtual bool isHomogeneous(double &degree) const { return false; }
+
+  /** \brief Return a string that identifies the kernel function, or an empty
+   *  string. Kernels with the same identifier share translation operators.
+   */
+  virtual std::string identifier() const { return std::string(); }
+};
+
+/** \brief Laplace kernel 1 / (4 pi |x - y|). */
+template <typename ValueType> class LaplaceKernel : public FmmKernel<ValueType> {
+
+public:
+  void evaluate(const Matrix<double> &targets, const Matrix<double> &sources,
+                Matrix<ValueType> &values) const override;
+
+  void evaluateTrialNormalDerivatives(const Matrix<double> &targets,
+                                      const Matrix<double> &sources,
+                                      const Matrix<double> &sourceNormals,
+                                      Matrix<ValueType> &values) const override;
+
+  bool isHomogeneous(double &degree) const override;
+
+  std::string identifier() const override;
+};
+}
+
+#include "fmm_kernel_impl.hpp"
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef bempp_fmm_fmm_kernel_impl_hpp
+#define bempp_fmm_fmm_kernel_impl_hpp
+
+#include "fmm_kernel.hpp"
+
+#include <cmath>
+
+namespace Fmm {
+
+template <typename ValueType>
+void LaplaceKernel<ValueType>::evaluate(const Matrix<double> &targets,
+                                        const Matrix<double> &sources,
+                                        Matrix<ValueType> &values) const {
+
+  values.resize(targets.cols(), sources.cols());
+  for (int j = 0; j < sources.cols(); ++j)
+    for (int i = 0; i < targets.cols(); ++i)
+      values(i, j) = 1. / (4 * M_PI * (targets.col(i) - sources.col(j)).norm());
+}
+
+template <typename ValueType>
+void LaplaceKernel<ValueType>::evaluateTrialNormalDerivatives(
+    const Matrix<double> &targets, const Matrix<double> &sources,
+    const Matrix<double> &sourceNormals, Matrix<ValueType> &values) const {
+
+  values.resize(targets.cols(), sources.cols());
+  for (int j = 0; j < sources.cols(); ++j)
+    for (int i = 0; i < targets.cols(); ++i) {
+      Vector<double> diff = targets.col(i) - sources.col(j);
+      double distance = diff.norm();
+      values(i, j) = diff.dot(sourceNormals.col(j)) /
+                     (4 * M_PI * distance * distance * distance);
+    }
+}
+
+template <typename ValueType>
+bool LaplaceKernel<ValueType>::isHomogeneous(double &degree) const {
+
+  degree = -1;
+  return true;
+}
+
+template <typename ValueType>
+std::string LaplaceKernel<ValueType>::identifier() const {
+
+  return "laplace";
+}
+}
+
+#endif
@@ -10,8 +10,7 @@
 
 #include "../assembly/transposition_mode.hpp"
 #include <iostream>
-#include <unordered_map>
-#include <unordered_set>
+#include <utility>
 
 namespace Bempp {
 
@@ -27,14 +26,32 @@ public:
   // extend each leaf box on each size by RESIZE_FACTOR * h.
   static constexpr double RESIZE_FACTOR = 1.1;
 
-  // Width of a box relative to the maximum element width h.
-  static const int WIDTH_MULTIPLIER = 2.5;
+  // Minimum width of a leaf box relative to the maximum element width h.
+  static constexpr double WIDTH_MULTIPLIER = 2.5;
 
+  // Morton keys store 10 bits per direction.
+  static constexpr int MAX_LEVELS = 10;
+
+  /** \brief Construct a uniform octree whose leafs all lie on the given
+   *  level, or on the deepest level whose boxes are still WIDTH_MULTIPLIER
+   *  times wider than the largest element if levels is out of range. */
   Octree(const shared_ptr<const Bempp::Grid> &grid, int levels);
 
+  /** \brief Construct an adaptive octree.
+   *
+   *  Boxes with more than leafSize elements are subdivided as long as their
+   *  children are WIDTH_MULTIPLIER times wider than the elements in the box,
+   *  down to at most the given number of levels (MAX_LEVELS if out of
+   *  range). Leafs can lie on any level. */
+  Octree(const shared_ptr<const Bempp::Grid> &grid, int levels,
+         std::size_t leafSize);
+
   /** \brief Return the number of levels in the grid. */
   unsigned int levels() const;
 
+  /** \brief Return true if the leafs can lie on different levels. */
+  bool isAdaptive() const;
+
   /** \brief Return the bounding box of the grid. */
   BoundingBox<double> getBoundingBox() const;
 
@@ -59,6 +76,12 @@ public:
   /** \brief Return of a node on a given level is empty. */
   bool isEmpty(unsigned long nodeIndex, unsigned int level) const;
 
+  /** \brief Return true if a node is a non-empty leaf. */
+  bool isLeaf(unsigned long nodeIndex, unsigned int level) const;
+
+  /** \brief Return the sorted indices of the non-empty nodes on a level. */
+  const std::vector<unsigned long> &getNonEmptyNodes(unsigned int level) const;
+
   /** \brief Return the cube width on a given level. */
   double cubeWidth(unsigned int level) const;
 
@@ -74,15 +97,42 @@ public:
   void extendedCubeBounds(unsigned long nodeIndex, unsigned int level,
                           Vector<double> &lbound, Vector<double> &ubound) const;
 
-  /** \brief Get all leaf cubes */
-  const std::vector<unsigned int> &
-  getLeafCubeEntities(unsigned long nodeIndex) const;
+  /** \brief Append the indices of the entities of a cube on a given
+   *  level. */
+  void getCubeEntities(std::vector<unsigned int> &entities,
+                       unsigned long nodeIndex, unsigned int level) const;
+
+  /** \brief Append the indices of the entities of a cube on the deepest
+   *  level. */
+  void getLeafCubeEntities(std::vector<unsigned int> &entities,
+                           unsigned long nodeIndex) const;
+
+  /** \brief Return true if the closures of two cubes intersect. */
+  bool areAdjacent(unsigned long nodeIndex1, unsigned int level1,
+                   unsigned long nodeIndex2, unsigned int level2) const;
 
   /** \brief Get the neighbors of the cube on a given level. */
   void getNeighbors(std::vector<unsigned long> &neighbors,
                     unsigned long nodeIndex, unsigned int level) const;
 
+  /** \brief Sort values by keys of the given number of bits with a stable
+   *  parallel radix sort. The keys must be smaller than 2^bits. */
+  static void radixSort(std::vector<unsigned long> &keys,
+                        std::vector<unsigned int> &values, unsigned int bits);
+
 private:
+  typedef std::pair<std::size_t, std::size_t> EntityRange;
+
+  /** \brief Compute the bounding cube and the maximum element diameter. */
+  void initializeBounds();
+
+  /** \brief Sort the entities into the boxes. */
+  void build(std::size_t leafSize);
+
+  /** \brief Position of a node in m_nodes, or the number of nodes on the
+   *  level if the node is empty. */
+  std::size_t nodePosition(unsigned long nodeIndex, unsigned int level) const;
+
   /** \brief return the Morton index of a leaf node */
   unsigned long morton(unsigned long x, unsigned long y, unsigned long z) const;
 
@@ -108,11 +158,13 @@ private:
   // The number of levels in the Octree
   unsigned int m_levels;
 
+  bool m_adaptive;
+
   // Maximum element size in the grid
   double m_maxElementDiam;
 
-  // Store the non empty octree node ids for each level
-  std::vector<std::unordered_set<unsigned long>> m_Nodes;
+  // Sorted ids of the non-empty octree nodes on each level
+  std::vector<std::vector<unsigned long>> m_nodes;
 
   // Lower bound of global bounding cube
   Vector<double> m_lbound;
@@ -120,13 +172,19 @@ private:
   // Upper bounds of global bounding cube
   Vector<double> m_ubound;
 
-  // Stores for each non-empty leaf box the associated grid entities
-  std::unordered_map<unsigned long, std::vector<unsigned int>>
-      m_leafsToEntities;
+  // Entities sorted by the boxes containing them. The entities of the i-th
+  // non-empty box on level l are those at positions m_entityRanges[l - 1][i]
+  // of m_entities.
+  std::vector<unsigned int> m_entities;
+  std::vector<std::vector<EntityRange>> m_entityRanges;
+
+  // Whether the non-empty boxes of each level are leafs.
+  std::vector<std::vector<bool>> m_isLeaf;
 
-  // Value by which the boundaries of boxes are extended to accommodate
-  // overhanging triangles. Set to RESIZE_FACTOR * m_maxElementDiam
-  double m_extensionSize;
+  // Value on each level by which the boundaries of boxes are extended to
+  // accommodate overhanging triangles. RESIZE_FACTOR times the largest
+  // element diameter, in an adaptive octree of the elements on the level.
+  std::vector<double> m_extensionSizes;
 };
 }
 
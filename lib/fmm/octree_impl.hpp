@@ -2,20 +2,49 @@
 #define bempp_fmm_octree_impl_hpp
 
 #include "../grid/grid.hpp"
+#include "../grid/grid_view.hpp"
 #include "./octree.hpp"
 
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <functional>
+
 namespace Fmm {
 
 inline Octree::Octree(const shared_ptr<const Bempp::Grid> &grid, int levels)
-    : m_grid(grid), m_levels(levels) {
+    : m_grid(grid), m_levels(levels), m_adaptive(false) {
 
   // Compute maximum allowed level
 
-  auto gridView = m_grid->leafView();
+  initializeBounds();
+
+  double width = m_ubound(0) - m_lbound(0);
+  int maxLevels = (int)std::trunc(
+      std::log2(width / (Octree::WIDTH_MULTIPLIER * m_maxElementDiam)));
+
+  maxLevels = std::min(maxLevels, MAX_LEVELS);
+  if (levels < 1 || levels > maxLevels)
+    m_levels = std::max(1, maxLevels);
+
+  build(0);
+}
+
+inline Octree::Octree(const shared_ptr<const Bempp::Grid> &grid, int levels,
+                      std::size_t leafSize)
+    : m_grid(grid), m_levels(levels), m_adaptive(true) {
+
+  initializeBounds();
+
+  if (levels < 1 || levels > MAX_LEVELS)
+    m_levels = MAX_LEVELS;
+
+  build(leafSize);
+}
+
+inline void Octree::initializeBounds() {
 
   // Compute the grid bounding box.
-  Vector<double> lbound(3);
-  Vector<double> ubound(3);
 
   m_grid->getBoundingBox(m_lbound, m_ubound);
 
@@ -27,54 +56,166 @@ inline Octree::Octree(const shared_ptr<const Bempp::Grid> &grid, int levels)
 
   m_ubound = m_lbound + width * Vector<double>::Ones(3);
 
-  // Get the maximum allowed level
-
-  m_maxElementDiam = gridView->maximumElementDiameter();
-  m_extensionSize = m_maxElementDiam * Octree::RESIZE_FACTOR;
-
-  int maxLevels = (int)std::trunc(
-      std::log2(width / (Octree::WIDTH_MULTIPLIER * m_maxElementDiam)));
-
-  if (levels < 0 || levels > maxLevels)
-    m_levels = maxLevels;
-
-  // Compute node assignments
+  m_maxElementDiam = m_grid->leafView()->maximumElementDiameter();
+}
 
-  m_Nodes.resize(m_levels);
+inline void Octree::build(std::size_t leafSize) {
 
-  auto view = grid->leafView();
-  const auto &indexSet = view->indexSet();
+  // Compute the key on the deepest possible level of every element from the
+  // centroid of its corners.
 
-  for (auto it = view->entityIterator<0>(); !it->finished(); it->next()) {
-    const auto &entity = it->entity();
-    int entityIndex = indexSet.entityIndex(entity);
+  auto gridView = m_grid->leafView();
+  Matrix<double> vertices;
+  Matrix<int> elementCorners;
+  Matrix<char> auxData;
+  gridView->getRawElementData(vertices, elementCorners, auxData);
+
+  std::size_t elementCount = elementCorners.cols();
+  std::vector<unsigned long> keys(elementCount);
+  std::vector<unsigned int> entities(elementCount);
+  std::vector<double> diameters(elementCount);
+  tbb::parallel_for(std::size_t(0), elementCount, [&](std::size_t i) {
+    Vector<double> centroid = Vector<double>::Zero(3);
+    int cornerCount = 0;
+    diameters[i] = 0;
+    for (int j = 0; j < elementCorners.rows() && elementCorners(j, i) >= 0;
+         ++j) {
+      centroid += vertices.col(elementCorners(j, i));
+      for (int k = 0; k < j; ++k)
+        diameters[i] = std::max(diameters[i],
+                                (vertices.col(elementCorners(j, i)) -
+                                 vertices.col(elementCorners(k, i)))
+                                    .norm());
+      ++cornerCount;
+    }
+    centroid /= cornerCount;
+    keys[i] = getLeafContainingPoint({centroid(0), centroid(1), centroid(2)});
+    entities[i] = i;
+  });
+
+  radixSort(keys, entities, 3 * m_levels);
+
+  // Subdivide the boxes from the top. The entities of every box are a
+  // contiguous range of the sorted entities. A uniform octree subdivides
+  // every box down to the deepest level. An adaptive octree subdivides
+  // boxes with more than leafSize entities as long as the children are
+  // still WIDTH_MULTIPLIER times wider than the entities of the box.
+
+  unsigned int depth = m_levels;
+  m_entities.swap(entities);
+  m_nodes.assign(depth, std::vector<unsigned long>());
+  m_entityRanges.assign(depth, std::vector<EntityRange>());
+  m_isLeaf.assign(depth, std::vector<bool>());
+  m_extensionSizes.assign(depth, 0);
+
+  auto levelKey = [&](std::size_t i, unsigned int level) {
+    return keys[i] >> (3 * (depth - level));
+  };
 
-    Vector<double> centroid(3);
+  std::vector<EntityRange> ranges;
+  if (elementCount > 0)
+    ranges.push_back({0, elementCount});
+  for (unsigned int level = 1; level <= depth && !ranges.empty(); ++level) {
+    // Split the ranges subdivided on the previous level into the boxes of
+    // this level.
+    std::vector<EntityRange> boxes;
+    for (const auto &range : ranges) {
+      std::size_t begin = range.first;
+      for (std::size_t i = range.first + 1; i <= range.second; ++i)
+        if (i == range.second ||
+            levelKey(i, level) != levelKey(begin, level)) {
+          boxes.push_back({begin, i});
+          begin = i;
+        }
+    }
 
-    // Get the center and corners of the entity.
-    entity.geometry().getCenter(centroid);
+    ranges.clear();
+    double childWidth = cubeWidth(level + 1);
+    for (const auto &box : boxes) {
+      // The diameters are indexed by the element, not by its position in
+      // the sorted entities.
+      double diameter = 0;
+      for (std::size_t k = box.first; k < box.second; ++k)
+        diameter = std::max(diameter, diameters[m_entities[k]]);
+      bool leaf;
+      if (level == depth)
+        leaf = true;
+      else if (m_adaptive)
+        leaf = box.second - box.first <= leafSize ||
+               childWidth < WIDTH_MULTIPLIER * diameter;
+      else
+        leaf = false;
+
+      m_nodes[level - 1].push_back(levelKey(box.first, level));
+      m_entityRanges[level - 1].push_back(box);
+      m_isLeaf[level - 1].push_back(leaf);
+      m_extensionSizes[level - 1] =
+          std::max(m_extensionSizes[level - 1],
+                   RESIZE_FACTOR * (m_adaptive ? diameter : m_maxElementDiam));
+      if (!leaf)
+        ranges.push_back(box);
+    }
+  }
 
-    // Find out in which leaf node the element lives
-    unsigned long nodeIndex =
-        getLeafContainingPoint({centroid(0), centroid(1), centroid(2)});
+  // Remove the levels below the deepest leafs.
+  while (m_levels > 1 && m_nodes[m_levels - 1].empty())
+    --m_levels;
+  m_nodes.resize(m_levels);
+  m_entityRanges.resize(m_levels);
+  m_isLeaf.resize(m_levels);
+  m_extensionSizes.resize(m_levels);
+}
 
-    // Check if box is empty.
-    if (m_Nodes[m_levels - 1].count(nodeIndex) == 0) {
-      // Box has not yet been inserted as nonzero
-      m_Nodes[m_levels - 1].insert(nodeIndex);
-      // Mark all parents as nonzero
-      unsigned long parent = nodeIndex;
-      for (int level = m_levels; level >= 1; level--) {
-        parent = getParent(parent);
-        m_Nodes[level - 1].insert(parent);
+inline void Octree::radixSort(std::vector<unsigned long> &keys,
+                              std::vector<unsigned int> &values,
+                              unsigned int bits) {
+
+  const int digitBits = 8;
+  const std::size_t bucketCount = 1 << digitBits;
+  const std::size_t chunkSize = 1 << 16;
+
+  std::size_t n = keys.size();
+  std::size_t chunkCount = (n + chunkSize - 1) / chunkSize;
+  std::vector<unsigned long> sortedKeys(n);
+  std::vector<unsigned int> sortedValues(n);
+  std::vector<std::size_t> offsets(chunkCount * bucketCount);
+
+  for (unsigned int shift = 0; shift < bits; shift += digitBits) {
+    auto digit = [shift, bucketCount](unsigned long key) {
+      return (key >> shift) & (bucketCount - 1);
+    };
+
+    // Count the digits of every chunk.
+    tbb::parallel_for(std::size_t(0), chunkCount, [&](std::size_t chunk) {
+      std::size_t *count = &offsets[chunk * bucketCount];
+      std::fill(count, count + bucketCount, 0);
+      for (std::size_t i = chunk * chunkSize;
+           i < std::min(n, (chunk + 1) * chunkSize); ++i)
+        ++count[digit(keys[i])];
+    });
+
+    // Each chunk writes a bucket behind the same bucket of the previous
+    // chunks, which keeps the sort stable.
+    std::size_t position = 0;
+    for (std::size_t bucket = 0; bucket < bucketCount; ++bucket)
+      for (std::size_t chunk = 0; chunk < chunkCount; ++chunk) {
+        std::size_t count = offsets[chunk * bucketCount + bucket];
+        offsets[chunk * bucketCount + bucket] = position;
+        position += count;
       }
-    }
 
-    // Add entity index to the list of entities associated with the leaf box.
-    if (m_leafsToEntities.count(nodeIndex) == 0)
-      m_leafsToEntities[nodeIndex] == std::vector<unsigned int>();
+    tbb::parallel_for(std::size_t(0), chunkCount, [&](std::size_t chunk) {
+      std::size_t *offset = &offsets[chunk * bucketCount];
+      for (std::size_t i = chunk * chunkSize;
+           i < std::min(n, (chunk + 1) * chunkSize); ++i) {
+        std::size_t target = offset[digit(keys[i])]++;
+        sortedKeys[target] = keys[i];
+        sortedValues[target] = values[i];
+      }
+    });
 
-    m_leafsToEntities[nodeIndex].push_back(entityIndex);
+    keys.swap(sortedKeys);
+    values.swap(sortedValues);
   }
 }
 
@@ -108,29 +249,31 @@ inline unsigned long Octree::getNodesPerLevel(unsigned int level) const {
 
 inline unsigned long
 Octree::getLeafContainingPoint(const Point3D<double> &point) const {
-  int invleafsize = getNodesPerSide(m_levels);
-
-  Vector<double> boxSize = m_ubound - m_lbound;
+  long invleafsize = getNodesPerSide(m_levels);
 
   // be careful of precision, outside allocation bad
-  Vector<double> pt(3);
-  pt(0) = (point.x - m_lbound(0)) / boxSize(0);
-  pt(1) = (point.y - m_lbound(1)) / boxSize(1);
-  pt(2) = (point.z - m_lbound(2)) / boxSize(2);
+  double pt[3] = {(point.x - m_lbound(0)) / (m_ubound(0) - m_lbound(0)),
+                  (point.y - m_lbound(1)) / (m_ubound(1) - m_lbound(1)),
+                  (point.z - m_lbound(2)) / (m_ubound(2) - m_lbound(2))};
 
-  double zero = 0;
-
-  std::vector<unsigned long> ind;
+  unsigned long ind[3];
   for (int i = 0; i < 3; ++i)
-    ind.push_back(
-        std::min(int(std::max(zero, pt(i)) * invleafsize), invleafsize - 1));
+    ind[i] = std::min(static_cast<long>(std::max(0., pt[i]) * invleafsize),
+                      invleafsize - 1);
 
-  return morton(ind);
+  return morton(ind[0], ind[1], ind[2]);
 }
 
 inline bool Octree::isEmpty(unsigned long nodeIndex, unsigned int level) const {
 
-  return (m_Nodes[level - 1].count(nodeIndex) == 0);
+  return !std::binary_search(m_nodes[level - 1].begin(),
+                             m_nodes[level - 1].end(), nodeIndex);
+}
+
+inline const std::vector<unsigned long> &
+Octree::getNonEmptyNodes(unsigned int level) const {
+
+  return m_nodes[level - 1];
 }
 
 inline double Octree::cubeWidth(unsigned int level) const {
@@ -144,7 +287,7 @@ inline double Octree::extendedCubeWidth(unsigned int level) const {
 
   double width = m_ubound(0) - m_lbound(0);
 
-  return width / (1 << level) + 2 * m_extensionSize;
+  return width / (1 << level) + 2 * m_extensionSizes[level - 1];
 }
 
 inline void Octree::cubeBounds(unsigned long nodeIndex, unsigned int level,
@@ -177,19 +320,70 @@ inline void Octree::extendedCubeBounds(unsigned long nodeIndex,
   lbound.resize(3);
   ubound.resize(3);
 
-  lbound(0) -= m_extensionSize;
-  lbound(1) -= m_extensionSize;
-  lbound(2) -= m_extensionSize;
+  double extensionSize = m_extensionSizes[level - 1];
+
+  lbound(0) -= extensionSize;
+  lbound(1) -= extensionSize;
+  lbound(2) -= extensionSize;
 
-  ubound(0) += m_extensionSize;
-  ubound(1) += m_extensionSize;
-  ubound(2) += m_extensionSize;
+  ubound(0) += extensionSize;
+  ubound(1) += extensionSize;
+  ubound(2) += extensionSize;
 }
 
-inline const std::vector<unsigned int> &
-Octree::getLeafCubeEntities(unsigned long nodeIndex) const {
+inline bool Octree::isAdaptive() const { return m_adaptive; }
+
+inline bool Octree::isLeaf(unsigned long nodeIndex, unsigned int level) const {
 
-  return m_leafsToEntities.at(nodeIndex);
+  auto position = nodePosition(nodeIndex, level);
+  return position < m_nodes[level - 1].size() &&
+         m_isLeaf[level - 1][position];
+}
+
+inline std::size_t Octree::nodePosition(unsigned long nodeIndex,
+                                        unsigned int level) const {
+
+  const auto &nodes = m_nodes[level - 1];
+  auto it = std::lower_bound(nodes.begin(), nodes.end(), nodeIndex);
+  if (it == nodes.end() || *it != nodeIndex)
+    return nodes.size();
+  return it - nodes.begin();
+}
+
+inline void Octree::getCubeEntities(std::vector<unsigned int> &entities,
+                                    unsigned long nodeIndex,
+                                    unsigned int level) const {
+
+  auto position = nodePosition(nodeIndex, level);
+  if (position == m_nodes[level - 1].size())
+    return;
+  const auto &range = m_entityRanges[level - 1][position];
+  entities.insert(entities.end(), m_entities.begin() + range.first,
+                  m_entities.begin() + range.second);
+}
+
+inline void Octree::getLeafCubeEntities(std::vector<unsigned int> &entities,
+                                        unsigned long nodeIndex) const {
+
+  getCubeEntities(entities, nodeIndex, m_levels);
+}
+
+inline bool Octree::areAdjacent(unsigned long nodeIndex1, unsigned int level1,
+                                unsigned long nodeIndex2,
+                                unsigned int level2) const {
+
+  // Compare the index ranges of the cubes on the finer level.
+  unsigned int level = std::max(level1, level2);
+  unsigned long scale1 = 1ul << (level - level1);
+  unsigned long scale2 = 1ul << (level - level2);
+  unsigned long ind1[3], ind2[3];
+  deMorton(&ind1[0], &ind1[1], &ind1[2], nodeIndex1);
+  deMorton(&ind2[0], &ind2[1], &ind2[2], nodeIndex2);
+  for (int i = 0; i < 3; ++i)
+    if (ind1[i] * scale1 > (ind2[i] + 1) * scale2 ||
+        ind2[i] * scale2 > (ind1[i] + 1) * scale1)
+      return false;
+  return true;
 }
 
 inline void Octree::getNeighbors(std::vector<unsigned long> &neighbors,
@@ -0,0 +1,68 @@
+// vi: set et ts=4 sw=2 sts=2:
+
+#ifndef HMAT_BINARY_IO_HPP
+#define HMAT_BINARY_IO_HPP
+
+#include "common.hpp"
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace hmat {
+
+// Sequentially writes plain values in native byte order to a file.
+class BinaryWriter {
+public:
+  explicit BinaryWriter(const std::string &fileName);
+
+  template <typename T> void write(const T &value);
+  template <typename T> void write(const std::vector<T> &values);
+  void write(const void *data, std::size_t bytes);
+
+  // Pad with zeros up to the next multiple of alignment bytes.
+  void align(std::size_t alignment);
+
+  std::size_t position() const;
+
+  // Flush the file and throw if any write failed.
+  void close();
+
+private:
+  std::string m_fileName;
+  std::ofstream m_stream;
+  std::size_t m_position;
+};
+
+// Sequentially reads plain values from a file, which is mapped read-only
+// into memory. Data pointers into the mapping stay valid as long as the
+// mapping returned by mapping() is alive.
+class BinaryReader {
+public:
+  explicit BinaryReader(const std::string &fileName);
+
+  template <typename T> T read();
+  template <typename T> void read(std::vector<T> &values, std::size_t size);
+
+  // Return a pointer to the next bytes and skip them.
+  const void *read(std::size_t bytes);
+
+  // Skip up to the next multiple of alignment bytes.
+  void align(std::size_t alignment);
+
+  std::size_t position() const;
+
+  shared_ptr<const void> mapping() const;
+
+private:
+  std::string m_fileName;
+  shared_ptr<const void> m_mapping;
+  const char *m_data;
+  std::size_t m_size;
+  std::size_t m_position;
+};
+}
+
+#include "binary_io_impl.hpp"
+
+#endif
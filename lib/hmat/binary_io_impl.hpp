@@ -0,0 +1,130 @@
+// vi: set et ts=4 sw=2 sts=2:
+
+#ifndef HMAT_BINARY_IO_IMPL_HPP
+#define HMAT_BINARY_IO_IMPL_HPP
+
+#include "binary_io.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace hmat {
+
+inline BinaryWriter::BinaryWriter(const std::string &fileName)
+    : m_fileName(fileName),
+      m_stream(fileName, std::ios::binary | std::ios::trunc), m_position(0) {
+  if (!m_stream)
+    throw std::runtime_error("BinaryWriter::BinaryWriter: Cannot open " +
+                             fileName + " for writing.");
+}
+
+template <typename T> void BinaryWriter::write(const T &value) {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "BinaryWriter::write: Type must be trivially copyable.");
+  write(&value, sizeof(T));
+}
+
+template <typename T> void BinaryWriter::write(const std::vector<T> &values) {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "BinaryWriter::write: Type must be trivially copyable.");
+  write(values.data(), sizeof(T) * values.size());
+}
+
+inline void BinaryWriter::write(const void *data, std::size_t bytes) {
+  m_stream.write(static_cast<const char *>(data), bytes);
+  m_position += bytes;
+}
+
+inline void BinaryWriter::align(std::size_t alignment) {
+  static const char zeros[64] = {};
+  std::size_t padding = (alignment - m_position % alignment) % alignment;
+  while (padding > 0) {
+    std::size_t bytes = std::min(padding, sizeof(zeros));
+    write(zeros, bytes);
+    padding -= bytes;
+  }
+}
+
+inline std::size_t BinaryWriter::position() const { return m_position; }
+
+inline void BinaryWriter::close() {
+  m_stream.close();
+  if (!m_stream)
+    throw std::runtime_error("BinaryWriter::close: Writing " + m_fileName +
+                             " failed.");
+}
+
+inline BinaryReader::BinaryReader(const std::string &fileName)
+    : m_fileName(fileName), m_data(nullptr), m_size(0), m_position(0) {
+
+  int fd = ::open(fileName.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error("BinaryReader::BinaryReader: Cannot open " +
+                             fileName + " for reading.");
+
+  struct stat fileStatus;
+  if (::fstat(fd, &fileStatus) != 0 || fileStatus.st_size == 0) {
+    ::close(fd);
+    throw std::runtime_error("BinaryReader::BinaryReader: " + fileName +
+                             " is empty or cannot be accessed.");
+  }
+  m_size = fileStatus.st_size;
+
+  void *data = ::mmap(nullptr, m_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED)
+    throw std::runtime_error("BinaryReader::BinaryReader: Cannot map " +
+                             fileName + " into memory.");
+
+  std::size_t size = m_size;
+  m_mapping.reset(data, [size](void *p) { ::munmap(p, size); });
+  m_data = static_cast<const char *>(data);
+}
+
+template <typename T> T BinaryReader::read() {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "BinaryReader::read: Type must be trivially copyable.");
+  T value;
+  std::memcpy(&value, read(sizeof(T)), sizeof(T));
+  return value;
+}
+
+template <typename T>
+void BinaryReader::read(std::vector<T> &values, std::size_t size) {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "BinaryReader::read: Type must be trivially copyable.");
+  if (size > (m_size - m_position) / sizeof(T))
+    throw std::runtime_error("BinaryReader::read: Unexpected end of " +
+                             m_fileName + ".");
+  values.resize(size);
+  std::memcpy(values.data(), read(sizeof(T) * size), sizeof(T) * size);
+}
+
+inline const void *BinaryReader::read(std::size_t bytes) {
+  if (bytes > m_size - m_position)
+    throw std::runtime_error("BinaryReader::read: Unexpected end of " +
+                             m_fileName + ".");
+  const char *data = m_data + m_position;
+  m_position += bytes;
+  return data;
+}
+
+inline void BinaryReader::align(std::size_t alignment) {
+  read((alignment - m_position % alignment) % alignment);
+}
+
+inline std::size_t BinaryReader::position() const { return m_position; }
+
+inline shared_ptr<const void> BinaryReader::mapping() const {
+  return m_mapping;
+}
+}
+
+#endif
@@ -40,6 +40,12 @@ public:
                    int maxBlockSize,
                    const AdmissibilityFunction &admissibilityFunction);
 
+  // Create a block cluster tree from an existing tree, e.g. when reading a
+  // saved tree. The nodes must refer to the given cluster trees.
+  BlockClusterTree(const shared_ptr<const ClusterTree<N>> &rowClusterTree,
+                   const shared_ptr<const ClusterTree<N>> &columnClusterTree,
+                   const shared_ptr<BlockClusterTreeNode<N>> &root);
+
   //  void writeToPdfFile(const std::string &fname, double widthInPoints,
   //                      double heightInPoints) const;
 
@@ -55,11 +61,21 @@ public:
   std::vector<shared_ptr<const BlockClusterTreeNode<N>>> leafNodes() const;
   std::vector<shared_ptr<BlockClusterTreeNode<N>>> leafNodes();
 
+  // Copy of the block tree on the same cluster trees. HMatrix::coarsen
+  // changes the block tree in place, so new matrices get their own copy.
+  shared_ptr<BlockClusterTree<N>> copy() const;
+
 private:
   void
   initializeBlockClusterTree(const AdmissibilityFunction &admissibilityFunction,
                              int maxBlockSize);
 
+  // Recursively refine a block. Independent subtrees are refined in
+  // parallel.
+  void splitBlockClusterTreeNode(
+      const shared_ptr<BlockClusterTreeNode<N>> &node,
+      const AdmissibilityFunction &admissibilityFunction, int maxBlockSize);
+
   shared_ptr<const ClusterTree<N>> m_rowClusterTree;
   shared_ptr<const ClusterTree<N>> m_columnClusterTree;
 
@@ -89,6 +105,26 @@ public:
                   const ClusterTreeNodeData &cluster2) const;
 };
 
+// Strong admissibility with the cluster distance estimated from the
+// oriented bounding boxes of the clusters in addition to the axis aligned
+// ones. For thin or slanted clusters this bound is much sharper, so more
+// blocks are admissible for the same eta.
+class OrientedAdmissibility {
+public:
+  OrientedAdmissibility(double eta);
+
+  bool operator()(const ClusterTreeNodeData &cluster1,
+                  const ClusterTreeNodeData &cluster2) const;
+
+private:
+  double m_eta;
+};
+
+// Lower bound for the distance of two clusters from separating axes of
+// their oriented bounding boxes and their axis aligned bounding boxes.
+double orientedDistance(const ClusterTreeNodeData &cluster1,
+                        const ClusterTreeNodeData &cluster2);
+
 typedef BlockClusterTree<2> DefaultBlockClusterTreeType;
 }
 #include "block_cluster_tree_impl.hpp"
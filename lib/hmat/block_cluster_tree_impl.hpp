@@ -4,8 +4,7 @@
 #define HMAT_BLOCK_CLUSTER_TREE_IMPL_HPP
 
 #include "block_cluster_tree.hpp"
-#include <tbb/blocked_range.h>
-#include <tbb/parallel_for.h>
+#include <tbb/task_group.h>
 
 //#include "cairo/cairo.h"
 //#include "cairo/cairo-pdf.h"
@@ -30,6 +29,14 @@ BlockClusterTree<N>::BlockClusterTree(
   initializeBlockClusterTree(admissibilityFunction, maxBlockSize);
 }
 
+template <int N>
+BlockClusterTree<N>::BlockClusterTree(
+    const shared_ptr<const ClusterTree<N>> &rowClusterTree,
+    const shared_ptr<const ClusterTree<N>> &columnClusterTree,
+    const shared_ptr<BlockClusterTreeNode<N>> &root)
+    : m_rowClusterTree(rowClusterTree), m_columnClusterTree(columnClusterTree),
+      m_root(root) {}
+
 // template <int N>
 // void BlockClusterTree<N>::writeToPdfFile(const std::string &fname,
 //                                         double widthInPoints,
@@ -116,7 +123,7 @@ BlockClusterTree<N>::columnClusterTree() const {
 template <int N>
 std::vector<shared_ptr<const BlockClusterTreeNode<N>>>
 BlockClusterTree<N>::leafNodes() const {
-  return m_root->leafNodes();
+  return root()->leafNodes();
 }
 
 template <int N>
@@ -125,74 +132,99 @@ BlockClusterTree<N>::leafNodes() {
   return m_root->leafNodes();
 }
 
+template <int N>
+shared_ptr<BlockClusterTree<N>> BlockClusterTree<N>::copy() const {
+
+  std::function<void(const BlockClusterTreeNode<N> &,
+                     const shared_ptr<BlockClusterTreeNode<N>> &)>
+      copyChildren = [&copyChildren](
+          const BlockClusterTreeNode<N> &node,
+          const shared_ptr<BlockClusterTreeNode<N>> &target) {
+        if (node.isLeaf())
+          return;
+        for (int i = 0; i < N * N; ++i) {
+          target->addChild(node.child(i)->data(), i);
+          copyChildren(*node.child(i), target->child(i));
+        }
+      };
+
+  auto root = make_shared<BlockClusterTreeNode<N>>(m_root->data());
+  copyChildren(*m_root, root);
+  return make_shared<BlockClusterTree<N>>(m_rowClusterTree,
+                                          m_columnClusterTree, root);
+}
+
 template <int N>
 void BlockClusterTree<N>::initializeBlockClusterTree(
     const AdmissibilityFunction &admissibilityFunction, int maxBlockSize) {
 
-  std::function<void(const shared_ptr<BlockClusterTreeNode<N>> &)>
-      splittingFunction;
+  bool admissible = admissibilityFunction(m_rowClusterTree->root()->data(),
+                                          m_columnClusterTree->root()->data());
+  m_root = shared_ptr<BlockClusterTreeNode<N>>(
+      new BlockClusterTreeNode<N>(BlockClusterTreeNodeData<N>(
+          m_rowClusterTree->root(), m_columnClusterTree->root(), admissible)));
+  splitBlockClusterTreeNode(m_root, admissibilityFunction, maxBlockSize);
+}
 
-  splittingFunction = [this, &admissibilityFunction, &splittingFunction,
-                       &maxBlockSize](
-      const shared_ptr<BlockClusterTreeNode<N>> &node) {
+template <int N>
+void BlockClusterTree<N>::splitBlockClusterTreeNode(
+    const shared_ptr<BlockClusterTreeNode<N>> &node,
+    const AdmissibilityFunction &admissibilityFunction, int maxBlockSize) {
 
-    auto nodeData = node->data();
+  // Blocks with fewer rows plus columns are refined without spawning tasks.
+  const std::size_t PARALLEL_SPLIT_SIZE = 4096;
 
-    // Adjust admissibility condition to only accept blocks smaller than
-    // maxBlockSize
+  auto &nodeData = node->data();
 
-    auto rowClusterTreeNodeIndexRange =
-        nodeData.rowClusterTreeNode->data().indexRange;
-    auto columnClusterTreeNodeIndexRange =
-        nodeData.columnClusterTreeNode->data().indexRange;
-    auto rowBlockSize =
-        rowClusterTreeNodeIndexRange[1] - rowClusterTreeNodeIndexRange[0];
-    auto columnBlockSize =
-        columnClusterTreeNodeIndexRange[1] - columnClusterTreeNodeIndexRange[0];
+  // Adjust admissibility condition to only accept blocks smaller than
+  // maxBlockSize
 
-    if (columnBlockSize > maxBlockSize || rowBlockSize > maxBlockSize)
-      nodeData.admissible = false;
+  std::size_t rowBlockSize, columnBlockSize;
+  IndexRangeType rowClusterRange, columnClusterRange;
+  getBlockClusterTreeNodeDimensions(*node, rowClusterRange, columnClusterRange,
+                                    rowBlockSize, columnBlockSize);
 
-    // If admissible do not refine further
+  if (columnBlockSize > maxBlockSize || rowBlockSize > maxBlockSize)
+    nodeData.admissible = false;
 
-    if (nodeData.admissible)
-      return;
+  // If admissible do not refine further
 
-    const auto &rowClusterData = nodeData.rowClusterTreeNode->data();
-    const auto &columnClusterData = nodeData.columnClusterTreeNode->data();
+  if (nodeData.admissible)
+    return;
 
-    // If row or column cluster is leaf do not refine further
+  // If row or column cluster is leaf do not refine further
 
-    if (nodeData.rowClusterTreeNode->isLeaf() ||
-        nodeData.columnClusterTreeNode->isLeaf())
-      return;
+  if (nodeData.rowClusterTreeNode->isLeaf() ||
+      nodeData.columnClusterTreeNode->isLeaf())
+    return;
 
-    // Create the block clusters
+  // Create the block clusters
 
-    for (int rowCount = 0; rowCount < N; ++rowCount) {
-      auto rowChild = nodeData.rowClusterTreeNode->child(rowCount);
-      for (int columnCount = 0; columnCount < N; ++columnCount) {
-        auto columnChild = nodeData.columnClusterTreeNode->child(columnCount);
-        node->addChild(
-            BlockClusterTreeNodeData<N>(
-                rowChild, columnChild,
-                admissibilityFunction(rowClusterData, columnClusterData)),
-            N * rowCount + columnCount);
-        splittingFunction(node->child(N * rowCount + columnCount));
-      }
+  for (int rowCount = 0; rowCount < N; ++rowCount) {
+    auto rowChild = nodeData.rowClusterTreeNode->child(rowCount);
+    for (int columnCount = 0; columnCount < N; ++columnCount) {
+      auto columnChild = nodeData.columnClusterTreeNode->child(columnCount);
+      node->addChild(BlockClusterTreeNodeData<N>(
+                         rowChild, columnChild,
+                         admissibilityFunction(rowChild->data(),
+                                               columnChild->data())),
+                     N * rowCount + columnCount);
     }
-    // tbb::parallel_for(tbb::blocked_range<int>(0,N*N),[&splittingFunction,&node](
-    //      const tbb::blocked_range<int>& range){
-    //    for (int i = range.begin(); i!=range.end(); ++i)
-    //      splittingFunction(node->child(i));});
-  };
-
-  bool admissible = admissibilityFunction(m_rowClusterTree->root()->data(),
-                                          m_columnClusterTree->root()->data());
-  m_root = shared_ptr<BlockClusterTreeNode<N>>(
-      new BlockClusterTreeNode<N>(BlockClusterTreeNodeData<N>(
-          m_rowClusterTree->root(), m_columnClusterTree->root(), admissible)));
-  splittingFunction(m_root);
+  }
+
+  if (rowBlockSize + columnBlockSize < PARALLEL_SPLIT_SIZE) {
+    for (int i = 0; i < N * N; ++i)
+      splitBlockClusterTreeNode(node->child(i), admissibilityFunction,
+                                maxBlockSize);
+  } else {
+    tbb::task_group taskGroup;
+    for (int i = 0; i < N * N; ++i)
+      taskGroup.run([&, i] {
+        splitBlockClusterTreeNode(node->child(i), admissibilityFunction,
+                                  maxBlockSize);
+      });
+    taskGroup.wait();
+  }
 }
 
 template <int N>
@@ -228,5 +260,54 @@ operator()(const ClusterTreeNodeData &cluster1,
 
   return cluster1.boundingBox.distance(cluster2.boundingBox) > 0;
 }
+
+inline double orientedDistance(const ClusterTreeNodeData &cluster1,
+                               const ClusterTreeNodeData &cluster2) {
+
+  double dist = cluster1.boundingBox.distance(cluster2.boundingBox);
+
+  const Eigen::Matrix3d &axes1 = cluster1.principalAxes;
+  const Eigen::Matrix3d &axes2 = cluster2.principalAxes;
+
+  // Centers and half widths of the oriented boxes
+  Eigen::Vector3d center1 =
+      cluster1.centroid +
+      .5 * axes1 * (cluster1.orientedMin + cluster1.orientedMax);
+  Eigen::Vector3d center2 =
+      cluster2.centroid +
+      .5 * axes2 * (cluster2.orientedMin + cluster2.orientedMax);
+  Eigen::Vector3d halfWidth1 =
+      .5 * (cluster1.orientedMax - cluster1.orientedMin);
+  Eigen::Vector3d halfWidth2 =
+      .5 * (cluster2.orientedMax - cluster2.orientedMin);
+
+  // The gap between the projections of the boxes onto any unit vector is a
+  // lower bound for their distance. Test the principal axes of both boxes.
+  auto separation = [&](const Eigen::Vector3d &axis) {
+    double radius1 = (axes1.transpose() * axis).cwiseAbs().dot(halfWidth1);
+    double radius2 = (axes2.transpose() * axis).cwiseAbs().dot(halfWidth2);
+    return std::abs(axis.dot(center2 - center1)) - radius1 - radius2;
+  };
+
+  for (int i = 0; i < 3; ++i) {
+    dist = std::max(dist, separation(axes1.col(i)));
+    dist = std::max(dist, separation(axes2.col(i)));
+  }
+
+  return dist;
+}
+
+inline OrientedAdmissibility::OrientedAdmissibility(double eta) : m_eta(eta) {}
+
+inline bool OrientedAdmissibility::
+operator()(const ClusterTreeNodeData &cluster1,
+           const ClusterTreeNodeData &cluster2) const {
+  double diam1 = cluster1.diameter;
+  double diam2 = cluster2.diameter;
+
+  double dist = orientedDistance(cluster1, cluster2);
+
+  return std::min(diam1, diam2) < m_eta * dist;
+}
 }
 #endif
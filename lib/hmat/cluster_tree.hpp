@@ -13,18 +13,30 @@ namespace hmat {
 
 struct ClusterTreeNodeData {
 
+  // The dofs of the cluster are indices[indexRange[0]], ...,
+  // indices[indexRange[1] - 1].
   ClusterTreeNodeData(const IndexRangeType &indexRange,
-                      const std::vector<Point> &centerPoints,
-                      const std::vector<Point> &dofBoundingPoints);
+                      const Geometry &geometry, const IndexSetType &indices);
 
-  void geometryData(const std::vector<Point> &centerPoints,
-                    const std::vector<Point> &dofBoundingPoints);
+  // Only sets the index range. The geometric data is left to the caller,
+  // e.g. when reading a saved tree.
+  explicit ClusterTreeNodeData(const IndexRangeType &indexRange);
+
+  void geometryData(const Geometry &geometry, const IndexSetType &indices);
 
   IndexRangeType indexRange;
   BoundingBox boundingBox;
   double diameter;
   Eigen::Vector3d centroid;
   Eigen::Vector3d mainDirection;
+
+  // Oriented bounding box of the cluster. The columns of principalAxes are
+  // the principal directions of the dof bounding boxes, the last one being
+  // mainDirection. The box spans orientedMin to orientedMax in these
+  // coordinates relative to the centroid.
+  Eigen::Matrix3d principalAxes;
+  Eigen::Vector3d orientedMin;
+  Eigen::Vector3d orientedMax;
 };
 
 template <int N> using ClusterTreeNode = SimpleTreeNode<ClusterTreeNodeData, N>;
@@ -36,6 +48,11 @@ template <int N> class ClusterTree {
 public:
   ClusterTree(const Geometry &geometry, int minBlockSize);
 
+  // Create a cluster tree from an existing tree and the map from H-matrix
+  // dofs to original dofs, e.g. when reading a saved tree.
+  ClusterTree(const shared_ptr<ClusterTreeNode<N>> &root,
+              const std::vector<std::size_t> &hMatDofToOriginalDofMap);
+
   const shared_ptr<const ClusterTreeNode<N>> root() const;
   const shared_ptr<ClusterTreeNode<N>> root();
 
@@ -50,12 +67,21 @@ public:
 
   std::size_t numberOfDofs() const;
 
+  // True if both trees have the same dof permutation and clusters, so that
+  // blocks defined on one tree can be combined with blocks on the other.
+  bool hasSameClusters(const ClusterTree<N> &other) const;
+
 private:
   shared_ptr<ClusterTreeNode<N>>
-  initializeClusterTree(const Geometry &geometry);
-  void splitClusterTreeByGeometry(const Geometry &geometry,
-                                  DofPermutation &dofPermutation,
-                                  int minBlockSize);
+  initializeClusterTree(const Geometry &geometry, const IndexSetType &indices);
+
+  // Recursively split the cluster by reordering the entries of indices
+  // in its index range. On return indices maps H-matrix dofs to original
+  // dofs. Independent subtrees are split in parallel.
+  void splitClusterTreeByGeometry(
+      const shared_ptr<ClusterTreeNode<N>> &clusterTreeNode,
+      const Geometry &geometry, IndexSetType &indices,
+      std::vector<double> &projections, int minBlockSize);
 
   shared_ptr<ClusterTreeNode<N>> m_root;
   DofPermutation m_dofPermutation;
@@ -12,94 +12,149 @@
 
 #include "cluster_tree.hpp"
 
-#include <functional>
+#include <algorithm>
 #include <cassert>
+#include <functional>
+#include <limits>
+#include <tbb/task_group.h>
 
 namespace hmat {
 
 inline ClusterTreeNodeData::ClusterTreeNodeData(
-    const IndexRangeType &indexRange, const std::vector<Point> &centerPoints,
-    const std::vector<Point> &dofBoundingPoints)
+    const IndexRangeType &indexRange, const Geometry &geometry,
+    const IndexSetType &indices)
     : indexRange(indexRange) {
 
-  geometryData(centerPoints, dofBoundingPoints);
+  geometryData(geometry, indices);
 }
 
+inline ClusterTreeNodeData::ClusterTreeNodeData(
+    const IndexRangeType &indexRange)
+    : indexRange(indexRange), diameter(0), centroid(Eigen::Vector3d::Zero()),
+      mainDirection(Eigen::Vector3d::Zero()),
+      principalAxes(Eigen::Matrix3d::Identity()),
+      orientedMin(Eigen::Vector3d::Zero()),
+      orientedMax(Eigen::Vector3d::Zero()) {}
+
 template <int N>
 ClusterTree<N>::ClusterTree(const Geometry &geometry, int minBlockSize)
-    : m_root(initializeClusterTree(geometry)),
-      m_dofPermutation(geometry.size()) {
+    : m_dofPermutation(geometry.size()) {
+
+  IndexSetType indices = fillIndexRange(0, geometry.size());
+  std::vector<double> projections(geometry.size());
+
+  m_root = initializeClusterTree(geometry, indices);
+  splitClusterTreeByGeometry(m_root, geometry, indices, projections,
+                             minBlockSize);
+
+  for (std::size_t hMatDof = 0; hMatDof < indices.size(); ++hMatDof)
+    m_dofPermutation.addDofIndexPair(indices[hMatDof], hMatDof);
+}
 
-  splitClusterTreeByGeometry(geometry, m_dofPermutation, minBlockSize);
+template <int N>
+ClusterTree<N>::ClusterTree(
+    const shared_ptr<ClusterTreeNode<N>> &root,
+    const std::vector<std::size_t> &hMatDofToOriginalDofMap)
+    : m_root(root), m_dofPermutation(hMatDofToOriginalDofMap.size()) {
+
+  for (std::size_t hMatDof = 0; hMatDof < hMatDofToOriginalDofMap.size();
+       ++hMatDof)
+    m_dofPermutation.addDofIndexPair(hMatDofToOriginalDofMap[hMatDof],
+                                     hMatDof);
 }
 
-inline void
-ClusterTreeNodeData::geometryData(const std::vector<Point> &centerPoints,
-                                  const std::vector<Point> &dofBoundingPoints) {
+inline void ClusterTreeNodeData::geometryData(const Geometry &geometry,
+                                              const IndexSetType &indices) {
 
   // Compute the centroid
 
   centroid = Eigen::Vector3d::Zero();
 
-  for (const auto &p : centerPoints) {
-
+  for (std::size_t i = indexRange[0]; i < indexRange[1]; ++i) {
+    const auto &p = geometry[indices[i]]->center;
     centroid(0) += p.x();
     centroid(1) += p.y();
     centroid(2) += p.z();
   }
 
-  centroid /= centerPoints.size();
-
-  // Now compute the main direction of the cluster
-
-  Eigen::Matrix<double, 3, Eigen::Dynamic> boundingPoints(
-      3, dofBoundingPoints.size());
+  centroid /= indexRange[1] - indexRange[0];
 
-  for (int i = 0; i < dofBoundingPoints.size(); ++i) {
-    boundingPoints(0, i) = dofBoundingPoints[i].x();
-    boundingPoints(1, i) = dofBoundingPoints[i].y();
-    boundingPoints(2, i) = dofBoundingPoints[i].z();
-  }
-
-  auto shiftedBoundingPoints = boundingPoints.colwise() - centroid;
+  // Now compute the main direction of the cluster from the corners of the
+  // dof bounding boxes. The bounding box of the cluster is computed in the
+  // same pass.
 
   Eigen::Matrix3d covarianceMatrix(Eigen::Matrix3d::Zero());
-
-  for (int i = 0; i < boundingPoints.cols(); ++i)
-    covarianceMatrix +=
-        shiftedBoundingPoints.col(i) * shiftedBoundingPoints.col(i).transpose();
+  Eigen::Vector3d minVector = Eigen::Vector3d::Constant(
+      std::numeric_limits<double>::infinity());
+  Eigen::Vector3d maxVector = -minVector;
+
+  for (std::size_t i = indexRange[0]; i < indexRange[1]; ++i) {
+    const auto &dofBoundingBox = geometry[indices[i]]->boundingBox;
+    for (int corner = 0; corner < 8; ++corner) {
+      auto point = dofBoundingBox.cornerPoint(corner);
+      Eigen::Vector3d p(point[0], point[1], point[2]);
+      minVector = minVector.cwiseMin(p);
+      maxVector = maxVector.cwiseMax(p);
+      p -= centroid;
+      covarianceMatrix += p * p.transpose();
+    }
+  }
 
   Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> es(covarianceMatrix);
-  mainDirection = es.eigenvectors().col(2);
-  mainDirection /= mainDirection.norm();
-
-  // Now compute the bounding box
-
-  double xmin, xmax, ymin, ymax, zmin, zmax;
-
-  Eigen::Vector3d maxVector = boundingPoints.rowwise().maxCoeff();
-  Eigen::Vector3d minVector = boundingPoints.rowwise().minCoeff();
-
-  xmin = minVector(0);
-  ymin = minVector(1);
-  zmin = minVector(2);
-  xmax = maxVector(0);
-  ymax = maxVector(1);
-  zmax = maxVector(2);
-
-  boundingBox = BoundingBox(xmin, xmax, ymin, ymax, zmin, zmax);
-
-  // Compute the diameter
-
-  auto projections = shiftedBoundingPoints.transpose() * mainDirection;
+  principalAxes = es.eigenvectors();
+  mainDirection = principalAxes.col(2);
+
+  boundingBox = BoundingBox(minVector(0), maxVector(0), minVector(1),
+                            maxVector(1), minVector(2), maxVector(2));
+
+  // Compute the extents along the principal directions and the diameter
+
+  orientedMin =
+      Eigen::Vector3d::Constant(std::numeric_limits<double>::infinity());
+  orientedMax = -orientedMin;
+
+  for (std::size_t i = indexRange[0]; i < indexRange[1]; ++i) {
+    const auto &dofBoundingBox = geometry[indices[i]]->boundingBox;
+    for (int corner = 0; corner < 8; ++corner) {
+      auto point = dofBoundingBox.cornerPoint(corner);
+      Eigen::Vector3d p(point[0], point[1], point[2]);
+      Eigen::Vector3d projection = principalAxes.transpose() * (p - centroid);
+      orientedMin = orientedMin.cwiseMin(projection);
+      orientedMax = orientedMax.cwiseMax(projection);
+    }
+  }
 
-  diameter = projections.maxCoeff() - projections.minCoeff();
+  diameter = orientedMax(2) - orientedMin(2);
 }
 
 template <int N> std::size_t ClusterTree<N>::numberOfDofs() const {
   return (m_root->data().indexRange[1] - m_root->data().indexRange[0]);
 }
 
+template <int N>
+bool ClusterTree<N>::hasSameClusters(const ClusterTree<N> &other) const {
+
+  if (this == &other)
+    return true;
+  if (hMatDofToOriginalDofMap() != other.hMatDofToOriginalDofMap())
+    return false;
+
+  std::function<bool(const ClusterTreeNode<N> &, const ClusterTreeNode<N> &)>
+      sameClusters = [&sameClusters](const ClusterTreeNode<N> &first,
+                                     const ClusterTreeNode<N> &second) {
+        if (first.data().indexRange != second.data().indexRange ||
+            first.isLeaf() != second.isLeaf())
+          return false;
+        if (first.isLeaf())
+          return true;
+        for (int i = 0; i < N; ++i)
+          if (!sameClusters(*first.child(i), *second.child(i)))
+            return false;
+        return true;
+      };
+  return sameClusters(*m_root, *other.m_root);
+}
+
 template <int N>
 const shared_ptr<const ClusterTreeNode<N>> ClusterTree<N>::root() const {
   return m_root;
@@ -111,22 +166,13 @@ template <int N> const shared_ptr<ClusterTreeNode<N>> ClusterTree<N>::root() {
 
 template <int N>
 shared_ptr<ClusterTreeNode<N>>
-ClusterTree<N>::initializeClusterTree(const Geometry &geometry) {
+ClusterTree<N>::initializeClusterTree(const Geometry &geometry,
+                                      const IndexSetType &indices) {
 
   IndexRangeType indexRange{{0, geometry.size()}};
 
-  std::vector<Point> centerPoints;
-  centerPoints.reserve(geometry.size());
-  std::vector<Point> dofBoundingPoints;
-  dofBoundingPoints.reserve(8 * geometry.size());
-
-  for (const auto &geometryData : geometry) {
-    centerPoints.push_back(geometryData->center);
-    geometryData->boundingBox.corners(dofBoundingPoints);
-  }
-
   return make_shared<ClusterTreeNode<N>>(
-      ClusterTreeNodeData(indexRange, centerPoints, dofBoundingPoints));
+      ClusterTreeNodeData(indexRange, geometry, indices));
 }
 
 template <int N>
@@ -142,131 +188,65 @@ ClusterTree<N>::originalDofToHMatDofMap() const {
 }
 
 template <>
-inline void
-ClusterTree<2>::splitClusterTreeByGeometry(const Geometry &geometry,
-                                           DofPermutation &dofPermutation,
-                                           int minBlockSize) {
-
-  std::function<void(const shared_ptr<ClusterTreeNode<2>> &clusterTreeNode,
-                     const IndexSetType &indexSet)> splittingFun;
-
-  splittingFun = [&dofPermutation, &geometry, minBlockSize, &splittingFun](
-      const shared_ptr<ClusterTreeNode<2>> &clusterTreeNode,
-      const IndexSetType &indexSet) {
-
-    std::size_t indexSetSize = indexSet.size();
-    bool stop_recursion = false;
-
-    assert(indexSetSize ==
-           clusterTreeNode->data().indexRange[1] -
-               clusterTreeNode->data().indexRange[0]);
-
-    if (indexSetSize <= minBlockSize)
-      stop_recursion = true;
-
-    if (!stop_recursion) {
-
-      IndexSetType firstIndexSet;
-      IndexSetType secondIndexSet;
-
-      // Approximate the points in the cluster with a line.
-
-      std::vector<Point> firstPointSet;
-      std::vector<Point> secondPointSet;
-      std::vector<Point> firstBoundingPointSet;
-      std::vector<Point> secondBoundingPointSet;
-
-      // Compute all inner products along the main direction
-
-      std::map<std::size_t, double> products;
-
-      for (auto index : indexSet) {
-
-        Eigen::Vector3d shiftedCenter = -1. * clusterTreeNode->data().centroid;
-        shiftedCenter(0) += geometry[index]->center.x();
-        shiftedCenter(1) += geometry[index]->center.y();
-        shiftedCenter(2) += geometry[index]->center.z();
-
-        products[index] =
-            (shiftedCenter.transpose() * clusterTreeNode->data().mainDirection);
-      }
-
-      // Create the sort indices;
-
-      IndexSetType sortedIndices(indexSet);
-      std::sort(begin(sortedIndices), end(sortedIndices),
-                [&](std::size_t i, std::size_t j) {
-                  return (products[i] < products[j]);
-                });
-
-      int i1 = 0;
-      int i2 = sortedIndices.size() - 1;
-
-      while (i1 <= i2) {
-
-        if (i1 == i2) {
-          std::size_t index = sortedIndices[i1];
-          firstIndexSet.push_back(index);
-          firstPointSet.push_back(geometry[index]->center);
-          geometry[index]->boundingBox.corners(firstBoundingPointSet);
-        } else {
-
-          std::size_t index1 = sortedIndices[i1];
-          std::size_t index2 = sortedIndices[i2];
-
-          firstIndexSet.push_back(index1);
-          firstPointSet.push_back(geometry[index1]->center);
-          geometry[index1]->boundingBox.corners(firstBoundingPointSet);
-
-          secondIndexSet.push_back(index2);
-          secondPointSet.push_back(geometry[index2]->center);
-          geometry[index2]->boundingBox.corners(secondBoundingPointSet);
-        }
-
-        i1++;
-        i2--;
-      }
-
-      // This does not occur unless there is only one element left in the
-      // IndexSet.
-      if (firstIndexSet.size() == 0 || secondIndexSet.size() == 0) {
-        stop_recursion = true;
-      }
-
-      if (!stop_recursion) {
-
-        auto pivot = firstIndexSet.size();
-
-        IndexRangeType newRangeFirst = clusterTreeNode->data().indexRange;
-        IndexRangeType newRangeSecond = clusterTreeNode->data().indexRange;
+inline void ClusterTree<2>::splitClusterTreeByGeometry(
+    const shared_ptr<ClusterTreeNode<2>> &clusterTreeNode,
+    const Geometry &geometry, IndexSetType &indices,
+    std::vector<double> &projections, int minBlockSize) {
+
+  // Clusters below this size are split without spawning tasks.
+  const std::size_t PARALLEL_SPLIT_SIZE = 2048;
+
+  const auto &data = clusterTreeNode->data();
+  const auto &indexRange = data.indexRange;
+  std::size_t indexSetSize = indexRange[1] - indexRange[0];
+
+  // A single dof cannot be split any further.
+  if (indexSetSize <= minBlockSize || indexSetSize < 2)
+    return;
+
+  // Project the dof centers onto the main direction of the cluster. The
+  // projections are stored by original dof index, so that concurrent
+  // subtrees write disjoint entries.
+
+  for (std::size_t i = indexRange[0]; i < indexRange[1]; ++i) {
+    std::size_t index = indices[i];
+    const auto &center = geometry[index]->center;
+    projections[index] =
+        (center.x() - data.centroid(0)) * data.mainDirection(0) +
+        (center.y() - data.centroid(1)) * data.mainDirection(1) +
+        (center.z() - data.centroid(2)) * data.mainDirection(2);
+  }
 
-        newRangeFirst[1] = newRangeSecond[0] = newRangeFirst[0] + pivot;
+  // The first child gets the (larger) half with the smaller projections.
 
-        clusterTreeNode->addChild(ClusterTreeNodeData(newRangeFirst,
-                                                      firstPointSet,
-                                                      firstBoundingPointSet),
-                                  0);
-        clusterTreeNode->addChild(ClusterTreeNodeData(newRangeSecond,
-                                                      secondPointSet,
-                                                      secondBoundingPointSet),
-                                  1);
-        splittingFun(clusterTreeNode->child(0), firstIndexSet);
-        splittingFun(clusterTreeNode->child(1), secondIndexSet);
-      }
-    }
+  std::size_t pivot = (indexSetSize + 1) / 2;
+  auto first = begin(indices) + indexRange[0];
+  std::nth_element(first, first + pivot, first + indexSetSize,
+                   [&projections](std::size_t i, std::size_t j) {
+                     return projections[i] < projections[j];
+                   });
 
-    if (stop_recursion) {
+  IndexRangeType newRangeFirst = indexRange;
+  IndexRangeType newRangeSecond = indexRange;
 
-      int originalIndexCount = 0;
-      const auto &indexRange = clusterTreeNode->data().indexRange;
-      for (int hMatDof = indexRange[0]; hMatDof < indexRange[1]; ++hMatDof) {
-        dofPermutation.addDofIndexPair(indexSet[originalIndexCount], hMatDof);
-        ++originalIndexCount;
-      }
-    }
+  newRangeFirst[1] = newRangeSecond[0] = newRangeFirst[0] + pivot;
 
+  auto splitChild = [&](const IndexRangeType &range, int i) {
+    clusterTreeNode->addChild(ClusterTreeNodeData(range, geometry, indices),
+                              i);
+    splitClusterTreeByGeometry(clusterTreeNode->child(i), geometry, indices,
+                               projections, minBlockSize);
   };
-  splittingFun(m_root, fillIndexRange(0, geometry.size()));
+
+  if (indexSetSize < PARALLEL_SPLIT_SIZE) {
+    splitChild(newRangeFirst, 0);
+    splitChild(newRangeSecond, 1);
+  } else {
+    tbb::task_group taskGroup;
+    taskGroup.run([&] { splitChild(newRangeFirst, 0); });
+    splitChild(newRangeSecond, 1);
+    taskGroup.wait();
+  }
 }
 
 template <int N>
@@ -28,6 +28,34 @@ enum DataBlockType {
 
 };
 
+// Strategy used to avoid write conflicts between leafs during a matvec.
+enum MatVecStrategy {
+
+  OWNER_COMPUTES, // Leafs grouped by output cluster, one task per group.
+  THREAD_LOCAL    // Each thread accumulates into a private output vector.
+
+};
+
+// Precision in which the leaf blocks of a packed H-matrix are stored.
+// Products are always accumulated in the value type of the H-matrix.
+enum StoragePrecision {
+
+  NATIVE_PRECISION, // Blocks are stored in the value type.
+  SINGLE_PRECISION  // Blocks are stored in float or complex<float>.
+
+};
+
+// Symmetry of a square H-matrix. Symmetric and Hermitian matrices only
+// store the leafs on and below the block diagonal. A leaf B below the
+// diagonal also stands for the leaf B^T or B^H above it.
+enum MatrixSymmetry {
+
+  UNSYMMETRIC,
+  SYMMETRIC, // A^T = A, e.g. complex Helmholtz single layer operators.
+  HERMITIAN  // A^H = A
+
+};
+
 IndexSetType fillIndexRange(std::size_t start, std::size_t stop);
 }
 
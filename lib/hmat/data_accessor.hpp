@@ -20,6 +20,23 @@ class DataAccessor {
   virtual double scale(const BlockClusterTreeNode<N>& node) const = 0;
 
   virtual void dofVolumes(Vector<double>& testVolumes, Vector<double>& trialVolumes) const = 0;
+
+  // Positions of the test and trial dofs in H-matrix dof ordering as the
+  // columns of 3 x n matrices. Returns false if they are not available.
+  virtual bool dofPositions(Matrix<double>& testPositions,
+                            Matrix<double>& trialPositions) const {
+    return false;
+  }
+
+  // Kernel of the underlying integral operator between arbitrary points,
+  // values(i, j) = k(testPoints.col(i), trialPoints.col(j)). Returns false
+  // if the kernel cannot be evaluated away from the dofs. Accessors that
+  // provide the kernel return true for any points, also for none.
+  virtual bool evaluateKernel(const Matrix<double>& testPoints,
+                              const Matrix<double>& trialPoints,
+                              Matrix<ValueType>& values) const {
+    return false;
+  }
 };
 }
 
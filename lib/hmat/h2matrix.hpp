@@ -0,0 +1,154 @@
+// vi: set et ts=4 sw=2 sts=2:
+
+#ifndef HMAT_H2MATRIX_HPP
+#define HMAT_H2MATRIX_HPP
+
+#include "common.hpp"
+#include "eigen_fwd.hpp"
+#include "hmatrix.hpp"
+
+#include <unordered_map>
+#include <vector>
+
+namespace hmat {
+
+template <typename ValueType, int N> class H2Matrix;
+
+template <typename ValueType>
+using DefaultH2MatrixType = H2Matrix<ValueType, 2>;
+
+// H2-matrix on the cluster trees of an H-matrix. A low-rank block b = (t, s)
+// is stored as V_t * S_b * W_s^H with a small coupling matrix S_b. The
+// cluster bases are nested: the basis of a non-leaf cluster is not stored,
+// but given by the bases of its sons and small transfer matrices,
+// V_t = diag(V_t1, ..., V_tN) * [E_t1; ...; E_tN]. Storage and matvec cost
+// therefore grow linearly with the number of dofs for a bounded rank.
+// Dense leafs are kept as they are.
+//
+// The bases are computed by algebraic recompression of an assembled
+// H-matrix. The basis of a cluster spans the low-rank blocks of the cluster
+// and of its ancestors, each scaled to unit norm, up to the accuracy eps.
+template <typename ValueType, int N> class H2Matrix {
+public:
+  // All blocks of the H-matrix must be local to this process.
+  H2Matrix(const HMatrix<ValueType, N> &hMatrix, double eps);
+
+  std::size_t rows() const;
+  std::size_t columns() const;
+
+  // Y := alpha * op(H) * X + beta * Y with X and Y in original dof ordering.
+  void apply(const Eigen::Ref<Matrix<ValueType>> &X,
+             Eigen::Ref<Matrix<ValueType>> Y, TransposeMode trans,
+             ValueType alpha, ValueType beta) const;
+
+  // Same as apply, but X and Y are given in H-matrix dof ordering.
+  void applyPermuted(const Eigen::Ref<Matrix<ValueType>> &X,
+                     Eigen::Ref<Matrix<ValueType>> Y, TransposeMode trans,
+                     ValueType alpha, ValueType beta) const;
+
+  // Largest rank of the row or column cluster basis.
+  std::size_t maxRank(RowColSelector rowOrColumn) const;
+
+  int numberOfCouplingBlocks() const;
+  int numberOfDenseBlocks() const;
+
+  double memSizeKb() const;
+
+private:
+  typedef ClusterTreeNode<N> Cluster;
+
+  struct ClusterBasis {
+    std::size_t rank = 0;
+    // Basis of a leaf cluster with orthonormal columns.
+    Matrix<ValueType> basis;
+    // Transfer matrix into the basis of the father, rank x father rank.
+    Matrix<ValueType> transfer;
+  };
+
+  // Cluster bases of one cluster tree, indexed in pre-order.
+  struct NestedBasis {
+    std::unordered_map<const Cluster *, std::size_t> indices;
+    std::vector<ClusterBasis> clusters;
+  };
+
+  struct CouplingBlock {
+    std::size_t rowCluster;
+    std::size_t columnCluster;
+    Matrix<ValueType> S;
+  };
+
+  struct DenseBlock {
+    IndexRangeType rowRange;
+    IndexRangeType columnRange;
+    Matrix<ValueType> A;
+  };
+
+  // Phases of groups of indices into m_denseBlocks. Groups within a phase
+  // write to disjoint output ranges and can be processed concurrently.
+  typedef std::vector<std::vector<std::vector<std::size_t>>> DenseSchedule;
+
+  static void indexClusters(const shared_ptr<const Cluster> &cluster,
+                            NestedBasis &nestedBasis);
+
+  // Orthonormal basis of the dominant left singular vectors of Z, scaled
+  // with the singular values if requested. Singular values below eps are
+  // dropped.
+  static Matrix<ValueType> dominantRange(const Matrix<ValueType> &Z,
+                                         double eps, bool scaled);
+
+  // Compute the nested basis of a cluster and its descendants. The columns
+  // of inherited span the scaled blocks of all ancestors restricted to the
+  // cluster, blocks holds the scaled low-rank blocks of every cluster.
+  void computeClusterBasis(
+      const shared_ptr<const Cluster> &cluster,
+      const Matrix<ValueType> &inherited,
+      const std::unordered_map<const Cluster *,
+                               std::vector<Matrix<ValueType>>> &blocks,
+      double eps, NestedBasis &nestedBasis) const;
+
+  // V_t^H * X for X with the rows of the cluster t.
+  static Matrix<ValueType>
+  project(const Cluster &cluster, const NestedBasis &nestedBasis,
+          const Eigen::Ref<const Matrix<ValueType>> &X);
+
+  // Compute the coefficients V_t^H * X|_t of all clusters bottom-up.
+  static void forwardTransform(const shared_ptr<const Cluster> &cluster,
+                               const NestedBasis &nestedBasis,
+                               const Eigen::Ref<Matrix<ValueType>> &X,
+                               std::vector<Matrix<ValueType>> &coefficients);
+
+  // Y|_t := Y|_t + alpha * V_t * coefficients_t for all clusters top-down.
+  static void backwardTransform(const shared_ptr<const Cluster> &cluster,
+                                const NestedBasis &nestedBasis,
+                                std::vector<Matrix<ValueType>> &coefficients,
+                                Eigen::Ref<Matrix<ValueType>> Y,
+                                ValueType alpha);
+
+  // Group the dense blocks by their row or column cluster, as
+  // HMatrix::computeLeafSchedule does for the leafs of an H-matrix.
+  void computeDenseSchedule(
+      RowColSelector rowOrColumn,
+      const std::unordered_map<const BlockClusterTreeNode<N> *, std::size_t>
+          &denseIndices,
+      DenseSchedule &schedule) const;
+
+  shared_ptr<const BlockClusterTree<N>> m_blockClusterTree;
+
+  NestedBasis m_rowBasis;
+  NestedBasis m_columnBasis;
+
+  std::vector<CouplingBlock> m_couplingBlocks;
+  // Indices of the coupling blocks of every row and column cluster.
+  std::vector<std::vector<std::size_t>> m_couplingBlocksByRow;
+  std::vector<std::vector<std::size_t>> m_couplingBlocksByColumn;
+
+  std::vector<DenseBlock> m_denseBlocks;
+  // Schedules of the dense blocks with output in row or column ordering.
+  DenseSchedule m_denseRowSchedule;
+  DenseSchedule m_denseColumnSchedule;
+};
+}
+
+#include "h2matrix_impl.hpp"
+
+#endif
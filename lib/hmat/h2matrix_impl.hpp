@@ -0,0 +1,605 @@
+// vi: set et ts=4 sw=2 sts=2:
+
+#ifndef HMAT_H2MATRIX_IMPL_HPP
+#define HMAT_H2MATRIX_IMPL_HPP
+
+#include "h2matrix.hpp"
+#include "hmatrix_data.hpp"
+#include "hmatrix_dense_data.hpp"
+#include "hmatrix_low_rank_data.hpp"
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+#include <tbb/task_group.h>
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <stdexcept>
+
+namespace hmat {
+
+template <typename ValueType, int N>
+H2Matrix<ValueType, N>::H2Matrix(const HMatrix<ValueType, N> &hMatrix,
+                                 double eps)
+    : m_blockClusterTree(hMatrix.blockClusterTree()) {
+
+  auto leafs = m_blockClusterTree->leafNodes();
+  // Symmetric matrices are only stored on one process.
+  if (hMatrix.symmetry() == UNSYMMETRIC &&
+      hMatrix.numberOfBlocks() != static_cast<int>(leafs.size()))
+    throw std::runtime_error("H2Matrix::H2Matrix: All blocks must be local "
+                             "to this process.");
+
+  const auto &rowRoot = m_blockClusterTree->rowClusterTree()->root();
+  const auto &columnRoot = m_blockClusterTree->columnClusterTree()->root();
+  indexClusters(rowRoot, m_rowBasis);
+  indexClusters(columnRoot, m_columnBasis);
+
+  std::vector<shared_ptr<const HMatrixData<ValueType>>> data(leafs.size());
+  std::vector<Matrix<ValueType>> rowFactors(leafs.size());
+  std::vector<Matrix<ValueType>> columnFactors(leafs.size());
+
+  // A low-rank block A * B enters the row basis as A * R_B^H and the column
+  // basis as B^H * R_A^H with the triangular QR factors of B^H and A. Both
+  // have the same Gram matrix as the block, scaling them to unit norm
+  // makes eps a relative accuracy for every block.
+  tbb::parallel_for(
+      tbb::blocked_range<std::size_t>(0, leafs.size()),
+      [&](const tbb::blocked_range<std::size_t> &r) {
+        for (auto i = r.begin(); i != r.end(); ++i) {
+          data[i] = hMatrix.data(leafs[i]);
+          if (data[i]->type() != LOW_RANK_AB || data[i]->rank() == 0)
+            continue;
+          const auto &lowRankData =
+              static_cast<const HMatrixLowRankData<ValueType> &>(*data[i]);
+          const auto &A = lowRankData.A();
+          const auto &B = lowRankData.B();
+
+          Eigen::HouseholderQR<Matrix<ValueType>> qrA(A);
+          Eigen::HouseholderQR<Matrix<ValueType>> qrB(B.adjoint());
+          Matrix<ValueType> Ra =
+              qrA.matrixQR()
+                  .topRows(std::min(A.rows(), A.cols()))
+                  .template triangularView<Eigen::Upper>();
+          Matrix<ValueType> Rb =
+              qrB.matrixQR()
+                  .topRows(std::min(B.rows(), B.cols()))
+                  .template triangularView<Eigen::Upper>();
+
+          rowFactors[i] = A * Rb.adjoint();
+          columnFactors[i] = B.adjoint() * Ra.adjoint();
+          double norm = rowFactors[i].norm();
+          if (norm == 0) {
+            rowFactors[i].resize(0, 0);
+            columnFactors[i].resize(0, 0);
+            continue;
+          }
+          rowFactors[i] /= norm;
+          columnFactors[i] /= norm;
+        }
+      });
+
+  std::unordered_map<const Cluster *, std::vector<Matrix<ValueType>>>
+      rowBlocks;
+  std::unordered_map<const Cluster *, std::vector<Matrix<ValueType>>>
+      columnBlocks;
+  for (std::size_t i = 0; i < leafs.size(); ++i) {
+    if (rowFactors[i].size() == 0)
+      continue;
+    const auto &leafData = leafs[i]->data();
+    rowBlocks[leafData.rowClusterTreeNode.get()].push_back(
+        std::move(rowFactors[i]));
+    columnBlocks[leafData.columnClusterTreeNode.get()].push_back(
+        std::move(columnFactors[i]));
+  }
+
+  tbb::task_group group;
+  group.run([&] {
+    computeClusterBasis(rowRoot, Matrix<ValueType>(rows(), 0), rowBlocks, eps,
+                        m_rowBasis);
+  });
+  group.run([&] {
+    computeClusterBasis(columnRoot, Matrix<ValueType>(columns(), 0),
+                        columnBlocks, eps, m_columnBasis);
+  });
+  group.wait();
+
+  std::vector<std::size_t> lowRankLeafs;
+  std::unordered_map<const BlockClusterTreeNode<N> *, std::size_t>
+      denseIndices;
+  for (std::size_t i = 0; i < leafs.size(); ++i) {
+    if (data[i]->type() == LOW_RANK_AB) {
+      lowRankLeafs.push_back(i);
+      continue;
+    }
+    denseIndices[leafs[i].get()] = m_denseBlocks.size();
+    DenseBlock block;
+    block.rowRange = leafs[i]->data().rowClusterTreeNode->data().indexRange;
+    block.columnRange =
+        leafs[i]->data().columnClusterTreeNode->data().indexRange;
+    block.A =
+        static_cast<const HMatrixDenseData<ValueType> &>(*data[i]).A();
+    m_denseBlocks.push_back(std::move(block));
+  }
+  computeDenseSchedule(ROW, denseIndices, m_denseRowSchedule);
+  computeDenseSchedule(COL, denseIndices, m_denseColumnSchedule);
+
+  // Coupling matrices S_b = (V_t^H * A) * (W_s^H * B^H)^H.
+  m_couplingBlocks.resize(lowRankLeafs.size());
+  tbb::parallel_for(
+      tbb::blocked_range<std::size_t>(0, lowRankLeafs.size()),
+      [&](const tbb::blocked_range<std::size_t> &r) {
+        for (auto i = r.begin(); i != r.end(); ++i) {
+          const auto &leafData = leafs[lowRankLeafs[i]]->data();
+          const auto &rowCluster = *leafData.rowClusterTreeNode;
+          const auto &columnCluster = *leafData.columnClusterTreeNode;
+          const auto &lowRankData =
+              static_cast<const HMatrixLowRankData<ValueType> &>(
+                  *data[lowRankLeafs[i]]);
+
+          auto &block = m_couplingBlocks[i];
+          block.rowCluster = m_rowBasis.indices.at(&rowCluster);
+          block.columnCluster = m_columnBasis.indices.at(&columnCluster);
+          block.S = project(rowCluster, m_rowBasis, lowRankData.A()) *
+                    project(columnCluster, m_columnBasis,
+                            lowRankData.B().adjoint()).adjoint();
+        }
+      });
+
+  m_couplingBlocksByRow.resize(m_rowBasis.clusters.size());
+  m_couplingBlocksByColumn.resize(m_columnBasis.clusters.size());
+  for (std::size_t i = 0; i < m_couplingBlocks.size(); ++i) {
+    m_couplingBlocksByRow[m_couplingBlocks[i].rowCluster].push_back(i);
+    m_couplingBlocksByColumn[m_couplingBlocks[i].columnCluster].push_back(i);
+  }
+}
+
+template <typename ValueType, int N>
+std::size_t H2Matrix<ValueType, N>::rows() const {
+  return m_blockClusterTree->rows();
+}
+
+template <typename ValueType, int N>
+std::size_t H2Matrix<ValueType, N>::columns() const {
+  return m_blockClusterTree->columns();
+}
+
+template <typename ValueType, int N>
+void H2Matrix<ValueType, N>::apply(const Eigen::Ref<Matrix<ValueType>> &X,
+                                   Eigen::Ref<Matrix<ValueType>> Y,
+                                   TransposeMode trans, ValueType alpha,
+                                   ValueType beta) const {
+
+  const ClusterTree<N> *xClusterTree =
+      m_blockClusterTree->columnClusterTree().get();
+  const ClusterTree<N> *yClusterTree =
+      m_blockClusterTree->rowClusterTree().get();
+  if (trans == TransposeMode::TRANS || trans == TransposeMode::CONJTRANS)
+    std::swap(xClusterTree, yClusterTree);
+
+  Matrix<ValueType> xPermuted(X.rows(), X.cols());
+  Matrix<ValueType> yPermuted(Y.rows(), Y.cols());
+  for (int i = 0; i < X.rows(); ++i)
+    xPermuted.row(xClusterTree->mapOriginalDofToHMatDof(i)) = X.row(i);
+  for (int i = 0; i < Y.rows(); ++i)
+    yPermuted.row(yClusterTree->mapOriginalDofToHMatDof(i)) = Y.row(i);
+
+  applyPermuted(xPermuted, yPermuted, trans, alpha, beta);
+
+  for (int i = 0; i < Y.rows(); ++i)
+    Y.row(yClusterTree->mapHMatDofToOriginalDof(i)) = yPermuted.row(i);
+}
+
+template <typename ValueType, int N>
+void H2Matrix<ValueType, N>::applyPermuted(
+    const Eigen::Ref<Matrix<ValueType>> &X, Eigen::Ref<Matrix<ValueType>> Y,
+    TransposeMode trans, ValueType alpha, ValueType beta) const {
+
+  // op(H) * X = conj(conj(op(H)) * conj(X)) reduces TRANS and CONJ to
+  // CONJTRANS and NOTRANS.
+  if (trans == TransposeMode::TRANS || trans == TransposeMode::CONJ) {
+    Matrix<ValueType> xConj = X.conjugate();
+    Matrix<ValueType> yConj = Y.conjugate();
+    applyPermuted(xConj, yConj,
+                  trans == TransposeMode::TRANS ? TransposeMode::CONJTRANS
+                                                : TransposeMode::NOTRANS,
+                  Eigen::numext::conj(alpha), Eigen::numext::conj(beta));
+    Y = yConj.conjugate();
+    return;
+  }
+
+  bool notTransposed = (trans == TransposeMode::NOTRANS);
+  if (X.rows() != static_cast<int>(notTransposed ? columns() : rows()) ||
+      Y.rows() != static_cast<int>(notTransposed ? rows() : columns()) ||
+      X.cols() != Y.cols())
+    throw std::runtime_error(
+        "H2Matrix::applyPermuted: Incompatible matrix dimensions.");
+
+  if (beta == ValueType(0))
+    Y.setZero();
+  else if (beta != ValueType(1))
+    Y *= beta;
+
+  const auto &xBasis = notTransposed ? m_columnBasis : m_rowBasis;
+  const auto &yBasis = notTransposed ? m_rowBasis : m_columnBasis;
+  const auto &xRoot = notTransposed
+                          ? m_blockClusterTree->columnClusterTree()->root()
+                          : m_blockClusterTree->rowClusterTree()->root();
+  const auto &yRoot = notTransposed
+                          ? m_blockClusterTree->rowClusterTree()->root()
+                          : m_blockClusterTree->columnClusterTree()->root();
+  const auto &couplingBlocks =
+      notTransposed ? m_couplingBlocksByRow : m_couplingBlocksByColumn;
+
+  std::vector<Matrix<ValueType>> xCoefficients(xBasis.clusters.size());
+  std::vector<Matrix<ValueType>> yCoefficients(yBasis.clusters.size());
+  forwardTransform(xRoot, xBasis, X, xCoefficients);
+
+  // Every cluster collects the coupling terms of its own blocks, so that
+  // the clusters can be processed in parallel.
+  tbb::parallel_for(
+      tbb::blocked_range<std::size_t>(0, yCoefficients.size()),
+      [&](const tbb::blocked_range<std::size_t> &r) {
+        for (auto i = r.begin(); i != r.end(); ++i) {
+          yCoefficients[i].setZero(yBasis.clusters[i].rank, X.cols());
+          for (auto blockIndex : couplingBlocks[i]) {
+            const auto &block = m_couplingBlocks[blockIndex];
+            if (block.S.size() == 0)
+              continue;
+            if (notTransposed)
+              yCoefficients[i].noalias() +=
+                  block.S * xCoefficients[block.columnCluster];
+            else
+              yCoefficients[i].noalias() +=
+                  block.S.adjoint() * xCoefficients[block.rowCluster];
+          }
+        }
+      });
+
+  backwardTransform(yRoot, yBasis, yCoefficients, Y, alpha);
+
+  // Each group of the schedule owns its output rows, so the dense blocks
+  // add directly into Y.
+  const auto &denseSchedule =
+      notTransposed ? m_denseRowSchedule : m_denseColumnSchedule;
+  for (const auto &phase : denseSchedule)
+    tbb::parallel_for(
+        tbb::blocked_range<std::size_t>(0, phase.size()),
+        [&](const tbb::blocked_range<std::size_t> &r) {
+          for (auto g = r.begin(); g != r.end(); ++g)
+            for (auto i : phase[g]) {
+              const auto &block = m_denseBlocks[i];
+              auto rowSize = block.rowRange[1] - block.rowRange[0];
+              auto columnSize = block.columnRange[1] - block.columnRange[0];
+              if (notTransposed)
+                Y.middleRows(block.rowRange[0], rowSize).noalias() +=
+                    alpha * block.A *
+                    X.middleRows(block.columnRange[0], columnSize);
+              else
+                Y.middleRows(block.columnRange[0], columnSize).noalias() +=
+                    alpha * block.A.adjoint() *
+                    X.middleRows(block.rowRange[0], rowSize);
+            }
+        });
+}
+
+template <typename ValueType, int N>
+void H2Matrix<ValueType, N>::computeDenseSchedule(
+    RowColSelector rowOrColumn,
+    const std::unordered_map<const BlockClusterTreeNode<N> *, std::size_t>
+        &denseIndices,
+    DenseSchedule &schedule) const {
+
+  schedule.clear();
+
+  // Below cutDepth blocks are grouped by their ancestor cluster on level
+  // cutDepth, with enough groups to keep all threads busy.
+  std::size_t targetNumberOfGroups =
+      8 * static_cast<std::size_t>(tbb::this_task_arena::max_concurrency());
+  int cutDepth = 0;
+  for (std::size_t groups = 1; groups < targetNumberOfGroups; groups *= N)
+    ++cutDepth;
+
+  // Blocks above cutDepth go into one phase per level, grouped by their own
+  // output cluster. All deeper blocks go into the last phase.
+  std::vector<std::map<const Cluster *, std::vector<std::size_t>>> phases(
+      cutDepth + 1);
+
+  std::function<void(const shared_ptr<const BlockClusterTreeNode<N>> &, int,
+                     const Cluster *)> traverse;
+
+  traverse = [&](const shared_ptr<const BlockClusterTreeNode<N>> &node,
+                 int depth, const Cluster *owner) {
+
+    if (depth <= cutDepth)
+      owner = (rowOrColumn == ROW) ? node->data().rowClusterTreeNode.get()
+                                   : node->data().columnClusterTreeNode.get();
+
+    if (node->isLeaf()) {
+      auto it = denseIndices.find(node.get());
+      if (it != denseIndices.end())
+        phases[std::min(depth, cutDepth)][owner].push_back(it->second);
+      return;
+    }
+
+    for (int i = 0; i < N * N; ++i)
+      traverse(node->child(i), depth + 1, owner);
+  };
+
+  traverse(m_blockClusterTree->root(), 0, nullptr);
+
+  for (const auto &phase : phases) {
+    if (phase.empty())
+      continue;
+    schedule.push_back(std::vector<std::vector<std::size_t>>());
+    for (const auto &group : phase)
+      schedule.back().push_back(group.second);
+  }
+}
+
+template <typename ValueType, int N>
+std::size_t
+H2Matrix<ValueType, N>::maxRank(RowColSelector rowOrColumn) const {
+
+  const auto &nestedBasis = (rowOrColumn == ROW) ? m_rowBasis : m_columnBasis;
+  std::size_t result = 0;
+  for (const auto &cluster : nestedBasis.clusters)
+    result = std::max(result, cluster.rank);
+  return result;
+}
+
+template <typename ValueType, int N>
+int H2Matrix<ValueType, N>::numberOfCouplingBlocks() const {
+  return m_couplingBlocks.size();
+}
+
+template <typename ValueType, int N>
+int H2Matrix<ValueType, N>::numberOfDenseBlocks() const {
+  return m_denseBlocks.size();
+}
+
+template <typename ValueType, int N>
+double H2Matrix<ValueType, N>::memSizeKb() const {
+
+  std::size_t entries = 0;
+  for (const auto *nestedBasis : {&m_rowBasis, &m_columnBasis})
+    for (const auto &cluster : nestedBasis->clusters)
+      entries += cluster.basis.size() + cluster.transfer.size();
+  for (const auto &block : m_couplingBlocks)
+    entries += block.S.size();
+  for (const auto &block : m_denseBlocks)
+    entries += block.A.size();
+  return sizeof(ValueType) * entries / 1024.0;
+}
+
+template <typename ValueType, int N>
+void H2Matrix<ValueType, N>::indexClusters(
+    const shared_ptr<const Cluster> &cluster, NestedBasis &nestedBasis) {
+
+  nestedBasis.indices[cluster.get()] = nestedBasis.clusters.size();
+  nestedBasis.clusters.push_back(ClusterBasis());
+  if (!cluster->isLeaf())
+    for (int i = 0; i < N; ++i)
+      indexClusters(cluster->child(i), nestedBasis);
+}
+
+template <typename ValueType, int N>
+Matrix<ValueType>
+H2Matrix<ValueType, N>::dominantRange(const Matrix<ValueType> &Z, double eps,
+                                      bool scaled) {
+
+  if (Z.size() == 0)
+    return Matrix<ValueType>(Z.rows(), 0);
+
+  // Reduce Z to a square triangular factor first, so that the SVD only
+  // works on the smaller dimension.
+  Matrix<ValueType> Q;
+  Matrix<ValueType> R;
+  if (Z.rows() > Z.cols()) {
+    Eigen::HouseholderQR<Matrix<ValueType>> qr(Z);
+    Q = qr.householderQ() * Matrix<ValueType>::Identity(Z.rows(), Z.cols());
+    R = qr.matrixQR().topRows(Z.cols()).template triangularView<Eigen::Upper>();
+  } else if (Z.cols() > Z.rows()) {
+    // Z = R^H * Q^H and the left singular vectors of R^H are the ones of Z.
+    Eigen::HouseholderQR<Matrix<ValueType>> qr(Z.adjoint());
+    R = Matrix<ValueType>(qr.matrixQR()
+                              .topRows(Z.rows())
+                              .template triangularView<Eigen::Upper>())
+            .adjoint();
+  } else
+    R = Z;
+
+  Eigen::JacobiSVD<Matrix<ValueType>> svd(R, Eigen::ComputeThinU);
+  const auto &singularValues = svd.singularValues();
+  int rank = 0;
+  while (rank < singularValues.size() && singularValues(rank) > eps)
+    ++rank;
+
+  Matrix<ValueType> U = svd.matrixU().leftCols(rank);
+  if (scaled)
+    U = U * singularValues.head(rank).asDiagonal();
+  if (Q.size() != 0)
+    return Q * U;
+  return U;
+}
+
+template <typename ValueType, int N>
+void H2Matrix<ValueType, N>::computeClusterBasis(
+    const shared_ptr<const Cluster> &cluster,
+    const Matrix<ValueType> &inherited,
+    const std::unordered_map<const Cluster *, std::vector<Matrix<ValueType>>>
+        &blocks,
+    double eps, NestedBasis &nestedBasis) const {
+
+  auto &entry = nestedBasis.clusters[nestedBasis.indices.at(cluster.get())];
+  const auto &range = cluster->data().indexRange;
+
+  auto it = blocks.find(cluster.get());
+  auto cols = inherited.cols();
+  if (it != blocks.end())
+    for (const auto &block : it->second)
+      cols += block.cols();
+
+  Matrix<ValueType> Z(range[1] - range[0], cols);
+  Z.leftCols(inherited.cols()) = inherited;
+  if (it != blocks.end()) {
+    auto offset = inherited.cols();
+    for (const auto &block : it->second) {
+      Z.middleCols(offset, block.cols()) = block;
+      offset += block.cols();
+    }
+  }
+
+  if (cluster->isLeaf()) {
+    entry.basis = dominantRange(Z, eps, false);
+    entry.rank = entry.basis.cols();
+    return;
+  }
+
+  // Condense the blocks before passing them to the sons, so that their
+  // number of columns stays bounded by the rank.
+  Matrix<ValueType> condensed = dominantRange(Z, eps, true);
+
+  tbb::task_group group;
+  for (int i = 0; i < N; ++i) {
+    auto child = cluster->child(i);
+    group.run([&, child] {
+      const auto &childRange = child->data().indexRange;
+      Matrix<ValueType> childInherited = condensed.middleRows(
+          childRange[0] - range[0], childRange[1] - childRange[0]);
+      computeClusterBasis(child, childInherited, blocks, eps, nestedBasis);
+    });
+  }
+  group.wait();
+
+  // The basis of the cluster is the dominant range of the condensed blocks
+  // expressed in the bases of the sons.
+  std::size_t stackedRank = 0;
+  for (int i = 0; i < N; ++i)
+    stackedRank +=
+        nestedBasis.clusters[nestedBasis.indices.at(cluster->child(i).get())]
+            .rank;
+
+  Matrix<ValueType> stacked(stackedRank, condensed.cols());
+  std::size_t offset = 0;
+  for (int i = 0; i < N; ++i) {
+    auto child = cluster->child(i);
+    const auto &childRange = child->data().indexRange;
+    auto childRank =
+        nestedBasis.clusters[nestedBasis.indices.at(child.get())].rank;
+    stacked.middleRows(offset, childRank) =
+        project(*child, nestedBasis,
+                condensed.middleRows(childRange[0] - range[0],
+                                     childRange[1] - childRange[0]));
+    offset += childRank;
+  }
+
+  Matrix<ValueType> transfer = dominantRange(stacked, eps, false);
+  entry.rank = transfer.cols();
+
+  offset = 0;
+  for (int i = 0; i < N; ++i) {
+    auto child = cluster->child(i);
+    auto &childEntry =
+        nestedBasis.clusters[nestedBasis.indices.at(child.get())];
+    childEntry.transfer = transfer.middleRows(offset, childEntry.rank);
+    offset += childEntry.rank;
+  }
+}
+
+template <typename ValueType, int N>
+Matrix<ValueType>
+H2Matrix<ValueType, N>::project(const Cluster &cluster,
+                                const NestedBasis &nestedBasis,
+                                const Eigen::Ref<const Matrix<ValueType>> &X) {
+
+  const auto &entry = nestedBasis.clusters[nestedBasis.indices.at(&cluster)];
+  if (cluster.isLeaf())
+    return entry.basis.adjoint() * X;
+
+  const auto &range = cluster.data().indexRange;
+  Matrix<ValueType> result = Matrix<ValueType>::Zero(entry.rank, X.cols());
+  for (int i = 0; i < N; ++i) {
+    auto child = cluster.child(i);
+    const auto &childEntry =
+        nestedBasis.clusters[nestedBasis.indices.at(child.get())];
+    if (childEntry.rank == 0 || entry.rank == 0)
+      continue;
+    const auto &childRange = child->data().indexRange;
+    result.noalias() +=
+        childEntry.transfer.adjoint() *
+        project(*child, nestedBasis,
+                X.middleRows(childRange[0] - range[0],
+                             childRange[1] - childRange[0]));
+  }
+  return result;
+}
+
+template <typename ValueType, int N>
+void H2Matrix<ValueType, N>::forwardTransform(
+    const shared_ptr<const Cluster> &cluster, const NestedBasis &nestedBasis,
+    const Eigen::Ref<Matrix<ValueType>> &X,
+    std::vector<Matrix<ValueType>> &coefficients) {
+
+  auto index = nestedBasis.indices.at(cluster.get());
+  const auto &entry = nestedBasis.clusters[index];
+  const auto &range = cluster->data().indexRange;
+
+  if (cluster->isLeaf()) {
+    coefficients[index].noalias() =
+        entry.basis.adjoint() * X.middleRows(range[0], range[1] - range[0]);
+    return;
+  }
+
+  tbb::task_group group;
+  for (int i = 0; i < N; ++i) {
+    auto child = cluster->child(i);
+    group.run([&, child] {
+      forwardTransform(child, nestedBasis, X, coefficients);
+    });
+  }
+  group.wait();
+
+  coefficients[index].setZero(entry.rank, X.cols());
+  for (int i = 0; i < N; ++i) {
+    auto child = cluster->child(i);
+    auto childIndex = nestedBasis.indices.at(child.get());
+    coefficients[index].noalias() +=
+        nestedBasis.clusters[childIndex].transfer.adjoint() *
+        coefficients[childIndex];
+  }
+}
+
+template <typename ValueType, int N>
+void H2Matrix<ValueType, N>::backwardTransform(
+    const shared_ptr<const Cluster> &cluster, const NestedBasis &nestedBasis,
+    std::vector<Matrix<ValueType>> &coefficients,
+    Eigen::Ref<Matrix<ValueType>> Y, ValueType alpha) {
+
+  auto index = nestedBasis.indices.at(cluster.get());
+  const auto &entry = nestedBasis.clusters[index];
+  const auto &range = cluster->data().indexRange;
+
+  if (cluster->isLeaf()) {
+    Y.middleRows(range[0], range[1] - range[0]).noalias() +=
+        alpha * entry.basis * coefficients[index];
+    return;
+  }
+
+  tbb::task_group group;
+  for (int i = 0; i < N; ++i) {
+    auto child = cluster->child(i);
+    auto childIndex = nestedBasis.indices.at(child.get());
+    coefficients[childIndex].noalias() +=
+        nestedBasis.clusters[childIndex].transfer * coefficients[index];
+    group.run([&, child] {
+      backwardTransform(child, nestedBasis, coefficients, Y, alpha);
+    });
+  }
+  group.wait();
+}
+}
+
+#endif
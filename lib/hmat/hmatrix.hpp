@@ -8,9 +8,17 @@
 #include "compressed_matrix.hpp"
 #include "data_accessor.hpp"
 #include "eigen_fwd.hpp"
+#include "hmatrix_compact_storage.hpp"
 #include "hmatrix_compressor.hpp"
+#include "hmatrix_statistics.hpp"
 
+#include <cstdint>
+#include <functional>
+#include <array>
+#include <atomic>
 #include <mpi.h>
+#include <string>
+#include <tbb/enumerable_thread_specific.h>
 #include <unordered_map>
 
 namespace hmat {
@@ -32,20 +40,87 @@ public:
   HMatrix(const shared_ptr<BlockClusterTree<N>> &blockClusterTree,
           const HMatrixCompressor<ValueType, N> &hMatrixCompressor,
           MPI_Comm comm = MPI_COMM_WORLD);
+  HMatrix(const shared_ptr<BlockClusterTree<N>> &blockClusterTree,
+          const HMatrixCompressor<ValueType, N> &hMatrixCompressor,
+          MatrixSymmetry symmetry, MPI_Comm comm = MPI_COMM_WORLD);
 
   std::size_t rows() const;
   std::size_t columns() const;
 
   double frobeniusNorm() const;
 
-  void initialize(const HMatrixCompressor<ValueType, N> &hMatrixCompressor);
+  // With a symmetry other than UNSYMMETRIC only the leafs on and below the
+  // block diagonal are compressed and stored. This requires the same row
+  // and column clusters and a block cluster tree that is symmetric to the
+  // diagonal. With several processes the symmetry is not used and all leafs
+  // are stored.
+  void initialize(const HMatrixCompressor<ValueType, N> &hMatrixCompressor,
+                  MatrixSymmetry symmetry = UNSYMMETRIC);
   bool isInitialized() const;
   void reset();
 
+  // Symmetry used for the storage of the matrix.
+  MatrixSymmetry symmetry() const;
+
+  // Move the leaf data into one contiguous buffer in matvec order. After
+  // packing data() returns copies of the leaf blocks. With single precision
+  // the blocks are rounded to float or complex<float>. Packed data is
+  // repacked if the precision differs.
+  void packLeafData(StoragePrecision precision = NATIVE_PRECISION);
+  bool isPacked() const;
+  StoragePrecision storagePrecision() const;
+
+  // Merge the children of a block into one low-rank block whenever this
+  // needs less storage and the merged block can be approximated to the
+  // given relative accuracy. Only blocks whose children are all local to
+  // this process are merged.
+  void coarsen(double accuracy);
+
+  // Copy of the matrix on a copy of its block cluster tree. Packed data
+  // stays packed.
+  shared_ptr<HMatrix<ValueType, N>> copy() const;
+
+  // Multiply the matrix with alpha. A Hermitian matrix is expanded to full
+  // storage for a complex alpha.
+  void scale(ValueType alpha);
+
+  // this := this + alpha * other in truncated arithmetic. Low-rank blocks
+  // are recompressed to the relative accuracy eps. Both matrices must have
+  // the same cluster trees, their block cluster trees may differ. All
+  // blocks of both matrices must be local to this process. A symmetric
+  // matrix is expanded to full storage first.
+  void add(ValueType alpha, const HMatrix<ValueType, N> &other, double eps);
+
+  // Product alpha * A * B in truncated arithmetic with relative accuracy
+  // eps on the given block cluster tree. Its row clusters must be the ones
+  // of A, its column clusters the ones of B, and the column clusters of A
+  // the row clusters of B. All blocks must be local to this process.
+  static shared_ptr<HMatrix<ValueType, N>>
+  multiply(ValueType alpha, const HMatrix<ValueType, N> &A,
+           const HMatrix<ValueType, N> &B,
+           const shared_ptr<BlockClusterTree<N>> &blockClusterTree,
+           double eps);
+
+  // Same on a copy of the block cluster tree of A if B has the column
+  // clusters of A, and otherwise of B if A has the row clusters of B.
+  static shared_ptr<HMatrix<ValueType, N>>
+  multiply(ValueType alpha, const HMatrix<ValueType, N> &A,
+           const HMatrix<ValueType, N> &B, double eps);
+
+  // Y := alpha * op(H) * X + beta * Y. All columns of X are processed in
+  // one pass over the leafs with matrix-matrix products, which is much
+  // faster than one apply per column.
   void apply(const Eigen::Ref<Matrix<ValueType>> &X,
              Eigen::Ref<Matrix<ValueType>> Y, TransposeMode trans,
              ValueType alpha, ValueType beta) const;
 
+  // Same as apply, but X and Y are expected in H-matrix dof ordering. On a
+  // single process this does not allocate apart from growing the
+  // workspaces on first use.
+  void applyPermuted(const Eigen::Ref<Matrix<ValueType>> &X,
+                     Eigen::Ref<Matrix<ValueType>> Y, TransposeMode trans,
+                     ValueType alpha, ValueType beta) const;
+
   Matrix<ValueType>
   permuteMatToHMatDofs(const Eigen::Ref<Matrix<ValueType>> &mat,
                        RowColSelector rowOrColumn) const;
@@ -53,7 +128,17 @@ public:
   permuteMatToOriginalDofs(const Eigen::Ref<Matrix<ValueType>> &mat,
                            RowColSelector rowOrColumn) const;
 
+  // Permute into a caller provided buffer, which must not alias mat.
+  void permuteMatToHMatDofs(const Eigen::Ref<Matrix<ValueType>> &mat,
+                            RowColSelector rowOrColumn,
+                            Eigen::Ref<Matrix<ValueType>> result) const;
+  void permuteMatToOriginalDofs(const Eigen::Ref<Matrix<ValueType>> &mat,
+                                RowColSelector rowOrColumn,
+                                Eigen::Ref<Matrix<ValueType>> result) const;
+
   shared_ptr<const BlockClusterTree<N>> blockClusterTree() const;
+  // Blocks above the diagonal of a symmetric matrix are returned as
+  // transposed copies of the stored blocks.
   shared_ptr<const hmat::HMatrixData<ValueType>>
   data(shared_ptr<const BlockClusterTreeNode<N>> node) const;
 
@@ -63,34 +148,250 @@ public:
 
   double memSizeKb() const;
 
+  // Load imbalance of the block compression in initialize, as the ratio of
+  // the maximum to the mean work. With several processes this compares the
+  // processes, otherwise the worker threads. The predicted value is based
+  // on the cost estimates of the compressor, the actual value on measured
+  // times.
+  double predictedImbalance() const;
+  double actualImbalance() const;
+
+  // Statistics of the assembly in initialize on this process and, if
+  // matvec profiling is enabled, of the matvecs since it was enabled.
+  HMatrixStatistics statistics() const;
+
+  // If enabled, each matvec measures the time spent in dense and in
+  // low-rank leafs. This adds two clock reads per leaf.
+  void setMatVecProfiling(bool value);
+  bool matVecProfiling() const;
+
+  void setMatVecStrategy(MatVecStrategy strategy);
+  MatVecStrategy matVecStrategy() const;
+
+  // Contiguous range of H-matrix rows or columns owned by a process. A
+  // process computes the leafs whose row cluster starts in its row range.
+  IndexRangeType ownedRange(RowColSelector rowOrColumn, int rank) const;
+
+  // Write the matrix to a file in a versioned binary format in native byte
+  // order. The file holds the cluster trees with their dof permutations,
+  // the block cluster tree and the leaf data of this process in packed
+  // layout. With several processes each process writes its own file
+  // fileName.<rank>.
+  void save(const std::string &fileName) const;
+
+  // Read a matrix written by save. The leaf data is memory mapped instead
+  // of copied, so that a matvec reads it from the page cache. The matrix
+  // is packed and must be loaded with as many processes as it was saved.
+  static shared_ptr<HMatrix<ValueType, N>>
+  load(const std::string &fileName, MPI_Comm comm = MPI_COMM_WORLD);
+
 private:
-  void apply_impl_parallel(const shared_ptr<BlockClusterTreeNode<N>> &node,
-                           const Eigen::Ref<Matrix<ValueType>> &X,
-                           Eigen::Ref<Matrix<ValueType>> Y, TransposeMode trans,
-                           int levelCount) const;
+  // Leading bytes of a saved matrix.
+  struct FileHeader {
+    std::uint64_t magic;
+    std::uint64_t version;
+    std::uint64_t valueSize;
+    std::uint64_t realSize;
+    std::uint64_t n;
+    std::uint64_t precision;
+    std::uint64_t nproc;
+    std::uint64_t rank;
+    std::uint64_t rows;
+    std::uint64_t columns;
+  };
+
+  // Header with the fields identifying the format and the template
+  // parameters filled in.
+  static FileHeader fileHeader();
+
+  // Phases of groups of indices into m_myLeafs. Phases are processed one
+  // after another. Groups within a phase write to disjoint output ranges
+  // and can therefore be processed concurrently without locking.
+  typedef std::vector<std::vector<std::vector<std::size_t>>> LeafSchedule;
+
+  // Leafs and messages of a matvec with output in row or column ordering.
+  // The remote leafs write partial results into the ranges of other
+  // processes. These are sent first, so that the communication overlaps
+  // with the local leafs.
+  struct CommunicationPlan {
+    LeafSchedule remoteSchedule;
+    LeafSchedule localSchedule;
+    std::vector<std::size_t> remoteLeafs;
+    std::vector<std::size_t> localLeafs;
+    // Hull of the output sent to and received from each process.
+    std::vector<IndexRangeType> sendRanges;
+    std::vector<IndexRangeType> receiveRanges;
+  };
+
+  void computePartition(
+      const std::vector<shared_ptr<BlockClusterTreeNode<N>>> &leafNodes,
+      const std::vector<double> &costs);
+
+  void computeLeafSchedule(RowColSelector rowOrColumn,
+                           const std::function<bool(std::size_t)> &selected,
+                           LeafSchedule &schedule) const;
+
+  void computeCommunicationPlan(RowColSelector rowOrColumn,
+                                CommunicationPlan &plan) const;
+
+  void applyLeaf(std::size_t leafIndex, const Eigen::Ref<Matrix<ValueType>> &X,
+                 Eigen::Ref<Matrix<ValueType>> Y, TransposeMode trans,
+                 ValueType alpha, Matrix<ValueType> &workspace) const;
 
-  void apply_impl_serial(const shared_ptr<BlockClusterTreeNode<N>> &node,
-                         const Eigen::Ref<Matrix<ValueType>> &X,
-                         Eigen::Ref<Matrix<ValueType>> Y,
-                         TransposeMode trans) const;
+  void applyLeafData(std::size_t leafIndex,
+                     const Eigen::Ref<Matrix<ValueType>> &X,
+                     Eigen::Ref<Matrix<ValueType>> Y, TransposeMode trans,
+                     ValueType alpha, Matrix<ValueType> &workspace) const;
+
+  void apply_impl_ownerComputes(const Eigen::Ref<Matrix<ValueType>> &X,
+                                Eigen::Ref<Matrix<ValueType>> Y,
+                                TransposeMode trans, ValueType alpha,
+                                const LeafSchedule &schedule) const;
+
+  void apply_impl_threadLocal(const Eigen::Ref<Matrix<ValueType>> &X,
+                              Eigen::Ref<Matrix<ValueType>> Y,
+                              TransposeMode trans, ValueType alpha,
+                              const std::vector<std::size_t> &leafs) const;
+
+  void applyPermuted_impl(const Eigen::Ref<Matrix<ValueType>> &X,
+                          Eigen::Ref<Matrix<ValueType>> Y, TransposeMode trans,
+                          ValueType alpha, ValueType beta) const;
+
+  void apply_impl(const Eigen::Ref<Matrix<ValueType>> &X,
+                  Eigen::Ref<Matrix<ValueType>> Y, TransposeMode trans,
+                  ValueType alpha, const LeafSchedule &schedule,
+                  const std::vector<std::size_t> &leafs) const;
+
+  // Block with the row and column clusters of a node swapped, or null if
+  // the block cluster tree has no such block.
+  shared_ptr<BlockClusterTreeNode<N>>
+  mirroredNode(const BlockClusterTreeNode<N> &node) const;
+
+  // Transpose or adjoint of a stored block according to the symmetry.
+  shared_ptr<HMatrixData<ValueType>>
+  mirroredData(const HMatrixData<ValueType> &data) const;
+
+  // Mode in which a stored block below the diagonal is applied to stand
+  // for its mirror above the diagonal in op(H).
+  TransposeMode mirroredTransposeMode(TransposeMode trans) const;
+
+  // Store the blocks above the diagonal of a symmetric matrix explicitly.
+  void expandSymmetry();
 
   double
   frobeniusNorm_impl(const shared_ptr<BlockClusterTreeNode<N>> &node) const;
 
   bool coarsen_impl(const shared_ptr<BlockClusterTreeNode<N>> &node,
-                    double coarsen_accuracy);
+                    double coarsen_accuracy,
+                    shared_ptr<HMatrixData<ValueType>> &mergedData) const;
+
+  typedef BlockClusterTreeNode<N> Node;
+  typedef std::unordered_map<const Node *, shared_ptr<HMatrixData<ValueType>>>
+      LeafDataMap;
+
+  // Factors of a low-rank leaf under update. A and B have room for more
+  // columns and rows than the rank, so that updates are appended in place.
+  struct LowRankUpdate {
+    Matrix<ValueType> A;
+    Matrix<ValueType> B;
+    std::size_t rank;
+  };
+  typedef std::unordered_map<const Node *, LowRankUpdate> LowRankUpdateMap;
+
+  // Leaf data of this process by node. Packed leafs are copied.
+  LeafDataMap leafDataMap() const;
+
+  // Take the given blocks as leaf data of a matrix on one process.
+  void setLeafData(const LeafDataMap &leafData);
+
+  // Truncated arithmetic on the blocks of subtrees, see HMatrixLu.
+  // Y := Y + alpha * op(block) * X for the block of a node.
+  static void applySubtree(const LeafDataMap &leafData, const Node *node,
+                           Eigen::Ref<Matrix<ValueType>> X,
+                           Eigen::Ref<Matrix<ValueType>> Y,
+                           TransposeMode trans, ValueType alpha);
+
+  // Product of two blocks as U * V truncated to eps.
+  static void multiplyToLowRank(const LeafDataMap &leafDataA,
+                                const Node *nodeA,
+                                const LeafDataMap &leafDataB,
+                                const Node *nodeB, double eps,
+                                Matrix<ValueType> &U, Matrix<ValueType> &V);
+
+  // C := C + alpha * A * B for the blocks of three nodes.
+  static void multiplyAdd(LeafDataMap &leafDataC, LowRankUpdateMap &updatesC,
+                          const Node *nodeC, const LeafDataMap &leafDataA,
+                          const Node *nodeA, const LeafDataMap &leafDataB,
+                          const Node *nodeB, ValueType alpha, double eps);
+
+  // Move the factors of the low-rank leafs into updates.
+  static LowRankUpdateMap beginLowRankUpdates(LeafDataMap &leafData);
+
+  // Add U * V to the part of the block of a node that starts at the given
+  // row and column. Leafs only partially covered are updated in the
+  // covered part. Low-rank leafs append the factors to their update and
+  // are only truncated when their rank exceeds their size.
+  static void addLowRank(LeafDataMap &leafData, LowRankUpdateMap &updates,
+                         const Node *node, std::size_t rowStart,
+                         std::size_t columnStart,
+                         const Eigen::Ref<const Matrix<ValueType>> &U,
+                         const Eigen::Ref<const Matrix<ValueType>> &V,
+                         double eps);
+
+  // Truncate the updates to eps and move them back into the low-rank leafs.
+  static void truncateLeafs(LeafDataMap &leafData, LowRankUpdateMap &updates,
+                            double eps);
+
+  // Copy the leaf data of this process into a compact storage.
+  shared_ptr<HMatrixCompactStorage<ValueType>>
+  packedStorage(StoragePrecision precision) const;
+
+  void unpackLeafData();
+  void updateLeafSchedules();
+  void updateMirroredSchedules();
+  void updateStatistics();
 
   shared_ptr<BlockClusterTree<N>> m_blockClusterTree;
   ParallelDataContainer m_hMatrixData;
 
   int m_numberOfDenseBlocks;
   int m_numberOfLowRankBlocks;
-  int m_memSizeKb;
+  double m_memSizeKb;
+  double m_predictedImbalance;
+  double m_actualImbalance;
   int m_nproc;
   int m_rank;
   MPI_Comm m_comm;
 
   std::vector<shared_ptr<BlockClusterTreeNode<N>>> m_myLeafs;
+  std::unordered_map<const BlockClusterTreeNode<N> *, std::size_t>
+      m_leafIndices;
+  shared_ptr<HMatrixCompactStorage<ValueType>> m_compactStorage;
+
+  std::vector<std::size_t> m_rowOffsets;
+  std::vector<std::size_t> m_columnOffsets;
+
+  MatVecStrategy m_matVecStrategy;
+  CommunicationPlan m_rowPlan;
+  CommunicationPlan m_columnPlan;
+
+  MatrixSymmetry m_symmetry;
+  // Stored leafs off the diagonal of a symmetric matrix and their
+  // schedules for output in row and column ordering.
+  std::vector<std::size_t> m_offDiagonalLeafs;
+  LeafSchedule m_mirroredRowSchedule;
+  LeafSchedule m_mirroredColumnSchedule;
+
+  // Per-thread workspace for the intermediate products of low-rank blocks.
+  mutable tbb::enumerable_thread_specific<Matrix<ValueType>> m_workspace;
+
+  HMatrixStatistics m_statistics;
+  bool m_matVecProfiling;
+  mutable std::atomic<std::size_t> m_numberOfMatVecs;
+  // Per-thread time of the matvecs, of the dense and of the low-rank
+  // leafs.
+  mutable tbb::enumerable_thread_specific<std::array<double, 3>>
+      m_matVecTimes;
 };
 }
 
@@ -9,14 +9,18 @@
 #include "hmatrix_compressor.hpp"
 #include "hmatrix_dense_compressor.hpp"
 #include <set>
+#include <tbb/concurrent_queue.h>
 
 namespace hmat {
 
 template <typename ValueType, int N>
 class HMatrixAcaCompressor : public HMatrixCompressor<ValueType, N> {
 public:
+  // If recompress is true the ACA factors of each block are truncated by
+  // a QR/SVD recompression to the smallest rank that attains eps.
   HMatrixAcaCompressor(const DataAccessor<ValueType, N> &dataAccessor,
-                       double eps, unsigned int maxRank, double cutoff);
+                       double eps, unsigned int maxRank, double cutoff,
+                       bool recompress = false);
 
   enum class ModeType { ROW, COL };
   enum class CrossStatusType { SUCCESS, ZERO };
@@ -32,21 +36,41 @@ public:
 protected:
   void compressBlockImpl(
       const BlockClusterTreeNode<N> &blockClusterTreeNode,
-      shared_ptr<HMatrixData<ValueType>> &hMatrixData) const override;
+      shared_ptr<HMatrixData<ValueType>> &hMatrixData,
+      CompressionStatistics &statistics) const override;
+
+  // Admissible blocks cost one row and one column per rank. The rank is
+  // guessed from eps.
+  double estimateCostImpl(
+      const BlockClusterTreeNode<N> &blockClusterTreeNode) const override;
 
 private:
+  // Buffers reused across blocks. The factors are reserved up to the
+  // maximum rank of a block, so that the ACA iteration does not allocate.
+  struct AcaWorkspace {
+    Matrix<ValueType> A; // rows x capacity
+    Matrix<ValueType> B; // capacity x columns
+    Matrix<ValueType> origRow;
+    Matrix<ValueType> origCol;
+    Matrix<ValueType> row;
+    Matrix<ValueType> col;
+    Vector<ValueType> u;
+    Vector<ValueType> v;
+  };
+
   static std::size_t randomIndex(const IndexRangeType &range,
                                  std::set<std::size_t> &previousIndices);
 
   CrossStatusType
   computeCross(const BlockClusterTreeNode<N> &blockClusterTreeNode,
-               const Matrix<ValueType> &A, const Matrix<ValueType> &B,
+               const Eigen::Ref<const Matrix<ValueType>> &A,
+               const Eigen::Ref<const Matrix<ValueType>> &B,
                std::size_t &nextPivot, Matrix<ValueType> &origRow,
                Matrix<ValueType> &origCol, Matrix<ValueType> &row,
                Matrix<ValueType> &col,
                std::vector<std::size_t> &rowApproxCounter,
                std::vector<std::size_t> &colApproxCounter, ModeType mode,
-               double zeroTol) const;
+               double zeroTol, CompressionStatistics &statistics) const;
 
   bool selectMinPivot(const Matrix<ValueType> &vec,
                       const std::vector<std::size_t> &approximationCount,
@@ -54,27 +78,30 @@ private:
 
   double updateLowRankBlocksAndNorm(const Matrix<ValueType> &newRow,
                                     const Matrix<ValueType> &newCol,
-                                    Matrix<ValueType> &A, Matrix<ValueType> &B,
+                                    AcaWorkspace &workspace, std::size_t &rank,
                                     double currentBlockNorm) const;
 
   bool checkConvergence(const Matrix<ValueType> &row,
                         const Matrix<ValueType> &col, double tol) const;
 
   AcaStatusType aca(const BlockClusterTreeNode<N> &blockClusterTreeNode,
-                    std::size_t startPivot, Matrix<ValueType> &A,
-                    Matrix<ValueType> &B, std::size_t &maxIterations,
+                    std::size_t startPivot, AcaWorkspace &workspace,
+                    std::size_t &rank, std::size_t &maxIterations,
                     std::vector<size_t> &rowApproxCounter,
-                    std::vector<size_t> &colApproxCounter,
-                    Matrix<ValueType> &origRow, Matrix<ValueType> &origCol,
-                    double &blockNorm, double eps, double zeroTol,
-                    ModeType mode) const;
+                    std::vector<size_t> &colApproxCounter, double &blockNorm,
+                    double eps, double zeroTol, ModeType mode,
+                    CompressionStatistics &statistics) const;
 
   const DataAccessor<ValueType, N> &m_dataAccessor;
   double m_eps;
   unsigned int m_maxRank;
+  bool m_recompress;
   HMatrixDenseCompressor<ValueType, N> m_hMatrixDenseCompressor;
   Vector<double> m_testVolumes;
   Vector<double> m_trialVolumes;
+  // Pool instead of thread-local storage, since the data accessor may run
+  // nested parallel loops during which a thread can start another block.
+  mutable tbb::concurrent_queue<shared_ptr<AcaWorkspace>> m_workspaces;
 };
 }
 
@@ -6,6 +6,7 @@
 #include "eigen_fwd.hpp"
 #include "hmatrix_aca_compressor.hpp"
 #include "hmatrix_low_rank_data.hpp"
+#include "math_helper.hpp"
 #include "scalar_traits.hpp"
 #include <algorithm>
 #include <boost/numeric/conversion/cast.hpp>
@@ -44,12 +45,13 @@ template <typename ValueType, int N>
 typename HMatrixAcaCompressor<ValueType, N>::CrossStatusType
 HMatrixAcaCompressor<ValueType, N>::computeCross(
     const BlockClusterTreeNode<N> &blockClusterTreeNode,
-    const Matrix<ValueType> &A, const Matrix<ValueType> &B,
-    std::size_t &nextPivot, Matrix<ValueType> &origRow,
+    const Eigen::Ref<const Matrix<ValueType>> &A,
+    const Eigen::Ref<const Matrix<ValueType>> &B, std::size_t &nextPivot,
+    Matrix<ValueType> &origRow,
     Matrix<ValueType> &origCol, Matrix<ValueType> &row, Matrix<ValueType> &col,
     std::vector<std::size_t> &rowApproxCounter,
     std::vector<std::size_t> &colApproxCounter, ModeType mode,
-    double zeroTol) const {
+    double zeroTol, CompressionStatistics &statistics) const {
 
   const auto &rowClusterRange =
       blockClusterTreeNode.data().rowClusterTreeNode->data().indexRange;
@@ -74,9 +76,10 @@ HMatrixAcaCompressor<ValueType, N>::computeCross(
     rowIndexRange = {{rowIndex, rowIndex + 1}};
     m_dataAccessor.computeMatrixBlock(rowIndexRange, columnClusterRange,
                                       blockClusterTreeNode, origRow);
+    statistics.evaluatedEntries += origRow.size();
     row = origRow;
     if (A.cols() > 0 && B.rows() > 0)
-      row -= A.row(rowIndex - rowClusterRange[0]) * B;
+      row.noalias() -= A.row(rowIndex - rowClusterRange[0]) * B;
 
     row.cwiseAbs().maxCoeff(&maxRowInd, &maxColInd);
     pivotValue = row(0, maxColInd);
@@ -90,10 +93,11 @@ HMatrixAcaCompressor<ValueType, N>::computeCross(
     columnIndexRange = {{columnIndex, columnIndex + 1}};
     m_dataAccessor.computeMatrixBlock(rowClusterRange, columnIndexRange,
                                       blockClusterTreeNode, origCol);
+    statistics.evaluatedEntries += origCol.size();
 
     col = origCol;
     if (A.cols() > 0 && B.rows() > 0)
-      col -= A * B.col(columnIndex - columnClusterRange[0]);
+      col.noalias() -= A * B.col(columnIndex - columnClusterRange[0]);
 
     row /= pivotValue;
 
@@ -112,9 +116,10 @@ HMatrixAcaCompressor<ValueType, N>::computeCross(
     columnIndexRange = {{columnIndex, columnIndex + 1}};
     m_dataAccessor.computeMatrixBlock(rowClusterRange, columnIndexRange,
                                       blockClusterTreeNode, origCol);
+    statistics.evaluatedEntries += origCol.size();
     col = origCol;
     if (A.cols() > 0 && B.rows() > 0)
-      col -= A * B.col(columnIndex - columnClusterRange[0]);
+      col.noalias() -= A * B.col(columnIndex - columnClusterRange[0]);
 
     col.cwiseAbs().maxCoeff(&maxRowInd, &maxColInd);
     pivotValue = col(maxRowInd, 0);
@@ -127,10 +132,11 @@ HMatrixAcaCompressor<ValueType, N>::computeCross(
     rowIndexRange = {{rowIndex, rowIndex + 1}};
     m_dataAccessor.computeMatrixBlock(rowIndexRange, columnClusterRange,
                                       blockClusterTreeNode, origRow);
+    statistics.evaluatedEntries += origRow.size();
 
     row = origRow;
     if (A.cols() > 0 && B.rows() > 0)
-      row -= A.row(rowIndex - rowClusterRange[0]) * B;
+      row.noalias() -= A.row(rowIndex - rowClusterRange[0]) * B;
 
     col /= pivotValue;
 
@@ -152,29 +158,29 @@ HMatrixAcaCompressor<ValueType, N>::computeCross(
 template <typename ValueType, int N>
 double HMatrixAcaCompressor<ValueType, N>::updateLowRankBlocksAndNorm(
     const Matrix<ValueType> &newRow, const Matrix<ValueType> &newCol,
-    Matrix<ValueType> &A, Matrix<ValueType> &B, double currentBlockNorm) const {
+    AcaWorkspace &workspace, std::size_t &rank, double currentBlockNorm) const {
 
   // Compute norm update
 
   double newNormSquared = newRow.squaredNorm() * newCol.squaredNorm();
 
-  if (A.cols() > 0 && B.rows() > 0) {
-    double val1 =
-        2 * (newRow * (B.adjoint() * (A.adjoint() * newCol))).real()(0, 0);
+  if (rank > 0) {
+    auto A = workspace.A.topLeftCorner(newCol.rows(), rank);
+    auto B = workspace.B.topLeftCorner(rank, newRow.cols());
+    auto u = workspace.u.head(rank);
+    auto v = workspace.v.head(rank);
+    // newRow * B^H * A^H * newCol = (B * newRow^H)^H * (A^H * newCol)
+    u.noalias() = A.adjoint() * newCol;
+    v.noalias() = B * newRow.adjoint();
+    double val1 = 2 * std::real(v.dot(u));
     double val2 = currentBlockNorm * currentBlockNorm;
     newNormSquared += val1 + val2;
   }
 
-  // Now increase size of blocks
-  Matrix<ValueType> Atmp(A.rows(), A.cols() + 1);
-  Matrix<ValueType> Btmp(B.rows() + 1, B.cols());
-  Atmp.leftCols(A.cols()) = A;
-  Btmp.topRows(B.rows()) = B;
-  A.swap(Atmp);
-  B.swap(Btmp);
-
-  A.rightCols(1) = newCol;
-  B.bottomRows(1) = newRow;
+  // Append the new cross to the reserved factors
+  workspace.A.col(rank).head(newCol.rows()) = newCol;
+  workspace.B.row(rank).head(newRow.cols()) = newRow;
+  ++rank;
 
   // Return 0 if due to rounding errors newNormSquared is smaller 0.
   return std::sqrt((newNormSquared > 0) ? newNormSquared : 0);
@@ -191,10 +197,12 @@ bool HMatrixAcaCompressor<ValueType, N>::checkConvergence(
 template <typename ValueType, int N>
 void HMatrixAcaCompressor<ValueType, N>::compressBlockImpl(
     const BlockClusterTreeNode<N> &blockClusterTreeNode,
-    shared_ptr<HMatrixData<ValueType>> &hMatrixData) const {
+    shared_ptr<HMatrixData<ValueType>> &hMatrixData,
+    CompressionStatistics &statistics) const {
 
   if (!blockClusterTreeNode.data().admissible) {
-    m_hMatrixDenseCompressor.compressBlock(blockClusterTreeNode, hMatrixData);
+    m_hMatrixDenseCompressor.compressBlock(blockClusterTreeNode, hMatrixData,
+                                           statistics);
     return;
   }
 
@@ -203,20 +211,12 @@ void HMatrixAcaCompressor<ValueType, N>::compressBlockImpl(
   std::size_t numberOfRows;
   std::size_t numberOfColumns;
 
-  Matrix<ValueType> A;
-  Matrix<ValueType> B;
-
-  Matrix<ValueType> origRow, origCol;
-
   getBlockClusterTreeNodeDimensions(blockClusterTreeNode, rowClusterRange,
                                     columnClusterRange, numberOfRows,
                                     numberOfColumns);
 
   hMatrixData.reset(new HMatrixLowRankData<ValueType>());
 
-  A.resize(numberOfRows, 0);
-  B.resize(0, numberOfColumns);
-
   std::vector<size_t> rowApproxCounter(numberOfRows);
   std::vector<size_t> colApproxCounter(numberOfColumns);
 
@@ -224,6 +224,27 @@ void HMatrixAcaCompressor<ValueType, N>::compressBlockImpl(
   std::size_t maxIterations = std::min(static_cast<std::size_t>(m_maxRank),
                                        std::min(numberOfRows, numberOfColumns));
 
+  // The rank can never exceed the initial number of iterations.
+  shared_ptr<AcaWorkspace> workspace;
+  if (!m_workspaces.try_pop(workspace))
+    workspace = make_shared<AcaWorkspace>();
+  // Eigen sizes are signed, so the required sizes are compared as such.
+  typedef typename Matrix<ValueType>::Index Index;
+  const auto rows = static_cast<Index>(numberOfRows);
+  const auto columns = static_cast<Index>(numberOfColumns);
+  const auto capacity = static_cast<Index>(maxIterations);
+  if (workspace->A.rows() < rows || workspace->A.cols() < capacity)
+    workspace->A.resize(std::max(workspace->A.rows(), rows),
+                        std::max(workspace->A.cols(), capacity));
+  if (workspace->B.rows() < capacity || workspace->B.cols() < columns)
+    workspace->B.resize(std::max(workspace->B.rows(), capacity),
+                        std::max(workspace->B.cols(), columns));
+  if (workspace->u.size() < capacity) {
+    workspace->u.resize(capacity);
+    workspace->v.resize(capacity);
+  }
+  std::size_t rank = 0;
+
   bool finished = false;
   AcaAlgorithmStateType state = AcaAlgorithmStateType::START;
   AcaStatusType acaStatus;
@@ -247,9 +268,9 @@ void HMatrixAcaCompressor<ValueType, N>::compressBlockImpl(
 
   while (!finished) {
     // First run the ACA
-    acaStatus = aca(blockClusterTreeNode, nextPivot, A, B, maxIterations,
-                    rowApproxCounter, colApproxCounter, origRow, origCol,
-                    blockNorm, m_eps, 1E-12, mode);
+    acaStatus = aca(blockClusterTreeNode, nextPivot, *workspace, rank,
+                    maxIterations, rowApproxCounter, colApproxCounter,
+                    blockNorm, m_eps, 1E-12, mode, statistics);
     // Now test the status for different cases
     if (acaStatus == AcaStatusType::RANK_LIMIT_REACHED) {
       finished = true; // Approximation does not work. So just stop.
@@ -294,7 +315,8 @@ void HMatrixAcaCompressor<ValueType, N>::compressBlockImpl(
     }
     if (!finished && state == AcaAlgorithmStateType::ROW_TRIAL) {
       if ((rowTrialCount < MAX_ROW_TRIAL_COUNT) &&
-          selectMinPivot(origRow, colApproxCounter, nextPivot, ModeType::ROW)) {
+          selectMinPivot(workspace->origRow, colApproxCounter, nextPivot,
+                         ModeType::ROW)) {
         mode = ModeType::COL;
         rowTrialCount++;
       } else {
@@ -304,7 +326,8 @@ void HMatrixAcaCompressor<ValueType, N>::compressBlockImpl(
     }
     if (!finished && state == AcaAlgorithmStateType::COLUMN_TRIAL) {
       if ((columnTrialCount < MAX_COLUMN_TRIAL_COUNT) &&
-          selectMinPivot(origCol, rowApproxCounter, nextPivot, ModeType::COL)) {
+          selectMinPivot(workspace->origCol, rowApproxCounter, nextPivot,
+                         ModeType::COL)) {
         mode = ModeType::ROW;
         columnTrialCount++;
       } else {
@@ -313,19 +336,59 @@ void HMatrixAcaCompressor<ValueType, N>::compressBlockImpl(
       }
     }
   }
+
+  statistics.zeroTermination =
+      rowModeZeroTermination && columnModeZeroTermination;
+  statistics.rankLimitReached =
+      acaStatus == AcaStatusType::RANK_LIMIT_REACHED;
+
+  Matrix<ValueType> A = workspace->A.topLeftCorner(numberOfRows, rank);
+  Matrix<ValueType> B = workspace->B.topLeftCorner(rank, numberOfColumns);
+  m_workspaces.push(workspace);
+
+  if (m_recompress) {
+    bool success;
+    truncateLowRank(A, B, m_eps, A.cols(), success);
+  }
+
   static_cast<HMatrixLowRankData<ValueType> *>(hMatrixData.get())->A().swap(A);
   static_cast<HMatrixLowRankData<ValueType> *>(hMatrixData.get())->B().swap(B);
 }
 
+template <typename ValueType, int N>
+double HMatrixAcaCompressor<ValueType, N>::estimateCostImpl(
+    const BlockClusterTreeNode<N> &blockClusterTreeNode) const {
+
+  IndexRangeType rowClusterRange;
+  IndexRangeType columnClusterRange;
+  std::size_t numberOfRows;
+  std::size_t numberOfColumns;
+  getBlockClusterTreeNodeDimensions(blockClusterTreeNode, rowClusterRange,
+                                    columnClusterRange, numberOfRows,
+                                    numberOfColumns);
+
+  if (!blockClusterTreeNode.data().admissible)
+    return static_cast<double>(numberOfRows) * numberOfColumns;
+
+  // For asymptotically smooth kernels the rank grows with the number of
+  // digits of accuracy.
+  double expectedRank = 4 * std::max(1., -std::log10(m_eps));
+  expectedRank = std::min(expectedRank, static_cast<double>(m_maxRank));
+  expectedRank = std::min(
+      expectedRank,
+      static_cast<double>(std::min(numberOfRows, numberOfColumns)));
+
+  return expectedRank * (numberOfRows + numberOfColumns);
+}
+
 template <typename ValueType, int N>
 typename HMatrixAcaCompressor<ValueType, N>::AcaStatusType
 HMatrixAcaCompressor<ValueType, N>::aca(
     const BlockClusterTreeNode<N> &blockClusterTreeNode, std::size_t startPivot,
-    Matrix<ValueType> &A, Matrix<ValueType> &B, std::size_t &maxIterations,
+    AcaWorkspace &workspace, std::size_t &rank, std::size_t &maxIterations,
     std::vector<size_t> &rowApproxCounter,
-    std::vector<size_t> &colApproxCounter, Matrix<ValueType> &origRow,
-    Matrix<ValueType> &origCol, double &blockNorm, double eps, double zeroTol,
-    ModeType mode) const {
+    std::vector<size_t> &colApproxCounter, double &blockNorm, double eps,
+    double zeroTol, ModeType mode, CompressionStatistics &statistics) const {
 
   IndexRangeType rowClusterRange;
   IndexRangeType columnClusterRange;
@@ -341,12 +404,16 @@ HMatrixAcaCompressor<ValueType, N>::aca(
   std::size_t iterationCount = 0;
 
   CrossStatusType crossStatus;
-  Matrix<ValueType> row, col;
+  Matrix<ValueType> &row = workspace.row;
+  Matrix<ValueType> &col = workspace.col;
 
   while (maxIterations > 0) {
-    crossStatus = computeCross(blockClusterTreeNode, A, B, nextPivot, origRow,
-                               origCol, row, col, rowApproxCounter,
-                               colApproxCounter, mode, zeroTol);
+    crossStatus = computeCross(
+        blockClusterTreeNode, workspace.A.topLeftCorner(numberOfRows, rank),
+        workspace.B.topLeftCorner(rank, numberOfColumns), nextPivot,
+        workspace.origRow, workspace.origCol, row, col, rowApproxCounter,
+        colApproxCounter, mode, zeroTol, statistics);
+    statistics.iterations++;
     if (crossStatus == CrossStatusType::ZERO)
       return (iterationCount == 0)
                  ? AcaStatusType::ZERO_TERMINATION_WITHOUT_ITERATION
@@ -355,7 +422,8 @@ HMatrixAcaCompressor<ValueType, N>::aca(
     if (converged)
       break;
     else {
-      blockNorm = updateLowRankBlocksAndNorm(row, col, A, B, blockNorm);
+      blockNorm =
+          updateLowRankBlocksAndNorm(row, col, workspace, rank, blockNorm);
       maxIterations--; // Putting it here implies that cross computation for
                        // convergence testing does not count towards the max
                        // number of iterations.
@@ -373,9 +441,9 @@ HMatrixAcaCompressor<ValueType, N>::aca(
 template <typename ValueType, int N>
 HMatrixAcaCompressor<ValueType, N>::HMatrixAcaCompressor(
     const DataAccessor<ValueType, N> &dataAccessor, double eps,
-    unsigned int maxRank, double cutoff)
+    unsigned int maxRank, double cutoff, bool recompress)
     : HMatrixCompressor<ValueType, N>(cutoff), m_dataAccessor(dataAccessor),
-      m_eps(eps), m_maxRank(maxRank),
+      m_eps(eps), m_maxRank(maxRank), m_recompress(recompress),
       m_hMatrixDenseCompressor(dataAccessor, cutoff) {
 
   dataAccessor.dofVolumes(m_testVolumes, m_trialVolumes);
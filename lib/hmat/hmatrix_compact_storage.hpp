@@ -0,0 +1,122 @@
+// vi: set et ts=4 sw=2 sts=2:
+
+#ifndef HMAT_HMATRIX_COMPACT_STORAGE_HPP
+#define HMAT_HMATRIX_COMPACT_STORAGE_HPP
+
+#include "common.hpp"
+#include "eigen_fwd.hpp"
+#include "hmatrix_data.hpp"
+#include "scalar_traits.hpp"
+
+#include <vector>
+
+namespace hmat {
+
+// Stores the data of a sequence of leaf blocks in one contiguous buffer.
+// Dense blocks are stored as a column major rows x cols matrix, low-rank
+// blocks as the factors A (rows x rank) and B (rank x cols). Each factor
+// starts on a cache line boundary. In single precision mode the factors
+// are rounded to float or complex<float>. During a matvec they are
+// converted back in column panels that stay in cache, so that only the
+// single precision data is read from memory.
+template <typename ValueType> class HMatrixCompactStorage {
+public:
+  struct LeafRecord {
+    DataBlockType type;
+    std::size_t rowStart;
+    std::size_t rows;
+    std::size_t columnStart;
+    std::size_t columns;
+    std::size_t rank;
+    std::size_t offsetA;
+    std::size_t offsetB;
+  };
+
+  // Pack the given blocks in the given order. Ranges are the row and column
+  // index ranges of the blocks in H-matrix dof ordering.
+  HMatrixCompactStorage(
+      const std::vector<IndexRangeType> &rowRanges,
+      const std::vector<IndexRangeType> &columnRanges,
+      const std::vector<shared_ptr<const HMatrixData<ValueType>>> &data,
+      StoragePrecision precision = NATIVE_PRECISION);
+
+  // Use records and a buffer that live elsewhere, e.g. in a memory mapped
+  // file. The buffer must be laid out as by the constructor above. It is
+  // kept alive by owner.
+  HMatrixCompactStorage(const std::vector<LeafRecord> &records,
+                        StoragePrecision precision, const void *buffer,
+                        std::size_t bufferBytes,
+                        const shared_ptr<const void> &owner);
+
+  HMatrixCompactStorage(const HMatrixCompactStorage &other) = delete;
+  HMatrixCompactStorage &operator=(const HMatrixCompactStorage &other) = delete;
+
+  std::size_t numberOfLeafs() const;
+  StoragePrecision precision() const;
+  const LeafRecord &record(std::size_t leafIndex) const;
+
+  // Computes Y += alpha * op(block) * X for the rows and columns of the
+  // block. X and Y are full vectors in H-matrix dof ordering.
+  void apply(std::size_t leafIndex, const Eigen::Ref<Matrix<ValueType>> &X,
+             Eigen::Ref<Matrix<ValueType>> Y, TransposeMode trans,
+             ValueType alpha, Matrix<ValueType> &workspace) const;
+
+  // Return a stand-alone copy of the data of a leaf.
+  shared_ptr<HMatrixData<ValueType>> data(std::size_t leafIndex) const;
+
+  typename ScalarTraits<ValueType>::RealType
+  frobeniusNorm(std::size_t leafIndex) const;
+
+  double memSizeKb() const;
+
+  // Raw buffer holding the factors of all leafs.
+  const void *buffer() const;
+  std::size_t bufferBytes() const;
+
+private:
+  typedef typename ScalarTraits<ValueType>::SinglePrecisionType SingleType;
+  typedef Eigen::Map<const Matrix<ValueType>> ConstMatrixMap;
+  typedef Eigen::Map<const Matrix<SingleType>> ConstSingleMatrixMap;
+
+  std::size_t columnsOfA(const LeafRecord &record) const;
+
+  ConstMatrixMap mapA(const LeafRecord &record) const;
+  ConstMatrixMap mapB(const LeafRecord &record) const;
+  ConstSingleMatrixMap singleMapA(const LeafRecord &record) const;
+  ConstSingleMatrixMap singleMapB(const LeafRecord &record) const;
+
+  // Converted column panels of single precision factors hold at most
+  // PANEL_BYTES.
+  static const std::size_t PANEL_BYTES = 32768;
+
+  std::size_t panelColumns(std::size_t rows) const;
+
+  // y += alpha * op(M) * x for a single precision factor M, converting one
+  // column panel of M at a time into panelData.
+  template <typename InputType, typename OutputType>
+  void applySinglePanels(const ConstSingleMatrixMap &M, const InputType &x,
+                         OutputType &y, TransposeMode trans, ValueType alpha,
+                         ValueType *panelData) const;
+
+  // Return the factors in the value type.
+  Matrix<ValueType> copyA(const LeafRecord &record) const;
+  Matrix<ValueType> copyB(const LeafRecord &record) const;
+
+  std::vector<LeafRecord> m_records;
+  StoragePrecision m_precision;
+  // Only the buffer matching the precision is used.
+  std::vector<ValueType, Eigen::aligned_allocator<ValueType>> m_buffer;
+  std::vector<SingleType, Eigen::aligned_allocator<SingleType>>
+      m_singleBuffer;
+  // Start of the factors, either in the buffers above or in external
+  // memory.
+  const ValueType *m_data;
+  const SingleType *m_singleData;
+  std::size_t m_bufferBytes;
+  shared_ptr<const void> m_owner;
+};
+}
+
+#include "hmatrix_compact_storage_impl.hpp"
+
+#endif
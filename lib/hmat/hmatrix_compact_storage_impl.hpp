@@ -0,0 +1,368 @@
+// vi: set et ts=4 sw=2 sts=2:
+
+#ifndef HMAT_HMATRIX_COMPACT_STORAGE_IMPL_HPP
+#define HMAT_HMATRIX_COMPACT_STORAGE_IMPL_HPP
+
+#include "hmatrix_compact_storage.hpp"
+#include "hmatrix_dense_data.hpp"
+#include "hmatrix_low_rank_data.hpp"
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace hmat {
+
+template <typename ValueType>
+HMatrixCompactStorage<ValueType>::HMatrixCompactStorage(
+    const std::vector<IndexRangeType> &rowRanges,
+    const std::vector<IndexRangeType> &columnRanges,
+    const std::vector<shared_ptr<const HMatrixData<ValueType>>> &data,
+    StoragePrecision precision)
+    : m_precision(precision), m_data(nullptr), m_singleData(nullptr),
+      m_bufferBytes(0) {
+
+  const bool single = (precision == SINGLE_PRECISION);
+
+  // Number of elements in a cache line of 64 bytes.
+  const std::size_t alignment = std::max<std::size_t>(
+      1, 64 / (single ? sizeof(SingleType) : sizeof(ValueType)));
+  auto align = [alignment](std::size_t offset) {
+    return alignment * ((offset + alignment - 1) / alignment);
+  };
+
+  std::size_t size = 0;
+  m_records.resize(data.size());
+
+  for (std::size_t i = 0; i < data.size(); ++i) {
+    auto &record = m_records[i];
+    record.type = data[i]->type();
+    record.rowStart = rowRanges[i][0];
+    record.rows = rowRanges[i][1] - rowRanges[i][0];
+    record.columnStart = columnRanges[i][0];
+    record.columns = columnRanges[i][1] - columnRanges[i][0];
+    record.offsetA = size;
+    if (record.type == DENSE) {
+      record.rank = 0;
+      size = align(size + record.rows * record.columns);
+      record.offsetB = size;
+    } else {
+      record.rank = data[i]->rank();
+      size = align(size + record.rows * record.rank);
+      record.offsetB = size;
+      size = align(size + record.rank * record.columns);
+    }
+  }
+
+  if (single) {
+    m_singleBuffer.resize(size);
+    m_singleData = m_singleBuffer.data();
+    m_bufferBytes = sizeof(SingleType) * size;
+  } else {
+    m_buffer.resize(size);
+    m_data = m_buffer.data();
+    m_bufferBytes = sizeof(ValueType) * size;
+  }
+
+  // Copy a factor into the buffer of the storage precision.
+  auto store = [this, single](std::size_t offset,
+                              const Matrix<ValueType> &factor) {
+    if (single)
+      Eigen::Map<Matrix<SingleType>>(m_singleBuffer.data() + offset,
+                                     factor.rows(), factor.cols()) =
+          factor.template cast<SingleType>();
+    else
+      Eigen::Map<Matrix<ValueType>>(m_buffer.data() + offset, factor.rows(),
+                                    factor.cols()) = factor;
+  };
+
+  tbb::parallel_for(
+      tbb::blocked_range<std::size_t>(0, data.size()),
+      [&](const tbb::blocked_range<std::size_t> &r) {
+        for (auto i = r.begin(); i != r.end(); ++i) {
+          const auto &record = m_records[i];
+          if (record.type == DENSE) {
+            store(record.offsetA,
+                  static_cast<const HMatrixDenseData<ValueType> &>(*data[i])
+                      .A());
+          } else if (record.rank > 0) {
+            const auto &lowRankData =
+                static_cast<const HMatrixLowRankData<ValueType> &>(*data[i]);
+            store(record.offsetA, lowRankData.A());
+            store(record.offsetB, lowRankData.B());
+          }
+        }
+      });
+}
+
+template <typename ValueType>
+HMatrixCompactStorage<ValueType>::HMatrixCompactStorage(
+    const std::vector<LeafRecord> &records, StoragePrecision precision,
+    const void *buffer, std::size_t bufferBytes,
+    const shared_ptr<const void> &owner)
+    : m_records(records), m_precision(precision), m_data(nullptr),
+      m_singleData(nullptr), m_bufferBytes(bufferBytes), m_owner(owner) {
+
+  const std::size_t elementSize = (precision == SINGLE_PRECISION)
+                                      ? sizeof(SingleType)
+                                      : sizeof(ValueType);
+
+  for (const auto &record : m_records) {
+    std::size_t end =
+        record.type == DENSE
+            ? record.offsetA + record.rows * record.columns
+            : std::max(record.offsetA + record.rows * record.rank,
+                       record.offsetB + record.rank * record.columns);
+    if (elementSize * end > bufferBytes)
+      throw std::runtime_error("HMatrixCompactStorage::HMatrixCompactStorage: "
+                               "Leaf data exceeds the buffer.");
+  }
+
+  if (precision == SINGLE_PRECISION)
+    m_singleData = static_cast<const SingleType *>(buffer);
+  else
+    m_data = static_cast<const ValueType *>(buffer);
+}
+
+template <typename ValueType>
+std::size_t HMatrixCompactStorage<ValueType>::numberOfLeafs() const {
+  return m_records.size();
+}
+
+template <typename ValueType>
+const typename HMatrixCompactStorage<ValueType>::LeafRecord &
+HMatrixCompactStorage<ValueType>::record(std::size_t leafIndex) const {
+  return m_records[leafIndex];
+}
+
+template <typename ValueType>
+StoragePrecision HMatrixCompactStorage<ValueType>::precision() const {
+  return m_precision;
+}
+
+template <typename ValueType>
+std::size_t
+HMatrixCompactStorage<ValueType>::columnsOfA(const LeafRecord &record) const {
+  return record.type == DENSE ? record.columns : record.rank;
+}
+
+template <typename ValueType>
+typename HMatrixCompactStorage<ValueType>::ConstMatrixMap
+HMatrixCompactStorage<ValueType>::mapA(const LeafRecord &record) const {
+  return ConstMatrixMap(m_data + record.offsetA, record.rows,
+                        columnsOfA(record));
+}
+
+template <typename ValueType>
+typename HMatrixCompactStorage<ValueType>::ConstMatrixMap
+HMatrixCompactStorage<ValueType>::mapB(const LeafRecord &record) const {
+  return ConstMatrixMap(m_data + record.offsetB, record.rank,
+                        record.columns);
+}
+
+template <typename ValueType>
+typename HMatrixCompactStorage<ValueType>::ConstSingleMatrixMap
+HMatrixCompactStorage<ValueType>::singleMapA(const LeafRecord &record) const {
+  return ConstSingleMatrixMap(m_singleData + record.offsetA,
+                              record.rows, columnsOfA(record));
+}
+
+template <typename ValueType>
+typename HMatrixCompactStorage<ValueType>::ConstSingleMatrixMap
+HMatrixCompactStorage<ValueType>::singleMapB(const LeafRecord &record) const {
+  return ConstSingleMatrixMap(m_singleData + record.offsetB,
+                              record.rank, record.columns);
+}
+
+template <typename ValueType>
+Matrix<ValueType>
+HMatrixCompactStorage<ValueType>::copyA(const LeafRecord &record) const {
+  if (m_precision == SINGLE_PRECISION)
+    return singleMapA(record).template cast<ValueType>();
+  return mapA(record);
+}
+
+template <typename ValueType>
+Matrix<ValueType>
+HMatrixCompactStorage<ValueType>::copyB(const LeafRecord &record) const {
+  if (m_precision == SINGLE_PRECISION)
+    return singleMapB(record).template cast<ValueType>();
+  return mapB(record);
+}
+
+template <typename ValueType>
+void HMatrixCompactStorage<ValueType>::apply(
+    std::size_t leafIndex, const Eigen::Ref<Matrix<ValueType>> &X,
+    Eigen::Ref<Matrix<ValueType>> Y, TransposeMode trans, ValueType alpha,
+    Matrix<ValueType> &workspace) const {
+
+  const auto &record = m_records[leafIndex];
+  auto cols = X.cols();
+
+  if (record.type == LOW_RANK_AB && record.rank == 0)
+    return;
+
+  bool noTrans = (trans == TransposeMode::NOTRANS || trans == CONJ);
+
+  auto x = noTrans ? X.block(record.columnStart, 0, record.columns, cols)
+                   : X.block(record.rowStart, 0, record.rows, cols);
+  auto y = noTrans ? Y.block(record.rowStart, 0, record.rows, cols)
+                   : Y.block(record.columnStart, 0, record.columns, cols);
+
+  const std::size_t rank = record.rank;
+  const std::size_t sizeTmp = rank * cols;
+
+  if (m_precision == SINGLE_PRECISION) {
+    // The workspace holds the intermediate product of a low-rank block and
+    // one converted column panel of a factor.
+    const auto A = singleMapA(record);
+    std::size_t workspaceSize =
+        sizeTmp + std::max(record.rows * panelColumns(record.rows),
+                           rank * panelColumns(rank));
+    if (static_cast<std::size_t>(workspace.size()) < workspaceSize)
+      workspace.resize(workspaceSize, 1);
+    ValueType *panelData = workspace.data() + sizeTmp;
+
+    if (record.type == DENSE) {
+      applySinglePanels(A, x, y, trans, alpha, panelData);
+      return;
+    }
+
+    const auto B = singleMapB(record);
+    Eigen::Map<Matrix<ValueType>> tmp(workspace.data(), rank, cols);
+    tmp.setZero();
+    if (noTrans) {
+      applySinglePanels(B, x, tmp, trans, ValueType(1), panelData);
+      applySinglePanels(A, tmp, y, trans, alpha, panelData);
+    } else {
+      applySinglePanels(A, x, tmp, trans, ValueType(1), panelData);
+      applySinglePanels(B, tmp, y, trans, alpha, panelData);
+    }
+    return;
+  }
+
+  auto A = mapA(record);
+
+  if (record.type == DENSE) {
+    if (trans == TransposeMode::NOTRANS)
+      y.noalias() += alpha * A * x;
+    else if (trans == TransposeMode::TRANS)
+      y.noalias() += alpha * A.transpose() * x;
+    else if (trans == TransposeMode::CONJ)
+      y.noalias() += alpha * A.conjugate() * x;
+    else
+      y.noalias() += alpha * A.adjoint() * x;
+    return;
+  }
+
+  if (static_cast<std::size_t>(workspace.size()) < sizeTmp)
+    workspace.resize(sizeTmp, 1);
+  auto B = mapB(record);
+  Eigen::Map<Matrix<ValueType>> tmp(workspace.data(), rank, cols);
+
+  if (trans == TransposeMode::NOTRANS) {
+    tmp.noalias() = B * x;
+    y.noalias() += alpha * A * tmp;
+  } else if (trans == TransposeMode::TRANS) {
+    tmp.noalias() = A.transpose() * x;
+    y.noalias() += alpha * B.transpose() * tmp;
+  } else if (trans == TransposeMode::CONJ) {
+    tmp.noalias() = B.conjugate() * x;
+    y.noalias() += alpha * A.conjugate() * tmp;
+  } else {
+    tmp.noalias() = A.adjoint() * x;
+    y.noalias() += alpha * B.adjoint() * tmp;
+  }
+}
+
+template <typename ValueType>
+std::size_t
+HMatrixCompactStorage<ValueType>::panelColumns(std::size_t rows) const {
+  return std::max<std::size_t>(
+      1, PANEL_BYTES / (sizeof(ValueType) * std::max<std::size_t>(rows, 1)));
+}
+
+template <typename ValueType>
+template <typename InputType, typename OutputType>
+void HMatrixCompactStorage<ValueType>::applySinglePanels(
+    const ConstSingleMatrixMap &M, const InputType &x, OutputType &y,
+    TransposeMode trans, ValueType alpha, ValueType *panelData) const {
+
+  const std::size_t rows = M.rows();
+  const std::size_t columns = M.cols();
+  const std::size_t width = panelColumns(rows);
+
+  for (std::size_t start = 0; start < columns; start += width) {
+    std::size_t count = std::min(width, columns - start);
+    Eigen::Map<Matrix<ValueType>> panel(panelData, rows, count);
+    panel = M.middleCols(start, count).template cast<ValueType>();
+    if (trans == TransposeMode::NOTRANS)
+      y.noalias() += alpha * panel * x.middleRows(start, count);
+    else if (trans == TransposeMode::TRANS)
+      y.middleRows(start, count).noalias() += alpha * panel.transpose() * x;
+    else if (trans == TransposeMode::CONJ)
+      y.noalias() += alpha * panel.conjugate() * x.middleRows(start, count);
+    else
+      y.middleRows(start, count).noalias() += alpha * panel.adjoint() * x;
+  }
+}
+
+template <typename ValueType>
+shared_ptr<HMatrixData<ValueType>>
+HMatrixCompactStorage<ValueType>::data(std::size_t leafIndex) const {
+
+  const auto &record = m_records[leafIndex];
+
+  if (record.type == DENSE) {
+    auto denseData = make_shared<HMatrixDenseData<ValueType>>();
+    denseData->A() = copyA(record);
+    return denseData;
+  }
+
+  return shared_ptr<HMatrixData<ValueType>>(
+      new HMatrixLowRankData<ValueType>(copyA(record), copyB(record)));
+}
+
+template <typename ValueType>
+typename ScalarTraits<ValueType>::RealType
+HMatrixCompactStorage<ValueType>::frobeniusNorm(std::size_t leafIndex) const {
+
+  const auto &record = m_records[leafIndex];
+
+  if (record.type == DENSE)
+    return m_precision == SINGLE_PRECISION
+               ? singleMapA(record).template cast<ValueType>().norm()
+               : mapA(record).norm();
+
+  if (record.rank == 0)
+    return 0;
+
+  // ||AB||_F^2 = trace((A^H A)(B B^H))
+  Matrix<ValueType> A = copyA(record);
+  Matrix<ValueType> B = copyB(record);
+  Matrix<ValueType> aHa = A.adjoint() * A;
+  Matrix<ValueType> bbH = B * B.adjoint();
+  return std::sqrt(std::abs(aHa.cwiseProduct(bbH.transpose()).sum()));
+}
+
+template <typename ValueType>
+double HMatrixCompactStorage<ValueType>::memSizeKb() const {
+  return m_bufferBytes / (1.0 * 1024);
+}
+
+template <typename ValueType>
+const void *HMatrixCompactStorage<ValueType>::buffer() const {
+  return m_precision == SINGLE_PRECISION
+             ? static_cast<const void *>(m_singleData)
+             : static_cast<const void *>(m_data);
+}
+
+template <typename ValueType>
+std::size_t HMatrixCompactStorage<ValueType>::bufferBytes() const {
+  return m_bufferBytes;
+}
+}
+
+#endif
@@ -6,6 +6,7 @@
 #include "block_cluster_tree.hpp"
 #include "common.hpp"
 #include "eigen_fwd.hpp"
+#include "hmatrix_statistics.hpp"
 
 namespace hmat {
 
@@ -16,11 +17,29 @@ public:
   HMatrixCompressor(double cutoff);
   void compressBlock(const BlockClusterTreeNode<N> &blockClusterTreeNode,
                      shared_ptr<HMatrixData<ValueType>> &hMatrixData) const;
+  void compressBlock(const BlockClusterTreeNode<N> &blockClusterTreeNode,
+                     shared_ptr<HMatrixData<ValueType>> &hMatrixData,
+                     CompressionStatistics &statistics) const;
+
+  // Estimated work of compressBlock in units of matrix entry evaluations.
+  // Used to order and distribute the assembly work.
+  double
+  estimateCost(const BlockClusterTreeNode<N> &blockClusterTreeNode) const;
 
 protected:
   virtual void
   compressBlockImpl(const BlockClusterTreeNode<N> &blockClusterTreeNode,
-                    shared_ptr<HMatrixData<ValueType>> &hMatrixData) const = 0;
+                    shared_ptr<HMatrixData<ValueType>> &hMatrixData,
+                    CompressionStatistics &statistics) const = 0;
+
+  // The default assumes that all entries of the block are evaluated.
+  virtual double
+  estimateCostImpl(const BlockClusterTreeNode<N> &blockClusterTreeNode) const;
+
+  // True if the block is admissible and its clusters are farther apart
+  // than the cutoff distance, so that the block is set to zero.
+  bool
+  isBeyondCutoff(const BlockClusterTreeNode<N> &blockClusterTreeNode) const;
 
 private:
   double m_cutoff;
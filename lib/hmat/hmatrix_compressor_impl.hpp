@@ -11,9 +11,8 @@ HMatrixCompressor<ValueType, N>::HMatrixCompressor(double cutoff)
     : m_cutoff(cutoff) {}
 
 template <typename ValueType, int N>
-void HMatrixCompressor<ValueType, N>::compressBlock(
-    const BlockClusterTreeNode<N> &blockClusterTreeNode,
-    shared_ptr<HMatrixData<ValueType>> &hMatrixData) const {
+bool HMatrixCompressor<ValueType, N>::isBeyondCutoff(
+    const BlockClusterTreeNode<N> &blockClusterTreeNode) const {
 
   const auto &rowClusterData =
       blockClusterTreeNode.data().rowClusterTreeNode->data();
@@ -23,24 +22,66 @@ void HMatrixCompressor<ValueType, N>::compressBlock(
   double distance =
       rowClusterData.boundingBox.distance(colClusterData.boundingBox);
 
-  if ((distance <= m_cutoff) || (!blockClusterTreeNode.data().admissible))
-    compressBlockImpl(blockClusterTreeNode, hMatrixData);
-  else {
-    // If admissible create a zero HMatrix data block and return this
-    auto numberOfRows =
-        rowClusterData.indexRange[1] - rowClusterData.indexRange[0];
-    auto numberOfCols =
-        colClusterData.indexRange[1] - colClusterData.indexRange[0];
-    hMatrixData.reset(new HMatrixLowRankData<ValueType>());
-    static_cast<HMatrixLowRankData<ValueType> *>(hMatrixData.get())
-        ->A()
-        .resize(numberOfRows, 0);
-    static_cast<HMatrixLowRankData<ValueType> *>(hMatrixData.get())
-        ->B()
-        .resize(numberOfCols, 0);
+  return blockClusterTreeNode.data().admissible && distance > m_cutoff;
+}
+
+template <typename ValueType, int N>
+void HMatrixCompressor<ValueType, N>::compressBlock(
+    const BlockClusterTreeNode<N> &blockClusterTreeNode,
+    shared_ptr<HMatrixData<ValueType>> &hMatrixData) const {
+  CompressionStatistics statistics;
+  compressBlock(blockClusterTreeNode, hMatrixData, statistics);
+}
+
+template <typename ValueType, int N>
+void HMatrixCompressor<ValueType, N>::compressBlock(
+    const BlockClusterTreeNode<N> &blockClusterTreeNode,
+    shared_ptr<HMatrixData<ValueType>> &hMatrixData,
+    CompressionStatistics &statistics) const {
+
+  if (!isBeyondCutoff(blockClusterTreeNode)) {
+    compressBlockImpl(blockClusterTreeNode, hMatrixData, statistics);
+    return;
   }
 
-  compressBlockImpl(blockClusterTreeNode, hMatrixData);
+  // If admissible and beyond the cutoff create a zero HMatrix data block
+  IndexRangeType rowClusterRange;
+  IndexRangeType columnClusterRange;
+  std::size_t numberOfRows;
+  std::size_t numberOfColumns;
+  getBlockClusterTreeNodeDimensions(blockClusterTreeNode, rowClusterRange,
+                                    columnClusterRange, numberOfRows,
+                                    numberOfColumns);
+  hMatrixData.reset(new HMatrixLowRankData<ValueType>());
+  static_cast<HMatrixLowRankData<ValueType> *>(hMatrixData.get())
+      ->A()
+      .resize(numberOfRows, 0);
+  static_cast<HMatrixLowRankData<ValueType> *>(hMatrixData.get())
+      ->B()
+      .resize(0, numberOfColumns);
+}
+
+template <typename ValueType, int N>
+double HMatrixCompressor<ValueType, N>::estimateCost(
+    const BlockClusterTreeNode<N> &blockClusterTreeNode) const {
+
+  if (isBeyondCutoff(blockClusterTreeNode))
+    return 0;
+  return estimateCostImpl(blockClusterTreeNode);
+}
+
+template <typename ValueType, int N>
+double HMatrixCompressor<ValueType, N>::estimateCostImpl(
+    const BlockClusterTreeNode<N> &blockClusterTreeNode) const {
+
+  IndexRangeType rowClusterRange;
+  IndexRangeType columnClusterRange;
+  std::size_t numberOfRows;
+  std::size_t numberOfColumns;
+  getBlockClusterTreeNodeDimensions(blockClusterTreeNode, rowClusterRange,
+                                    columnClusterRange, numberOfRows,
+                                    numberOfColumns);
+  return static_cast<double>(numberOfRows) * numberOfColumns;
 }
 }
 #endif
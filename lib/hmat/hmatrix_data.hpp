@@ -17,6 +17,13 @@ public:
                      Eigen::Ref<Matrix<ValueType>> Y, TransposeMode trans,
                      ValueType alpha, ValueType beta) const = 0;
 
+  // Same as above but uses workspace for intermediate results. The
+  // workspace is only reallocated if it is too small.
+  virtual void apply(const Eigen::Ref<Matrix<ValueType>> &X,
+                     Eigen::Ref<Matrix<ValueType>> Y, TransposeMode trans,
+                     ValueType alpha, ValueType beta,
+                     Matrix<ValueType> &workspace) const = 0;
+
   virtual int rows() const = 0;
   virtual int cols() const = 0;
   virtual int rank() const = 0;
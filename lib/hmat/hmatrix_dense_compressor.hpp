@@ -18,7 +18,8 @@ public:
 protected:
   void compressBlockImpl(
       const BlockClusterTreeNode<N> &blockClusterTreeNode,
-      shared_ptr<HMatrixData<ValueType>> &hMatrixData) const override;
+      shared_ptr<HMatrixData<ValueType>> &hMatrixData,
+      CompressionStatistics &statistics) const override;
 
 private:
   const DataAccessor<ValueType, N> &m_dataAccessor;
@@ -16,7 +16,8 @@ HMatrixDenseCompressor<ValueType, N>::HMatrixDenseCompressor(
 template <typename ValueType, int N>
 void HMatrixDenseCompressor<ValueType, N>::compressBlockImpl(
     const BlockClusterTreeNode<N> &blockClusterTreeNode,
-    shared_ptr<HMatrixData<ValueType>> &hMatrixData) const {
+    shared_ptr<HMatrixData<ValueType>> &hMatrixData,
+    CompressionStatistics &statistics) const {
 
   auto rowIndexRange =
       blockClusterTreeNode.data().rowClusterTreeNode->data().indexRange;
@@ -31,6 +32,7 @@ void HMatrixDenseCompressor<ValueType, N>::compressBlockImpl(
 
   m_dataAccessor.computeMatrixBlock(rowIndexRange, columnIndexRange,
                                     blockClusterTreeNode, A);
+  statistics.evaluatedEntries += A.size();
 }
 }
 
@@ -16,6 +16,11 @@ public:
              Eigen::Ref<Matrix<ValueType>> Y, TransposeMode trans,
              ValueType alpha, ValueType beta) const override;
 
+  void apply(const Eigen::Ref<Matrix<ValueType>> &X,
+             Eigen::Ref<Matrix<ValueType>> Y, TransposeMode trans,
+             ValueType alpha, ValueType beta,
+             Matrix<ValueType> &workspace) const override;
+
   const Matrix<ValueType> &A() const;
   Matrix<ValueType> &A();
 
@@ -18,19 +18,28 @@ void HMatrixDenseData<ValueType>::apply(const Eigen::Ref<Matrix<ValueType>> &X,
 
   if (beta == ValueType(0))
     Y.setZero();
-  if (alpha == ValueType(0)) {
-    Y = beta * Y;
+  else if (beta != ValueType(1))
+    Y *= beta;
+  if (alpha == ValueType(0))
     return;
-  }
 
   if (trans == TransposeMode::NOTRANS)
-    Y = alpha * m_A * X + beta * Y;
+    Y.noalias() += alpha * m_A * X;
   else if (trans == TransposeMode::TRANS)
-    Y = alpha * m_A.transpose() * X + beta * Y;
+    Y.noalias() += alpha * m_A.transpose() * X;
   else if (trans == TransposeMode::CONJ)
-    Y = alpha * m_A.conjugate() * X + beta * Y;
+    Y.noalias() += alpha * m_A.conjugate() * X;
   else
-    Y = alpha * m_A.adjoint() * X + beta * Y;
+    Y.noalias() += alpha * m_A.adjoint() * X;
+}
+
+template <typename ValueType>
+void HMatrixDenseData<ValueType>::apply(const Eigen::Ref<Matrix<ValueType>> &X,
+                                        Eigen::Ref<Matrix<ValueType>> Y,
+                                        TransposeMode trans, ValueType alpha,
+                                        ValueType beta,
+                                        Matrix<ValueType> &) const {
+  apply(X, Y, trans, alpha, beta);
 }
 
 template <typename ValueType>
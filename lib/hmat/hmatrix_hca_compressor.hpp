@@ -0,0 +1,78 @@
+// vi: set et ts=4 sw=2 sts=2:
+
+#ifndef HMAT_HMATRIX_HCA_COMPRESSOR_HPP
+#define HMAT_HMATRIX_HCA_COMPRESSOR_HPP
+
+#include "common.hpp"
+#include "data_accessor.hpp"
+#include "eigen_fwd.hpp"
+#include "hmatrix_aca_compressor.hpp"
+#include "hmatrix_compressor.hpp"
+#include "../fmm/chebychev_tools.hpp"
+
+#include <vector>
+
+namespace hmat {
+
+// Hybrid cross approximation. The kernel is evaluated between Chebychev
+// nodes of the bounding boxes of the two clusters, or between the dofs
+// themselves if a cluster has fewer dofs than nodes. ACA with full pivoting
+// on this small point matrix selects pivot nodes, which are mapped to the
+// nearest dofs. Only the rows and columns of these dofs are computed by the
+// data accessor, and the block is approximated by the cross
+// G(:, J) * G(I, J)^+ * G(I, :).
+//
+// The data accessor must provide the dof positions and evaluate the kernel
+// at arbitrary points. Otherwise all blocks are compressed with ACA, since
+// pivots chosen with another kernel need not be good pivots of the block.
+// The cross is checked against a few further columns of the block. Blocks
+// that fail this check are also compressed with ACA.
+template <typename ValueType, int N>
+class HMatrixHcaCompressor : public HMatrixCompressor<ValueType, N> {
+public:
+  // An interpolation order of 0 chooses the order from eps.
+  HMatrixHcaCompressor(const DataAccessor<ValueType, N> &dataAccessor,
+                       double eps, unsigned int maxRank, double cutoff,
+                       int interpolationOrder = 0);
+
+protected:
+  void compressBlockImpl(
+      const BlockClusterTreeNode<N> &blockClusterTreeNode,
+      shared_ptr<HMatrixData<ValueType>> &hMatrixData,
+      CompressionStatistics &statistics) const override;
+
+  double estimateCostImpl(
+      const BlockClusterTreeNode<N> &blockClusterTreeNode) const override;
+
+private:
+  // Points that represent a cluster, either the tensor Chebychev nodes of
+  // its bounding box or the positions of its dofs, whichever are fewer.
+  // Directions in which the box is flat get a single node.
+  Matrix<double> interpolationPoints(const ClusterTreeNodeData &cluster,
+                                     const Matrix<double> &positions) const;
+
+  // ACA with full pivoting on the kernel matrix. Returns the pivot rows
+  // and columns, or false if more than m_maxRank pivots are needed.
+  bool selectPivots(Matrix<ValueType> kernel, std::vector<int> &rowPivots,
+                    std::vector<int> &columnPivots) const;
+
+  // Distinct dofs of the index range nearest to the given points.
+  static std::vector<std::size_t>
+  nearestDofs(const Matrix<double> &positions, const IndexRangeType &range,
+              const Matrix<double> &points, const std::vector<int> &pivots);
+
+  const DataAccessor<ValueType, N> &m_dataAccessor;
+  double m_eps;
+  unsigned int m_maxRank;
+  Fmm::ChebychevTools m_chebychevTools;
+  bool m_hasPositions;
+  bool m_hasKernel;
+  Matrix<double> m_testPositions;
+  Matrix<double> m_trialPositions;
+  HMatrixAcaCompressor<ValueType, N> m_hMatrixAcaCompressor;
+};
+}
+
+#include "hmatrix_hca_compressor_impl.hpp"
+
+#endif
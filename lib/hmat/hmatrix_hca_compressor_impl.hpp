@@ -0,0 +1,254 @@
+// vi: set et ts=4 sw=2 sts=2:
+
+#ifndef HMAT_HMATRIX_HCA_COMPRESSOR_IMPL_HPP
+#define HMAT_HMATRIX_HCA_COMPRESSOR_IMPL_HPP
+
+#include "hmatrix_hca_compressor.hpp"
+#include "hmatrix_low_rank_data.hpp"
+#include "math_helper.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+
+namespace hmat {
+
+template <typename ValueType, int N>
+HMatrixHcaCompressor<ValueType, N>::HMatrixHcaCompressor(
+    const DataAccessor<ValueType, N> &dataAccessor, double eps,
+    unsigned int maxRank, double cutoff, int interpolationOrder)
+    : HMatrixCompressor<ValueType, N>(cutoff), m_dataAccessor(dataAccessor),
+      m_eps(eps), m_maxRank(maxRank),
+      // One node per direction and digit of accuracy.
+      m_chebychevTools(interpolationOrder > 0
+                           ? interpolationOrder
+                           : std::min(6, std::max(2, static_cast<int>(std::ceil(
+                                                         -std::log10(eps)))))),
+      m_hMatrixAcaCompressor(dataAccessor, eps, maxRank, cutoff, true) {
+
+  m_hasPositions =
+      m_dataAccessor.dofPositions(m_testPositions, m_trialPositions);
+  Matrix<ValueType> values;
+  m_hasKernel = m_dataAccessor.evaluateKernel(Matrix<double>(3, 0),
+                                              Matrix<double>(3, 0), values);
+}
+
+template <typename ValueType, int N>
+Matrix<double> HMatrixHcaCompressor<ValueType, N>::interpolationPoints(
+    const ClusterTreeNodeData &cluster,
+    const Matrix<double> &positions) const {
+
+  const auto &nodes = m_chebychevTools.chebychevNodes();
+  const auto &bounds = cluster.boundingBox.bounds();
+
+  std::array<int, 3> counts;
+  std::size_t numberOfNodes = 1;
+  for (int d = 0; d < 3; ++d) {
+    double width = bounds[2 * d + 1] - bounds[2 * d];
+    counts[d] = (width > 1E-10 * cluster.diameter) ? nodes.size() : 1;
+    numberOfNodes *= counts[d];
+  }
+
+  auto numberOfDofs = cluster.indexRange[1] - cluster.indexRange[0];
+  if (numberOfDofs <= numberOfNodes)
+    return positions.middleCols(cluster.indexRange[0], numberOfDofs);
+
+  Matrix<double> points(3, numberOfNodes);
+  std::size_t index = 0;
+  for (int i = 0; i < counts[0]; ++i)
+    for (int j = 0; j < counts[1]; ++j)
+      for (int k = 0; k < counts[2]; ++k) {
+        std::array<int, 3> node = {{i, j, k}};
+        for (int d = 0; d < 3; ++d) {
+          double center = (bounds[2 * d] + bounds[2 * d + 1]) / 2;
+          double halfWidth = (bounds[2 * d + 1] - bounds[2 * d]) / 2;
+          points(d, index) =
+              (counts[d] == 1) ? center : center + halfWidth * nodes(node[d]);
+        }
+        ++index;
+      }
+  return points;
+}
+
+template <typename ValueType, int N>
+bool HMatrixHcaCompressor<ValueType, N>::selectPivots(
+    Matrix<ValueType> kernel, std::vector<int> &rowPivots,
+    std::vector<int> &columnPivots) const {
+
+  rowPivots.clear();
+  columnPivots.clear();
+
+  double firstPivot = 0;
+  while (rowPivots.size() < std::min(kernel.rows(), kernel.cols())) {
+    Eigen::Index i;
+    Eigen::Index j;
+    double pivot = kernel.cwiseAbs().maxCoeff(&i, &j);
+    if (rowPivots.empty())
+      firstPivot = pivot;
+    if (pivot <= m_eps * firstPivot)
+      break;
+    if (rowPivots.size() == m_maxRank)
+      return false;
+    rowPivots.push_back(i);
+    columnPivots.push_back(j);
+    Vector<ValueType> u = kernel.col(j) / kernel(i, j);
+    RowVector<ValueType> v = kernel.row(i);
+    kernel -= u * v;
+  }
+  return true;
+}
+
+template <typename ValueType, int N>
+std::vector<std::size_t> HMatrixHcaCompressor<ValueType, N>::nearestDofs(
+    const Matrix<double> &positions, const IndexRangeType &range,
+    const Matrix<double> &points, const std::vector<int> &pivots) {
+
+  std::vector<std::size_t> dofs;
+  for (int pivot : pivots) {
+    std::size_t nearest = range[0];
+    double minDistance = std::numeric_limits<double>::max();
+    for (std::size_t dof = range[0]; dof < range[1]; ++dof) {
+      double distance = (positions.col(dof) - points.col(pivot)).squaredNorm();
+      if (distance < minDistance) {
+        minDistance = distance;
+        nearest = dof;
+      }
+    }
+    dofs.push_back(nearest - range[0]);
+  }
+  std::sort(dofs.begin(), dofs.end());
+  dofs.erase(std::unique(dofs.begin(), dofs.end()), dofs.end());
+  return dofs;
+}
+
+template <typename ValueType, int N>
+void HMatrixHcaCompressor<ValueType, N>::compressBlockImpl(
+    const BlockClusterTreeNode<N> &blockClusterTreeNode,
+    shared_ptr<HMatrixData<ValueType>> &hMatrixData,
+    CompressionStatistics &statistics) const {
+
+  if (!blockClusterTreeNode.data().admissible || !m_hasPositions ||
+      !m_hasKernel) {
+    m_hMatrixAcaCompressor.compressBlock(blockClusterTreeNode, hMatrixData,
+                                         statistics);
+    return;
+  }
+
+  IndexRangeType rowClusterRange;
+  IndexRangeType columnClusterRange;
+  std::size_t numberOfRows;
+  std::size_t numberOfColumns;
+  getBlockClusterTreeNodeDimensions(blockClusterTreeNode, rowClusterRange,
+                                    columnClusterRange, numberOfRows,
+                                    numberOfColumns);
+
+  const auto &rowCluster =
+      blockClusterTreeNode.data().rowClusterTreeNode->data();
+  const auto &columnCluster =
+      blockClusterTreeNode.data().columnClusterTreeNode->data();
+
+  Matrix<double> rowPoints = interpolationPoints(rowCluster, m_testPositions);
+  Matrix<double> columnPoints =
+      interpolationPoints(columnCluster, m_trialPositions);
+
+  Matrix<ValueType> kernel;
+  bool hasKernel =
+      m_dataAccessor.evaluateKernel(rowPoints, columnPoints, kernel);
+
+  std::vector<int> rowPivots;
+  std::vector<int> columnPivots;
+  if (!hasKernel || !kernel.allFinite() ||
+      !selectPivots(kernel, rowPivots, columnPivots) || rowPivots.empty()) {
+    m_hMatrixAcaCompressor.compressBlock(blockClusterTreeNode, hMatrixData,
+                                         statistics);
+    return;
+  }
+  statistics.iterations += rowPivots.size();
+
+  auto rowDofs =
+      nearestDofs(m_testPositions, rowClusterRange, rowPoints, rowPivots);
+  auto columnDofs = nearestDofs(m_trialPositions, columnClusterRange,
+                                columnPoints, columnPivots);
+
+  // The only matrix entries computed are the rows and columns of the pivots.
+  Matrix<ValueType> data;
+  Matrix<ValueType> columns(numberOfRows, columnDofs.size());
+  for (std::size_t k = 0; k < columnDofs.size(); ++k) {
+    auto column = columnClusterRange[0] + columnDofs[k];
+    m_dataAccessor.computeMatrixBlock(rowClusterRange, {{column, column + 1}},
+                                      blockClusterTreeNode, data);
+    columns.col(k) = data;
+  }
+  Matrix<ValueType> rows(rowDofs.size(), numberOfColumns);
+  for (std::size_t k = 0; k < rowDofs.size(); ++k) {
+    auto row = rowClusterRange[0] + rowDofs[k];
+    m_dataAccessor.computeMatrixBlock({{row, row + 1}}, columnClusterRange,
+                                      blockClusterTreeNode, data);
+    rows.row(k) = data;
+  }
+  statistics.evaluatedEntries += columns.size() + rows.size();
+
+  // G = G(:, J) * G(I, J)^+ * G(I, :). The pseudo-inverse is truncated
+  // below eps, since the cross is recompressed to eps afterwards.
+  Matrix<ValueType> core(rowDofs.size(), columnDofs.size());
+  for (std::size_t j = 0; j < columnDofs.size(); ++j)
+    for (std::size_t i = 0; i < rowDofs.size(); ++i)
+      core(i, j) = columns(rowDofs[i], j);
+  Eigen::JacobiSVD<Matrix<ValueType>> svd(core, Eigen::ComputeThinU |
+                                                    Eigen::ComputeThinV);
+  auto rank = computeRank(svd, .1 * m_eps);
+
+  Matrix<ValueType> A = columns * svd.matrixV().leftCols(rank) *
+                        svd.singularValues()
+                            .head(rank)
+                            .cwiseInverse()
+                            .template cast<ValueType>()
+                            .asDiagonal();
+  Matrix<ValueType> B = svd.matrixU().leftCols(rank).adjoint() * rows;
+
+  // Compare a few columns of the block with the cross. The squared
+  // Frobenius norm of A * B is the trace of A^H * A * B * B^H.
+  const int numberOfChecks = 2;
+  double blockNorm = std::sqrt(std::abs(
+      (A.adjoint() * A).cwiseProduct((B * B.adjoint()).transpose()).sum()));
+  std::mt19937 generator(rowClusterRange[0] + 7919 * columnClusterRange[0]);
+  std::uniform_int_distribution<std::size_t> distribution(
+      0, numberOfColumns - 1);
+  bool accurate = rank > 0;
+  for (int check = 0; check < numberOfChecks && accurate; ++check) {
+    auto column = columnClusterRange[0] + distribution(generator);
+    m_dataAccessor.computeMatrixBlock(rowClusterRange, {{column, column + 1}},
+                                      blockClusterTreeNode, data);
+    statistics.evaluatedEntries += data.size();
+    double error = (data - A * B.col(column - columnClusterRange[0])).norm();
+    double reference =
+        std::max(data.norm(), blockNorm / std::sqrt(numberOfColumns));
+    accurate = error <= m_eps * reference;
+  }
+
+  bool success = false;
+  if (accurate)
+    truncateLowRank(A, B, m_eps, m_maxRank, success);
+
+  if (!success) {
+    m_hMatrixAcaCompressor.compressBlock(blockClusterTreeNode, hMatrixData,
+                                         statistics);
+    return;
+  }
+
+  hMatrixData.reset(new HMatrixLowRankData<ValueType>());
+  static_cast<HMatrixLowRankData<ValueType> *>(hMatrixData.get())->A().swap(A);
+  static_cast<HMatrixLowRankData<ValueType> *>(hMatrixData.get())->B().swap(B);
+}
+
+template <typename ValueType, int N>
+double HMatrixHcaCompressor<ValueType, N>::estimateCostImpl(
+    const BlockClusterTreeNode<N> &blockClusterTreeNode) const {
+
+  // One row and one column per pivot, as for ACA.
+  return m_hMatrixAcaCompressor.estimateCost(blockClusterTreeNode);
+}
+}
+
+#endif
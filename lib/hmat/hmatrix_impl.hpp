@@ -4,16 +4,25 @@
 #define HMAT_HMATRIX_IMPL_HPP
 
 #include "hmatrix.hpp"
+#include "binary_io.hpp"
 #include "hmatrix_data.hpp"
 #include "hmatrix_dense_data.hpp"
 #include "hmatrix_low_rank_data.hpp"
 #include "math_helper.hpp"
+#include "partition.hpp"
 #include <tbb/parallel_for.h>
 #include <tbb/parallel_for_each.h>
-#include <tbb/spin_mutex.h>
+#include <tbb/task_arena.h>
 #include <tbb/task_group.h>
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace hmat {
 
@@ -21,7 +30,11 @@ template <typename ValueType, int N>
 HMatrix<ValueType, N>::HMatrix(
     const shared_ptr<BlockClusterTree<N>> &blockClusterTree, MPI_Comm comm)
     : m_blockClusterTree(blockClusterTree), m_numberOfDenseBlocks(0),
-      m_numberOfLowRankBlocks(0), m_memSizeKb(0.0), m_comm(comm) {
+      m_numberOfLowRankBlocks(0), m_memSizeKb(0.0),
+      m_predictedImbalance(1.0), m_actualImbalance(1.0), m_comm(comm),
+      m_matVecStrategy(OWNER_COMPUTES), m_symmetry(UNSYMMETRIC),
+      m_matVecProfiling(false),
+      m_numberOfMatVecs(0), m_matVecTimes(std::array<double, 3>{{0, 0, 0}}) {
 
   MPI_Comm_size(comm, &m_nproc);
   MPI_Comm_rank(comm, &m_rank);
@@ -35,6 +48,15 @@ HMatrix<ValueType, N>::HMatrix(
   initialize(hMatrixCompressor);
 }
 
+template <typename ValueType, int N>
+HMatrix<ValueType, N>::HMatrix(
+    const shared_ptr<BlockClusterTree<N>> &blockClusterTree,
+    const HMatrixCompressor<ValueType, N> &hMatrixCompressor,
+    MatrixSymmetry symmetry, MPI_Comm comm)
+    : HMatrix<ValueType, N>(blockClusterTree, comm) {
+  initialize(hMatrixCompressor, symmetry);
+}
+
 template <typename ValueType, int N>
 std::size_t HMatrix<ValueType, N>::rows() const {
   return m_blockClusterTree->rows();
@@ -70,58 +92,535 @@ double HMatrix<ValueType, N>::memSizeKb() const {
   return m_memSizeKb;
 }
 
+template <typename ValueType, int N>
+double HMatrix<ValueType, N>::predictedImbalance() const {
+  return m_predictedImbalance;
+}
+
+template <typename ValueType, int N>
+double HMatrix<ValueType, N>::actualImbalance() const {
+  return m_actualImbalance;
+}
+
+template <typename ValueType, int N>
+HMatrixStatistics HMatrix<ValueType, N>::statistics() const {
+  HMatrixStatistics statistics = m_statistics;
+  statistics.numberOfMatVecs = m_numberOfMatVecs;
+  for (const auto &times : m_matVecTimes) {
+    statistics.matVecTime += times[0];
+    statistics.denseMatVecTime += times[1];
+    statistics.lowRankMatVecTime += times[2];
+  }
+  return statistics;
+}
+
+template <typename ValueType, int N>
+void HMatrix<ValueType, N>::setMatVecProfiling(bool value) {
+  if (value && !m_matVecProfiling) {
+    m_numberOfMatVecs = 0;
+    m_matVecTimes.clear();
+  }
+  m_matVecProfiling = value;
+}
+
+template <typename ValueType, int N>
+bool HMatrix<ValueType, N>::matVecProfiling() const {
+  return m_matVecProfiling;
+}
+
+template <typename ValueType, int N>
+void HMatrix<ValueType, N>::setMatVecStrategy(MatVecStrategy strategy) {
+  m_matVecStrategy = strategy;
+}
+
+template <typename ValueType, int N>
+MatVecStrategy HMatrix<ValueType, N>::matVecStrategy() const {
+  return m_matVecStrategy;
+}
+
+template <typename ValueType, int N>
+IndexRangeType HMatrix<ValueType, N>::ownedRange(RowColSelector rowOrColumn,
+                                                 int rank) const {
+  const auto &offsets = (rowOrColumn == ROW) ? m_rowOffsets : m_columnOffsets;
+  if (offsets.empty())
+    return IndexRangeType{{0, (rowOrColumn == ROW) ? rows() : columns()}};
+  return IndexRangeType{{offsets[rank], offsets[rank + 1]}};
+}
+
 template <typename ValueType, int N>
 void HMatrix<ValueType, N>::initialize(
-    const HMatrixCompressor<ValueType, N> &hMatrixCompressor) {
+    const HMatrixCompressor<ValueType, N> &hMatrixCompressor,
+    MatrixSymmetry symmetry) {
 
   reset();
 
   auto leafNodes = this->m_blockClusterTree->leafNodes();
 
-  // Type of a block cluster tree node.
-  typedef decltype(m_blockClusterTree->root()) node_t;
+  if (symmetry != UNSYMMETRIC) {
+    if (!m_blockClusterTree->rowClusterTree()->hasSameClusters(
+            *m_blockClusterTree->columnClusterTree()))
+      throw std::runtime_error("HMatrix::initialize: A symmetric matrix "
+                               "needs the same row and column clusters.");
+    if (m_nproc == 1)
+      m_symmetry = symmetry;
+  }
+
+  if (m_symmetry != UNSYMMETRIC) {
+    // Keep the leafs on and below the diagonal. Each leaf above the
+    // diagonal must have its mirror below.
+    std::vector<shared_ptr<BlockClusterTreeNode<N>>> lowerLeafs;
+    for (const auto &leaf : leafNodes) {
+      auto rowStart = leaf->data().rowClusterTreeNode->data().indexRange[0];
+      auto columnStart =
+          leaf->data().columnClusterTreeNode->data().indexRange[0];
+      if (rowStart >= columnStart) {
+        lowerLeafs.push_back(leaf);
+        continue;
+      }
+      auto mirrored = mirroredNode(*leaf);
+      if (!mirrored || !mirrored->isLeaf())
+        throw std::runtime_error("HMatrix::initialize: Block cluster tree "
+                                 "is not symmetric.");
+    }
+    if (2 * lowerLeafs.size() < leafNodes.size())
+      throw std::runtime_error("HMatrix::initialize: Block cluster tree "
+                               "is not symmetric.");
+    leafNodes.swap(lowerLeafs);
+  }
+
+  std::vector<double> costs(leafNodes.size());
+  tbb::parallel_for(tbb::blocked_range<std::size_t>(0, leafNodes.size()),
+                    [&](const tbb::blocked_range<std::size_t> &r) {
+                      for (auto index = r.begin(); index != r.end(); ++index)
+                        costs[index] =
+                            hMatrixCompressor.estimateCost(*leafNodes[index]);
+                    });
+
+  computePartition(leafNodes, costs);
+
+  std::vector<double> myCosts;
+  for (std::size_t index = 0; index < leafNodes.size(); ++index) {
+    const auto &leaf = leafNodes[index];
+    auto rowStart = leaf->data().rowClusterTreeNode->data().indexRange[0];
+    if (rowStart >= m_rowOffsets[m_rank] &&
+        rowStart < m_rowOffsets[m_rank + 1]) {
+      m_myLeafs.push_back(leaf);
+      myCosts.push_back(costs[index]);
+    }
+  }
+
+  std::size_t numberOfLeafs = m_myLeafs.size();
+
+  // Compress the most expensive leafs first. Each worker takes the next
+  // leaf from the sorted list when it becomes idle, so that a few large
+  // blocks do not finish last.
+  std::vector<std::size_t> order(numberOfLeafs);
+  for (std::size_t index = 0; index < numberOfLeafs; ++index)
+    order[index] = index;
+  std::stable_sort(begin(order), end(order),
+                   [&myCosts](std::size_t i, std::size_t j) {
+                     return myCosts[i] > myCosts[j];
+                   });
+
+  std::size_t numberOfWorkers =
+      std::max<std::size_t>(1, std::min<std::size_t>(
+                                   tbb::this_task_arena::max_concurrency(),
+                                   numberOfLeafs));
+  std::vector<double> busyTime(numberOfWorkers, 0);
+  std::atomic<std::size_t> nextLeaf(0);
+  m_statistics.leafs.resize(numberOfLeafs);
+
+  auto start = std::chrono::steady_clock::now();
 
-  // Sorting by size not necessary any more as a natural size
-  // ordering is induced by the breadth-first search of the
-  // leafs function that returns the leaf vector.
-  /*
+  tbb::parallel_for(
+      tbb::blocked_range<std::size_t>(0, numberOfWorkers, 1),
+      [&](const tbb::blocked_range<std::size_t> &r) {
+        for (auto worker = r.begin(); worker != r.end(); ++worker) {
+          auto workerStart = std::chrono::steady_clock::now();
+          std::size_t index;
+          while ((index = nextLeaf++) < numberOfLeafs) {
+            const auto &leaf = m_myLeafs[order[index]];
+            auto &leafStatistics = m_statistics.leafs[order[index]];
+            auto leafStart = std::chrono::steady_clock::now();
+            shared_ptr<HMatrixData<ValueType>> nodeData;
+            hMatrixCompressor.compressBlock(*leaf, nodeData,
+                                            leafStatistics.compression);
+            m_hMatrixData[leaf] = nodeData;
+            leafStatistics.time =
+                std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - leafStart)
+                    .count();
+            leafStatistics.rowRange =
+                leaf->data().rowClusterTreeNode->data().indexRange;
+            leafStatistics.columnRange =
+                leaf->data().columnClusterTreeNode->data().indexRange;
+            leafStatistics.type = nodeData->type();
+            leafStatistics.rank =
+                (nodeData->type() == DENSE) ? 0 : nodeData->rank();
+          }
+          busyTime[worker] = std::chrono::duration<double>(
+                                 std::chrono::steady_clock::now() - workerStart)
+                                 .count();
+        }
+      });
 
-    // Sort the leaf nodes by size.
-    std::stable_sort(
-        leafNodes.begin(), leafNodes.end(),
-        [&](const node_t &a, const node_t &b) -> bool {
-          auto rowRange_a = a->data().rowClusterTreeNode->data().indexRange;
-          auto colRange_a = a->data().columnClusterTreeNode->data().indexRange;
-          auto rowRange_b = b->data().rowClusterTreeNode->data().indexRange;
-          auto colRange_b = b->data().columnClusterTreeNode->data().indexRange;
+  double elapsed = std::chrono::duration<double>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  m_statistics.assemblyTime = elapsed;
+  m_statistics.threadBusyTimes = busyTime;
 
-          std::size_t size_a = std::max(rowRange_a[1] - rowRange_a[0],
-                                        colRange_a[1] - colRange_a[0]);
-          std::size_t size_b = std::max(rowRange_b[1] - rowRange_b[0],
-                                        colRange_b[1] - colRange_b[0]);
+  // Predicted and measured imbalance, across processes if there are
+  // several and across the workers otherwise.
+  auto imbalance = [](double maxLoad, double totalLoad, std::size_t parts) {
+    return (totalLoad > 0) ? maxLoad * parts / totalLoad : 1.;
+  };
 
-          // Sort in descending order
-          return size_a > size_b;
+  if (m_nproc > 1) {
+    double myCost = 0;
+    for (auto cost : myCosts)
+      myCost += cost;
+    double loads[2] = {myCost, elapsed};
+    double maxLoads[2];
+    double totalLoads[2];
+    MPI_Allreduce(loads, maxLoads, 2, MPI_DOUBLE, MPI_MAX, m_comm);
+    MPI_Allreduce(loads, totalLoads, 2, MPI_DOUBLE, MPI_SUM, m_comm);
+    m_predictedImbalance = imbalance(maxLoads[0], totalLoads[0], m_nproc);
+    m_actualImbalance = imbalance(maxLoads[1], totalLoads[1], m_nproc);
+  } else {
+    // Simulate the greedy assignment of the sorted leafs to the workers.
+    std::vector<double> workerLoads(numberOfWorkers, 0);
+    for (auto index : order)
+      *std::min_element(begin(workerLoads), end(workerLoads)) +=
+          myCosts[index];
+    double totalCost = 0;
+    for (auto cost : myCosts)
+      totalCost += cost;
+    m_predictedImbalance = imbalance(
+        *std::max_element(begin(workerLoads), end(workerLoads)), totalCost,
+        numberOfWorkers);
+    double totalTime = 0;
+    for (auto time : busyTime)
+      totalTime += time;
+    m_actualImbalance =
+        imbalance(*std::max_element(begin(busyTime), end(busyTime)), totalTime,
+                  numberOfWorkers);
+  }
+
+  updateLeafSchedules();
+  updateStatistics();
+
+  MPI_Barrier(m_comm);
+}
 
-        });
-  */
+template <typename ValueType, int N>
+void HMatrix<ValueType, N>::computePartition(
+    const std::vector<shared_ptr<BlockClusterTreeNode<N>>> &leafNodes,
+    const std::vector<double> &costs) {
+
+  m_rowOffsets = {0, rows()};
+  m_columnOffsets = {0, columns()};
+
+  if (m_nproc == 1)
+    return;
+
+  // The ranges are split at the boundaries of the clusters on a level with
+  // several clusters per process.
+  int cutDepth = 0;
+  for (int clusters = 1; clusters < 8 * m_nproc; clusters *= N)
+    ++cutDepth;
+
+  auto partitionUnits = [cutDepth](const ClusterTree<N> &clusterTree) {
+    std::vector<std::size_t> starts;
+    std::function<void(const shared_ptr<const ClusterTreeNode<N>> &, int)>
+        collect;
+    collect = [&](const shared_ptr<const ClusterTreeNode<N>> &node,
+                  int depth) {
+      if (depth == cutDepth || node->isLeaf()) {
+        starts.push_back(node->data().indexRange[0]);
+        return;
+      }
+      for (int i = 0; i < N; ++i)
+        collect(node->child(i), depth + 1);
+    };
+    collect(clusterTree.root(), 0);
+    starts.push_back(clusterTree.numberOfDofs());
+    return starts;
+  };
+
+  // Rows are balanced by the estimated work of the leafs starting in each
+  // unit.
+  auto rowStarts = partitionUnits(*m_blockClusterTree->rowClusterTree());
+  std::vector<double> rowCosts(rowStarts.size() - 1, 0);
+  for (std::size_t index = 0; index < leafNodes.size(); ++index) {
+    auto rowStart =
+        leafNodes[index]->data().rowClusterTreeNode->data().indexRange[0];
+    std::size_t unit =
+        std::upper_bound(begin(rowStarts), end(rowStarts), rowStart) -
+        begin(rowStarts) - 1;
+    rowCosts[unit] += costs[index];
+  }
+  m_rowOffsets = partitionByCost(rowStarts, rowCosts, m_nproc);
+
+  // Columns only receive output in transposed matvecs and are balanced by
+  // the number of dofs.
+  auto columnStarts = partitionUnits(*m_blockClusterTree->columnClusterTree());
+  std::vector<double> columnCosts(columnStarts.size() - 1);
+  for (std::size_t unit = 0; unit + 1 < columnStarts.size(); ++unit)
+    columnCosts[unit] = columnStarts[unit + 1] - columnStarts[unit];
+  m_columnOffsets = partitionByCost(columnStarts, columnCosts, m_nproc);
+}
 
-  for (int index = m_rank; index < leafNodes.size(); index += m_nproc)
-    m_myLeafs.push_back(leafNodes[index]);
+template <typename ValueType, int N>
+void HMatrix<ValueType, N>::updateLeafSchedules() {
 
   std::size_t numberOfLeafs = m_myLeafs.size();
+  auto allLeafs = [](std::size_t) { return true; };
+
+  // Reorder the leafs so that the leafs of each output cluster are
+  // contiguous in the row schedule.
+  m_leafIndices.clear();
+  for (std::size_t index = 0; index < numberOfLeafs; ++index)
+    m_leafIndices[m_myLeafs[index].get()] = index;
+  LeafSchedule rowSchedule;
+  computeLeafSchedule(ROW, allLeafs, rowSchedule);
+  std::vector<shared_ptr<BlockClusterTreeNode<N>>> orderedLeafs;
+  orderedLeafs.reserve(numberOfLeafs);
+  for (const auto &phase : rowSchedule)
+    for (const auto &group : phase)
+      for (auto index : group)
+        orderedLeafs.push_back(m_myLeafs[index]);
+  m_myLeafs.swap(orderedLeafs);
+
+  for (std::size_t index = 0; index < numberOfLeafs; ++index)
+    m_leafIndices[m_myLeafs[index].get()] = index;
+
+  computeCommunicationPlan(ROW, m_rowPlan);
+  computeCommunicationPlan(COL, m_columnPlan);
+  updateMirroredSchedules();
+}
 
-  tbb::parallel_for(tbb::blocked_range<std::size_t>(0, numberOfLeafs),
-                    [&](const tbb::blocked_range<std::size_t> &r) {
-                      for (auto index = r.begin(); index != r.end(); index++) {
-                        shared_ptr<HMatrixData<ValueType>> nodeData;
-                        hMatrixCompressor.compressBlock(*m_myLeafs[index],
-                                                        nodeData);
-                        m_hMatrixData[m_myLeafs[index]] = nodeData;
-                      }
-                    });
+template <typename ValueType, int N>
+void HMatrix<ValueType, N>::updateMirroredSchedules() {
+
+  m_offDiagonalLeafs.clear();
+  m_mirroredRowSchedule.clear();
+  m_mirroredColumnSchedule.clear();
+  if (m_symmetry == UNSYMMETRIC)
+    return;
+
+  // Diagonal leafs are stored completely and have no mirror.
+  std::vector<char> isOffDiagonal(m_myLeafs.size(), 0);
+  for (std::size_t index = 0; index < m_myLeafs.size(); ++index) {
+    const auto &leafData = m_myLeafs[index]->data();
+    if (leafData.rowClusterTreeNode->data().indexRange[0] !=
+        leafData.columnClusterTreeNode->data().indexRange[0]) {
+      isOffDiagonal[index] = 1;
+      m_offDiagonalLeafs.push_back(index);
+    }
+  }
+
+  auto offDiagonal = [&isOffDiagonal](std::size_t index) {
+    return isOffDiagonal[index] != 0;
+  };
+  computeLeafSchedule(ROW, offDiagonal, m_mirroredRowSchedule);
+  computeLeafSchedule(COL, offDiagonal, m_mirroredColumnSchedule);
+}
+
+template <typename ValueType, int N>
+shared_ptr<BlockClusterTreeNode<N>>
+HMatrix<ValueType, N>::mirroredNode(const BlockClusterTreeNode<N> &node) const {
+
+  auto rowRange = node.data().columnClusterTreeNode->data().indexRange;
+  auto columnRange = node.data().rowClusterTreeNode->data().indexRange;
+  auto contains = [](const IndexRangeType &outer, const IndexRangeType &inner) {
+    return outer[0] <= inner[0] && inner[1] <= outer[1];
+  };
+
+  // Descend to the block with the swapped ranges.
+  auto current = m_blockClusterTree->root();
+  while (true) {
+    const auto &data = current->data();
+    if (data.rowClusterTreeNode->data().indexRange == rowRange &&
+        data.columnClusterTreeNode->data().indexRange == columnRange)
+      return current;
+    if (current->isLeaf())
+      return shared_ptr<BlockClusterTreeNode<N>>();
+    shared_ptr<BlockClusterTreeNode<N>> next;
+    for (int i = 0; i < N * N && !next; ++i) {
+      const auto &childData = current->child(i)->data();
+      if (contains(childData.rowClusterTreeNode->data().indexRange,
+                   rowRange) &&
+          contains(childData.columnClusterTreeNode->data().indexRange,
+                   columnRange))
+        next = current->child(i);
+    }
+    if (!next)
+      return next;
+    current = next;
+  }
+}
+
+template <typename ValueType, int N>
+shared_ptr<HMatrixData<ValueType>>
+HMatrix<ValueType, N>::mirroredData(const HMatrixData<ValueType> &data) const {
+
+  bool adjoint = (m_symmetry == HERMITIAN);
+
+  if (data.type() == DENSE) {
+    const auto &A = static_cast<const HMatrixDenseData<ValueType> &>(data).A();
+    auto result = make_shared<HMatrixDenseData<ValueType>>();
+    if (adjoint)
+      result->A() = A.adjoint();
+    else
+      result->A() = A.transpose();
+    return result;
+  }
+
+  // (A * B)^T = B^T * A^T
+  const auto &lowRankData =
+      static_cast<const HMatrixLowRankData<ValueType> &>(data);
+  Matrix<ValueType> A;
+  Matrix<ValueType> B;
+  if (adjoint) {
+    A = lowRankData.B().adjoint();
+    B = lowRankData.A().adjoint();
+  } else {
+    A = lowRankData.B().transpose();
+    B = lowRankData.A().transpose();
+  }
+  return shared_ptr<HMatrixData<ValueType>>(
+      new HMatrixLowRankData<ValueType>(A, B));
+}
+
+template <typename ValueType, int N>
+TransposeMode
+HMatrix<ValueType, N>::mirroredTransposeMode(TransposeMode trans) const {
+
+  // The block above the diagonal is B^T or B^H for the stored block B.
+  if (m_symmetry == HERMITIAN)
+    switch (trans) {
+    case NOTRANS:
+      return CONJTRANS;
+    case TRANS:
+      return CONJ;
+    case CONJ:
+      return TRANS;
+    default:
+      return NOTRANS;
+    }
+
+  switch (trans) {
+  case NOTRANS:
+    return TRANS;
+  case TRANS:
+    return NOTRANS;
+  case CONJ:
+    return CONJTRANS;
+  default:
+    return CONJ;
+  }
+}
+
+template <typename ValueType, int N>
+void HMatrix<ValueType, N>::expandSymmetry() {
 
-  // Compute statistics
+  if (m_symmetry == UNSYMMETRIC)
+    return;
+
+  bool packed = isPacked();
+  StoragePrecision precision = storagePrecision();
+  unpackLeafData();
+
+  for (const auto &leaf : m_blockClusterTree->leafNodes())
+    if (!m_leafIndices.count(leaf.get()))
+      m_hMatrixData[leaf] =
+          mirroredData(*m_hMatrixData.at(mirroredNode(*leaf)));
+
+  m_symmetry = UNSYMMETRIC;
+  m_myLeafs = m_blockClusterTree->leafNodes();
+  updateLeafSchedules();
+
+  if (packed)
+    packLeafData(precision);
+  else
+    updateStatistics();
+}
+
+template <typename ValueType, int N>
+void HMatrix<ValueType, N>::computeCommunicationPlan(
+    RowColSelector rowOrColumn, CommunicationPlan &plan) const {
+
+  const auto &offsets = (rowOrColumn == ROW) ? m_rowOffsets : m_columnOffsets;
+  std::size_t ownStart = offsets[m_rank];
+  std::size_t ownEnd = offsets[m_rank + 1];
+
+  plan.receiveRanges.assign(m_nproc, IndexRangeType{{0, 0}});
+  plan.remoteLeafs.clear();
+  plan.localLeafs.clear();
+
+  std::vector<char> isRemote(m_myLeafs.size(), 0);
+  std::vector<IndexRangeType> remoteRanges;
+  for (std::size_t index = 0; index < m_myLeafs.size(); ++index) {
+    const auto &leafData = m_myLeafs[index]->data();
+    const auto &range = (rowOrColumn == ROW)
+                            ? leafData.rowClusterTreeNode->data().indexRange
+                            : leafData.columnClusterTreeNode->data().indexRange;
+    if (range[0] >= ownStart && range[1] <= ownEnd) {
+      plan.localLeafs.push_back(index);
+      continue;
+    }
+    isRemote[index] = 1;
+    plan.remoteLeafs.push_back(index);
+    remoteRanges.push_back(range);
+  }
+  plan.sendRanges = partitionSendRanges(offsets, m_rank, remoteRanges);
+
+  computeLeafSchedule(rowOrColumn,
+                      [&isRemote](std::size_t index) {
+                        return isRemote[index] != 0;
+                      },
+                      plan.remoteSchedule);
+  computeLeafSchedule(rowOrColumn,
+                      [&isRemote](std::size_t index) {
+                        return isRemote[index] == 0;
+                      },
+                      plan.localSchedule);
+
+  if (m_nproc == 1)
+    return;
+
+  // Tell every process which part of its range it receives from us.
+  std::vector<unsigned long long> sendBuffer(2 * m_nproc);
+  std::vector<unsigned long long> receiveBuffer(2 * m_nproc);
+  for (int proc = 0; proc < m_nproc; ++proc) {
+    sendBuffer[2 * proc] = plan.sendRanges[proc][0];
+    sendBuffer[2 * proc + 1] = plan.sendRanges[proc][1];
+  }
+  MPI_Alltoall(sendBuffer.data(), 2, MPI_UNSIGNED_LONG_LONG,
+               receiveBuffer.data(), 2, MPI_UNSIGNED_LONG_LONG, m_comm);
+  for (int proc = 0; proc < m_nproc; ++proc)
+    plan.receiveRanges[proc] = IndexRangeType{
+        {receiveBuffer[2 * proc], receiveBuffer[2 * proc + 1]}};
+}
+
+template <typename ValueType, int N>
+void HMatrix<ValueType, N>::updateStatistics() {
+
+  m_numberOfDenseBlocks = 0;
+  m_numberOfLowRankBlocks = 0;
+  m_memSizeKb = 0;
+
+  if (m_compactStorage) {
+    for (std::size_t index = 0; index < m_compactStorage->numberOfLeafs();
+         ++index)
+      if (m_compactStorage->record(index).type == DENSE)
+        m_numberOfDenseBlocks++;
+      else
+        m_numberOfLowRankBlocks++;
+    m_memSizeKb = m_compactStorage->memSizeKb();
+    return;
+  }
 
   for (auto &elem : m_hMatrixData) {
     if (!elem.second)
@@ -132,16 +631,148 @@ void HMatrix<ValueType, N>::initialize(
       m_numberOfLowRankBlocks++;
     m_memSizeKb += elem.second->memSizeKb();
   }
-  MPI_Barrier(m_comm);
 }
 
 template <typename ValueType, int N> void HMatrix<ValueType, N>::reset() {
   m_hMatrixData.clear();
+  m_compactStorage.reset();
+  m_myLeafs.clear();
+  m_leafIndices.clear();
+  m_rowPlan = CommunicationPlan();
+  m_columnPlan = CommunicationPlan();
+  m_symmetry = UNSYMMETRIC;
+  m_offDiagonalLeafs.clear();
+  m_mirroredRowSchedule.clear();
+  m_mirroredColumnSchedule.clear();
+  m_statistics = HMatrixStatistics();
+  m_numberOfMatVecs = 0;
+  m_matVecTimes.clear();
+  m_numberOfDenseBlocks = 0;
+  m_numberOfLowRankBlocks = 0;
+  m_memSizeKb = 0;
+}
+
+template <typename ValueType, int N>
+void HMatrix<ValueType, N>::computeLeafSchedule(
+    RowColSelector rowOrColumn,
+    const std::function<bool(std::size_t)> &selected,
+    LeafSchedule &schedule) const {
+
+  typedef const ClusterTreeNode<N> *cluster_t;
+
+  schedule.clear();
+
+  // Below cutDepth leafs are grouped by their ancestor cluster on level
+  // cutDepth. Choose it such that there are enough groups to keep all
+  // threads busy.
+  std::size_t targetNumberOfGroups =
+      8 * static_cast<std::size_t>(tbb::this_task_arena::max_concurrency());
+  int cutDepth = 0;
+  for (std::size_t groups = 1; groups < targetNumberOfGroups; groups *= N)
+    ++cutDepth;
+
+  // Leafs above cutDepth go into one phase per level, grouped by their own
+  // output cluster. All deeper leafs go into the last phase.
+  std::vector<std::map<cluster_t, std::vector<std::size_t>>> phases(cutDepth +
+                                                                    1);
+
+  std::function<void(const shared_ptr<BlockClusterTreeNode<N>> &, int,
+                     cluster_t)> traverse;
+
+  traverse = [&](const shared_ptr<BlockClusterTreeNode<N>> &node, int depth,
+                 cluster_t owner) {
+
+    if (depth <= cutDepth)
+      owner = (rowOrColumn == ROW) ? node->data().rowClusterTreeNode.get()
+                                   : node->data().columnClusterTreeNode.get();
+
+    if (node->isLeaf()) {
+      auto it = m_leafIndices.find(node.get());
+      if (it != m_leafIndices.end() && selected(it->second))
+        phases[std::min(depth, cutDepth)][owner].push_back(it->second);
+      return;
+    }
+
+    for (int i = 0; i < N * N; ++i)
+      traverse(node->child(i), depth + 1, owner);
+  };
+
+  traverse(m_blockClusterTree->root(), 0, nullptr);
+
+  for (const auto &phase : phases) {
+    if (phase.empty())
+      continue;
+    schedule.push_back(std::vector<std::vector<std::size_t>>());
+    for (const auto &group : phase)
+      schedule.back().push_back(group.second);
+  }
+}
+
+template <typename ValueType, int N>
+MatrixSymmetry HMatrix<ValueType, N>::symmetry() const {
+  return m_symmetry;
 }
 
 template <typename ValueType, int N>
 bool HMatrix<ValueType, N>::isInitialized() const {
-  return (!m_hMatrixData.empty());
+  return (!m_hMatrixData.empty() || m_compactStorage);
+}
+
+template <typename ValueType, int N>
+void HMatrix<ValueType, N>::packLeafData(StoragePrecision precision) {
+
+  if (m_compactStorage) {
+    if (m_compactStorage->precision() == precision)
+      return;
+    unpackLeafData();
+  }
+
+  m_compactStorage = packedStorage(precision);
+  m_hMatrixData.clear();
+
+  updateStatistics();
+}
+
+template <typename ValueType, int N>
+shared_ptr<HMatrixCompactStorage<ValueType>>
+HMatrix<ValueType, N>::packedStorage(StoragePrecision precision) const {
+
+  std::vector<IndexRangeType> rowRanges;
+  std::vector<IndexRangeType> columnRanges;
+  std::vector<shared_ptr<const HMatrixData<ValueType>>> leafData;
+
+  for (const auto &leaf : m_myLeafs) {
+    rowRanges.push_back(leaf->data().rowClusterTreeNode->data().indexRange);
+    columnRanges.push_back(
+        leaf->data().columnClusterTreeNode->data().indexRange);
+    leafData.push_back(m_hMatrixData.at(leaf));
+  }
+
+  return shared_ptr<HMatrixCompactStorage<ValueType>>(
+      new HMatrixCompactStorage<ValueType>(rowRanges, columnRanges, leafData,
+                                           precision));
+}
+
+template <typename ValueType, int N>
+void HMatrix<ValueType, N>::unpackLeafData() {
+
+  if (!m_compactStorage)
+    return;
+
+  for (std::size_t index = 0; index < m_myLeafs.size(); ++index)
+    m_hMatrixData[m_myLeafs[index]] = m_compactStorage->data(index);
+
+  m_compactStorage.reset();
+}
+
+template <typename ValueType, int N>
+bool HMatrix<ValueType, N>::isPacked() const {
+  return static_cast<bool>(m_compactStorage);
+}
+
+template <typename ValueType, int N>
+StoragePrecision HMatrix<ValueType, N>::storagePrecision() const {
+  return m_compactStorage ? m_compactStorage->precision() : NATIVE_PRECISION;
 }
 
 template <typename ValueType, int N>
@@ -153,6 +784,13 @@ HMatrix<ValueType, N>::blockClusterTree() const {
 template <typename ValueType, int N>
 shared_ptr<const HMatrixData<ValueType>> HMatrix<ValueType, N>::data(
     shared_ptr<const BlockClusterTreeNode<N>> node) const {
+  if (m_symmetry != UNSYMMETRIC && !m_leafIndices.count(node.get())) {
+    auto mirrored = mirroredNode(*node);
+    if (mirrored && m_leafIndices.count(mirrored.get()))
+      return mirroredData(*data(mirrored));
+  }
+  if (m_compactStorage)
+    return m_compactStorage->data(m_leafIndices.at(node.get()));
   return this->m_hMatrixData.at(
       const_pointer_cast<BlockClusterTreeNode<N>>(node));
 }
@@ -163,20 +801,7 @@ Matrix<ValueType> HMatrix<ValueType, N>::permuteMatToHMatDofs(
     RowColSelector rowOrColumn) const {
 
   Matrix<ValueType> permutedDofs(mat.rows(), mat.cols());
-
-  shared_ptr<const ClusterTree<N>> clusterTree;
-
-  if (rowOrColumn == ROW)
-    clusterTree = m_blockClusterTree->rowClusterTree();
-  else
-    clusterTree = m_blockClusterTree->columnClusterTree();
-
-  for (std::size_t i = 0; i < mat.rows(); ++i) {
-    auto permutedIndex = clusterTree->mapOriginalDofToHMatDof(i);
-    for (std::size_t j = 0; j < mat.cols(); ++j)
-      permutedDofs(permutedIndex, j) = mat(i, j);
-  }
-
+  permuteMatToHMatDofs(mat, rowOrColumn, permutedDofs);
   return permutedDofs;
 }
 
@@ -186,21 +811,48 @@ Matrix<ValueType> HMatrix<ValueType, N>::permuteMatToOriginalDofs(
     RowColSelector rowOrColumn) const {
 
   Matrix<ValueType> originalDofs(mat.rows(), mat.cols());
+  permuteMatToOriginalDofs(mat, rowOrColumn, originalDofs);
+  return originalDofs;
+}
 
-  shared_ptr<const ClusterTree<N>> clusterTree;
-
-  if (rowOrColumn == ROW)
-    clusterTree = m_blockClusterTree->rowClusterTree();
-  else
-    clusterTree = m_blockClusterTree->columnClusterTree();
-
-  for (std::size_t i = 0; i < mat.rows(); ++i) {
-    auto originalIndex = clusterTree->mapHMatDofToOriginalDof(i);
-    for (std::size_t j = 0; j < mat.cols(); ++j)
-      originalDofs(originalIndex, j) = mat(i, j);
-  }
+template <typename ValueType, int N>
+void HMatrix<ValueType, N>::permuteMatToHMatDofs(
+    const Eigen::Ref<Matrix<ValueType>> &mat, RowColSelector rowOrColumn,
+    Eigen::Ref<Matrix<ValueType>> result) const {
+
+  const auto &clusterTree = (rowOrColumn == ROW)
+                                ? *m_blockClusterTree->rowClusterTree()
+                                : *m_blockClusterTree->columnClusterTree();
+
+  // Column by column, so that the reads are contiguous and the scattered
+  // writes stay within one column of the result.
+  auto permuteColumns = [&](const tbb::blocked_range<Eigen::Index> &r) {
+    for (auto j = r.begin(); j != r.end(); ++j)
+      for (Eigen::Index i = 0; i < mat.rows(); ++i)
+        result(clusterTree.mapOriginalDofToHMatDof(i), j) = mat(i, j);
+  };
+  tbb::parallel_for(tbb::blocked_range<Eigen::Index>(0, mat.cols()),
+                    permuteColumns);
+}
 
-  return originalDofs;
+template <typename ValueType, int N>
+void HMatrix<ValueType, N>::permuteMatToOriginalDofs(
+    const Eigen::Ref<Matrix<ValueType>> &mat, RowColSelector rowOrColumn,
+    Eigen::Ref<Matrix<ValueType>> result) const {
+
+  const auto &clusterTree = (rowOrColumn == ROW)
+                                ? *m_blockClusterTree->rowClusterTree()
+                                : *m_blockClusterTree->columnClusterTree();
+
+  // Column by column, so that the reads are contiguous and the scattered
+  // writes stay within one column of the result.
+  auto permuteColumns = [&](const tbb::blocked_range<Eigen::Index> &r) {
+    for (auto j = r.begin(); j != r.end(); ++j)
+      for (Eigen::Index i = 0; i < mat.rows(); ++i)
+        result(clusterTree.mapHMatDofToOriginalDof(i), j) = mat(i, j);
+  };
+  tbb::parallel_for(tbb::blocked_range<Eigen::Index>(0, mat.cols()),
+                    permuteColumns);
 }
 
 template <typename ValueType, int N>
@@ -209,95 +861,1062 @@ void HMatrix<ValueType, N>::apply(const Eigen::Ref<Matrix<ValueType>> &X,
                                   TransposeMode trans, ValueType alpha,
                                   ValueType beta) const {
 
-  if (beta == ValueType(0) || m_rank != 0)
-    Y.setZero();
+  RowColSelector xSelector = COL;
+  RowColSelector ySelector = ROW;
+  if (trans == TransposeMode::TRANS || trans == TransposeMode::CONJTRANS)
+    std::swap(xSelector, ySelector);
+
+  Matrix<ValueType> xPermuted(X.rows(), X.cols());
+  Matrix<ValueType> yPermuted(Y.rows(), Y.cols());
+
+  permuteMatToHMatDofs(X, xSelector, xPermuted);
+  if (beta != ValueType(0))
+    permuteMatToHMatDofs(Y, ySelector, yPermuted);
+
+  applyPermuted(xPermuted, yPermuted, trans, alpha, beta);
+
+  permuteMatToOriginalDofs(yPermuted, ySelector, Y);
+}
+
+template <typename ValueType, int N>
+void HMatrix<ValueType, N>::applyPermuted(
+    const Eigen::Ref<Matrix<ValueType>> &X, Eigen::Ref<Matrix<ValueType>> Y,
+    TransposeMode trans, ValueType alpha, ValueType beta) const {
+
+  if (!m_matVecProfiling) {
+    applyPermuted_impl(X, Y, trans, alpha, beta);
+    return;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  applyPermuted_impl(X, Y, trans, alpha, beta);
+  m_matVecTimes.local()[0] += std::chrono::duration<double>(
+                                  std::chrono::steady_clock::now() - start)
+                                  .count();
+  ++m_numberOfMatVecs;
+}
+
+template <typename ValueType, int N>
+void HMatrix<ValueType, N>::applyPermuted_impl(
+    const Eigen::Ref<Matrix<ValueType>> &X, Eigen::Ref<Matrix<ValueType>> Y,
+    TransposeMode trans, ValueType alpha, ValueType beta) const {
+
+  bool notTransposed =
+      (trans == TransposeMode::NOTRANS || trans == TransposeMode::CONJ);
+  const auto &plan = notTransposed ? m_rowPlan : m_columnPlan;
+
+  if (m_nproc == 1) {
+    if (beta == ValueType(0))
+      Y.setZero();
+    else if (beta != ValueType(1))
+      Y *= beta;
+    apply_impl(X, Y, trans, alpha, plan.localSchedule, plan.localLeafs);
+    // The leafs below the diagonal once more for their mirrors, which
+    // write to the output ranges of the other ordering.
+    if (m_symmetry != UNSYMMETRIC)
+      apply_impl(X, Y, mirroredTransposeMode(trans), alpha,
+                 notTransposed ? m_mirroredColumnSchedule
+                               : m_mirroredRowSchedule,
+                 m_offDiagonalLeafs);
+    return;
+  }
+
+  // Each process only keeps beta * Y in its own range. The partial results
+  // of the other ranges are sent to their owners, and the complete result
+  // is gathered at the end.
+
+  const auto &offsets = notTransposed ? m_rowOffsets : m_columnOffsets;
+  std::size_t ownStart = offsets[m_rank];
+  std::size_t ownSize = offsets[m_rank + 1] - ownStart;
+  auto cols = Y.cols();
+  MPI_Datatype type = MpiTrait<ValueType>().type;
+  const int tag = 0;
+
+  Y.topRows(ownStart).setZero();
+  Y.bottomRows(Y.rows() - ownStart - ownSize).setZero();
+  if (beta == ValueType(0))
+    Y.middleRows(ownStart, ownSize).setZero();
+  else if (beta != ValueType(1))
+    Y.middleRows(ownStart, ownSize) *= beta;
+
+  std::vector<MPI_Request> receiveRequests;
+  std::vector<MPI_Request> sendRequests;
+  std::vector<Matrix<ValueType>> receiveBuffers(m_nproc);
+  std::vector<Matrix<ValueType>> sendBuffers(m_nproc);
+
+  for (int proc = 0; proc < m_nproc; ++proc) {
+    const auto &range = plan.receiveRanges[proc];
+    if (range[0] == range[1])
+      continue;
+    receiveBuffers[proc].resize(range[1] - range[0], cols);
+    receiveRequests.push_back(MPI_Request());
+    MPI_Irecv(receiveBuffers[proc].data(), receiveBuffers[proc].size(), type,
+              proc, tag, m_comm, &receiveRequests.back());
+  }
+
+  apply_impl(X, Y, trans, alpha, plan.remoteSchedule, plan.remoteLeafs);
+
+  for (int proc = 0; proc < m_nproc; ++proc) {
+    const auto &range = plan.sendRanges[proc];
+    if (range[0] == range[1])
+      continue;
+    sendBuffers[proc] = Y.middleRows(range[0], range[1] - range[0]);
+    sendRequests.push_back(MPI_Request());
+    MPI_Isend(sendBuffers[proc].data(), sendBuffers[proc].size(), type, proc,
+              tag, m_comm, &sendRequests.back());
+  }
+
+  apply_impl(X, Y, trans, alpha, plan.localSchedule, plan.localLeafs);
+
+  MPI_Waitall(receiveRequests.size(), receiveRequests.data(),
+              MPI_STATUSES_IGNORE);
+  for (int proc = 0; proc < m_nproc; ++proc) {
+    const auto &range = plan.receiveRanges[proc];
+    if (range[0] != range[1])
+      Y.middleRows(range[0], range[1] - range[0]) += receiveBuffers[proc];
+  }
+
+  // Gather the owned ranges. Rows of a range are contiguous in row major
+  // storage.
+  std::vector<int> counts(m_nproc);
+  std::vector<int> displacements(m_nproc);
+  for (int proc = 0; proc < m_nproc; ++proc) {
+    counts[proc] = (offsets[proc + 1] - offsets[proc]) * cols;
+    displacements[proc] = offsets[proc] * cols;
+  }
+
+  if (cols == 1 && Y.innerStride() == 1)
+    MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, Y.data(), counts.data(),
+                   displacements.data(), type, m_comm);
   else {
-    Y *= beta;
+    Eigen::Matrix<ValueType, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor>
+        globalY(Y.rows(), cols);
+    globalY.middleRows(ownStart, ownSize) = Y.middleRows(ownStart, ownSize);
+    MPI_Allgatherv(MPI_IN_PLACE, 0, MPI_DATATYPE_NULL, globalY.data(),
+                   counts.data(), displacements.data(), type, m_comm);
+    Y = globalY;
   }
 
-  Matrix<ValueType> xPermuted;
-  Matrix<ValueType> yPermuted;
+  MPI_Waitall(sendRequests.size(), sendRequests.data(), MPI_STATUSES_IGNORE);
+}
+
+template <typename ValueType, int N>
+void HMatrix<ValueType, N>::apply_impl(
+    const Eigen::Ref<Matrix<ValueType>> &X, Eigen::Ref<Matrix<ValueType>> Y,
+    TransposeMode trans, ValueType alpha, const LeafSchedule &schedule,
+    const std::vector<std::size_t> &leafs) const {
+
+  if (m_matVecStrategy == THREAD_LOCAL)
+    apply_impl_threadLocal(X, Y, trans, alpha, leafs);
+  else
+    apply_impl_ownerComputes(X, Y, trans, alpha, schedule);
+}
 
-  if (trans == TransposeMode::NOTRANS || trans == TransposeMode::CONJ) {
+template <typename ValueType, int N>
+void HMatrix<ValueType, N>::applyLeaf(std::size_t leafIndex,
+                                      const Eigen::Ref<Matrix<ValueType>> &X,
+                                      Eigen::Ref<Matrix<ValueType>> Y,
+                                      TransposeMode trans, ValueType alpha,
+                                      Matrix<ValueType> &workspace) const {
+
+  if (!m_matVecProfiling) {
+    applyLeafData(leafIndex, X, Y, trans, alpha, workspace);
+    return;
+  }
 
-    xPermuted = alpha * permuteMatToHMatDofs(X, COL);
-    yPermuted = permuteMatToHMatDofs(Y, ROW);
+  auto start = std::chrono::steady_clock::now();
+  applyLeafData(leafIndex, X, Y, trans, alpha, workspace);
+  double time = std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - start)
+                    .count();
 
-  } else {
+  DataBlockType type =
+      m_compactStorage ? m_compactStorage->record(leafIndex).type
+                       : m_hMatrixData.at(m_myLeafs[leafIndex])->type();
+  m_matVecTimes.local()[type == DENSE ? 1 : 2] += time;
+}
 
-    xPermuted = alpha * permuteMatToHMatDofs(X, ROW);
-    yPermuted = permuteMatToHMatDofs(Y, COL);
+template <typename ValueType, int N>
+void HMatrix<ValueType, N>::applyLeafData(
+    std::size_t leafIndex, const Eigen::Ref<Matrix<ValueType>> &X,
+    Eigen::Ref<Matrix<ValueType>> Y, TransposeMode trans, ValueType alpha,
+    Matrix<ValueType> &workspace) const {
+
+  if (m_compactStorage) {
+    m_compactStorage->apply(leafIndex, X, Y, trans, alpha, workspace);
+    return;
   }
 
-  std::size_t numberOfLeafs = m_myLeafs.size();
-  auto cols = xPermuted.cols();
+  // Eigen::Ref does not accept blocks of a const reference.
+  auto &xNoConst = const_cast<Eigen::Ref<Matrix<ValueType>> &>(X);
+
+  const auto &leaf = m_myLeafs[leafIndex];
+  auto rowRange = leaf->data().rowClusterTreeNode->data().indexRange;
+  auto colRange = leaf->data().columnClusterTreeNode->data().indexRange;
+  auto cols = X.cols();
+
+  if (trans == TransposeMode::NOTRANS || trans == TransposeMode::CONJ)
+    m_hMatrixData.at(leaf)->apply(
+        xNoConst.block(colRange[0], 0, colRange[1] - colRange[0], cols),
+        Y.block(rowRange[0], 0, rowRange[1] - rowRange[0], cols), trans, alpha,
+        1, workspace);
+  else
+    m_hMatrixData.at(leaf)->apply(
+        xNoConst.block(rowRange[0], 0, rowRange[1] - rowRange[0], cols),
+        Y.block(colRange[0], 0, colRange[1] - colRange[0], cols), trans, alpha,
+        1, workspace);
+}
+
+template <typename ValueType, int N>
+void HMatrix<ValueType, N>::apply_impl_ownerComputes(
+    const Eigen::Ref<Matrix<ValueType>> &X, Eigen::Ref<Matrix<ValueType>> Y,
+    TransposeMode trans, ValueType alpha, const LeafSchedule &schedule) const {
+
+  for (const auto &phase : schedule)
+    tbb::parallel_for(tbb::blocked_range<std::size_t>(0, phase.size()),
+                      [&](const tbb::blocked_range<std::size_t> &r) {
+                        auto &workspace = m_workspace.local();
+                        for (auto group = r.begin(); group != r.end(); ++group)
+                          for (auto index : phase[group])
+                            applyLeaf(index, X, Y, trans, alpha, workspace);
+                      });
+}
+
+template <typename ValueType, int N>
+void HMatrix<ValueType, N>::apply_impl_threadLocal(
+    const Eigen::Ref<Matrix<ValueType>> &X, Eigen::Ref<Matrix<ValueType>> Y,
+    TransposeMode trans, ValueType alpha,
+    const std::vector<std::size_t> &leafs) const {
+
+  if (leafs.empty())
+    return;
+
+  // The per-thread outputs are local to this call, so that concurrent
+  // matvecs with the same matrix do not interfere.
+  auto rows = Y.rows();
+  auto cols = Y.cols();
+
+  tbb::enumerable_thread_specific<Matrix<ValueType>> localY(
+      [rows, cols]() -> Matrix<ValueType> {
+        return Matrix<ValueType>::Zero(rows, cols);
+      });
+
+  tbb::parallel_for(tbb::blocked_range<std::size_t>(0, leafs.size()),
+                    [&](const tbb::blocked_range<std::size_t> &r) {
+                      auto &y = localY.local();
+                      auto &workspace = m_workspace.local();
+                      for (auto index = r.begin(); index != r.end(); ++index)
+                        applyLeaf(leafs[index], X, y, trans, alpha, workspace);
+                    });
+
+  localY.combine_each([&](const Matrix<ValueType> &y) { Y += y; });
+}
+
+template <typename ValueType, int N>
+void HMatrix<ValueType, N>::coarsen(double accuracy) {
+
+  bool packed = isPacked();
+  StoragePrecision precision = storagePrecision();
+  unpackLeafData();
+
+  // The block cluster tree may be shared with other H-matrices or an LU
+  // decomposition, so the merged blocks are removed from a private copy.
+  // The leafs of both trees are listed in the same order.
+  auto blockClusterTree = m_blockClusterTree->copy();
+  auto leafs = m_blockClusterTree->leafNodes();
+  auto copiedLeafs = blockClusterTree->leafNodes();
+  ParallelDataContainer hMatrixData;
+  for (std::size_t index = 0; index < leafs.size(); ++index) {
+    auto it = m_hMatrixData.find(leafs[index]);
+    if (it != m_hMatrixData.end())
+      hMatrixData[copiedLeafs[index]] = it->second;
+  }
+  m_blockClusterTree = blockClusterTree;
+  m_hMatrixData.swap(hMatrixData);
+
+  std::unordered_set<const BlockClusterTreeNode<N> *> rejected;
+
+  // Blocks above the diagonal of a symmetric matrix follow their mirrors.
+  auto isMirror = [this](const BlockClusterTreeNode<N> &node) {
+    return m_symmetry != UNSYMMETRIC &&
+           node.data().rowClusterTreeNode->data().indexRange[0] <
+               node.data().columnClusterTreeNode->data().indexRange[0];
+  };
+
+  // Merge bottom-up. In each sweep all nodes whose children are leafs are
+  // tried in parallel. Merged nodes become leafs and their parents are
+  // candidates in the next sweep.
+  while (true) {
+
+    std::vector<shared_ptr<BlockClusterTreeNode<N>>> candidates;
+
+    std::function<void(const shared_ptr<BlockClusterTreeNode<N>> &)> collect;
+    collect = [&](const shared_ptr<BlockClusterTreeNode<N>> &node) {
+      if (node->isLeaf())
+        return;
+      bool childrenAreLeafs = true;
+      for (int i = 0; i < N * N; ++i)
+        if (!node->child(i)->isLeaf()) {
+          childrenAreLeafs = false;
+          collect(node->child(i));
+        }
+      if (childrenAreLeafs && !rejected.count(node.get()) && !isMirror(*node))
+        candidates.push_back(node);
+    };
+    collect(m_blockClusterTree->root());
+
+    std::vector<shared_ptr<HMatrixData<ValueType>>> mergedData(
+        candidates.size());
+
+    tbb::parallel_for(tbb::blocked_range<std::size_t>(0, candidates.size()),
+                      [&](const tbb::blocked_range<std::size_t> &r) {
+                        for (auto index = r.begin(); index != r.end(); ++index)
+                          if (!coarsen_impl(candidates[index], accuracy,
+                                            mergedData[index]))
+                            mergedData[index].reset();
+                      });
+
+    bool merged = false;
+    for (std::size_t index = 0; index < candidates.size(); ++index) {
+      const auto &node = candidates[index];
+      if (!mergedData[index]) {
+        rejected.insert(node.get());
+        continue;
+      }
+      for (int i = 0; i < N * N; ++i)
+        m_hMatrixData.unsafe_erase(node->child(i));
+      node->removeChildren();
+      m_hMatrixData[node] = mergedData[index];
+      if (m_symmetry != UNSYMMETRIC) {
+        auto mirrored = mirroredNode(*node);
+        if (mirrored != node)
+          mirrored->removeChildren();
+      }
+      merged = true;
+    }
+
+    if (!merged)
+      break;
+  }
+
+  m_myLeafs.clear();
+  for (const auto &leaf : m_blockClusterTree->leafNodes())
+    if (m_hMatrixData.count(leaf))
+      m_myLeafs.push_back(leaf);
+
+  updateLeafSchedules();
 
-  // Hack because Eigen ref does not like const.
-  // Eigen::Ref<Matrix<ValueType>> x_no_const =
-  // const_cast<Eigen::Ref<Matrix<ValueType>> &>(xPermuted);
+  if (packed)
+    packLeafData(precision);
+  else
+    updateStatistics();
+}
+
+template <typename ValueType, int N>
+bool HMatrix<ValueType, N>::coarsen_impl(
+    const shared_ptr<BlockClusterTreeNode<N>> &node, double coarsen_accuracy,
+    shared_ptr<HMatrixData<ValueType>> &mergedData) const {
+
+  auto rowRange = node->data().rowClusterTreeNode->data().indexRange;
+  auto colRange = node->data().columnClusterTreeNode->data().indexRange;
+  std::size_t rows = rowRange[1] - rowRange[0];
+  std::size_t cols = colRange[1] - colRange[0];
+
+  // Storage of the children and the sum of their ranks, where dense blocks
+  // count with their smaller dimension.
+  std::size_t childStorage = 0;
+  std::size_t totalRank = 0;
+  std::array<shared_ptr<HMatrixData<ValueType>>, N * N> childData;
+
+  for (int i = 0; i < N * N; ++i) {
+    auto it = m_hMatrixData.find(node->child(i));
+    if (it != m_hMatrixData.end())
+      childData[i] = it->second;
+    else if (m_symmetry != UNSYMMETRIC) {
+      // Children above the diagonal of a diagonal block.
+      auto mirrored = mirroredNode(*node->child(i));
+      if (!mirrored || !m_hMatrixData.count(mirrored))
+        return false;
+      childData[i] = mirroredData(*m_hMatrixData.at(mirrored));
+    } else
+      return false;
+    std::size_t childRows = childData[i]->rows();
+    std::size_t childCols = childData[i]->cols();
+    if (childData[i]->type() == DENSE) {
+      childStorage += childRows * childCols;
+      totalRank += std::min(childRows, childCols);
+    } else {
+      childStorage += childData[i]->rank() * (childRows + childCols);
+      totalRank += childData[i]->rank();
+    }
+  }
+
+  if (totalRank == 0) {
+    mergedData.reset(new HMatrixLowRankData<ValueType>(
+        Matrix<ValueType>::Zero(rows, 0), Matrix<ValueType>::Zero(0, cols)));
+    return true;
+  }
+
+  // Largest rank for which the merged block needs less storage.
+  if (childStorage == 0)
+    return false;
+  int maxRank = (childStorage - 1) / (rows + cols);
+
+  for (const auto &data : childData)
+    if (data->type() == DENSE &&
+        std::min(data->rows(), data->cols()) > maxRank)
+      return false;
+
+  // Write the parent block as A * B with the children factors placed at
+  // their offsets. Dense children D are written as D * I or I * D.
+  Matrix<ValueType> A = Matrix<ValueType>::Zero(rows, totalRank);
+  Matrix<ValueType> B = Matrix<ValueType>::Zero(totalRank, cols);
+
+  std::size_t k = 0;
+  for (int i = 0; i < N * N; ++i) {
+    auto childRowRange =
+        node->child(i)->data().rowClusterTreeNode->data().indexRange;
+    auto childColRange =
+        node->child(i)->data().columnClusterTreeNode->data().indexRange;
+    auto rowOffset = childRowRange[0] - rowRange[0];
+    auto colOffset = childColRange[0] - colRange[0];
+    auto childRows = childData[i]->rows();
+    auto childCols = childData[i]->cols();
+
+    if (childData[i]->type() == LOW_RANK_AB) {
+      const auto &lowRankData =
+          static_cast<const HMatrixLowRankData<ValueType> &>(*childData[i]);
+      auto rank = lowRankData.rank();
+      A.block(rowOffset, k, childRows, rank) = lowRankData.A();
+      B.block(k, colOffset, rank, childCols) = lowRankData.B();
+      k += rank;
+    } else {
+      const auto &denseData =
+          static_cast<const HMatrixDenseData<ValueType> &>(*childData[i]);
+      if (childRows <= childCols) {
+        A.block(rowOffset, k, childRows, childRows).setIdentity();
+        B.block(k, colOffset, childRows, childCols) = denseData.A();
+        k += childRows;
+      } else {
+        A.block(rowOffset, k, childRows, childCols) = denseData.A();
+        B.block(k, colOffset, childCols, childCols).setIdentity();
+        k += childCols;
+      }
+    }
+  }
+
+  bool success;
+  truncateLowRank(A, B, coarsen_accuracy, maxRank, success);
+  if (!success)
+    return false;
+
+  mergedData.reset(new HMatrixLowRankData<ValueType>(A, B));
+  return true;
+}
+
+template <typename ValueType, int N>
+shared_ptr<HMatrix<ValueType, N>> HMatrix<ValueType, N>::copy() const {
+
+  auto blockClusterTree = m_blockClusterTree->copy();
+  shared_ptr<HMatrix<ValueType, N>> result(
+      new HMatrix<ValueType, N>(blockClusterTree, m_comm));
+
+  // The leafs of both trees are listed in the same order.
+  auto leafs = m_blockClusterTree->leafNodes();
+  auto copiedLeafs = blockClusterTree->leafNodes();
+  std::unordered_map<const BlockClusterTreeNode<N> *,
+                     shared_ptr<BlockClusterTreeNode<N>>>
+      copiedLeaf;
+  for (std::size_t index = 0; index < leafs.size(); ++index)
+    copiedLeaf[leafs[index].get()] = copiedLeafs[index];
+
+  for (const auto &leaf : m_myLeafs) {
+    // Packed data is returned as a copy already.
+    auto leafData = data(leaf);
+    shared_ptr<HMatrixData<ValueType>> copiedData;
+    if (m_compactStorage)
+      copiedData = const_pointer_cast<HMatrixData<ValueType>>(leafData);
+    else if (leafData->type() == DENSE) {
+      auto denseData = make_shared<HMatrixDenseData<ValueType>>();
+      denseData->A() =
+          static_cast<const HMatrixDenseData<ValueType> &>(*leafData).A();
+      copiedData = denseData;
+    } else {
+      const auto &lowRankData =
+          static_cast<const HMatrixLowRankData<ValueType> &>(*leafData);
+      copiedData.reset(new HMatrixLowRankData<ValueType>(lowRankData.A(),
+                                                         lowRankData.B()));
+    }
+    const auto &node = copiedLeaf.at(leaf.get());
+    result->m_myLeafs.push_back(node);
+    result->m_hMatrixData[node] = copiedData;
+  }
+
+  result->m_rowOffsets = m_rowOffsets;
+  result->m_columnOffsets = m_columnOffsets;
+  result->m_predictedImbalance = m_predictedImbalance;
+  result->m_actualImbalance = m_actualImbalance;
+  result->m_matVecStrategy = m_matVecStrategy;
+  result->m_symmetry = m_symmetry;
+  result->updateLeafSchedules();
+
+  if (m_compactStorage)
+    result->packLeafData(storagePrecision());
+  else
+    result->updateStatistics();
+  return result;
+}
+
+template <typename ValueType, int N>
+void HMatrix<ValueType, N>::scale(ValueType alpha) {
 
-  // Initialize one mutex for each output row
-  Matrix<tbb::spin_mutex> mutex(Y.rows(), 1);
+  if (m_symmetry == HERMITIAN && std::imag(alpha) != 0)
+    expandSymmetry();
+
+  bool packed = isPacked();
+  StoragePrecision precision = storagePrecision();
+  unpackLeafData();
 
   tbb::parallel_for(
-      tbb::blocked_range<std::size_t>(0, numberOfLeafs),
+      tbb::blocked_range<std::size_t>(0, m_myLeafs.size()),
       [&](const tbb::blocked_range<std::size_t> &r) {
         for (auto index = r.begin(); index != r.end(); ++index) {
-          auto rowRange =
-              m_myLeafs[index]->data().rowClusterTreeNode->data().indexRange;
-          auto colRange =
-              m_myLeafs[index]->data().columnClusterTreeNode->data().indexRange;
-
-          if (trans == TransposeMode::NOTRANS || trans == TransposeMode::CONJ) {
-            Matrix<ValueType> x_data = xPermuted.block(
-                colRange[0], 0, colRange[1] - colRange[0], cols);
-            Matrix<ValueType> result =
-                Matrix<ValueType>::Zero(rowRange[1] - rowRange[0], cols);
-            this->m_hMatrixData.at(m_myLeafs[index])
-                ->apply(x_data, result, trans, 1, 1);
-
-            for (int i = rowRange[0]; i < rowRange[1]; ++i) {
-              tbb::spin_mutex::scoped_lock lock(mutex(i, 0));
-              for (int j = 0; j < cols; ++j)
-                yPermuted(i, j) += result(i - rowRange[0], j);
-            }
-          } else {
-            Eigen::Ref<Matrix<ValueType>> x_data = xPermuted.block(
-                rowRange[0], 0, rowRange[1] - rowRange[0], cols);
-            Matrix<ValueType> result =
-                Matrix<ValueType>::Zero(colRange[1] - colRange[0], cols);
-            this->m_hMatrixData.at(m_myLeafs[index])
-                ->apply(x_data, result, trans, 1, 1);
-
-            for (int i = colRange[0]; i < colRange[1]; ++i) {
-              tbb::spin_mutex::scoped_lock lock(mutex(i, 0));
-              for (int j = 0; j < cols; ++j)
-                yPermuted(i, j) += result(i - colRange[0], j);
-            }
-          }
+          auto &leafData = *m_hMatrixData.at(m_myLeafs[index]);
+          if (leafData.type() == DENSE)
+            static_cast<HMatrixDenseData<ValueType> &>(leafData).A() *= alpha;
+          else
+            static_cast<HMatrixLowRankData<ValueType> &>(leafData).A() *=
+                alpha;
         }
       });
 
-  if (trans == TransposeMode::NOTRANS || trans == TransposeMode::CONJ)
-    Y = this->permuteMatToOriginalDofs(yPermuted, ROW);
+  if (packed)
+    packLeafData(precision);
+}
+
+template <typename ValueType, int N>
+void HMatrix<ValueType, N>::add(ValueType alpha,
+                                const HMatrix<ValueType, N> &other,
+                                double eps) {
+
+  if (m_nproc > 1 || other.m_nproc > 1)
+    throw std::runtime_error(
+        "HMatrix::add: All blocks must be local to this process.");
+
+  if (!m_blockClusterTree->rowClusterTree()->hasSameClusters(
+          *other.m_blockClusterTree->rowClusterTree()) ||
+      !m_blockClusterTree->columnClusterTree()->hasSameClusters(
+          *other.m_blockClusterTree->columnClusterTree()))
+    throw std::runtime_error(
+        "HMatrix::add: Matrices must have the same cluster trees.");
+
+  if (&other == this) {
+    scale(ValueType(1) + alpha);
+    return;
+  }
+
+  expandSymmetry();
+
+  bool packed = isPacked();
+  StoragePrecision precision = storagePrecision();
+  unpackLeafData();
+
+  // Unpacked leaf data is shared with the map, so the blocks are updated
+  // in place.
+  auto leafData = leafDataMap();
+  auto updates = beginLowRankUpdates(leafData);
+  auto otherLeafData = other.leafDataMap();
+  const Node *root = m_blockClusterTree->root().get();
+
+  for (const auto &leaf : other.m_blockClusterTree->leafNodes()) {
+    auto it = otherLeafData.find(leaf.get());
+    if (it == otherLeafData.end())
+      continue;
+    const auto &data = *it->second;
+    auto rowStart = leaf->data().rowClusterTreeNode->data().indexRange[0];
+    auto columnStart =
+        leaf->data().columnClusterTreeNode->data().indexRange[0];
+
+    if (data.type() == LOW_RANK_AB) {
+      const auto &lowRankData =
+          static_cast<const HMatrixLowRankData<ValueType> &>(data);
+      if (lowRankData.rank() > 0)
+        addLowRank(leafData, updates, root, rowStart, columnStart,
+                   alpha * lowRankData.A(), lowRankData.B(), eps);
+      continue;
+    }
+
+    // Write a dense block D as I * D or D * I, whichever is smaller.
+    const auto &A = static_cast<const HMatrixDenseData<ValueType> &>(data).A();
+    if (A.rows() <= A.cols())
+      addLowRank(leafData, updates, root, rowStart, columnStart,
+                 alpha * Matrix<ValueType>::Identity(A.rows(), A.rows()), A,
+                 eps);
+    else
+      addLowRank(leafData, updates, root, rowStart, columnStart, alpha * A,
+                 Matrix<ValueType>::Identity(A.cols(), A.cols()), eps);
+  }
+
+  truncateLeafs(leafData, updates, eps);
+
+  if (packed)
+    packLeafData(precision);
   else
-    Y = this->permuteMatToOriginalDofs(yPermuted, COL);
+    updateStatistics();
+}
 
-  if (m_nproc > 1) {
-    // Perform an all reduce operation if there is more than one proc
-    Matrix<ValueType> globalY(Y.rows(), Y.cols());
-    MPI_Allreduce(Y.data(), globalY.data(), Y.rows() * Y.cols(),
-                  MpiTrait<ValueType>().type, MPI_SUM, m_comm);
-    Y = globalY;
+template <typename ValueType, int N>
+shared_ptr<HMatrix<ValueType, N>> HMatrix<ValueType, N>::multiply(
+    ValueType alpha, const HMatrix<ValueType, N> &A,
+    const HMatrix<ValueType, N> &B,
+    const shared_ptr<BlockClusterTree<N>> &blockClusterTree, double eps) {
+
+  if (A.m_nproc > 1 || B.m_nproc > 1)
+    throw std::runtime_error(
+        "HMatrix::multiply: All blocks must be local to this process.");
+
+  if (!blockClusterTree->rowClusterTree()->hasSameClusters(
+          *A.m_blockClusterTree->rowClusterTree()) ||
+      !blockClusterTree->columnClusterTree()->hasSameClusters(
+          *B.m_blockClusterTree->columnClusterTree()) ||
+      !A.m_blockClusterTree->columnClusterTree()->hasSameClusters(
+          *B.m_blockClusterTree->rowClusterTree()))
+    throw std::runtime_error(
+        "HMatrix::multiply: Incompatible cluster trees.");
+
+  // Start from zero blocks. Admissible leafs are low-rank, the others
+  // dense.
+  LeafDataMap leafData;
+  for (const auto &leaf : blockClusterTree->leafNodes()) {
+    std::size_t rows, cols;
+    IndexRangeType rowRange, columnRange;
+    getBlockClusterTreeNodeDimensions(*leaf, rowRange, columnRange, rows,
+                                      cols);
+    if (leaf->data().admissible)
+      leafData[leaf.get()].reset(new HMatrixLowRankData<ValueType>(
+          Matrix<ValueType>::Zero(rows, 0), Matrix<ValueType>::Zero(0, cols)));
+    else {
+      auto denseData = make_shared<HMatrixDenseData<ValueType>>();
+      denseData->A().setZero(rows, cols);
+      leafData[leaf.get()] = denseData;
+    }
   }
+
+  auto updates = beginLowRankUpdates(leafData);
+  auto leafDataA = A.leafDataMap();
+  auto leafDataB = B.leafDataMap();
+  multiplyAdd(leafData, updates, blockClusterTree->root().get(), leafDataA,
+              A.m_blockClusterTree->root().get(), leafDataB,
+              B.m_blockClusterTree->root().get(), alpha, eps);
+  truncateLeafs(leafData, updates, eps);
+
+  shared_ptr<HMatrix<ValueType, N>> result(
+      new HMatrix<ValueType, N>(blockClusterTree, A.m_comm));
+  result->setLeafData(leafData);
+  return result;
+}
+
+template <typename ValueType, int N>
+shared_ptr<HMatrix<ValueType, N>>
+HMatrix<ValueType, N>::multiply(ValueType alpha, const HMatrix<ValueType, N> &A,
+                                const HMatrix<ValueType, N> &B, double eps) {
+
+  const auto &treeA = *A.m_blockClusterTree;
+  const auto &treeB = *B.m_blockClusterTree;
+  if (treeB.columnClusterTree()->hasSameClusters(*treeA.columnClusterTree()))
+    return multiply(alpha, A, B, treeA.copy(), eps);
+  if (treeA.rowClusterTree()->hasSameClusters(*treeB.rowClusterTree()))
+    return multiply(alpha, A, B, treeB.copy(), eps);
+  throw std::runtime_error("HMatrix::multiply: No block cluster tree of the "
+                           "factors fits the product.");
+}
+
+template <typename ValueType, int N>
+typename HMatrix<ValueType, N>::LeafDataMap
+HMatrix<ValueType, N>::leafDataMap() const {
+
+  LeafDataMap result;
+  for (const auto &leaf : m_myLeafs)
+    result[leaf.get()];
+
+  tbb::parallel_for(tbb::blocked_range<std::size_t>(0, m_myLeafs.size()),
+                    [&](const tbb::blocked_range<std::size_t> &r) {
+                      for (auto index = r.begin(); index != r.end(); ++index)
+                        result.at(m_myLeafs[index].get()) =
+                            const_pointer_cast<HMatrixData<ValueType>>(
+                                data(m_myLeafs[index]));
+                    });
+
+  if (m_symmetry != UNSYMMETRIC)
+    for (const auto &leaf : m_blockClusterTree->leafNodes())
+      if (!m_leafIndices.count(leaf.get()))
+        result[leaf.get()] = const_pointer_cast<HMatrixData<ValueType>>(
+            data(leaf));
+  return result;
+}
+
+template <typename ValueType, int N>
+void HMatrix<ValueType, N>::setLeafData(const LeafDataMap &leafData) {
+
+  reset();
+  m_myLeafs = m_blockClusterTree->leafNodes();
+  for (const auto &leaf : m_myLeafs)
+    m_hMatrixData[leaf] = leafData.at(leaf.get());
+
+  m_rowOffsets = {0, rows()};
+  m_columnOffsets = {0, columns()};
+  updateLeafSchedules();
+  updateStatistics();
+}
+
+template <typename ValueType, int N>
+void HMatrix<ValueType, N>::applySubtree(const LeafDataMap &leafData,
+                                         const Node *node,
+                                         Eigen::Ref<Matrix<ValueType>> X,
+                                         Eigen::Ref<Matrix<ValueType>> Y,
+                                         TransposeMode trans,
+                                         ValueType alpha) {
+
+  if (node->isLeaf()) {
+    leafData.at(node)->apply(X, Y, trans, alpha, 1);
+    return;
+  }
+
+  const auto &rowRange = node->data().rowClusterTreeNode->data().indexRange;
+  const auto &columnRange =
+      node->data().columnClusterTreeNode->data().indexRange;
+
+  for (int i = 0; i < N * N; ++i) {
+    const Node *child = node->child(i).get();
+    const auto &childRowRange =
+        child->data().rowClusterTreeNode->data().indexRange;
+    const auto &childColumnRange =
+        child->data().columnClusterTreeNode->data().indexRange;
+    const std::size_t rowStart = childRowRange[0] - rowRange[0];
+    const std::size_t columnStart = childColumnRange[0] - columnRange[0];
+    const std::size_t rows = childRowRange[1] - childRowRange[0];
+    const std::size_t cols = childColumnRange[1] - childColumnRange[0];
+    if (trans == TransposeMode::NOTRANS || trans == TransposeMode::CONJ)
+      applySubtree(leafData, child, X.middleRows(columnStart, cols),
+                   Y.middleRows(rowStart, rows), trans, alpha);
+    else
+      applySubtree(leafData, child, X.middleRows(rowStart, rows),
+                   Y.middleRows(columnStart, cols), trans, alpha);
+  }
+}
+
+template <typename ValueType, int N>
+void HMatrix<ValueType, N>::multiplyToLowRank(
+    const LeafDataMap &leafDataA, const Node *nodeA,
+    const LeafDataMap &leafDataB, const Node *nodeB, double eps,
+    Matrix<ValueType> &U, Matrix<ValueType> &V) {
+
+  const auto &rowRange = nodeA->data().rowClusterTreeNode->data().indexRange;
+  const auto &columnRange =
+      nodeB->data().columnClusterTreeNode->data().indexRange;
+  const std::size_t rows = rowRange[1] - rowRange[0];
+  const std::size_t cols = columnRange[1] - columnRange[0];
+
+  // Write a dense product P as I * P or P * I, whichever is smaller.
+  auto fromDense = [rows, cols, &U, &V](Matrix<ValueType> &product) {
+    if (rows <= cols) {
+      U = Matrix<ValueType>::Identity(rows, rows);
+      V.swap(product);
+    } else {
+      U.swap(product);
+      V = Matrix<ValueType>::Identity(cols, cols);
+    }
+  };
+
+  if (nodeA->isLeaf() || nodeB->isLeaf()) {
+    const auto &data = nodeA->isLeaf() ? *leafDataA.at(nodeA)
+                                       : *leafDataB.at(nodeB);
+
+    if (data.type() == LOW_RANK_AB && data.rank() == 0) {
+      U.setZero(rows, 0);
+      V.setZero(0, cols);
+      return;
+    }
+
+    if (nodeA->isLeaf()) {
+      // A * B = (B^T * A^T)^T
+      Matrix<ValueType> transposed;
+      if (data.type() == DENSE)
+        transposed = static_cast<const HMatrixDenseData<ValueType> &>(data)
+                         .A()
+                         .transpose();
+      else
+        transposed = static_cast<const HMatrixLowRankData<ValueType> &>(data)
+                         .B()
+                         .transpose();
+      Matrix<ValueType> product =
+          Matrix<ValueType>::Zero(cols, transposed.cols());
+      applySubtree(leafDataB, nodeB, transposed, product,
+                   TransposeMode::TRANS, 1);
+      product.transposeInPlace();
+      if (data.type() == DENSE)
+        fromDense(product);
+      else {
+        U = static_cast<const HMatrixLowRankData<ValueType> &>(data).A();
+        V.swap(product);
+      }
+    } else {
+      Matrix<ValueType> factor;
+      if (data.type() == DENSE)
+        factor = static_cast<const HMatrixDenseData<ValueType> &>(data).A();
+      else
+        factor = static_cast<const HMatrixLowRankData<ValueType> &>(data).A();
+      Matrix<ValueType> product = Matrix<ValueType>::Zero(rows, factor.cols());
+      applySubtree(leafDataA, nodeA, factor, product, TransposeMode::NOTRANS,
+                   1);
+      if (data.type() == DENSE)
+        fromDense(product);
+      else {
+        U.swap(product);
+        V = static_cast<const HMatrixLowRankData<ValueType> &>(data).B();
+      }
+    }
+    return;
+  }
+
+  // Both factors are subdivided. Forming the products of all children
+  // recursively costs a multiple of the product of the subtree sizes, so
+  // sample the product with the subtrees instead. Products without a small
+  // rank are formed densely.
+  const auto &innerRange =
+      nodeA->data().columnClusterTreeNode->data().indexRange;
+  const std::size_t inner = innerRange[1] - innerRange[0];
+
+  matApply_t<ValueType> applyFun = [&](
+      const Eigen::Ref<Matrix<ValueType>> &X, const TransposeMode trans) {
+    Matrix<ValueType> input = X;
+    Matrix<ValueType> intermediate = Matrix<ValueType>::Zero(inner, X.cols());
+    if (trans == CONJTRANS) {
+      Matrix<ValueType> result = Matrix<ValueType>::Zero(cols, X.cols());
+      applySubtree(leafDataA, nodeA, input, intermediate, CONJTRANS, 1);
+      applySubtree(leafDataB, nodeB, intermediate, result, CONJTRANS, 1);
+      return result;
+    }
+    Matrix<ValueType> result = Matrix<ValueType>::Zero(rows, X.cols());
+    applySubtree(leafDataB, nodeB, input, intermediate, NOTRANS, 1);
+    applySubtree(leafDataA, nodeA, intermediate, result, NOTRANS, 1);
+    return result;
+  };
+
+  // Sampling does not pay off for small blocks. The samples are seeded by
+  // the block, so they do not depend on the scheduling of the tasks.
+  if (std::min(rows, cols) > 32) {
+    std::seed_seq seed{rowRange[0], rowRange[1], innerRange[0], innerRange[1],
+                       columnRange[0], columnRange[1]};
+    std::mt19937 generator(seed);
+    bool success;
+    adaptiveRandomizedLowRankApproximation(applyFun, rows, cols, eps,
+                                           std::min(rows, cols) / 2, 8,
+                                           generator, success, U, V);
+    if (success)
+      return;
+  }
+
+  Matrix<ValueType> identity = Matrix<ValueType>::Identity(cols, cols);
+  Matrix<ValueType> product = applyFun(identity, NOTRANS);
+  fromDense(product);
+}
+
+template <typename ValueType, int N>
+void HMatrix<ValueType, N>::multiplyAdd(
+    LeafDataMap &leafDataC, LowRankUpdateMap &updatesC, const Node *nodeC,
+    const LeafDataMap &leafDataA, const Node *nodeA,
+    const LeafDataMap &leafDataB, const Node *nodeB, ValueType alpha,
+    double eps) {
+
+  if (nodeC->isLeaf() || nodeA->isLeaf() || nodeB->isLeaf()) {
+    Matrix<ValueType> U;
+    Matrix<ValueType> V;
+    multiplyToLowRank(leafDataA, nodeA, leafDataB, nodeB, eps, U, V);
+    U *= alpha;
+    addLowRank(leafDataC, updatesC, nodeC,
+               nodeC->data().rowClusterTreeNode->data().indexRange[0],
+               nodeC->data().columnClusterTreeNode->data().indexRange[0], U,
+               V, eps);
+    return;
+  }
+
+  // The children of C are disjoint and are updated in parallel.
+  tbb::task_group group;
+  for (int i = 0; i < N; ++i)
+    for (int k = 0; k < N; ++k)
+      group.run([&leafDataC, &updatesC, nodeC, &leafDataA, nodeA,
+                 &leafDataB, nodeB, alpha, eps, i, k]() {
+        const Node *childC = nodeC->child(N * i + k).get();
+        if (!childC->isLeaf()) {
+          for (int j = 0; j < N; ++j)
+            multiplyAdd(leafDataC, updatesC, childC, leafDataA,
+                        nodeA->child(N * i + j).get(), leafDataB,
+                        nodeB->child(N * j + k).get(), alpha, eps);
+          return;
+        }
+
+        // Sum up all products first, so that the leaf is updated once.
+        std::vector<Matrix<ValueType>> childU(N);
+        std::vector<Matrix<ValueType>> childV(N);
+        std::size_t rank = 0;
+        for (int j = 0; j < N; ++j) {
+          multiplyToLowRank(leafDataA, nodeA->child(N * i + j).get(),
+                            leafDataB, nodeB->child(N * j + k).get(), eps,
+                            childU[j], childV[j]);
+          rank += childU[j].cols();
+        }
+        Matrix<ValueType> U(childU[0].rows(), rank);
+        Matrix<ValueType> V(rank, childV[0].cols());
+        std::size_t column = 0;
+        for (int j = 0; j < N; ++j) {
+          U.middleCols(column, childU[j].cols()) = alpha * childU[j];
+          V.middleRows(column, childU[j].cols()) = childV[j];
+          column += childU[j].cols();
+        }
+        addLowRank(leafDataC, updatesC, childC,
+                   childC->data().rowClusterTreeNode->data().indexRange[0],
+                   childC->data().columnClusterTreeNode->data().indexRange[0],
+                   U, V, eps);
+      });
+  group.wait();
+}
+
+template <typename ValueType, int N>
+typename HMatrix<ValueType, N>::LowRankUpdateMap
+HMatrix<ValueType, N>::beginLowRankUpdates(LeafDataMap &leafData) {
+
+  LowRankUpdateMap updates;
+  for (auto &entry : leafData)
+    if (entry.second->type() == LOW_RANK_AB) {
+      auto &lowRankData =
+          static_cast<HMatrixLowRankData<ValueType> &>(*entry.second);
+      auto &update = updates[entry.first];
+      update.rank = lowRankData.rank();
+      update.A.swap(lowRankData.A());
+      update.B.swap(lowRankData.B());
+    }
+  return updates;
+}
+
+template <typename ValueType, int N>
+void HMatrix<ValueType, N>::addLowRank(
+    LeafDataMap &leafData, LowRankUpdateMap &updates, const Node *node,
+    std::size_t rowStart, std::size_t columnStart,
+    const Eigen::Ref<const Matrix<ValueType>> &U,
+    const Eigen::Ref<const Matrix<ValueType>> &V, double eps) {
+
+  if (U.cols() == 0)
+    return;
+
+  const auto &rowRange = node->data().rowClusterTreeNode->data().indexRange;
+  const auto &columnRange =
+      node->data().columnClusterTreeNode->data().indexRange;
+
+  // Part of the update that lies in the block.
+  std::size_t firstRow = std::max(rowStart, rowRange[0]);
+  std::size_t lastRow = std::min(rowStart + U.rows(), rowRange[1]);
+  std::size_t firstColumn = std::max(columnStart, columnRange[0]);
+  std::size_t lastColumn = std::min(columnStart + V.cols(), columnRange[1]);
+  if (firstRow >= lastRow || firstColumn >= lastColumn)
+    return;
+
+  if (!node->isLeaf()) {
+    tbb::task_group group;
+    for (int i = 0; i < N * N; ++i)
+      group.run([&, i]() {
+        addLowRank(leafData, updates, node->child(i).get(), rowStart,
+                   columnStart, U, V, eps);
+      });
+    group.wait();
+    return;
+  }
+
+  auto localU = U.middleRows(firstRow - rowStart, lastRow - firstRow);
+  auto localV =
+      V.middleCols(firstColumn - columnStart, lastColumn - firstColumn);
+  const std::size_t rowOffset = firstRow - rowRange[0];
+  const std::size_t columnOffset = firstColumn - columnRange[0];
+
+  auto &data = *leafData.at(node);
+  if (data.type() == DENSE) {
+    static_cast<HMatrixDenseData<ValueType> &>(data)
+        .A()
+        .block(rowOffset, columnOffset, localU.rows(), localV.cols())
+        .noalias() += localU * localV;
+    return;
+  }
+
+  // The updates of a leaf are appended to the reserved columns of A and
+  // rows of B, whose number is doubled when they run out, up to the size of
+  // the block plus the update.
+  auto &update = updates.at(node);
+  const std::size_t rows = rowRange[1] - rowRange[0];
+  const std::size_t cols = columnRange[1] - columnRange[0];
+  const std::size_t size = std::min(rows, cols);
+  const std::size_t rank = update.rank + U.cols();
+  const std::size_t capacity = update.A.cols();
+  if (rank > capacity) {
+    const std::size_t newCapacity =
+        std::max(rank, std::min(2 * capacity, size + U.cols()));
+    update.A.conservativeResize(rows, newCapacity);
+    update.B.conservativeResize(newCapacity, cols);
+  }
+  update.A.middleCols(update.rank, U.cols()).setZero();
+  update.B.middleRows(update.rank, U.cols()).setZero();
+  update.A.block(rowOffset, update.rank, localU.rows(), U.cols()) = localU;
+  update.B.block(update.rank, columnOffset, U.cols(), localV.cols()) = localV;
+  update.rank = rank;
+
+  if (update.rank > size) {
+    Matrix<ValueType> A = update.A.leftCols(update.rank);
+    Matrix<ValueType> B = update.B.topRows(update.rank);
+    bool success;
+    truncateLowRank(A, B, eps, static_cast<int>(size), success);
+    update.rank = A.cols();
+    update.A.leftCols(update.rank) = A;
+    update.B.topRows(update.rank) = B;
+  }
+}
+
+template <typename ValueType, int N>
+void HMatrix<ValueType, N>::truncateLeafs(LeafDataMap &leafData,
+                                          LowRankUpdateMap &updates,
+                                          double eps) {
+
+  std::vector<std::pair<const Node *, LowRankUpdate *>> lowRankLeafs;
+  for (auto &entry : updates)
+    lowRankLeafs.push_back({entry.first, &entry.second});
+
+  tbb::parallel_for(
+      tbb::blocked_range<std::size_t>(0, lowRankLeafs.size()),
+      [&](const tbb::blocked_range<std::size_t> &r) {
+        for (auto index = r.begin(); index != r.end(); ++index) {
+          auto &update = *lowRankLeafs[index].second;
+          auto &lowRankData = static_cast<HMatrixLowRankData<ValueType> &>(
+              *leafData.at(lowRankLeafs[index].first));
+          lowRankData.A() = update.A.leftCols(update.rank);
+          lowRankData.B() = update.B.topRows(update.rank);
+          bool success;
+          truncateLowRank(lowRankData.A(), lowRankData.B(), eps,
+                          lowRankData.rank(), success);
+        }
+      });
+  updates.clear();
 }
 
 template <typename ValueType, int N>
 double HMatrix<ValueType, N>::frobeniusNorm_impl(
     const shared_ptr<BlockClusterTreeNode<N>> &node) const {
 
-  if (node->isLeaf())
-    return m_hMatrixData.at(node)->frobeniusNorm();
+  if (node->isLeaf()) {
+    auto leaf = node;
+    if (m_symmetry != UNSYMMETRIC && !m_leafIndices.count(node.get()))
+      leaf = mirroredNode(*node);
+    if (m_compactStorage)
+      return m_compactStorage->frobeniusNorm(m_leafIndices.at(leaf.get()));
+    return m_hMatrixData.at(leaf)->frobeniusNorm();
+  }
 
   tbb::task_group g;
 
@@ -317,6 +1936,327 @@ double HMatrix<ValueType, N>::frobeniusNorm_impl(
 
   return result;
 }
+
+template <typename ValueType, int N>
+typename HMatrix<ValueType, N>::FileHeader HMatrix<ValueType, N>::fileHeader() {
+  FileHeader header = FileHeader();
+  header.magic = 0x54414d48504d4542ULL; // "BEMPHMAT"
+  header.version = 2;
+  header.valueSize = sizeof(ValueType);
+  header.realSize = sizeof(typename ScalarTraits<ValueType>::RealType);
+  header.n = N;
+  return header;
+}
+
+// File layout of version 2, all integers as 64 bit unsigned values:
+//
+//   header
+//   row cluster tree, flag whether the column cluster tree is the same,
+//   column cluster tree unless it is the same
+//   block cluster tree
+//   row and column offsets of the processes
+//   symmetry, missing in version 1 for unsymmetric matrices
+//   leaf records
+//   packed leaf data, starting on a 4096 byte boundary
+//
+// A cluster tree is stored as its nodes in preorder followed by the map
+// from H-matrix dofs to original dofs. The block cluster tree is stored in
+// preorder. Each leaf record starts with the preorder index of its block.
+template <typename ValueType, int N>
+void HMatrix<ValueType, N>::save(const std::string &fileName) const {
+
+  typedef std::uint64_t index_t;
+
+  if (!isInitialized())
+    throw std::runtime_error("HMatrix::save: Matrix is not initialized.");
+
+  shared_ptr<const HMatrixCompactStorage<ValueType>> storage =
+      m_compactStorage ? m_compactStorage : packedStorage(NATIVE_PRECISION);
+
+  BinaryWriter writer(m_nproc > 1 ? fileName + "." + std::to_string(m_rank)
+                                  : fileName);
+
+  auto header = fileHeader();
+  header.precision = storage->precision();
+  header.nproc = m_nproc;
+  header.rank = m_rank;
+  header.rows = rows();
+  header.columns = columns();
+  writer.write(header);
+
+  auto writeIndices = [&writer](const std::vector<std::size_t> &indices) {
+    writer.write(static_cast<index_t>(indices.size()));
+    for (auto index : indices)
+      writer.write(static_cast<index_t>(index));
+  };
+
+  std::function<void(const shared_ptr<const ClusterTreeNode<N>> &)>
+      writeClusterTreeNode;
+  writeClusterTreeNode = [&](
+      const shared_ptr<const ClusterTreeNode<N>> &node) {
+    const auto &data = node->data();
+    writer.write(static_cast<index_t>(data.indexRange[0]));
+    writer.write(static_cast<index_t>(data.indexRange[1]));
+    writer.write(data.boundingBox.bounds());
+    writer.write(data.diameter);
+    writer.write(data.centroid.data(), sizeof(double) * 3);
+    writer.write(data.mainDirection.data(), sizeof(double) * 3);
+    writer.write(data.principalAxes.data(), sizeof(double) * 9);
+    writer.write(data.orientedMin.data(), sizeof(double) * 3);
+    writer.write(data.orientedMax.data(), sizeof(double) * 3);
+    writer.write(static_cast<index_t>(!node->isLeaf()));
+    if (!node->isLeaf())
+      for (int i = 0; i < N; ++i)
+        writeClusterTreeNode(node->child(i));
+  };
+
+  auto writeClusterTree = [&](const ClusterTree<N> &clusterTree) {
+    writeClusterTreeNode(clusterTree.root());
+    writeIndices(clusterTree.hMatDofToOriginalDofMap());
+  };
+
+  auto rowClusterTree = m_blockClusterTree->rowClusterTree();
+  auto columnClusterTree = m_blockClusterTree->columnClusterTree();
+  writeClusterTree(*rowClusterTree);
+  writer.write(static_cast<index_t>(rowClusterTree == columnClusterTree));
+  if (rowClusterTree != columnClusterTree)
+    writeClusterTree(*columnClusterTree);
+
+  std::unordered_map<const BlockClusterTreeNode<N> *, index_t> blockIndices;
+  std::function<void(const shared_ptr<const BlockClusterTreeNode<N>> &)>
+      writeBlockClusterTreeNode;
+  writeBlockClusterTreeNode = [&](
+      const shared_ptr<const BlockClusterTreeNode<N>> &node) {
+    auto blockIndex = blockIndices.size();
+    blockIndices[node.get()] = blockIndex;
+    writer.write(static_cast<index_t>(node->data().admissible));
+    writer.write(static_cast<index_t>(!node->isLeaf()));
+    if (!node->isLeaf())
+      for (int i = 0; i < N * N; ++i)
+        writeBlockClusterTreeNode(node->child(i));
+  };
+  writeBlockClusterTreeNode(m_blockClusterTree->root());
+
+  writeIndices(m_rowOffsets);
+  writeIndices(m_columnOffsets);
+  writer.write(static_cast<index_t>(m_symmetry));
+
+  writer.write(static_cast<index_t>(m_myLeafs.size()));
+  for (std::size_t index = 0; index < m_myLeafs.size(); ++index) {
+    const auto &record = storage->record(index);
+    writer.write(blockIndices.at(m_myLeafs[index].get()));
+    writer.write(static_cast<index_t>(record.type));
+    writer.write(static_cast<index_t>(record.rowStart));
+    writer.write(static_cast<index_t>(record.rows));
+    writer.write(static_cast<index_t>(record.columnStart));
+    writer.write(static_cast<index_t>(record.columns));
+    writer.write(static_cast<index_t>(record.rank));
+    writer.write(static_cast<index_t>(record.offsetA));
+    writer.write(static_cast<index_t>(record.offsetB));
+  }
+
+  writer.write(static_cast<index_t>(storage->bufferBytes()));
+  writer.align(4096);
+  writer.write(storage->buffer(), storage->bufferBytes());
+  writer.close();
+}
+
+template <typename ValueType, int N>
+shared_ptr<HMatrix<ValueType, N>>
+HMatrix<ValueType, N>::load(const std::string &fileName, MPI_Comm comm) {
+
+  typedef std::uint64_t index_t;
+
+  int nproc;
+  int rank;
+  MPI_Comm_size(comm, &nproc);
+  MPI_Comm_rank(comm, &rank);
+
+  BinaryReader reader(nproc > 1 ? fileName + "." + std::to_string(rank)
+                                : fileName);
+
+  auto fail = [&fileName](const std::string &message) {
+    throw std::runtime_error("HMatrix::load: " + fileName + ": " + message);
+  };
+
+  auto header = reader.read<FileHeader>();
+  auto expectedHeader = fileHeader();
+  if (header.magic != expectedHeader.magic)
+    fail("Not a saved H-matrix.");
+  if (header.version < 1 || header.version > expectedHeader.version)
+    fail("Unsupported file version " + std::to_string(header.version) + ".");
+  if (header.valueSize != expectedHeader.valueSize ||
+      header.realSize != expectedHeader.realSize ||
+      header.n != expectedHeader.n)
+    fail("Value type or tree arity does not match.");
+  if (header.nproc != static_cast<index_t>(nproc) ||
+      header.rank != static_cast<index_t>(rank))
+    fail("Saved with a different number of processes.");
+  if (header.precision != NATIVE_PRECISION &&
+      header.precision != SINGLE_PRECISION)
+    fail("Invalid storage precision.");
+
+  auto readIndices = [&reader](std::vector<std::size_t> &indices) {
+    std::vector<index_t> values;
+    reader.read(values, reader.read<index_t>());
+    indices.assign(values.begin(), values.end());
+  };
+
+  auto readClusterTreeNodeData = [&reader](bool &hasChildren) {
+    auto start = reader.read<index_t>();
+    auto end = reader.read<index_t>();
+    ClusterTreeNodeData data(IndexRangeType{{start, end}});
+    data.boundingBox = BoundingBox(reader.read<std::array<double, 6>>());
+    data.diameter = reader.read<double>();
+    std::memcpy(data.centroid.data(), reader.read(sizeof(double) * 3),
+                sizeof(double) * 3);
+    std::memcpy(data.mainDirection.data(), reader.read(sizeof(double) * 3),
+                sizeof(double) * 3);
+    std::memcpy(data.principalAxes.data(), reader.read(sizeof(double) * 9),
+                sizeof(double) * 9);
+    std::memcpy(data.orientedMin.data(), reader.read(sizeof(double) * 3),
+                sizeof(double) * 3);
+    std::memcpy(data.orientedMax.data(), reader.read(sizeof(double) * 3),
+                sizeof(double) * 3);
+    hasChildren = reader.read<index_t>() != 0;
+    return data;
+  };
+
+  std::function<void(const shared_ptr<ClusterTreeNode<N>> &)>
+      readClusterTreeChildren;
+  readClusterTreeChildren = [&](const shared_ptr<ClusterTreeNode<N>> &node) {
+    for (int i = 0; i < N; ++i) {
+      bool hasChildren;
+      node->addChild(readClusterTreeNodeData(hasChildren), i);
+      if (hasChildren)
+        readClusterTreeChildren(node->child(i));
+    }
+  };
+
+  auto readClusterTree = [&](std::size_t numberOfDofs) {
+    bool hasChildren;
+    auto root =
+        make_shared<ClusterTreeNode<N>>(readClusterTreeNodeData(hasChildren));
+    if (hasChildren)
+      readClusterTreeChildren(root);
+    std::vector<std::size_t> hMatDofToOriginalDofMap;
+    readIndices(hMatDofToOriginalDofMap);
+    if (root->data().indexRange != IndexRangeType{{0, numberOfDofs}} ||
+        hMatDofToOriginalDofMap.size() != numberOfDofs)
+      fail("Cluster tree does not match the matrix size.");
+    for (auto dof : hMatDofToOriginalDofMap)
+      if (dof >= numberOfDofs)
+        fail("Invalid dof permutation.");
+    return shared_ptr<const ClusterTree<N>>(
+        new ClusterTree<N>(root, hMatDofToOriginalDofMap));
+  };
+
+  shared_ptr<const ClusterTree<N>> rowClusterTree =
+      readClusterTree(header.rows);
+  shared_ptr<const ClusterTree<N>> columnClusterTree = rowClusterTree;
+  if (!reader.read<index_t>())
+    columnClusterTree = readClusterTree(header.columns);
+  else if (header.rows != header.columns)
+    fail("Cluster tree does not match the matrix size.");
+
+  std::vector<shared_ptr<BlockClusterTreeNode<N>>> blocks;
+  std::function<void(const shared_ptr<BlockClusterTreeNode<N>> &)>
+      readBlockClusterTreeChildren;
+  readBlockClusterTreeChildren = [&](
+      const shared_ptr<BlockClusterTreeNode<N>> &node) {
+    const auto &data = node->data();
+    if (data.rowClusterTreeNode->isLeaf() ||
+        data.columnClusterTreeNode->isLeaf())
+      fail("Block cluster tree does not match the cluster trees.");
+    for (int i = 0; i < N; ++i)
+      for (int j = 0; j < N; ++j) {
+        bool admissible = reader.read<index_t>() != 0;
+        bool hasChildren = reader.read<index_t>() != 0;
+        node->addChild(BlockClusterTreeNodeData<N>(
+                           data.rowClusterTreeNode->child(i),
+                           data.columnClusterTreeNode->child(j), admissible),
+                       N * i + j);
+        auto child = node->child(N * i + j);
+        blocks.push_back(child);
+        if (hasChildren)
+          readBlockClusterTreeChildren(child);
+      }
+  };
+
+  bool admissible = reader.read<index_t>() != 0;
+  bool hasChildren = reader.read<index_t>() != 0;
+  auto root = make_shared<BlockClusterTreeNode<N>>(BlockClusterTreeNodeData<N>(
+      rowClusterTree->root(), columnClusterTree->root(), admissible));
+  blocks.push_back(root);
+  if (hasChildren)
+    readBlockClusterTreeChildren(root);
+
+  shared_ptr<HMatrix<ValueType, N>> hMatrix(new HMatrix<ValueType, N>(
+      make_shared<BlockClusterTree<N>>(rowClusterTree, columnClusterTree,
+                                       root),
+      comm));
+
+  readIndices(hMatrix->m_rowOffsets);
+  readIndices(hMatrix->m_columnOffsets);
+  if (hMatrix->m_rowOffsets.size() != static_cast<std::size_t>(nproc + 1) ||
+      hMatrix->m_columnOffsets.size() != static_cast<std::size_t>(nproc + 1))
+    fail("Invalid process offsets.");
+
+  if (header.version >= 2) {
+    auto symmetry = reader.read<index_t>();
+    if (symmetry > HERMITIAN ||
+        (symmetry != UNSYMMETRIC &&
+         !rowClusterTree->hasSameClusters(*columnClusterTree)))
+      fail("Invalid symmetry.");
+    hMatrix->m_symmetry = static_cast<MatrixSymmetry>(symmetry);
+  }
+
+  auto numberOfLeafs = reader.read<index_t>();
+  std::vector<typename HMatrixCompactStorage<ValueType>::LeafRecord> records(
+      numberOfLeafs);
+  for (auto &record : records) {
+    auto blockIndex = reader.read<index_t>();
+    if (blockIndex >= blocks.size() || !blocks[blockIndex]->isLeaf())
+      fail("Invalid leaf record.");
+    const auto &leaf = blocks[blockIndex];
+    auto type = reader.read<index_t>();
+    if (type != DENSE && type != LOW_RANK_AB)
+      fail("Invalid leaf record.");
+    record.type = static_cast<DataBlockType>(type);
+    record.rowStart = reader.read<index_t>();
+    record.rows = reader.read<index_t>();
+    record.columnStart = reader.read<index_t>();
+    record.columns = reader.read<index_t>();
+    record.rank = reader.read<index_t>();
+    record.offsetA = reader.read<index_t>();
+    record.offsetB = reader.read<index_t>();
+    const auto &rowRange = leaf->data().rowClusterTreeNode->data().indexRange;
+    const auto &columnRange =
+        leaf->data().columnClusterTreeNode->data().indexRange;
+    if (record.rowStart != rowRange[0] ||
+        record.rows != rowRange[1] - rowRange[0] ||
+        record.columnStart != columnRange[0] ||
+        record.columns != columnRange[1] - columnRange[0])
+      fail("Leaf record does not match its block.");
+    hMatrix->m_leafIndices[leaf.get()] = hMatrix->m_myLeafs.size();
+    hMatrix->m_myLeafs.push_back(leaf);
+  }
+
+  auto bufferBytes = reader.read<index_t>();
+  reader.align(4096);
+  const void *buffer = reader.read(bufferBytes);
+
+  hMatrix->m_compactStorage.reset(new HMatrixCompactStorage<ValueType>(
+      records, static_cast<StoragePrecision>(header.precision), buffer,
+      bufferBytes, reader.mapping()));
+
+  hMatrix->computeCommunicationPlan(ROW, hMatrix->m_rowPlan);
+  hMatrix->computeCommunicationPlan(COL, hMatrix->m_columnPlan);
+  hMatrix->updateMirroredSchedules();
+  hMatrix->updateStatistics();
+
+  return hMatrix;
+}
 }
 
 #endif
@@ -6,6 +6,8 @@
 #include "hmatrix_low_rank_data.hpp"
 #include "eigen_fwd.hpp"
 
+#include <algorithm>
+
 namespace hmat {
 
 template <typename ValueType>
@@ -94,21 +96,41 @@ void HMatrixLowRankData<ValueType>::apply(
     const Eigen::Ref<Matrix<ValueType>> &X, Eigen::Ref<Matrix<ValueType>> Y,
     TransposeMode trans, ValueType alpha, ValueType beta) const {
 
+  Matrix<ValueType> workspace;
+  apply(X, Y, trans, alpha, beta, workspace);
+}
+
+template <typename ValueType>
+void HMatrixLowRankData<ValueType>::apply(
+    const Eigen::Ref<Matrix<ValueType>> &X, Eigen::Ref<Matrix<ValueType>> Y,
+    TransposeMode trans, ValueType alpha, ValueType beta,
+    Matrix<ValueType> &workspace) const {
+
   if (beta == ValueType(0))
     Y.setZero();
-  if (alpha == ValueType(0) || rank() == 0) {
-    Y = beta * Y;
+  else if (beta != ValueType(1))
+    Y *= beta;
+  if (alpha == ValueType(0) || rank() == 0)
     return;
-  }
 
-  if (trans == TransposeMode::NOTRANS)
-    Y = alpha * m_A * (m_B * X) + beta * Y;
-  else if (trans == TransposeMode::TRANS)
-    Y = alpha * m_B.transpose() * (m_A.transpose() * X) + beta * Y;
-  else if (trans == TransposeMode::CONJ)
-    Y = alpha * m_A.conjugate() * (m_B.conjugate() * X) + beta * Y;
-  else
-    Y = alpha * m_B.adjoint() * (m_A.adjoint() * X) + beta * Y;
+  if (workspace.rows() < rank() || workspace.cols() < X.cols())
+    workspace.resize(std::max<int>(workspace.rows(), rank()),
+                     std::max<int>(workspace.cols(), X.cols()));
+  auto tmp = workspace.topLeftCorner(rank(), X.cols());
+
+  if (trans == TransposeMode::NOTRANS) {
+    tmp.noalias() = m_B * X;
+    Y.noalias() += alpha * m_A * tmp;
+  } else if (trans == TransposeMode::TRANS) {
+    tmp.noalias() = m_A.transpose() * X;
+    Y.noalias() += alpha * m_B.transpose() * tmp;
+  } else if (trans == TransposeMode::CONJ) {
+    tmp.noalias() = m_B.conjugate() * X;
+    Y.noalias() += alpha * m_A.conjugate() * tmp;
+  } else {
+    tmp.noalias() = m_A.adjoint() * X;
+    Y.noalias() += alpha * m_B.adjoint() * tmp;
+  }
 }
 }
 
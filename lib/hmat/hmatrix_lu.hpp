@@ -0,0 +1,102 @@
+// vi: set et ts=4 sw=2 sts=2:
+
+#ifndef HMAT_HMATRIX_LU_HPP
+#define HMAT_HMATRIX_LU_HPP
+
+#include "common.hpp"
+#include "eigen_fwd.hpp"
+#include "hmatrix.hpp"
+
+#include <unordered_map>
+
+namespace hmat {
+
+template <typename ValueType, int N> class HMatrixLu;
+
+template <typename ValueType>
+using DefaultHMatrixLuType = HMatrixLu<ValueType, 2>;
+
+// Hierarchical LU factorization of a square H-matrix whose row and column
+// cluster trees coincide. The factors are stored in the block structure of
+// the H-matrix. Off-diagonal blocks are updated in truncated low-rank
+// arithmetic to the relative accuracy eps, the dense diagonal leaf blocks
+// are factorized with partial pivoting. With a coarse eps the factorization
+// is a cheap preconditioner, with a fine eps a direct solver.
+template <typename ValueType, int N> class HMatrixLu {
+public:
+  // Factorize a copy of the given matrix. All blocks of the matrix must be
+  // local to this process.
+  HMatrixLu(const HMatrix<ValueType, N> &hMatrix, double eps);
+
+  std::size_t rows() const;
+
+  // Overwrite X with the solution of H * Y = X. X is given in original dof
+  // ordering.
+  void solve(Eigen::Ref<Matrix<ValueType>> X) const;
+
+  // Same as solve, but X is given in H-matrix dof ordering.
+  void solvePermuted(Eigen::Ref<Matrix<ValueType>> X) const;
+
+  double memSizeKb() const;
+
+private:
+  typedef BlockClusterTreeNode<N> Node;
+
+  static const Node *child(const Node *node, int i, int j);
+  static const IndexRangeType &rowRange(const Node *node);
+  static const IndexRangeType &columnRange(const Node *node);
+  static std::size_t rowOffset(const Node *parent, const Node *node);
+  static std::size_t columnOffset(const Node *parent, const Node *node);
+
+  // Overwrite the diagonal block with its LU factors.
+  void factorize(const Node *node);
+
+  // X := L^{-1} * P * X with L and P from the diagonal block.
+  void solveLowerLeft(const Node *diagonal, const Node *node);
+
+  // X := X * U^{-1} with U from the diagonal block.
+  void solveUpperRight(const Node *diagonal, const Node *node);
+
+  // C := C - A * B in truncated arithmetic.
+  void multiplySubtract(const Node *nodeC, const Node *nodeA,
+                        const Node *nodeB);
+
+  // Compute A * B as the product U * V of two dense matrices.
+  void multiplyToLowRank(const Node *nodeA, const Node *nodeB,
+                         Matrix<ValueType> &U, Matrix<ValueType> &V) const;
+
+  // C := C + U * V in truncated arithmetic.
+  void addLowRank(const Node *node,
+                  const Eigen::Ref<const Matrix<ValueType>> &U,
+                  const Eigen::Ref<const Matrix<ValueType>> &V);
+
+  // Recompress the accumulated updates of a low-rank leaf.
+  void truncateLeaf(const Node *node);
+
+  // Y := Y + alpha * op(block) * X for dense X and Y.
+  void applySubtree(const Node *node, Eigen::Ref<Matrix<ValueType>> X,
+                    Eigen::Ref<Matrix<ValueType>> Y, TransposeMode trans,
+                    ValueType alpha) const;
+
+  // Triangular solves with the factors of a diagonal block for dense X.
+  void forwardSolve(const Node *diagonal,
+                    Eigen::Ref<Matrix<ValueType>> X) const;
+  void backwardSolve(const Node *diagonal,
+                     Eigen::Ref<Matrix<ValueType>> X) const;
+  void transposedBackwardSolve(const Node *diagonal,
+                               Eigen::Ref<Matrix<ValueType>> X) const;
+
+  shared_ptr<const BlockClusterTree<N>> m_blockClusterTree;
+  double m_eps;
+
+  // Both maps are filled before the factorization starts. Afterwards only
+  // the mapped values change, so that they can be accessed concurrently.
+  std::unordered_map<const Node *, shared_ptr<HMatrixData<ValueType>>> m_data;
+  std::unordered_map<const Node *, Eigen::PartialPivLU<Matrix<ValueType>>>
+      m_diagonalLu;
+};
+}
+
+#include "hmatrix_lu_impl.hpp"
+
+#endif
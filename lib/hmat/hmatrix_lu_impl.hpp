@@ -0,0 +1,596 @@
+// vi: set et ts=4 sw=2 sts=2:
+
+#ifndef HMAT_HMATRIX_LU_IMPL_HPP
+#define HMAT_HMATRIX_LU_IMPL_HPP
+
+#include "hmatrix_lu.hpp"
+#include "hmatrix_data.hpp"
+#include "hmatrix_dense_data.hpp"
+#include "hmatrix_low_rank_data.hpp"
+#include "math_helper.hpp"
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_group.h>
+
+#include <stdexcept>
+#include <vector>
+
+namespace hmat {
+
+template <typename ValueType, int N>
+HMatrixLu<ValueType, N>::HMatrixLu(const HMatrix<ValueType, N> &hMatrix,
+                                   double eps)
+    : m_blockClusterTree(hMatrix.blockClusterTree()), m_eps(eps) {
+
+  const auto &rowClusterTree = *m_blockClusterTree->rowClusterTree();
+  const auto &columnClusterTree = *m_blockClusterTree->columnClusterTree();
+
+  if (hMatrix.rows() != hMatrix.columns())
+    throw std::runtime_error("HMatrixLu::HMatrixLu: Matrix is not square.");
+
+  if (!rowClusterTree.hasSameClusters(columnClusterTree))
+    throw std::runtime_error("HMatrixLu::HMatrixLu: Row and column cluster "
+                             "trees must be identical.");
+
+  auto leafs = m_blockClusterTree->leafNodes();
+  // Symmetric matrices are only stored on one process.
+  if (hMatrix.symmetry() == UNSYMMETRIC &&
+      hMatrix.numberOfBlocks() != static_cast<int>(leafs.size()))
+    throw std::runtime_error("HMatrixLu::HMatrixLu: All blocks must be local "
+                             "to this process.");
+
+  for (const auto &leaf : leafs) {
+    m_data[leaf.get()];
+    if (rowRange(leaf.get()) == columnRange(leaf.get()))
+      m_diagonalLu[leaf.get()];
+  }
+
+  // The factorization works in place, so copy the blocks.
+  tbb::parallel_for(tbb::blocked_range<std::size_t>(0, leafs.size()),
+                    [&](const tbb::blocked_range<std::size_t> &r) {
+                      for (auto i = r.begin(); i != r.end(); ++i) {
+                        auto data = hMatrix.data(leafs[i]);
+                        auto &copy = m_data.at(leafs[i].get());
+                        if (data->type() == DENSE) {
+                          auto denseData =
+                              make_shared<HMatrixDenseData<ValueType>>();
+                          denseData->A() =
+                              static_cast<const HMatrixDenseData<ValueType> &>(
+                                  *data).A();
+                          copy = denseData;
+                        } else {
+                          const auto &lowRankData = static_cast<
+                              const HMatrixLowRankData<ValueType> &>(*data);
+                          copy.reset(new HMatrixLowRankData<ValueType>(
+                              lowRankData.A(), lowRankData.B()));
+                        }
+                      }
+                    });
+
+  factorize(m_blockClusterTree->root().get());
+}
+
+template <typename ValueType, int N>
+std::size_t HMatrixLu<ValueType, N>::rows() const {
+  return m_blockClusterTree->rows();
+}
+
+template <typename ValueType, int N>
+void HMatrixLu<ValueType, N>::solve(Eigen::Ref<Matrix<ValueType>> X) const {
+
+  const auto &clusterTree = *m_blockClusterTree->rowClusterTree();
+
+  Matrix<ValueType> permuted(X.rows(), X.cols());
+  for (std::size_t i = 0; i < rows(); ++i)
+    permuted.row(clusterTree.mapOriginalDofToHMatDof(i)) = X.row(i);
+
+  solvePermuted(permuted);
+
+  for (std::size_t i = 0; i < rows(); ++i)
+    X.row(clusterTree.mapHMatDofToOriginalDof(i)) = permuted.row(i);
+}
+
+template <typename ValueType, int N>
+void HMatrixLu<ValueType, N>::solvePermuted(
+    Eigen::Ref<Matrix<ValueType>> X) const {
+
+  if (X.rows() != static_cast<int>(rows()))
+    throw std::runtime_error("HMatrixLu::solvePermuted: Wrong number of rows "
+                             "in right-hand side.");
+
+  forwardSolve(m_blockClusterTree->root().get(), X);
+  backwardSolve(m_blockClusterTree->root().get(), X);
+}
+
+template <typename ValueType, int N>
+double HMatrixLu<ValueType, N>::memSizeKb() const {
+
+  double result = 0;
+  for (const auto &entry : m_data)
+    result += entry.second->memSizeKb();
+  for (const auto &entry : m_diagonalLu)
+    result += sizeof(ValueType) * entry.second.matrixLU().size() / 1024.0;
+  return result;
+}
+
+template <typename ValueType, int N>
+const typename HMatrixLu<ValueType, N>::Node *
+HMatrixLu<ValueType, N>::child(const Node *node, int i, int j) {
+  return node->child(N * i + j).get();
+}
+
+template <typename ValueType, int N>
+const IndexRangeType &HMatrixLu<ValueType, N>::rowRange(const Node *node) {
+  return node->data().rowClusterTreeNode->data().indexRange;
+}
+
+template <typename ValueType, int N>
+const IndexRangeType &HMatrixLu<ValueType, N>::columnRange(const Node *node) {
+  return node->data().columnClusterTreeNode->data().indexRange;
+}
+
+template <typename ValueType, int N>
+std::size_t HMatrixLu<ValueType, N>::rowOffset(const Node *parent,
+                                               const Node *node) {
+  return rowRange(node)[0] - rowRange(parent)[0];
+}
+
+template <typename ValueType, int N>
+std::size_t HMatrixLu<ValueType, N>::columnOffset(const Node *parent,
+                                                  const Node *node) {
+  return columnRange(node)[0] - columnRange(parent)[0];
+}
+
+template <typename ValueType, int N>
+void HMatrixLu<ValueType, N>::factorize(const Node *node) {
+
+  if (node->isLeaf()) {
+    auto &data = *m_data.at(node);
+    if (data.type() != DENSE)
+      throw std::runtime_error("HMatrixLu::factorize: Diagonal leaf blocks "
+                               "must be dense.");
+    auto &A = static_cast<HMatrixDenseData<ValueType> &>(data).A();
+    m_diagonalLu.at(node).compute(A);
+    A.resize(0, 0);
+    return;
+  }
+
+  for (int i = 0; i < N; ++i) {
+    factorize(child(node, i, i));
+
+    tbb::task_group group;
+    for (int j = i + 1; j < N; ++j) {
+      group.run([this, node, i, j]() {
+        solveLowerLeft(child(node, i, i), child(node, i, j));
+      });
+      group.run([this, node, i, j]() {
+        solveUpperRight(child(node, i, i), child(node, j, i));
+      });
+    }
+    group.wait();
+
+    for (int j = i + 1; j < N; ++j)
+      for (int k = i + 1; k < N; ++k)
+        group.run([this, node, i, j, k]() {
+          multiplySubtract(child(node, j, k), child(node, j, i),
+                           child(node, i, k));
+        });
+    group.wait();
+  }
+}
+
+template <typename ValueType, int N>
+void HMatrixLu<ValueType, N>::solveLowerLeft(const Node *diagonal,
+                                             const Node *node) {
+
+  if (node->isLeaf()) {
+    auto &data = *m_data.at(node);
+    if (data.type() == DENSE)
+      forwardSolve(diagonal,
+                   static_cast<HMatrixDenseData<ValueType> &>(data).A());
+    else {
+      truncateLeaf(node);
+      if (data.rank() > 0)
+        forwardSolve(diagonal,
+                     static_cast<HMatrixLowRankData<ValueType> &>(data).A());
+    }
+    return;
+  }
+
+  if (diagonal->isLeaf())
+    throw std::runtime_error("HMatrixLu::solveLowerLeft: Block is finer than "
+                             "its diagonal block.");
+
+  for (int i = 0; i < N; ++i) {
+    tbb::task_group group;
+    for (int j = 0; j < N; ++j)
+      group.run([this, diagonal, node, i, j]() {
+        solveLowerLeft(child(diagonal, i, i), child(node, i, j));
+      });
+    group.wait();
+
+    for (int k = i + 1; k < N; ++k)
+      for (int j = 0; j < N; ++j)
+        group.run([this, diagonal, node, i, j, k]() {
+          multiplySubtract(child(node, k, j), child(diagonal, k, i),
+                           child(node, i, j));
+        });
+    group.wait();
+  }
+}
+
+template <typename ValueType, int N>
+void HMatrixLu<ValueType, N>::solveUpperRight(const Node *diagonal,
+                                              const Node *node) {
+
+  if (node->isLeaf()) {
+    auto &data = *m_data.at(node);
+    Matrix<ValueType> transposed;
+    if (data.type() == DENSE) {
+      auto &A = static_cast<HMatrixDenseData<ValueType> &>(data).A();
+      transposed = A.transpose();
+      transposedBackwardSolve(diagonal, transposed);
+      A = transposed.transpose();
+    } else {
+      truncateLeaf(node);
+      if (data.rank() > 0) {
+        auto &B = static_cast<HMatrixLowRankData<ValueType> &>(data).B();
+        transposed = B.transpose();
+        transposedBackwardSolve(diagonal, transposed);
+        B = transposed.transpose();
+      }
+    }
+    return;
+  }
+
+  if (diagonal->isLeaf())
+    throw std::runtime_error("HMatrixLu::solveUpperRight: Block is finer than "
+                             "its diagonal block.");
+
+  for (int j = 0; j < N; ++j) {
+    tbb::task_group group;
+    for (int i = 0; i < N; ++i)
+      group.run([this, diagonal, node, i, j]() {
+        solveUpperRight(child(diagonal, j, j), child(node, i, j));
+      });
+    group.wait();
+
+    for (int k = j + 1; k < N; ++k)
+      for (int i = 0; i < N; ++i)
+        group.run([this, diagonal, node, i, j, k]() {
+          multiplySubtract(child(node, i, k), child(node, i, j),
+                           child(diagonal, j, k));
+        });
+    group.wait();
+  }
+}
+
+template <typename ValueType, int N>
+void HMatrixLu<ValueType, N>::multiplySubtract(const Node *nodeC,
+                                               const Node *nodeA,
+                                               const Node *nodeB) {
+
+  if (nodeC->isLeaf() || nodeA->isLeaf() || nodeB->isLeaf()) {
+    Matrix<ValueType> U;
+    Matrix<ValueType> V;
+    multiplyToLowRank(nodeA, nodeB, U, V);
+    U = -U;
+    addLowRank(nodeC, U, V);
+    return;
+  }
+
+  tbb::task_group group;
+  for (int i = 0; i < N; ++i)
+    for (int k = 0; k < N; ++k)
+      group.run([this, nodeC, nodeA, nodeB, i, k]() {
+        const Node *childC = child(nodeC, i, k);
+        if (!childC->isLeaf()) {
+          for (int j = 0; j < N; ++j)
+            multiplySubtract(childC, child(nodeA, i, j), child(nodeB, j, k));
+          return;
+        }
+
+        // Sum up all products first, so that the leaf is truncated once.
+        std::vector<Matrix<ValueType>> childU(N);
+        std::vector<Matrix<ValueType>> childV(N);
+        std::size_t rank = 0;
+        for (int j = 0; j < N; ++j) {
+          multiplyToLowRank(child(nodeA, i, j), child(nodeB, j, k), childU[j],
+                            childV[j]);
+          rank += childU[j].cols();
+        }
+        Matrix<ValueType> U(childU[0].rows(), rank);
+        Matrix<ValueType> V(rank, childV[0].cols());
+        std::size_t column = 0;
+        for (int j = 0; j < N; ++j) {
+          U.middleCols(column, childU[j].cols()) = -childU[j];
+          V.middleRows(column, childU[j].cols()) = childV[j];
+          column += childU[j].cols();
+        }
+        addLowRank(childC, U, V);
+      });
+  group.wait();
+}
+
+template <typename ValueType, int N>
+void HMatrixLu<ValueType, N>::multiplyToLowRank(const Node *nodeA,
+                                                const Node *nodeB,
+                                                Matrix<ValueType> &U,
+                                                Matrix<ValueType> &V) const {
+
+  const std::size_t rows = rowRange(nodeA)[1] - rowRange(nodeA)[0];
+  const std::size_t cols = columnRange(nodeB)[1] - columnRange(nodeB)[0];
+
+  // Write a dense product P as I * P or P * I, whichever is smaller.
+  auto fromDense = [rows, cols, &U, &V](Matrix<ValueType> &product) {
+    if (rows <= cols) {
+      U = Matrix<ValueType>::Identity(rows, rows);
+      V.swap(product);
+    } else {
+      U.swap(product);
+      V = Matrix<ValueType>::Identity(cols, cols);
+    }
+  };
+
+  if (nodeA->isLeaf() || nodeB->isLeaf()) {
+    const auto &data = *m_data.at(nodeA->isLeaf() ? nodeA : nodeB);
+
+    if (data.type() == LOW_RANK_AB && data.rank() == 0) {
+      U.setZero(rows, 0);
+      V.setZero(0, cols);
+      return;
+    }
+
+    if (nodeA->isLeaf()) {
+      // A * B = (B^T * A^T)^T
+      Matrix<ValueType> transposed;
+      if (data.type() == DENSE)
+        transposed = static_cast<const HMatrixDenseData<ValueType> &>(data)
+                         .A()
+                         .transpose();
+      else
+        transposed = static_cast<const HMatrixLowRankData<ValueType> &>(data)
+                         .B()
+                         .transpose();
+      Matrix<ValueType> product =
+          Matrix<ValueType>::Zero(cols, transposed.cols());
+      applySubtree(nodeB, transposed, product, TransposeMode::TRANS, 1);
+      product.transposeInPlace();
+      if (data.type() == DENSE)
+        fromDense(product);
+      else {
+        U = static_cast<const HMatrixLowRankData<ValueType> &>(data).A();
+        V.swap(product);
+      }
+    } else {
+      Matrix<ValueType> factor;
+      if (data.type() == DENSE)
+        factor = static_cast<const HMatrixDenseData<ValueType> &>(data).A();
+      else
+        factor = static_cast<const HMatrixLowRankData<ValueType> &>(data).A();
+      Matrix<ValueType> product = Matrix<ValueType>::Zero(rows, factor.cols());
+      applySubtree(nodeA, factor, product, TransposeMode::NOTRANS, 1);
+      if (data.type() == DENSE)
+        fromDense(product);
+      else {
+        U.swap(product);
+        V = static_cast<const HMatrixLowRankData<ValueType> &>(data).B();
+      }
+    }
+    return;
+  }
+
+  // Both factors are subdivided. Collect the products of the children and
+  // truncate the stacked factors once.
+  std::vector<Matrix<ValueType>> childU(N * N * N);
+  std::vector<Matrix<ValueType>> childV(N * N * N);
+  std::size_t rank = 0;
+  for (int i = 0; i < N; ++i)
+    for (int j = 0; j < N; ++j)
+      for (int k = 0; k < N; ++k) {
+        const int index = N * (N * i + j) + k;
+        multiplyToLowRank(child(nodeA, i, j), child(nodeB, j, k),
+                          childU[index], childV[index]);
+        rank += childU[index].cols();
+      }
+
+  U.setZero(rows, rank);
+  V.setZero(rank, cols);
+  std::size_t column = 0;
+  for (int i = 0; i < N; ++i)
+    for (int j = 0; j < N; ++j)
+      for (int k = 0; k < N; ++k) {
+        const int index = N * (N * i + j) + k;
+        const std::size_t childRank = childU[index].cols();
+        U.block(rowOffset(nodeA, child(nodeA, i, j)), column,
+                childU[index].rows(), childRank) = childU[index];
+        V.block(column, columnOffset(nodeB, child(nodeB, j, k)), childRank,
+                childV[index].cols()) = childV[index];
+        column += childRank;
+      }
+
+  if (rank > 0) {
+    bool success;
+    truncateLowRank(U, V, m_eps, rank, success);
+  }
+}
+
+template <typename ValueType, int N>
+void HMatrixLu<ValueType, N>::addLowRank(
+    const Node *node, const Eigen::Ref<const Matrix<ValueType>> &U,
+    const Eigen::Ref<const Matrix<ValueType>> &V) {
+
+  if (U.cols() == 0)
+    return;
+
+  if (node->isLeaf()) {
+    auto &data = *m_data.at(node);
+    if (data.type() == DENSE) {
+      static_cast<HMatrixDenseData<ValueType> &>(data).A().noalias() += U * V;
+      return;
+    }
+
+    auto &lowRankData = static_cast<HMatrixLowRankData<ValueType> &>(data);
+    const std::size_t rank = lowRankData.rank();
+    Matrix<ValueType> A(U.rows(), rank + U.cols());
+    Matrix<ValueType> B(rank + U.cols(), V.cols());
+    if (rank > 0) {
+      A.leftCols(rank) = lowRankData.A();
+      B.topRows(rank) = lowRankData.B();
+    }
+    A.rightCols(U.cols()) = U;
+    B.bottomRows(U.cols()) = V;
+    lowRankData.A().swap(A);
+    lowRankData.B().swap(B);
+
+    // Updates are accumulated and truncated before the block is solved for.
+    // Truncate earlier only if the factors grow too large.
+    if (lowRankData.rank() > std::min(U.rows(), V.cols()))
+      truncateLeaf(node);
+    return;
+  }
+
+  tbb::task_group group;
+  for (int i = 0; i < N; ++i)
+    for (int k = 0; k < N; ++k)
+      group.run([this, node, &U, &V, i, k]() {
+        const Node *childNode = child(node, i, k);
+        addLowRank(childNode,
+                   U.middleRows(rowOffset(node, childNode),
+                                rowRange(childNode)[1] -
+                                    rowRange(childNode)[0]),
+                   V.middleCols(columnOffset(node, childNode),
+                                columnRange(childNode)[1] -
+                                    columnRange(childNode)[0]));
+      });
+  group.wait();
+}
+
+template <typename ValueType, int N>
+void HMatrixLu<ValueType, N>::truncateLeaf(const Node *node) {
+
+  auto &lowRankData =
+      static_cast<HMatrixLowRankData<ValueType> &>(*m_data.at(node));
+  bool success;
+  truncateLowRank(lowRankData.A(), lowRankData.B(), m_eps, lowRankData.rank(),
+                  success);
+}
+
+template <typename ValueType, int N>
+void HMatrixLu<ValueType, N>::applySubtree(const Node *node,
+                                           Eigen::Ref<Matrix<ValueType>> X,
+                                           Eigen::Ref<Matrix<ValueType>> Y,
+                                           TransposeMode trans,
+                                           ValueType alpha) const {
+
+  if (node->isLeaf()) {
+    m_data.at(node)->apply(X, Y, trans, alpha, 1);
+    return;
+  }
+
+  for (int i = 0; i < N; ++i)
+    for (int j = 0; j < N; ++j) {
+      const Node *childNode = child(node, i, j);
+      const std::size_t rowStart = rowOffset(node, childNode);
+      const std::size_t columnStart = columnOffset(node, childNode);
+      const std::size_t rows =
+          rowRange(childNode)[1] - rowRange(childNode)[0];
+      const std::size_t cols =
+          columnRange(childNode)[1] - columnRange(childNode)[0];
+      if (trans == TransposeMode::NOTRANS || trans == TransposeMode::CONJ)
+        applySubtree(childNode, X.middleRows(columnStart, cols),
+                     Y.middleRows(rowStart, rows), trans, alpha);
+      else
+        applySubtree(childNode, X.middleRows(rowStart, rows),
+                     Y.middleRows(columnStart, cols), trans, alpha);
+    }
+}
+
+template <typename ValueType, int N>
+void HMatrixLu<ValueType, N>::forwardSolve(
+    const Node *diagonal, Eigen::Ref<Matrix<ValueType>> X) const {
+
+  if (diagonal->isLeaf()) {
+    const auto &lu = m_diagonalLu.at(diagonal);
+    X = lu.permutationP() * X;
+    lu.matrixLU().template triangularView<Eigen::UnitLower>().solveInPlace(X);
+    return;
+  }
+
+  for (int i = 0; i < N; ++i) {
+    const Node *childNode = child(diagonal, i, i);
+    const std::size_t start = rowOffset(diagonal, childNode);
+    const std::size_t size = rowRange(childNode)[1] - rowRange(childNode)[0];
+    forwardSolve(childNode, X.middleRows(start, size));
+    for (int j = i + 1; j < N; ++j) {
+      const Node *lowerNode = child(diagonal, j, i);
+      applySubtree(lowerNode, X.middleRows(start, size),
+                   X.middleRows(rowOffset(diagonal, lowerNode),
+                                rowRange(lowerNode)[1] -
+                                    rowRange(lowerNode)[0]),
+                   TransposeMode::NOTRANS, -1);
+    }
+  }
+}
+
+template <typename ValueType, int N>
+void HMatrixLu<ValueType, N>::backwardSolve(
+    const Node *diagonal, Eigen::Ref<Matrix<ValueType>> X) const {
+
+  if (diagonal->isLeaf()) {
+    m_diagonalLu.at(diagonal)
+        .matrixLU()
+        .template triangularView<Eigen::Upper>()
+        .solveInPlace(X);
+    return;
+  }
+
+  for (int i = N - 1; i >= 0; --i) {
+    const Node *childNode = child(diagonal, i, i);
+    const std::size_t start = rowOffset(diagonal, childNode);
+    const std::size_t size = rowRange(childNode)[1] - rowRange(childNode)[0];
+    backwardSolve(childNode, X.middleRows(start, size));
+    for (int j = 0; j < i; ++j) {
+      const Node *upperNode = child(diagonal, j, i);
+      applySubtree(upperNode, X.middleRows(start, size),
+                   X.middleRows(rowOffset(diagonal, upperNode),
+                                rowRange(upperNode)[1] -
+                                    rowRange(upperNode)[0]),
+                   TransposeMode::NOTRANS, -1);
+    }
+  }
+}
+
+template <typename ValueType, int N>
+void HMatrixLu<ValueType, N>::transposedBackwardSolve(
+    const Node *diagonal, Eigen::Ref<Matrix<ValueType>> X) const {
+
+  // Solves U^T * Y = X, which is a forward substitution.
+  if (diagonal->isLeaf()) {
+    m_diagonalLu.at(diagonal)
+        .matrixLU()
+        .template triangularView<Eigen::Upper>()
+        .transpose()
+        .solveInPlace(X);
+    return;
+  }
+
+  for (int j = 0; j < N; ++j) {
+    const Node *childNode = child(diagonal, j, j);
+    const std::size_t start = rowOffset(diagonal, childNode);
+    const std::size_t size = rowRange(childNode)[1] - rowRange(childNode)[0];
+    transposedBackwardSolve(childNode, X.middleRows(start, size));
+    for (int k = j + 1; k < N; ++k) {
+      const Node *upperNode = child(diagonal, j, k);
+      applySubtree(upperNode, X.middleRows(start, size),
+                   X.middleRows(columnOffset(diagonal, upperNode),
+                                columnRange(upperNode)[1] -
+                                    columnRange(upperNode)[0]),
+                   TransposeMode::TRANS, -1);
+    }
+  }
+}
+}
+
+#endif
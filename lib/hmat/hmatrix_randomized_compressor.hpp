@@ -0,0 +1,46 @@
+// vi: set et ts=4 sw=2 sts=2:
+
+#ifndef HMAT_HMATRIX_RANDOMIZED_COMPRESSOR_HPP
+#define HMAT_HMATRIX_RANDOMIZED_COMPRESSOR_HPP
+
+#include "common.hpp"
+#include "data_accessor.hpp"
+#include "eigen_fwd.hpp"
+#include "hmatrix_compressor.hpp"
+#include "hmatrix_dense_compressor.hpp"
+
+namespace hmat {
+
+// Compress admissible blocks with an adaptive randomized range finder.
+// The range of a block is sampled with panels of sampleBlockSize
+// consecutive columns, taken in random order, until the approximation
+// attains eps. Each panel is evaluated in one accessor call. The block is
+// then interpolated from as many of its rows as the rank, which are
+// evaluated in runs of consecutive rows. Only the sampled columns and rows
+// are evaluated. Blocks that need a rank above maxRank are truncated to
+// maxRank, as in the ACA compressor.
+template <typename ValueType, int N>
+class HMatrixRandomizedCompressor : public HMatrixCompressor<ValueType, N> {
+public:
+  HMatrixRandomizedCompressor(const DataAccessor<ValueType, N> &dataAccessor,
+                              double eps, unsigned int maxRank, double cutoff,
+                              unsigned int sampleBlockSize = 8);
+
+protected:
+  void compressBlockImpl(
+      const BlockClusterTreeNode<N> &blockClusterTreeNode,
+      shared_ptr<HMatrixData<ValueType>> &hMatrixData,
+      CompressionStatistics &statistics) const override;
+
+private:
+  const DataAccessor<ValueType, N> &m_dataAccessor;
+  double m_eps;
+  unsigned int m_maxRank;
+  unsigned int m_sampleBlockSize;
+  HMatrixDenseCompressor<ValueType, N> m_hMatrixDenseCompressor;
+};
+}
+
+#include "hmatrix_randomized_compressor_impl.hpp"
+
+#endif
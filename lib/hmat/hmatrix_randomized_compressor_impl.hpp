@@ -0,0 +1,148 @@
+// vi: set et ts=4 sw=2 sts=2:
+
+#ifndef HMAT_HMATRIX_RANDOMIZED_COMPRESSOR_IMPL_HPP
+#define HMAT_HMATRIX_RANDOMIZED_COMPRESSOR_IMPL_HPP
+
+#include "hmatrix_randomized_compressor.hpp"
+#include "hmatrix_dense_data.hpp"
+#include "hmatrix_low_rank_data.hpp"
+#include "math_helper.hpp"
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <vector>
+
+namespace hmat {
+
+template <typename ValueType, int N>
+HMatrixRandomizedCompressor<ValueType, N>::HMatrixRandomizedCompressor(
+    const DataAccessor<ValueType, N> &dataAccessor, double eps,
+    unsigned int maxRank, double cutoff, unsigned int sampleBlockSize)
+    : HMatrixCompressor<ValueType, N>(cutoff), m_dataAccessor(dataAccessor),
+      m_eps(eps), m_maxRank(maxRank),
+      m_sampleBlockSize(std::max(sampleBlockSize, 1u)),
+      m_hMatrixDenseCompressor(dataAccessor, cutoff) {}
+
+template <typename ValueType, int N>
+void HMatrixRandomizedCompressor<ValueType, N>::compressBlockImpl(
+    const BlockClusterTreeNode<N> &blockClusterTreeNode,
+    shared_ptr<HMatrixData<ValueType>> &hMatrixData,
+    CompressionStatistics &statistics) const {
+
+  if (!blockClusterTreeNode.data().admissible) {
+    m_hMatrixDenseCompressor.compressBlock(blockClusterTreeNode, hMatrixData,
+                                           statistics);
+    return;
+  }
+
+  auto rowIndexRange =
+      blockClusterTreeNode.data().rowClusterTreeNode->data().indexRange;
+  auto columnIndexRange =
+      blockClusterTreeNode.data().columnClusterTreeNode->data().indexRange;
+  std::size_t rows = rowIndexRange[1] - rowIndexRange[0];
+  std::size_t cols = columnIndexRange[1] - columnIndexRange[0];
+
+  // The block is never evaluated as a whole. The range of the block is
+  // sampled with panels of consecutive columns in random order. The
+  // generator is seeded by the block, so the result does not depend on the
+  // scheduling of the tasks.
+  std::seed_seq seed{rowIndexRange[0], rowIndexRange[1], columnIndexRange[0],
+                     columnIndexRange[1]};
+  std::mt19937 generator(seed);
+  std::size_t panelCount = (cols + m_sampleBlockSize - 1) / m_sampleBlockSize;
+  std::vector<std::size_t> panelOrder(panelCount);
+  std::iota(panelOrder.begin(), panelOrder.end(), 0);
+  std::shuffle(panelOrder.begin(), panelOrder.end(), generator);
+
+  std::size_t maxBasisSize =
+      std::min(static_cast<std::size_t>(m_maxRank), std::min(rows, cols));
+  Matrix<ValueType> Q(rows, maxBasisSize);
+  std::size_t basisSize = 0;
+  bool rankLimitReached = false;
+
+  // Consecutive columns are correlated, so sampling only stops once the
+  // basis captures three panels in a row.
+  const int requiredPasses = 3;
+  int passes = 0;
+  Matrix<ValueType> samples;
+  for (auto panel : panelOrder) {
+    std::size_t firstColumn = columnIndexRange[0] + panel * m_sampleBlockSize;
+    IndexRangeType columnRange = {
+        {firstColumn,
+         std::min(firstColumn + m_sampleBlockSize, columnIndexRange[1])}};
+    m_dataAccessor.computeMatrixBlock(rowIndexRange, columnRange,
+                                      blockClusterTreeNode, samples);
+    statistics.evaluatedEntries += samples.size();
+    ++statistics.iterations;
+
+    // Project the samples twice against the basis for stability.
+    double sampleNorm = samples.norm();
+    auto basis = Q.leftCols(basisSize);
+    for (int pass = 0; pass < 2; ++pass) {
+      Matrix<ValueType> coefficients = basis.adjoint() * samples;
+      samples.noalias() -= basis * coefficients;
+    }
+    if (samples.norm() <= m_eps * sampleNorm) {
+      if (++passes == requiredPasses)
+        break;
+      continue;
+    }
+    passes = 0;
+
+    Eigen::ColPivHouseholderQR<Matrix<ValueType>> qr(samples);
+    std::size_t newDirections = qr.rank();
+    if (newDirections > maxBasisSize - basisSize) {
+      newDirections = maxBasisSize - basisSize;
+      rankLimitReached = true;
+    }
+    Matrix<ValueType> directions =
+        qr.householderQ() * Matrix<ValueType>::Identity(rows, newDirections);
+    Q.middleCols(basisSize, newDirections) = directions;
+    basisSize += newDirections;
+    if (rankLimitReached)
+      break;
+  }
+  statistics.rankLimitReached = rankLimitReached;
+
+  // Interpolate the block from the rows in which the basis is best
+  // conditioned, block ~ Q * Q(I, :)^-1 * block(I, :).
+  Matrix<ValueType> A = Q.leftCols(basisSize);
+  Matrix<ValueType> B(basisSize, cols);
+  if (basisSize > 0) {
+    Eigen::ColPivHouseholderQR<Matrix<ValueType>> rowQr(A.adjoint());
+    const auto &skeleton = rowQr.colsPermutation().indices();
+    std::vector<std::size_t> skeletonRows(
+        skeleton.data(), skeleton.data() + basisSize);
+    std::sort(skeletonRows.begin(), skeletonRows.end());
+    Matrix<ValueType> skeletonBasis(basisSize, basisSize);
+    Matrix<ValueType> rowBlock;
+    for (std::size_t begin = 0; begin < basisSize;) {
+      // Runs of consecutive skeleton rows are evaluated in one call.
+      std::size_t end = begin + 1;
+      while (end < basisSize &&
+             skeletonRows[end] == skeletonRows[end - 1] + 1)
+        ++end;
+      IndexRangeType rowRange = {{rowIndexRange[0] + skeletonRows[begin],
+                                  rowIndexRange[0] + skeletonRows[end - 1] +
+                                      1}};
+      m_dataAccessor.computeMatrixBlock(rowRange, columnIndexRange,
+                                        blockClusterTreeNode, rowBlock);
+      B.middleRows(begin, end - begin) = rowBlock;
+      for (std::size_t k = begin; k < end; ++k)
+        skeletonBasis.row(k) = A.row(skeletonRows[k]);
+      begin = end;
+    }
+    B = skeletonBasis.colPivHouseholderQr().solve(B).eval();
+
+    bool success;
+    truncateLowRank(A, B, m_eps, basisSize, success);
+  }
+
+  hMatrixData.reset(new HMatrixLowRankData<ValueType>());
+  static_cast<HMatrixLowRankData<ValueType> *>(hMatrixData.get())->A().swap(A);
+  static_cast<HMatrixLowRankData<ValueType> *>(hMatrixData.get())->B().swap(B);
+}
+}
+
+#endif
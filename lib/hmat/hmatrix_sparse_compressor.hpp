@@ -0,0 +1,46 @@
+// vi: set et ts=4 sw=2 sts=2:
+
+#ifndef HMAT_HMATRIX_SPARSE_COMPRESSOR_HPP
+#define HMAT_HMATRIX_SPARSE_COMPRESSOR_HPP
+
+#include "common.hpp"
+#include "hmatrix_compressor.hpp"
+
+#include <Eigen/Sparse>
+
+namespace hmat {
+
+// Compressor for a sparse matrix, e.g. a mass matrix, so that it can enter
+// truncated H-matrix arithmetic. The matrix is given in the original dof
+// ordering of the cluster trees of blockClusterTree. Admissible blocks
+// without nonzero entries have rank zero, other admissible blocks are
+// truncated to the relative accuracy eps if this saves storage.
+template <typename ValueType, int N>
+class HMatrixSparseCompressor : public HMatrixCompressor<ValueType, N> {
+public:
+  HMatrixSparseCompressor(const Eigen::SparseMatrix<ValueType> &matrix,
+                          const BlockClusterTree<N> &blockClusterTree,
+                          double eps);
+
+protected:
+  void compressBlockImpl(
+      const BlockClusterTreeNode<N> &blockClusterTreeNode,
+      shared_ptr<HMatrixData<ValueType>> &hMatrixData,
+      CompressionStatistics &statistics) const override;
+
+private:
+  // Number of nonzero entries of the block and the block itself if
+  // requested.
+  std::size_t extractBlock(const IndexRangeType &rowIndexRange,
+                           const IndexRangeType &columnIndexRange,
+                           Matrix<ValueType> *block) const;
+
+  // The matrix in H-matrix dof ordering.
+  Eigen::SparseMatrix<ValueType, Eigen::RowMajor> m_matrix;
+  double m_eps;
+};
+}
+
+#include "hmatrix_sparse_compressor_impl.hpp"
+
+#endif
@@ -0,0 +1,127 @@
+// vi: set et ts=4 sw=2 sts=2:
+
+#ifndef HMAT_HMATRIX_SPARSE_COMPRESSOR_IMPL_HPP
+#define HMAT_HMATRIX_SPARSE_COMPRESSOR_IMPL_HPP
+
+#include "hmatrix_sparse_compressor.hpp"
+#include "hmatrix_dense_data.hpp"
+#include "hmatrix_low_rank_data.hpp"
+#include "math_helper.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+namespace hmat {
+
+template <typename ValueType, int N>
+HMatrixSparseCompressor<ValueType, N>::HMatrixSparseCompressor(
+    const Eigen::SparseMatrix<ValueType> &matrix,
+    const BlockClusterTree<N> &blockClusterTree, double eps)
+    : HMatrixCompressor<ValueType, N>(std::numeric_limits<double>::max()),
+      m_eps(eps) {
+
+  const auto &rowMap =
+      blockClusterTree.rowClusterTree()->originalDofToHMatDofMap();
+  const auto &columnMap =
+      blockClusterTree.columnClusterTree()->originalDofToHMatDofMap();
+
+  typedef typename Eigen::SparseMatrix<ValueType>::Index Index;
+  if (matrix.rows() != static_cast<Index>(rowMap.size()) ||
+      matrix.cols() != static_cast<Index>(columnMap.size()))
+    throw std::runtime_error("HMatrixSparseCompressor::"
+                             "HMatrixSparseCompressor: Matrix size does not "
+                             "match the block cluster tree.");
+
+  std::vector<Eigen::Triplet<ValueType>> triplets;
+  triplets.reserve(matrix.nonZeros());
+  for (int k = 0; k < matrix.outerSize(); ++k)
+    for (typename Eigen::SparseMatrix<ValueType>::InnerIterator it(matrix, k);
+         it; ++it)
+      triplets.emplace_back(rowMap[it.row()], columnMap[it.col()],
+                            it.value());
+
+  m_matrix.resize(matrix.rows(), matrix.cols());
+  m_matrix.setFromTriplets(triplets.begin(), triplets.end());
+}
+
+template <typename ValueType, int N>
+std::size_t HMatrixSparseCompressor<ValueType, N>::extractBlock(
+    const IndexRangeType &rowIndexRange,
+    const IndexRangeType &columnIndexRange, Matrix<ValueType> *block) const {
+
+  if (block)
+    block->setZero(rowIndexRange[1] - rowIndexRange[0],
+                   columnIndexRange[1] - columnIndexRange[0]);
+
+  std::size_t nonZeros = 0;
+  const auto *innerIndices = m_matrix.innerIndexPtr();
+  const auto *values = m_matrix.valuePtr();
+  for (std::size_t i = rowIndexRange[0]; i < rowIndexRange[1]; ++i) {
+    // The column indices of a row are sorted.
+    const auto *begin = innerIndices + m_matrix.outerIndexPtr()[i];
+    const auto *end = innerIndices + m_matrix.outerIndexPtr()[i + 1];
+    const auto *first = std::lower_bound(begin, end, columnIndexRange[0]);
+    const auto *last = std::lower_bound(first, end, columnIndexRange[1]);
+    nonZeros += last - first;
+    if (block)
+      for (const auto *it = first; it != last; ++it)
+        (*block)(i - rowIndexRange[0], *it - columnIndexRange[0]) =
+            values[it - innerIndices];
+  }
+  return nonZeros;
+}
+
+template <typename ValueType, int N>
+void HMatrixSparseCompressor<ValueType, N>::compressBlockImpl(
+    const BlockClusterTreeNode<N> &blockClusterTreeNode,
+    shared_ptr<HMatrixData<ValueType>> &hMatrixData,
+    CompressionStatistics &statistics) const {
+
+  auto rowIndexRange =
+      blockClusterTreeNode.data().rowClusterTreeNode->data().indexRange;
+  auto columnIndexRange =
+      blockClusterTreeNode.data().columnClusterTreeNode->data().indexRange;
+  const std::size_t rows = rowIndexRange[1] - rowIndexRange[0];
+  const std::size_t cols = columnIndexRange[1] - columnIndexRange[0];
+
+  if (blockClusterTreeNode.data().admissible &&
+      extractBlock(rowIndexRange, columnIndexRange, nullptr) == 0) {
+    hMatrixData.reset(new HMatrixLowRankData<ValueType>());
+    auto lowRankData =
+        static_cast<HMatrixLowRankData<ValueType> *>(hMatrixData.get());
+    lowRankData->A().setZero(rows, 0);
+    lowRankData->B().setZero(0, cols);
+    return;
+  }
+
+  Matrix<ValueType> block;
+  statistics.evaluatedEntries +=
+      extractBlock(rowIndexRange, columnIndexRange, &block);
+
+  if (blockClusterTreeNode.data().admissible) {
+    Matrix<ValueType> A = block;
+    Matrix<ValueType> B = Matrix<ValueType>::Identity(cols, cols);
+    bool success;
+    truncateLowRank(A, B, m_eps, static_cast<int>(std::min(rows, cols)),
+                    success);
+    const auto rank = static_cast<std::size_t>(A.cols());
+    if (rank * (rows + cols) < rows * cols) {
+      hMatrixData.reset(new HMatrixLowRankData<ValueType>());
+      static_cast<HMatrixLowRankData<ValueType> *>(hMatrixData.get())
+          ->A()
+          .swap(A);
+      static_cast<HMatrixLowRankData<ValueType> *>(hMatrixData.get())
+          ->B()
+          .swap(B);
+      return;
+    }
+  }
+
+  hMatrixData.reset(new HMatrixDenseData<ValueType>());
+  static_cast<HMatrixDenseData<ValueType> *>(hMatrixData.get())->A().swap(
+      block);
+}
+}
+
+#endif
@@ -0,0 +1,69 @@
+// vi: set et ts=4 sw=2 sts=2:
+
+#ifndef HMAT_HMATRIX_STATISTICS_HPP
+#define HMAT_HMATRIX_STATISTICS_HPP
+
+#include "common.hpp"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace hmat {
+
+// Work and outcome of the compression of one block. Each compressor fills
+// in the fields that apply to it.
+struct CompressionStatistics {
+
+  CompressionStatistics();
+
+  // Matrix entries requested from the data accessor.
+  std::size_t evaluatedEntries;
+  // Iterations of an iterative compressor, e.g. the crosses of ACA.
+  std::size_t iterations;
+  // ACA stopped because it only found zero crosses.
+  bool zeroTermination;
+  // The compression stopped at the maximum rank.
+  bool rankLimitReached;
+};
+
+// Statistics of the assembly and of the matvecs of an H-matrix. They refer
+// to the leafs of this process as they were assembled, i.e. before any
+// coarsening.
+struct HMatrixStatistics {
+
+  struct LeafStatistics {
+    IndexRangeType rowRange;
+    IndexRangeType columnRange;
+    DataBlockType type;
+    std::size_t rank;
+    // Wall time of the compression in seconds.
+    double time;
+    CompressionStatistics compression;
+  };
+
+  HMatrixStatistics();
+
+  std::vector<LeafStatistics> leafs;
+
+  // Wall time of the compression and busy time of each worker in seconds.
+  double assemblyTime;
+  std::vector<double> threadBusyTimes;
+
+  // Matvec profile, only recorded if profiling is enabled. The leaf times
+  // are summed over all threads.
+  std::size_t numberOfMatVecs;
+  double matVecTime;
+  double denseMatVecTime;
+  double lowRankMatVecTime;
+
+  // Number of low-rank leafs of each rank.
+  std::map<std::size_t, std::size_t> rankHistogram() const;
+
+  std::string toJson() const;
+};
+}
+
+#include "hmatrix_statistics_impl.hpp"
+
+#endif
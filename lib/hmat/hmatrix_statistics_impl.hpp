@@ -0,0 +1,117 @@
+// vi: set et ts=4 sw=2 sts=2:
+
+#ifndef HMAT_HMATRIX_STATISTICS_IMPL_HPP
+#define HMAT_HMATRIX_STATISTICS_IMPL_HPP
+
+#include "hmatrix_statistics.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <sstream>
+
+namespace hmat {
+
+inline CompressionStatistics::CompressionStatistics()
+    : evaluatedEntries(0), iterations(0), zeroTermination(false),
+      rankLimitReached(false) {}
+
+inline HMatrixStatistics::HMatrixStatistics()
+    : assemblyTime(0), numberOfMatVecs(0), matVecTime(0), denseMatVecTime(0),
+      lowRankMatVecTime(0) {}
+
+inline std::map<std::size_t, std::size_t>
+HMatrixStatistics::rankHistogram() const {
+  std::map<std::size_t, std::size_t> histogram;
+  for (const auto &leaf : leafs)
+    if (leaf.type == LOW_RANK_AB)
+      histogram[leaf.rank]++;
+  return histogram;
+}
+
+inline std::string HMatrixStatistics::toJson() const {
+
+  std::size_t denseBlocks = 0;
+  std::size_t lowRankBlocks = 0;
+  std::size_t evaluatedEntries = 0;
+  std::size_t iterations = 0;
+  std::size_t maxIterations = 0;
+  std::size_t zeroTerminations = 0;
+  std::size_t rankLimitReached = 0;
+  double leafTime = 0;
+
+  for (const auto &leaf : leafs) {
+    if (leaf.type == DENSE)
+      denseBlocks++;
+    else
+      lowRankBlocks++;
+    evaluatedEntries += leaf.compression.evaluatedEntries;
+    iterations += leaf.compression.iterations;
+    maxIterations = std::max(maxIterations, leaf.compression.iterations);
+    zeroTerminations += leaf.compression.zeroTermination;
+    rankLimitReached += leaf.compression.rankLimitReached;
+    leafTime += leaf.time;
+  }
+
+  std::ostringstream json;
+  json.precision(std::numeric_limits<double>::max_digits10);
+
+  auto writeList = [&json](const std::vector<double> &values) {
+    json << "[";
+    for (std::size_t i = 0; i < values.size(); ++i)
+      json << (i ? ", " : "") << values[i];
+    json << "]";
+  };
+
+  json << "{\n";
+  json << "  \"numberOfLeafs\": " << leafs.size() << ",\n";
+  json << "  \"denseBlocks\": " << denseBlocks << ",\n";
+  json << "  \"lowRankBlocks\": " << lowRankBlocks << ",\n";
+  json << "  \"evaluatedEntries\": " << evaluatedEntries << ",\n";
+  json << "  \"iterations\": " << iterations << ",\n";
+  json << "  \"maxIterations\": " << maxIterations << ",\n";
+  json << "  \"zeroTerminations\": " << zeroTerminations << ",\n";
+  json << "  \"rankLimitReached\": " << rankLimitReached << ",\n";
+
+  json << "  \"rankHistogram\": {";
+  bool first = true;
+  for (const auto &bin : rankHistogram()) {
+    json << (first ? "" : ", ") << "\"" << bin.first << "\": " << bin.second;
+    first = false;
+  }
+  json << "},\n";
+
+  json << "  \"assemblyTime\": " << assemblyTime << ",\n";
+  json << "  \"leafTime\": " << leafTime << ",\n";
+  json << "  \"threadBusyTimes\": ";
+  writeList(threadBusyTimes);
+  json << ",\n";
+
+  json << "  \"matVec\": {\"count\": " << numberOfMatVecs
+       << ", \"time\": " << matVecTime
+       << ", \"denseTime\": " << denseMatVecTime
+       << ", \"lowRankTime\": " << lowRankMatVecTime << "},\n";
+
+  json << "  \"leafs\": [";
+  for (std::size_t i = 0; i < leafs.size(); ++i) {
+    const auto &leaf = leafs[i];
+    json << (i ? ",\n    " : "\n    ") << "{\"rowRange\": ["
+         << leaf.rowRange[0] << ", " << leaf.rowRange[1]
+         << "], \"columnRange\": [" << leaf.columnRange[0] << ", "
+         << leaf.columnRange[1] << "], \"type\": \""
+         << (leaf.type == DENSE ? "dense" : "lowRank")
+         << "\", \"rank\": " << leaf.rank << ", \"time\": " << leaf.time
+         << ", \"evaluatedEntries\": " << leaf.compression.evaluatedEntries
+         << ", \"iterations\": " << leaf.compression.iterations
+         << ", \"zeroTermination\": "
+         << (leaf.compression.zeroTermination ? "true" : "false")
+         << ", \"rankLimitReached\": "
+         << (leaf.compression.rankLimitReached ? "true" : "false") << "}";
+  }
+  json << (leafs.empty() ? "]\n" : "\n  ]\n");
+  json << "}\n";
+
+  return json.str();
+}
+}
+
+#endif
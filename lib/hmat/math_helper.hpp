@@ -4,6 +4,7 @@
 #include "common.hpp"
 #include "eigen_fwd.hpp"
 #include <functional>
+#include <random>
 
 namespace hmat {
 
@@ -21,13 +22,42 @@ template <typename ValueType>
 void compressQB(Matrix<ValueType> &Q, Matrix<ValueType> &B, double threshold,
                 int maxRank, bool &success);
 
+// Recompress the low-rank product A * B to the smallest rank such that all
+// discarded singular values are below threshold times the largest one.
+// If this rank exceeds maxRank, A and B are left unchanged and success is
+// set to false.
+template <typename ValueType>
+void truncateLowRank(Matrix<ValueType> &A, Matrix<ValueType> &B,
+                     double threshold, int maxRank, bool &success);
+
+// Return a matrix with entries uniformly distributed in [-1, 1], in both
+// the real and imaginary part for complex types. Unlike Matrix::Random the
+// entries only depend on the state of the generator, so every task can
+// sample with its own generator.
+template <typename ValueType>
+Matrix<ValueType> randomMatrix(int rows, int cols, std::mt19937 &generator);
+
 template <typename ValueType>
 void randomizedLowRankApproximation(const matApply_t<ValueType> &applyFun,
                                     int rows, int cols, double threshold,
                                     int maxRank, int sampleDimension,
-                                    bool &success, Matrix<ValueType> &A,
+                                    std::mt19937 &generator, bool &success,
+                                    Matrix<ValueType> &A,
                                     Matrix<ValueType> &B);
 
+// Adaptive variant of randomizedLowRankApproximation. The range of the
+// operator is sampled in blocks of sampleBlockSize random vectors until the
+// part of the samples outside the current basis is below threshold relative
+// to the samples. The product A * B is then truncated to threshold. If more
+// than maxRank directions are needed, success is set to false. The random
+// vectors are drawn from generator.
+template <typename ValueType>
+void adaptiveRandomizedLowRankApproximation(
+    const matApply_t<ValueType> &applyFun, int rows, int cols,
+    double threshold, int maxRank, int sampleBlockSize,
+    std::mt19937 &generator, bool &success, Matrix<ValueType> &A,
+    Matrix<ValueType> &B);
+
 template <typename ValueType>
 std::size_t computeRank(const Eigen::JacobiSVD<Matrix<ValueType>> &svd,
                         double threshold);
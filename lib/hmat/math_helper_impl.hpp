@@ -2,6 +2,7 @@
 #define HMAT_MATH_HELPER_IMPL_HPP
 
 #include "math_helper.hpp"
+#include <complex>
 #include <limits>
 
 namespace hmat {
@@ -50,17 +51,92 @@ void compressQB(Matrix<ValueType> &Q, Matrix<ValueType> &B, double threshold,
   }
 }
 
+template <typename ValueType>
+void truncateLowRank(Matrix<ValueType> &A, Matrix<ValueType> &B,
+                     double threshold, int maxRank, bool &success) {
+
+  if (A.cols() == 0) {
+    success = true;
+    return;
+  }
+
+  // With A = Qa * Ra and B^H = Qb * Rb the product is Qa * (Ra * Rb^H) * Qb^H,
+  // so only the small core matrix Ra * Rb^H needs to be decomposed.
+  Eigen::HouseholderQR<Matrix<ValueType>> qrA(A);
+  Eigen::HouseholderQR<Matrix<ValueType>> qrB(B.adjoint());
+
+  auto ka = std::min(A.rows(), A.cols());
+  auto kb = std::min(B.cols(), B.rows());
+
+  Matrix<ValueType> Ra = qrA.matrixQR().topRows(ka);
+  Ra = Ra.template triangularView<Eigen::Upper>();
+  Matrix<ValueType> Rb = qrB.matrixQR().topRows(kb);
+  Rb = Rb.template triangularView<Eigen::Upper>();
+
+  Eigen::JacobiSVD<Matrix<ValueType>> svd(Ra * Rb.adjoint(),
+                                          Eigen::ComputeThinU |
+                                              Eigen::ComputeThinV);
+  int rank = computeRank(svd, threshold);
+
+  if (rank > maxRank) {
+    success = false;
+    return;
+  }
+
+  Matrix<ValueType> Qa =
+      qrA.householderQ() * Matrix<ValueType>::Identity(A.rows(), ka);
+  Matrix<ValueType> Qb =
+      qrB.householderQ() * Matrix<ValueType>::Identity(B.cols(), kb);
+
+  A = Qa * svd.matrixU().leftCols(rank) *
+      svd.singularValues()
+          .head(rank)
+          .template cast<ValueType>()
+          .asDiagonal();
+  B = (Qb * svd.matrixV().leftCols(rank)).adjoint();
+
+  success = true;
+}
+
+template <typename RealType>
+RealType randomValue(std::uniform_real_distribution<double> &distribution,
+                     std::mt19937 &generator, RealType *) {
+  return static_cast<RealType>(distribution(generator));
+}
+
+template <typename RealType>
+std::complex<RealType>
+randomValue(std::uniform_real_distribution<double> &distribution,
+            std::mt19937 &generator, std::complex<RealType> *) {
+  RealType real = static_cast<RealType>(distribution(generator));
+  RealType imag = static_cast<RealType>(distribution(generator));
+  return std::complex<RealType>(real, imag);
+}
+
+template <typename ValueType>
+Matrix<ValueType> randomMatrix(int rows, int cols, std::mt19937 &generator) {
+  std::uniform_real_distribution<double> distribution(-1, 1);
+  Matrix<ValueType> result(rows, cols);
+  for (int j = 0; j < cols; ++j)
+    for (int i = 0; i < rows; ++i)
+      result(i, j) = randomValue(distribution, generator,
+                                 static_cast<ValueType *>(nullptr));
+  return result;
+}
+
 template <typename ValueType>
 void randomizedLowRankApproximation(const matApply_t<ValueType> &applyFun,
                                     int rows, int cols, double threshold,
                                     int maxRank, int sampleDimension,
-                                    bool &success, Matrix<ValueType> &A,
+                                    std::mt19937 &generator, bool &success,
+                                    Matrix<ValueType> &A,
                                     Matrix<ValueType> &B) {
 
   int actual_sample_size = std::min(rows, sampleDimension);
   Matrix<ValueType> identity =
       Matrix<ValueType>::Identity(rows, actual_sample_size);
-  Matrix<ValueType> Z = Matrix<ValueType>::Random(cols, actual_sample_size);
+  Matrix<ValueType> Z =
+      randomMatrix<ValueType>(cols, actual_sample_size, generator);
 
   A = applyFun(Eigen::Ref<Matrix<ValueType>>(Z), NOTRANS)
           .colPivHouseholderQr()
@@ -71,11 +147,69 @@ void randomizedLowRankApproximation(const matApply_t<ValueType> &applyFun,
   compressQB(A, B, threshold, maxRank, success);
 }
 
+template <typename ValueType>
+void adaptiveRandomizedLowRankApproximation(
+    const matApply_t<ValueType> &applyFun, int rows, int cols,
+    double threshold, int maxRank, int sampleBlockSize,
+    std::mt19937 &generator, bool &success, Matrix<ValueType> &A,
+    Matrix<ValueType> &B) {
+
+  const int fullRank = std::min(rows, cols);
+  const int maxSamples = std::min(fullRank, maxRank + sampleBlockSize);
+
+  Matrix<ValueType> Q(rows, maxSamples);
+  int basisSize = 0;
+  bool converged = false;
+
+  while (!converged && basisSize < maxSamples) {
+    int sampleSize = std::min(sampleBlockSize, maxSamples - basisSize);
+    Matrix<ValueType> Z =
+        randomMatrix<ValueType>(cols, sampleSize, generator);
+    Matrix<ValueType> Y = applyFun(Eigen::Ref<Matrix<ValueType>>(Z), NOTRANS);
+    double sampleNorm = Y.norm();
+
+    // Project out the current basis twice for numerical stability.
+    auto basis = Q.leftCols(basisSize);
+    for (int pass = 0; pass < 2; ++pass) {
+      Matrix<ValueType> coefficients = basis.adjoint() * Y;
+      Y.noalias() -= basis * coefficients;
+    }
+
+    if (Y.norm() <= threshold * sampleNorm) {
+      converged = true;
+      break;
+    }
+
+    Eigen::ColPivHouseholderQR<Matrix<ValueType>> qr(Y);
+    int newDirections = qr.rank();
+    if (newDirections == 0) {
+      converged = true;
+      break;
+    }
+    Q.middleCols(basisSize, newDirections) =
+        (qr.householderQ() * Matrix<ValueType>::Identity(rows, sampleSize))
+            .leftCols(newDirections);
+    basisSize += newDirections;
+  }
+
+  // A basis of full dimension captures the operator exactly.
+  if (!converged && basisSize < fullRank) {
+    success = false;
+    return;
+  }
+
+  A = Q.leftCols(basisSize);
+  B = applyFun(Eigen::Ref<Matrix<ValueType>>(A), CONJTRANS).adjoint();
+  truncateLowRank(A, B, threshold, maxRank, success);
+}
+
 template <typename ValueType>
 std::size_t computeRank(const Eigen::JacobiSVD<Matrix<ValueType>> &svd,
                         double threshold) {
 
   auto singularValues = svd.singularValues().array();
+  if (singularValues.size() == 0)
+    return 0;
   auto maxSingVal = singularValues(0);
   return (singularValues > (threshold * maxSingVal)).count();
 }
@@ -0,0 +1,26 @@
+// vi: set et ts=4 sw=2 sts=2:
+
+#ifndef HMAT_PARTITION_HPP
+#define HMAT_PARTITION_HPP
+
+#include "common.hpp"
+
+namespace hmat {
+
+// Split the units [starts[i], starts[i + 1]) into nproc contiguous ranges.
+// The boundaries are placed where the cumulative cost passes equal shares
+// of the total cost. Returns the nproc + 1 offsets of the ranges.
+std::vector<std::size_t> partitionByCost(const std::vector<std::size_t> &starts,
+                                         const std::vector<double> &costs,
+                                         std::size_t nproc);
+
+// Hull of the parts of the output ranges that fall into the range of each
+// process in the partition given by offsets. The hull for rank is empty.
+std::vector<IndexRangeType>
+partitionSendRanges(const std::vector<std::size_t> &offsets, std::size_t rank,
+                    const std::vector<IndexRangeType> &outputRanges);
+}
+
+#include "partition_impl.hpp"
+
+#endif
@@ -0,0 +1,60 @@
+// vi: set et ts=4 sw=2 sts=2:
+
+#ifndef HMAT_PARTITION_IMPL_HPP
+#define HMAT_PARTITION_IMPL_HPP
+
+#include "partition.hpp"
+
+#include <algorithm>
+
+namespace hmat {
+
+inline std::vector<std::size_t>
+partitionByCost(const std::vector<std::size_t> &starts,
+                const std::vector<double> &costs, std::size_t nproc) {
+
+  double totalCost = 0;
+  for (auto cost : costs)
+    totalCost += cost;
+  std::vector<std::size_t> offsets(1, 0);
+  double cumulativeCost = 0;
+  for (std::size_t unit = 0; unit < costs.size(); ++unit) {
+    cumulativeCost += costs[unit];
+    while (offsets.size() < nproc &&
+           cumulativeCost * nproc >= totalCost * offsets.size())
+      offsets.push_back(starts[unit + 1]);
+  }
+  while (offsets.size() < nproc)
+    offsets.push_back(starts.back());
+  offsets.push_back(starts.back());
+  return offsets;
+}
+
+inline std::vector<IndexRangeType>
+partitionSendRanges(const std::vector<std::size_t> &offsets, std::size_t rank,
+                    const std::vector<IndexRangeType> &outputRanges) {
+
+  std::size_t nproc = offsets.size() - 1;
+  std::vector<IndexRangeType> sendRanges(nproc, IndexRangeType{{0, 0}});
+  for (const auto &range : outputRanges) {
+    std::size_t proc =
+        std::upper_bound(begin(offsets), end(offsets), range[0]) -
+        begin(offsets) - 1;
+    for (; proc < nproc && offsets[proc] < range[1]; ++proc) {
+      std::size_t start = std::max(range[0], offsets[proc]);
+      std::size_t end = std::min(range[1], offsets[proc + 1]);
+      if (proc == rank || start >= end)
+        continue;
+      auto &sendRange = sendRanges[proc];
+      if (sendRange[0] == sendRange[1])
+        sendRange = IndexRangeType{{start, end}};
+      else
+        sendRange = IndexRangeType{{std::min(sendRange[0], start),
+                                    std::max(sendRange[1], end)}};
+    }
+  }
+  return sendRanges;
+}
+}
+
+#endif
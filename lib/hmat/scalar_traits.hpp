@@ -11,6 +11,7 @@ template <typename T> struct ScalarTraits {
 
   typedef T RealType;
   typedef T ComplexType;
+  typedef T SinglePrecisionType;
 
   ScalarTraits() {
     static_assert(
@@ -22,21 +23,25 @@ template <typename T> struct ScalarTraits {
 template <> struct ScalarTraits<float> {
   typedef float RealType;
   typedef std::complex<float> ComplexType;
+  typedef float SinglePrecisionType;
 };
 
 template <> struct ScalarTraits<double> {
   typedef double RealType;
   typedef std::complex<double> ComplexType;
+  typedef float SinglePrecisionType;
 };
 
 template <> struct ScalarTraits<std::complex<float>> {
   typedef float RealType;
   typedef std::complex<float> ComplexType;
+  typedef std::complex<float> SinglePrecisionType;
 };
 
 template <> struct ScalarTraits<std::complex<double>> {
   typedef double RealType;
   typedef std::complex<double> ComplexType;
+  typedef std::complex<float> SinglePrecisionType;
 };
 }
 
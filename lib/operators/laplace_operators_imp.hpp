@@ -46,6 +46,8 @@
 
 #include "../fiber/typical_test_scalar_kernel_trial_integral.hpp"
 
+#include "../fmm/fmm_kernel.hpp"
+
 #include <boost/type_traits/is_complex.hpp>
 
 namespace Bempp {
@@ -88,6 +90,8 @@ laplaceSingleLayerBoundaryOperator(
       ElementaryIntegralOperator<BasisFunctionType, KernelType, ResultType>>
       newOp(new Op(domain, range, dualToRange, label, symmetry, KernelFunctor(),
                    TransformationFunctor(), TransformationFunctor(), integral));
+  newOp->setFmmKernel(shared_ptr<const Fmm::FmmKernel<ResultType>>(
+      new Fmm::LaplaceKernel<ResultType>()));
   return newOp;
 }
 
@@ -131,6 +135,9 @@ laplaceDoubleLayerBoundaryOperator(
   shared_ptr<Op> newOp(new Op(domain, range, dualToRange, label, symmetry,
                               KernelFunctor(), TransformationFunctor(),
                               TransformationFunctor(), integral));
+  newOp->setFmmKernel(shared_ptr<const Fmm::FmmKernel<ResultType>>(
+                          new Fmm::LaplaceKernel<ResultType>()),
+                      true);
 
   return newOp;
 }
@@ -267,7 +267,9 @@ class GeneralNonlocalDiscreteBoundaryOperator(DiscreteBoundaryOperator):
         """Implements r-matrix-vector product."""
         return self._impl.rmatvec(vec)
 
+    @_timeit("Nonlocal Operator matmat")
     def _matmat(self, vec):
+        """Implements the product with all columns of a matrix at once."""
         return self._impl.matmat(vec)
 
     def _adjoint(self):
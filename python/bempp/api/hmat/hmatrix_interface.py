@@ -63,6 +63,55 @@ def mem_size(discrete_operator):
     return mem_size_ext(discrete_operator._impl)
 
 
+def load_imbalance(discrete_operator):
+    """
+    Return the predicted and the actual load imbalance of the assembly.
+
+    Both values are the ratio of the maximum to the mean work, across
+    MPI processes if there are several and across threads otherwise.
+    The predicted value is based on the cost estimates used to
+    distribute the blocks, the actual value on measured times.
+
+    """
+    from bempp.api.assembly.discrete_boundary_operator import \
+        GeneralNonlocalDiscreteBoundaryOperator
+
+    if not isinstance(
+            discrete_operator, GeneralNonlocalDiscreteBoundaryOperator):
+        raise ValueError("discrete operator is not an HMatrix operator.")
+    from bempp.core.hmat.hmatrix_interface import load_imbalance_ext
+    return load_imbalance_ext(discrete_operator._impl)
+
+
+def statistics_json(discrete_operator):
+    """
+    Return the assembly and matvec statistics as JSON string.
+
+    The statistics contain the rank histogram of the low-rank blocks,
+    the ACA iteration counts and zero-block terminations, the number of
+    evaluated matrix entries, the compression time of each block and
+    the busy time of each thread. If parameters.hmat.matvec_profiling
+    was enabled during assembly, they also contain the time spent in
+    dense and in low-rank blocks during matvecs. With several MPI
+    processes only the blocks of this process are included.
+
+    """
+    from bempp.api.assembly.discrete_boundary_operator import \
+        GeneralNonlocalDiscreteBoundaryOperator
+
+    if not isinstance(
+            discrete_operator, GeneralNonlocalDiscreteBoundaryOperator):
+        raise ValueError("discrete operator is not an HMatrix operator.")
+    from bempp.core.hmat.hmatrix_interface import statistics_ext
+    return statistics_ext(discrete_operator._impl)
+
+
+def statistics(discrete_operator):
+    """Return the statistics of statistics_json as a dictionary."""
+    import json
+    return json.loads(statistics_json(discrete_operator))
+
+
 def data_block(discrete_operator, block_cluster_tree_node):
     """Return the data block associated with a block cluster tree node."""
 
@@ -84,3 +133,156 @@ def compression_rate(discrete_operator):
     total *= discrete_operator.shape[0] * \
         discrete_operator.shape[1] / (1.0 * 1024)
     return mem / total
+
+
+def lu_inverse(discrete_operator, eps=1E-3):
+    """
+    Return the inverse of a HMatrix operator via a hierarchical LU.
+
+    The factors are computed in truncated low-rank arithmetic with
+    relative accuracy eps. With a coarse eps the result is a cheap
+    preconditioner, with a fine eps a direct solver. Block cluster tree
+    row and column clusters must coincide, which is the case for
+    square operators whose domain and dual space are identical.
+
+    """
+    from bempp.api.assembly.discrete_boundary_operator import \
+        GeneralNonlocalDiscreteBoundaryOperator
+
+    if not isinstance(
+            discrete_operator, GeneralNonlocalDiscreteBoundaryOperator):
+        raise ValueError("discrete operator is not an HMatrix operator.")
+    from bempp.core.hmat.hmatrix_interface import lu_inverse_ext
+    return GeneralNonlocalDiscreteBoundaryOperator(
+        lu_inverse_ext(discrete_operator._impl, eps))
+
+
+def h2matrix(discrete_operator, eps=1E-3):
+    """
+    Return a HMatrix operator recompressed into an H2-Matrix.
+
+    The low-rank blocks are expressed in nested cluster bases with
+    relative accuracy eps, which reduces storage and matvec cost to
+    linear complexity in the number of dofs. Dense blocks are kept.
+    All blocks of the operator must be local to the process.
+
+    """
+    from bempp.api.assembly.discrete_boundary_operator import \
+        GeneralNonlocalDiscreteBoundaryOperator
+
+    if not isinstance(
+            discrete_operator, GeneralNonlocalDiscreteBoundaryOperator):
+        raise ValueError("discrete operator is not an HMatrix operator.")
+    from bempp.core.hmat.hmatrix_interface import h2matrix_ext
+    return GeneralNonlocalDiscreteBoundaryOperator(
+        h2matrix_ext(discrete_operator._impl, eps))
+
+
+def scale(discrete_operator, alpha):
+    """Return a copy of a HMatrix operator multiplied with alpha."""
+    from bempp.api.assembly.discrete_boundary_operator import \
+        GeneralNonlocalDiscreteBoundaryOperator
+
+    if not isinstance(
+            discrete_operator, GeneralNonlocalDiscreteBoundaryOperator):
+        raise ValueError("discrete operator is not an HMatrix operator.")
+    from bempp.core.hmat.hmatrix_interface import scale_ext
+    return GeneralNonlocalDiscreteBoundaryOperator(
+        scale_ext(discrete_operator._impl, alpha))
+
+
+def add(op1, op2, alpha=1, eps=1E-3):
+    """
+    Return op1 + alpha * op2 as one HMatrix operator.
+
+    The sum is computed in truncated low-rank arithmetic with relative
+    accuracy eps. Both operators must have the same dtype and cluster
+    trees, which is the case if they were assembled on the same spaces.
+
+    """
+    from bempp.api.assembly.discrete_boundary_operator import \
+        GeneralNonlocalDiscreteBoundaryOperator
+
+    if not (isinstance(op1, GeneralNonlocalDiscreteBoundaryOperator) and
+            isinstance(op2, GeneralNonlocalDiscreteBoundaryOperator)):
+        raise ValueError("discrete operators must be HMatrix operators.")
+    if op1.dtype != op2.dtype:
+        raise ValueError("discrete operators must have the same dtype.")
+    from bempp.core.hmat.hmatrix_interface import add_ext
+    return GeneralNonlocalDiscreteBoundaryOperator(
+        add_ext(op1._impl, op2._impl, alpha, eps))
+
+
+def multiply(op1, op2, eps=1E-3):
+    """
+    Return op1 * op2 as one HMatrix operator.
+
+    The product is computed in truncated low-rank arithmetic with
+    relative accuracy eps. One of the factors may be a real sparse
+    operator, e.g. an inverse mass matrix, which must then be square
+    with the dofs of the adjacent space of the HMatrix operator.
+    Otherwise the column clusters of op1 must be the row clusters of
+    op2. All blocks must be local to the process.
+
+    """
+    from bempp.api.assembly.discrete_boundary_operator import \
+        GeneralNonlocalDiscreteBoundaryOperator
+    from bempp.api.assembly.discrete_boundary_operator import \
+        SparseDiscreteBoundaryOperator
+    from bempp.core.hmat.hmatrix_interface import multiply_ext
+    from bempp.core.hmat.hmatrix_interface import sparse_multiply_ext
+
+    if isinstance(op1, GeneralNonlocalDiscreteBoundaryOperator):
+        if isinstance(op2, GeneralNonlocalDiscreteBoundaryOperator):
+            if op1.dtype != op2.dtype:
+                raise ValueError(
+                    "discrete operators must have the same dtype.")
+            return GeneralNonlocalDiscreteBoundaryOperator(
+                multiply_ext(op1._impl, op2._impl, eps))
+        if isinstance(op2, SparseDiscreteBoundaryOperator):
+            return GeneralNonlocalDiscreteBoundaryOperator(
+                sparse_multiply_ext(
+                    op1._impl, op2.sparse_operator, False, eps))
+    elif isinstance(op1, SparseDiscreteBoundaryOperator) and \
+            isinstance(op2, GeneralNonlocalDiscreteBoundaryOperator):
+        return GeneralNonlocalDiscreteBoundaryOperator(
+            sparse_multiply_ext(op2._impl, op1.sparse_operator, True, eps))
+    raise ValueError(
+        "discrete operators must be HMatrix operators " +
+        "or one HMatrix and one sparse operator.")
+
+
+def save(discrete_operator, file_name):
+    """
+    Write a HMatrix operator to a file.
+
+    The file contains the cluster trees, the block cluster tree and the
+    matrix blocks in a versioned binary format. With several MPI
+    processes each process writes its blocks to file_name.<rank>.
+
+    """
+    from bempp.api.assembly.discrete_boundary_operator import \
+        GeneralNonlocalDiscreteBoundaryOperator
+
+    if not isinstance(
+            discrete_operator, GeneralNonlocalDiscreteBoundaryOperator):
+        raise ValueError("discrete operator is not an HMatrix operator.")
+    from bempp.core.hmat.hmatrix_interface import save_ext
+    save_ext(discrete_operator._impl, file_name)
+
+
+def load(file_name, dtype='float64'):
+    """
+    Read a HMatrix operator written by save.
+
+    The matrix blocks are memory mapped from the file instead of being
+    read into memory. The dtype must be the one of the saved operator
+    and the number of MPI processes the one it was saved with.
+
+    """
+    from bempp.api.assembly.discrete_boundary_operator import \
+        GeneralNonlocalDiscreteBoundaryOperator
+    from bempp.core.hmat.hmatrix_interface import load_ext
+    return GeneralNonlocalDiscreteBoundaryOperator(
+        load_ext(file_name, dtype))
+
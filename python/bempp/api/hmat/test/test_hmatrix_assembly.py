@@ -138,6 +138,467 @@ class TestHMatrixAssembly(TestCase):
             slp_hmat_fine - slp_dense) / np.linalg.norm(slp_dense)
         self.assertTrue(rel_diff_fine < TOL_FACTOR * TOL_FINE)
 
+    def test_matvec_storage_and_strategy_options(self):
+        """H-Matrix matvec with different storage and matvec strategies."""
+
+        parameters_dense = bempp.api.common.global_parameters()
+        parameters_dense.assembly.boundary_operator_assembly_type = 'dense'
+
+        grid = bempp.api.shapes.regular_sphere(4)
+        space = bempp.api.function_space(grid, "DP", 0)
+
+        slp_dense = bempp.api.as_matrix(
+            bempp.api.operators.boundary.laplace.single_layer(
+                space, space, space,
+                parameters=parameters_dense).weak_form())
+
+        for compact_storage in [True, False]:
+            for strategy in ['ownerComputes', 'threadLocal']:
+                parameters = bempp.api.common.global_parameters()
+                parameters.assembly.boundary_operator_assembly_type = 'hmat'
+                parameters.hmat.eps = TOL_FINE
+                parameters.hmat.compact_storage = compact_storage
+                parameters.hmat.matvec_strategy = strategy
+
+                slp_hmat = bempp.api.as_matrix(
+                    bempp.api.operators.boundary.laplace.single_layer(
+                        space, space, space,
+                        parameters=parameters).weak_form())
+
+                rel_diff = np.linalg.norm(
+                    slp_hmat - slp_dense) / np.linalg.norm(slp_dense)
+                self.assertTrue(rel_diff < TOL_FACTOR * TOL_FINE)
+
+    def test_randomized_compression(self):
+        """H-Matrix assembly with randomized compression."""
+
+        parameters_dense = bempp.api.common.global_parameters()
+        parameters_dense.assembly.boundary_operator_assembly_type = 'dense'
+
+        parameters = bempp.api.common.global_parameters()
+        parameters.assembly.boundary_operator_assembly_type = 'hmat'
+        parameters.hmat.eps = TOL_FINE
+        parameters.hmat.compression_algorithm = 'randomized'
+
+        grid = bempp.api.shapes.regular_sphere(4)
+        space = bempp.api.function_space(grid, "DP", 0)
+
+        slp_hmat = bempp.api.as_matrix(
+            bempp.api.operators.boundary.laplace.single_layer(
+                space, space, space,
+                parameters=parameters).weak_form())
+
+        slp_dense = bempp.api.as_matrix(
+            bempp.api.operators.boundary.laplace.single_layer(
+                space, space, space,
+                parameters=parameters_dense).weak_form())
+
+        rel_diff = np.linalg.norm(
+            slp_hmat - slp_dense) / np.linalg.norm(slp_dense)
+        self.assertTrue(rel_diff < TOL_FACTOR * TOL_FINE)
+
+    def test_hca_compression(self):
+        """H-Matrix assembly with hybrid cross approximation."""
+
+        parameters_dense = bempp.api.common.global_parameters()
+        parameters_dense.assembly.boundary_operator_assembly_type = 'dense'
+
+        parameters = bempp.api.common.global_parameters()
+        parameters.assembly.boundary_operator_assembly_type = 'hmat'
+        parameters.hmat.eps = TOL_FINE
+        parameters.hmat.compression_algorithm = 'hca'
+
+        grid = bempp.api.shapes.regular_sphere(4)
+        space = bempp.api.function_space(grid, "DP", 0)
+
+        for op in [bempp.api.operators.boundary.laplace.single_layer,
+                   bempp.api.operators.boundary.laplace.double_layer]:
+            op_hmat = bempp.api.as_matrix(
+                op(space, space, space, parameters=parameters).weak_form())
+            op_dense = bempp.api.as_matrix(
+                op(space, space, space,
+                   parameters=parameters_dense).weak_form())
+
+            rel_diff = np.linalg.norm(
+                op_hmat - op_dense) / np.linalg.norm(op_dense)
+            self.assertTrue(rel_diff < TOL_FACTOR * TOL_FINE)
+
+    def test_oriented_admissibility(self):
+        """H-Matrix assembly with oriented bounding box admissibility."""
+
+        parameters_dense = bempp.api.common.global_parameters()
+        parameters_dense.assembly.boundary_operator_assembly_type = 'dense'
+
+        grid = bempp.api.shapes.regular_sphere(4)
+        space = bempp.api.function_space(grid, "DP", 0)
+
+        slp_dense = bempp.api.as_matrix(
+            bempp.api.operators.boundary.laplace.single_layer(
+                space, space, space,
+                parameters=parameters_dense).weak_form())
+
+        for admissibility in ['strong', 'oriented']:
+            parameters = bempp.api.common.global_parameters()
+            parameters.assembly.boundary_operator_assembly_type = 'hmat'
+            parameters.hmat.eps = TOL_FINE
+            parameters.hmat.admissibility = admissibility
+
+            slp_hmat = bempp.api.as_matrix(
+                bempp.api.operators.boundary.laplace.single_layer(
+                    space, space, space,
+                    parameters=parameters).weak_form())
+
+            rel_diff = np.linalg.norm(
+                slp_hmat - slp_dense) / np.linalg.norm(slp_dense)
+            self.assertTrue(rel_diff < TOL_FACTOR * TOL_FINE)
+
+    def test_load_imbalance(self):
+        """Load imbalance is reported after H-Matrix assembly."""
+
+        parameters = bempp.api.common.global_parameters()
+        parameters.assembly.boundary_operator_assembly_type = 'hmat'
+
+        grid = bempp.api.shapes.regular_sphere(3)
+        space = bempp.api.function_space(grid, "DP", 0)
+
+        slp_hmat = bempp.api.operators.boundary.laplace.single_layer(
+            space, space, space, parameters=parameters).weak_form()
+
+        predicted, actual = bempp.api.hmat.hmatrix_interface.load_imbalance(
+            slp_hmat)
+        self.assertTrue(predicted >= 1)
+        self.assertTrue(actual >= 1)
+
+    def test_statistics(self):
+        """Assembly and matvec statistics of an H-Matrix."""
+
+        parameters = bempp.api.common.global_parameters()
+        parameters.assembly.boundary_operator_assembly_type = 'hmat'
+        parameters.hmat.matvec_profiling = True
+
+        grid = bempp.api.shapes.regular_sphere(3)
+        space = bempp.api.function_space(grid, "DP", 0)
+
+        slp_hmat = bempp.api.operators.boundary.laplace.single_layer(
+            space, space, space, parameters=parameters).weak_form()
+        x = np.random.rand(space.global_dof_count)
+        for _ in range(3):
+            slp_hmat * x
+
+        stats = bempp.api.hmat.hmatrix_interface.statistics(slp_hmat)
+        hmatrix_interface = bempp.api.hmat.hmatrix_interface
+        self.assertEqual(stats['numberOfLeafs'],
+                         hmatrix_interface.number_of_blocks(slp_hmat))
+        self.assertEqual(
+            sum(stats['rankHistogram'].values()),
+            hmatrix_interface.number_of_low_rank_blocks(slp_hmat))
+        self.assertTrue(stats['evaluatedEntries'] > 0)
+        self.assertEqual(len(stats['leafs']), stats['numberOfLeafs'])
+        self.assertEqual(stats['matVec']['count'], 3)
+        self.assertTrue(stats['matVec']['denseTime'] > 0)
+
+    def test_single_precision_storage(self):
+        """H-Matrix with blocks stored in single precision."""
+
+        parameters_dense = bempp.api.common.global_parameters()
+        parameters_dense.assembly.boundary_operator_assembly_type = 'dense'
+
+        grid = bempp.api.shapes.regular_sphere(4)
+        space = bempp.api.function_space(grid, "DP", 0)
+
+        slp_dense = bempp.api.as_matrix(
+            bempp.api.operators.boundary.laplace.single_layer(
+                space, space, space,
+                parameters=parameters_dense).weak_form())
+
+        mem_size = {}
+        for precision in ['double', 'single']:
+            parameters = bempp.api.common.global_parameters()
+            parameters.assembly.boundary_operator_assembly_type = 'hmat'
+            parameters.hmat.eps = TOL_COARSE
+            parameters.hmat.storage_precision = precision
+
+            slp_hmat = bempp.api.operators.boundary.laplace.single_layer(
+                space, space, space, parameters=parameters).weak_form()
+            mem_size[precision] = bempp.api.hmat.hmatrix_interface.mem_size(
+                slp_hmat)
+
+            rel_diff = np.linalg.norm(
+                bempp.api.as_matrix(slp_hmat) - slp_dense) / \
+                np.linalg.norm(slp_dense)
+            self.assertTrue(rel_diff < TOL_FACTOR * TOL_COARSE)
+
+        self.assertTrue(mem_size['single'] < 0.6 * mem_size['double'])
+
+    def test_coarsening(self):
+        """Coarsening reduces the memory of an H-Matrix within eps."""
+
+        parameters_dense = bempp.api.common.global_parameters()
+        parameters_dense.assembly.boundary_operator_assembly_type = 'dense'
+
+        grid = bempp.api.shapes.regular_sphere(4)
+        space = bempp.api.function_space(grid, "DP", 0)
+
+        slp_dense = bempp.api.as_matrix(
+            bempp.api.operators.boundary.laplace.single_layer(
+                space, space, space,
+                parameters=parameters_dense).weak_form())
+        x = np.random.rand(space.global_dof_count)
+        expected = slp_dense.dot(x)
+
+        mem_size = {}
+        for coarsening in [False, True]:
+            parameters = bempp.api.common.global_parameters()
+            parameters.assembly.boundary_operator_assembly_type = 'hmat'
+            parameters.hmat.eps = TOL_COARSE
+            parameters.hmat.coarsening = coarsening
+
+            slp_hmat = bempp.api.operators.boundary.laplace.single_layer(
+                space, space, space, parameters=parameters).weak_form()
+            mem_size[coarsening] = bempp.api.hmat.hmatrix_interface.mem_size(
+                slp_hmat)
+
+            rel_diff = np.linalg.norm(
+                slp_hmat * x - expected) / np.linalg.norm(expected)
+            self.assertTrue(rel_diff < TOL_FACTOR * TOL_COARSE)
+
+        self.assertTrue(mem_size[True] < mem_size[False])
+
+    def test_recompression(self):
+        """SVD recompression reduces the ranks of an H-Matrix within eps."""
+
+        parameters_dense = bempp.api.common.global_parameters()
+        parameters_dense.assembly.boundary_operator_assembly_type = 'dense'
+
+        grid = bempp.api.shapes.regular_sphere(4)
+        space = bempp.api.function_space(grid, "DP", 0)
+
+        slp_dense = bempp.api.as_matrix(
+            bempp.api.operators.boundary.laplace.single_layer(
+                space, space, space,
+                parameters=parameters_dense).weak_form())
+        x = np.random.rand(space.global_dof_count)
+        expected = slp_dense.dot(x)
+
+        total_rank = {}
+        for recompress in [False, True]:
+            parameters = bempp.api.common.global_parameters()
+            parameters.assembly.boundary_operator_assembly_type = 'hmat'
+            parameters.hmat.eps = TOL_COARSE
+            parameters.hmat.recompress = recompress
+
+            slp_hmat = bempp.api.operators.boundary.laplace.single_layer(
+                space, space, space, parameters=parameters).weak_form()
+            histogram = bempp.api.hmat.hmatrix_interface.statistics(
+                slp_hmat)['rankHistogram']
+            total_rank[recompress] = sum(
+                int(rank) * count for rank, count in histogram.items())
+
+            rel_diff = np.linalg.norm(
+                slp_hmat * x - expected) / np.linalg.norm(expected)
+            self.assertTrue(rel_diff < TOL_FACTOR * TOL_COARSE)
+
+        self.assertTrue(total_rank[True] < total_rank[False])
+
+    def test_lu_inverse(self):
+        """Solve with the H-LU factorization of an H-Matrix."""
+
+        parameters = bempp.api.common.global_parameters()
+        parameters.assembly.boundary_operator_assembly_type = 'hmat'
+        parameters.hmat.eps = TOL_FINE
+
+        grid = bempp.api.shapes.regular_sphere(4)
+        space = bempp.api.function_space(grid, "DP", 0)
+
+        slp_hmat = bempp.api.operators.boundary.laplace.single_layer(
+            space, space, space, parameters=parameters).weak_form()
+        slp_dense = bempp.api.as_matrix(slp_hmat)
+
+        rhs = np.random.rand(space.global_dof_count)
+        expected = np.linalg.solve(slp_dense, rhs)
+
+        inverse = bempp.api.hmat.hmatrix_interface.lu_inverse(
+            slp_hmat, TOL_FINE)
+        actual = inverse * rhs
+
+        rel_diff = np.linalg.norm(
+            actual - expected) / np.linalg.norm(expected)
+        self.assertTrue(rel_diff < TOL_FACTOR * TOL_COARSE)
+
+    def test_h2matrix(self):
+        """An H2-Matrix recompression gives the H-Matrix matvec."""
+
+        parameters = bempp.api.common.global_parameters()
+        parameters.assembly.boundary_operator_assembly_type = 'hmat'
+        parameters.hmat.eps = TOL_FINE
+
+        grid = bempp.api.shapes.regular_sphere(4)
+        space = bempp.api.function_space(grid, "DP", 0)
+
+        slp_hmat = bempp.api.operators.boundary.laplace.single_layer(
+            space, space, space, parameters=parameters).weak_form()
+        slp_h2mat = bempp.api.hmat.hmatrix_interface.h2matrix(
+            slp_hmat, TOL_FINE)
+
+        x = np.random.rand(space.global_dof_count)
+        expected = slp_hmat * x
+        actual = slp_h2mat * x
+
+        rel_diff = np.linalg.norm(
+            actual - expected) / np.linalg.norm(expected)
+        self.assertTrue(rel_diff < TOL_FACTOR * TOL_COARSE)
+
+    def test_arithmetic(self):
+        """Truncated sums and products of H-Matrices."""
+
+        parameters = bempp.api.common.global_parameters()
+        parameters.assembly.boundary_operator_assembly_type = 'hmat'
+        parameters.hmat.eps = TOL_FINE
+
+        grid = bempp.api.shapes.regular_sphere(3)
+        space = bempp.api.function_space(grid, "DP", 0)
+
+        slp_hmat = bempp.api.operators.boundary.laplace.single_layer(
+            space, space, space, parameters=parameters).weak_form()
+        dlp_hmat = bempp.api.operators.boundary.laplace.double_layer(
+            space, space, space, parameters=parameters).weak_form()
+        mass = bempp.api.operators.boundary.sparse.identity(
+            space, space, space).weak_form()
+        slp_dense = bempp.api.as_matrix(slp_hmat)
+        dlp_dense = bempp.api.as_matrix(dlp_hmat)
+        mass_dense = bempp.api.as_matrix(mass)
+
+        hmat = bempp.api.hmat.hmatrix_interface
+        results = [
+            (hmat.scale(slp_hmat, 2), 2 * slp_dense),
+            (hmat.add(slp_hmat, dlp_hmat, -0.5, TOL_FINE),
+             slp_dense - 0.5 * dlp_dense),
+            (hmat.multiply(slp_hmat, dlp_hmat, TOL_FINE),
+             slp_dense.dot(dlp_dense)),
+            (hmat.multiply(slp_hmat, mass, TOL_FINE),
+             slp_dense.dot(mass_dense)),
+            (hmat.multiply(mass, dlp_hmat, TOL_FINE),
+             mass_dense.dot(dlp_dense))]
+
+        for actual, expected in results:
+            rel_diff = np.linalg.norm(
+                bempp.api.as_matrix(actual) - expected) / np.linalg.norm(
+                    expected)
+            self.assertTrue(rel_diff < TOL_FACTOR * TOL_COARSE)
+
+    def test_symmetric_storage(self):
+        """Symmetric operators only store the lower block triangle."""
+
+        parameters_hmat = bempp.api.common.global_parameters()
+        parameters_hmat.assembly.boundary_operator_assembly_type = 'hmat'
+        parameters_hmat.hmat.eps = TOL_FINE
+
+        parameters_dense = bempp.api.common.global_parameters()
+        parameters_dense.assembly.boundary_operator_assembly_type = 'dense'
+
+        grid = bempp.api.shapes.regular_sphere(3)
+        space = bempp.api.function_space(grid, "DP", 0)
+        hmat = bempp.api.hmat.hmatrix_interface
+
+        for parameters in [parameters_hmat, parameters_dense]:
+            full = bempp.api.operators.boundary.helmholtz.single_layer(
+                space, space, space, 1.5,
+                parameters=parameters).weak_form()
+            symmetric = bempp.api.operators.boundary.helmholtz.single_layer(
+                space, space, space, 1.5, symmetry='symmetric',
+                parameters=parameters).weak_form()
+
+            expected = bempp.api.as_matrix(full)
+            actual = bempp.api.as_matrix(symmetric)
+            rel_diff = np.linalg.norm(
+                actual - expected) / np.linalg.norm(expected)
+            self.assertTrue(rel_diff < TOL_FACTOR * TOL_FINE)
+
+            if parameters is parameters_hmat:
+                self.assertTrue(
+                    hmat.mem_size(symmetric) < 0.75 * hmat.mem_size(full))
+
+    def test_matmat(self):
+        """Products with several vectors at once match the matvecs."""
+
+        parameters = bempp.api.common.global_parameters()
+        parameters.assembly.boundary_operator_assembly_type = 'hmat'
+
+        grid = bempp.api.shapes.regular_sphere(3)
+        space = bempp.api.function_space(grid, "DP", 0)
+
+        op = bempp.api.operators.boundary.laplace.single_layer(
+            space, space, space, parameters=parameters).weak_form()
+
+        x = np.random.rand(space.global_dof_count, 8) + 1j * np.random.rand(
+            space.global_dof_count, 8)
+        for actual_op in [op, op.transpose()]:
+            actual = actual_op.matmat(x)
+            for i in range(x.shape[1]):
+                self.assertTrue(np.allclose(actual[:, i],
+                                            actual_op * x[:, i]))
+
+    def test_save_and_load(self):
+        """An H-Matrix read from a file gives the same matvec."""
+        import os
+        import tempfile
+
+        parameters = bempp.api.common.global_parameters()
+        parameters.assembly.boundary_operator_assembly_type = 'hmat'
+
+        grid = bempp.api.shapes.regular_sphere(3)
+        space = bempp.api.function_space(grid, "DP", 0)
+
+        for dtype in ['float64', 'complex128']:
+            if dtype == 'float64':
+                op = bempp.api.operators.boundary.laplace.single_layer(
+                    space, space, space, parameters=parameters)
+            else:
+                op = bempp.api.operators.boundary.helmholtz.single_layer(
+                    space, space, space, 1.0, parameters=parameters)
+            hmat = op.weak_form()
+
+            file_name = os.path.join(tempfile.mkdtemp(), 'hmat.bin')
+            bempp.api.hmat.hmatrix_interface.save(hmat, file_name)
+            loaded = bempp.api.hmat.hmatrix_interface.load(file_name, dtype)
+
+            x = np.random.rand(space.global_dof_count)
+            self.assertEqual(loaded.shape, hmat.shape)
+            self.assertTrue(np.allclose(loaded * x, hmat * x))
+            self.assertEqual(
+                bempp.api.hmat.hmatrix_interface.number_of_blocks(loaded),
+                bempp.api.hmat.hmatrix_interface.number_of_blocks(hmat))
+
+    def test_fmm_assembly(self):
+        """FMM assembly of the Laplace single and double layer operators."""
+
+        parameters_dense = bempp.api.common.global_parameters()
+        parameters_dense.assembly.boundary_operator_assembly_type = 'dense'
+
+        parameters_fmm = bempp.api.common.global_parameters()
+        parameters_fmm.assembly.boundary_operator_assembly_type = 'fmm'
+        parameters_fmm.fmm.expansion_order = 6
+
+        grid = bempp.api.shapes.regular_sphere(4)
+        const_space = bempp.api.function_space(grid, "DP", 0)
+        lin_space = bempp.api.function_space(grid, "P", 1)
+
+        for operator, domain, dual_to_range in [
+                (bempp.api.operators.boundary.laplace.single_layer,
+                 const_space, const_space),
+                (bempp.api.operators.boundary.laplace.double_layer,
+                 lin_space, const_space)]:
+            fmm = operator(domain, domain, dual_to_range,
+                           parameters=parameters_fmm).weak_form()
+            dense = operator(domain, domain, dual_to_range,
+                             parameters=parameters_dense).weak_form()
+
+            x = np.random.rand(domain.global_dof_count)
+            expected = dense * x
+            rel_diff = np.linalg.norm(fmm * x - expected) / np.linalg.norm(
+                expected)
+            self.assertTrue(rel_diff < TOL_FACTOR * TOL_COARSE)
+
 if __name__ == "__main__":
     from unittest import main
     main()
@@ -0,0 +1,183 @@
+// Copyright (C) 2011 by the BEM++ Authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "assembly/elementary_integral_operator.hpp"
+#include "assembly/global_dof_helpers.hpp"
+#include "assembly/near_field_assembler.hpp"
+#include "common/global_parameters.hpp"
+#include "fiber/geometrical_data.hpp"
+#include "fiber/local_assembler_for_integral_operators.hpp"
+#include "fiber/numerical_quadrature.hpp"
+#include "fmm/fmm_kernel.hpp"
+#include "fmm/octree.hpp"
+#include "grid/entity.hpp"
+#include "grid/entity_pointer.hpp"
+#include "grid/geometry.hpp"
+#include "grid/grid.hpp"
+#include "grid/grid_factory.hpp"
+#include "grid/grid_view.hpp"
+#include "grid/reverse_element_mapper.hpp"
+#include "operators/laplace_operators.hpp"
+#include "space/piecewise_constant_scalar_space.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+#include <cmath>
+#include <utility>
+#include <vector>
+
+using namespace Bempp;
+
+namespace {
+
+typedef NearFieldAssembler<double, double> Assembler;
+
+struct NearFieldFixture {
+  NearFieldFixture() {
+    GridParameters gridParams;
+    gridParams.topology = GridParameters::TRIANGULAR;
+    grid = GridFactory::importGmshGrid(gridParams, "meshes/sphere-ico-2.msh",
+                                       false /* verbose */);
+    space.reset(new PiecewiseConstantScalarSpace<double>(grid));
+
+    parameters = GlobalParameters::parameterList();
+    parameters.put("options.assembly.boundaryOperatorAssemblyType",
+                   std::string("dense"));
+    op = laplaceSingleLayerBoundaryOperator<double, double, double>(
+        parameters, space, space, space);
+    dense = op->assembleWeakForm(parameters)->asMatrix();
+
+    std::vector<std::vector<double>> weights;
+    gatherGlobalDofs(*space, elementDofs, weights);
+  }
+
+  // Pairs of elements in adjacent leafs of the octree, found by comparing
+  // all pairs of leafs.
+  std::vector<std::pair<unsigned int, unsigned int>>
+  nearPairs(const Fmm::Octree &octree) const {
+    std::vector<std::pair<unsigned long, unsigned int>> leafs;
+    for (unsigned int level = 1; level <= octree.levels(); ++level)
+      for (auto node : octree.getNonEmptyNodes(level))
+        if (octree.isLeaf(node, level))
+          leafs.push_back({node, level});
+
+    std::vector<std::pair<unsigned int, unsigned int>> pairs;
+    std::vector<unsigned int> testElements, trialElements;
+    for (const auto &test : leafs)
+      for (const auto &trial : leafs) {
+        if (!octree.areAdjacent(test.first, test.second, trial.first,
+                                trial.second))
+          continue;
+        testElements.clear();
+        trialElements.clear();
+        octree.getCubeEntities(testElements, test.first, test.second);
+        octree.getCubeEntities(trialElements, trial.first, trial.second);
+        for (auto i : testElements)
+          for (auto j : trialElements)
+            pairs.push_back({i, j});
+      }
+    return pairs;
+  }
+
+  // Regular quadrature of the kernel over a pair of elements, without the
+  // coincident quadrature points.
+  double regularIntegral(unsigned int testElement,
+                         unsigned int trialElement) const {
+    Matrix<double> localPoints;
+    std::vector<double> weights;
+    Fiber::fillSingleQuadraturePointsAndWeights(3, 3, localPoints, weights);
+
+    const ReverseElementMapper &mapper =
+        space->gridView().reverseElementMapper();
+    Fiber::GeometricalData<double> testData, trialData;
+    mapper.entityPointer(testElement).entity().geometry().getData(
+        Fiber::GLOBALS | Fiber::INTEGRATION_ELEMENTS, localPoints, testData);
+    mapper.entityPointer(trialElement).entity().geometry().getData(
+        Fiber::GLOBALS | Fiber::INTEGRATION_ELEMENTS, localPoints, trialData);
+
+    Matrix<double> values;
+    kernel.evaluate(testData.globals, trialData.globals, values);
+    double result = 0;
+    for (std::size_t q = 0; q < weights.size(); ++q)
+      for (std::size_t p = 0; p < weights.size(); ++p)
+        if (std::isfinite(values(p, q)))
+          result += weights[p] * testData.integrationElements(p) *
+                    weights[q] * trialData.integrationElements(q) *
+                    values(p, q);
+    return result;
+  }
+
+  // The near field must hold the entries of the dense matrix for the pairs
+  // of elements in adjacent leafs, minus the regular quadrature if
+  // subtracted, and nothing else.
+  void check(const Fmm::Octree &octree, bool subtract) const {
+    auto assembler = op->makeAssembler(parameters);
+    shared_ptr<const Fmm::FmmKernel<double>> subtractedKernel;
+    if (subtract)
+      subtractedKernel.reset(new Fmm::LaplaceKernel<double>());
+    Matrix<double> nearField =
+        Matrix<double>(Assembler::assembleNearField(*space, *space, octree,
+                                                    *assembler,
+                                                    subtractedKernel));
+
+    Matrix<double> expected = Matrix<double>::Zero(dense.rows(), dense.cols());
+    for (const auto &pair : nearPairs(octree)) {
+      int row = elementDofs[pair.first][0];
+      int column = elementDofs[pair.second][0];
+      expected(row, column) = dense(row, column);
+      if (subtract)
+        expected(row, column) -= regularIntegral(pair.first, pair.second);
+    }
+
+    BOOST_CHECK(expected.cwiseAbs().maxCoeff() > 0);
+    BOOST_CHECK_SMALL((nearField - expected).cwiseAbs().maxCoeff() /
+                          expected.cwiseAbs().maxCoeff(),
+                      1e-12);
+  }
+
+  shared_ptr<Grid> grid;
+  shared_ptr<Space<double>> space;
+  ParameterList parameters;
+  shared_ptr<const ElementaryIntegralOperator<double, double, double>> op;
+  Matrix<double> dense;
+  std::vector<std::vector<GlobalDofIndex>> elementDofs;
+  Fmm::LaplaceKernel<double> kernel;
+};
+}
+
+BOOST_FIXTURE_TEST_SUITE(NearFieldAssembly, NearFieldFixture)
+
+BOOST_AUTO_TEST_CASE(uniform_octree_matches_dense_assembly) {
+  check(Fmm::Octree(grid, 2), false);
+}
+
+BOOST_AUTO_TEST_CASE(adaptive_octree_matches_dense_assembly) {
+  check(Fmm::Octree(grid, -1, 8), false);
+}
+
+BOOST_AUTO_TEST_CASE(uniform_octree_subtracts_regular_quadrature) {
+  check(Fmm::Octree(grid, 2), true);
+}
+
+BOOST_AUTO_TEST_CASE(adaptive_octree_subtracts_regular_quadrature) {
+  check(Fmm::Octree(grid, -1, 8), true);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
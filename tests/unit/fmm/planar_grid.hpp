@@ -0,0 +1,75 @@
+// Copyright (C) 2011 by the BEM++ Authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#ifndef bempp_fmm_planar_grid_hpp
+#define bempp_fmm_planar_grid_hpp
+
+#include "fmm/fmm_common.hpp"
+#include "grid/grid.hpp"
+#include "grid/grid_factory.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+#include <vector>
+
+// Order of the elements of a planar test grid.
+enum class ElementOrder { ROWS, REVERSED_ROWS, SHUFFLED };
+
+// Triangulation of the unit square in the plane z = 0, graded towards the
+// origin for a grading above 1. All boxes above the bottom layer of an
+// octree of the grid are empty. Reversing the rows of a graded grid puts the
+// largest elements first, so that element ids and octree order disagree.
+inline Fmm::shared_ptr<const Bempp::Grid>
+planarGrid(int n, double grading = 1,
+           ElementOrder elementOrder = ElementOrder::ROWS) {
+  Fmm::Matrix<double> vertices(3, (n + 1) * (n + 1));
+  for (int j = 0; j <= n; ++j)
+    for (int i = 0; i <= n; ++i)
+      vertices.col(j * (n + 1) + i) << std::pow(double(i) / n, grading),
+          std::pow(double(j) / n, grading), 0;
+  Fmm::Matrix<int> corners(3, 2 * n * n);
+  for (int j = 0; j < n; ++j)
+    for (int i = 0; i < n; ++i) {
+      int v = j * (n + 1) + i;
+      corners.col(2 * (j * n + i)) << v, v + 1, v + n + 2;
+      corners.col(2 * (j * n + i) + 1) << v, v + n + 2, v + n + 1;
+    }
+  if (elementOrder != ElementOrder::ROWS) {
+    std::vector<int> order(corners.cols());
+    std::iota(order.begin(), order.end(), 0);
+    if (elementOrder == ElementOrder::REVERSED_ROWS)
+      std::reverse(order.begin(), order.end());
+    else
+      std::shuffle(order.begin(), order.end(), std::mt19937(1));
+    Fmm::Matrix<int> orderedCorners(3, corners.cols());
+    for (int i = 0; i < corners.cols(); ++i)
+      orderedCorners.col(i) = corners.col(order[i]);
+    corners.swap(orderedCorners);
+  }
+
+  Bempp::GridParameters params;
+  params.topology = Bempp::GridParameters::TRIANGULAR;
+  return Bempp::GridFactory::createGridFromConnectivityArrays(params, vertices,
+                                                              corners);
+}
+
+#endif
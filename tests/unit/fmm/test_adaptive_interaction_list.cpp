@@ -0,0 +1,144 @@
+// Copyright (C) 2011 by the BEM++ Authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "planar_grid.hpp"
+
+#include "fmm/adaptive_interaction_list.hpp"
+#include "fmm/octree.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+#include <map>
+#include <utility>
+#include <vector>
+
+using namespace Fmm;
+
+namespace {
+
+typedef std::pair<unsigned long, unsigned int> Box;
+
+// Leafs below a box, including the box itself if it is a leaf.
+void leafDescendants(const Octree &octree, Box box, std::vector<Box> &leafs) {
+  if (octree.isEmpty(box.first, box.second))
+    return;
+  if (octree.isLeaf(box.first, box.second)) {
+    leafs.push_back(box);
+    return;
+  }
+  for (unsigned long child = box.first << 3; child < (box.first + 1) << 3;
+       ++child)
+    leafDescendants(octree, {child, box.second + 1}, leafs);
+}
+
+std::vector<Box> leafDescendants(const Octree &octree, Box box) {
+  std::vector<Box> leafs;
+  leafDescendants(octree, box, leafs);
+  return leafs;
+}
+
+std::vector<Box> interactionList(const Octree &octree, Box box,
+                                 AdaptiveInteractionList::ListType type) {
+  std::vector<Box> boxes;
+  for (AdaptiveInteractionList list(octree, box.first, box.second, type);
+       !list.finished(); list.next())
+    boxes.push_back({*list, list.level()});
+  return boxes;
+}
+
+// Count how often the lists of all boxes couple each ordered pair of a
+// target and a source leaf. The U and W lists of a leaf hold sources of
+// the leaf, the V and X lists of a box hold sources of all leafs below it.
+std::map<std::pair<Box, Box>, int> countInteractions(const Octree &octree) {
+  std::map<std::pair<Box, Box>, int> counts;
+  for (unsigned int level = 1; level <= octree.levels(); ++level)
+    for (auto index : octree.getNonEmptyNodes(level)) {
+      Box box(index, level);
+      auto targets = leafDescendants(octree, box);
+
+      if (octree.isLeaf(index, level)) {
+        for (auto source :
+             interactionList(octree, box, AdaptiveInteractionList::U_LIST)) {
+          BOOST_CHECK(octree.isLeaf(source.first, source.second));
+          ++counts[{box, source}];
+        }
+        for (auto w :
+             interactionList(octree, box, AdaptiveInteractionList::W_LIST))
+          for (auto source : leafDescendants(octree, w))
+            ++counts[{box, source}];
+      }
+
+      for (auto v :
+           interactionList(octree, box, AdaptiveInteractionList::V_LIST))
+        for (auto source : leafDescendants(octree, v))
+          for (auto target : targets)
+            ++counts[{target, source}];
+
+      for (auto source :
+           interactionList(octree, box, AdaptiveInteractionList::X_LIST)) {
+        BOOST_CHECK(octree.isLeaf(source.first, source.second));
+        for (auto target : targets)
+          ++counts[{target, source}];
+      }
+    }
+  return counts;
+}
+
+void checkInteractions(const Octree &octree) {
+  std::vector<Box> leafs;
+  for (auto index : octree.getNonEmptyNodes(1))
+    leafDescendants(octree, {index, 1}, leafs);
+
+  auto counts = countInteractions(octree);
+  BOOST_CHECK_EQUAL(counts.size(), leafs.size() * leafs.size());
+  int wrongCounts = 0;
+  for (const auto &count : counts)
+    if (count.second != 1)
+      ++wrongCounts;
+  BOOST_CHECK_EQUAL(wrongCounts, 0);
+}
+}
+
+BOOST_AUTO_TEST_SUITE(AdaptiveInteractionLists)
+
+BOOST_AUTO_TEST_CASE(lists_of_uniform_octree_cover_every_pair_once) {
+  auto grid = planarGrid(32);
+  checkInteractions(Octree(grid, 4));
+}
+
+BOOST_AUTO_TEST_CASE(lists_of_adaptive_octree_cover_every_pair_once) {
+  // The graded grid gives leafs on several levels, so that all four lists
+  // are used.
+  auto grid = planarGrid(80, 3, ElementOrder::REVERSED_ROWS);
+  Octree octree(grid, -1, 4);
+  checkInteractions(octree);
+
+  bool wListUsed = false;
+  for (unsigned int level = 1; level <= octree.levels(); ++level)
+    for (auto index : octree.getNonEmptyNodes(level))
+      if (octree.isLeaf(index, level) &&
+          !interactionList(octree, {index, level},
+                           AdaptiveInteractionList::W_LIST)
+               .empty())
+        wListUsed = true;
+  BOOST_CHECK(wListUsed);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
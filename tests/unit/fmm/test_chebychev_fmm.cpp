@@ -0,0 +1,172 @@
+// Copyright (C) 2011 by the BEM++ Authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "planar_grid.hpp"
+
+#include "fmm/chebychev_fmm.hpp"
+#include "fmm/fmm_kernel.hpp"
+#include "fmm/octree.hpp"
+#include "grid/grid.hpp"
+#include "grid/grid_view.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <cmath>
+#include <string>
+#include <vector>
+
+using namespace Fmm;
+
+namespace {
+
+const int ORDER = 3;
+
+// Laplace kernel that counts its evaluations, which only happen when the
+// M2L operators are compressed.
+class CountingKernel : public LaplaceKernel<double> {
+
+public:
+  explicit CountingKernel(const std::string &identifier)
+      : m_identifier(identifier), m_evaluations(0) {}
+
+  void evaluate(const Matrix<double> &targets, const Matrix<double> &sources,
+                Matrix<double> &values) const override {
+    ++m_evaluations;
+    LaplaceKernel<double>::evaluate(targets, sources, values);
+  }
+
+  std::string identifier() const override { return m_identifier; }
+
+  int evaluations() const { return m_evaluations; }
+
+private:
+  std::string m_identifier;
+  mutable std::atomic<int> m_evaluations;
+};
+
+struct PlanarFmmFixture {
+  // Leafs much wider than the elements keep the interpolation boxes small,
+  // so that the M2L operators have singular values below the tolerance.
+  PlanarFmmFixture() : grid(planarGrid(64)), octree(new Octree(grid, 3)) {
+    Matrix<int> corners;
+    Matrix<char> auxData;
+    grid->leafView()->getRawElementData(vertices, corners, auxData);
+    centroids.resize(3, corners.cols());
+    for (int element = 0; element < corners.cols(); ++element)
+      centroids.col(element) = (vertices.col(corners(0, element)) +
+                                vertices.col(corners(1, element)) +
+                                vertices.col(corners(2, element))) /
+                               3;
+  }
+
+  // FMM of the kernel between the element centroids, without near field.
+  shared_ptr<ChebychevFmm<double>>
+  createFmm(const shared_ptr<const FmmKernel<double>> &kernel,
+            bool truncateM2l = true) const {
+    shared_ptr<ChebychevFmm<double>> fmm(new ChebychevFmm<double>(
+        octree, kernel, ORDER, centroids.cols(), centroids.cols(),
+        truncateM2l));
+    for (auto leaf : fmm->leafs()) {
+      std::vector<unsigned int> entities;
+      octree->getLeafCubeEntities(entities, leaf);
+      std::vector<std::size_t> dofs(entities.begin(), entities.end());
+      Matrix<double> points(3, dofs.size());
+      for (std::size_t k = 0; k < dofs.size(); ++k)
+        points.col(k) = centroids.col(dofs[k]);
+      Matrix<double> values;
+      fmm->interpolationValues(leaf, points, values);
+      fmm->setLeafMatrices(leaf, dofs, values, dofs, values.transpose());
+    }
+    return fmm;
+  }
+
+  Matrix<double> apply(const ChebychevFmm<double> &fmm, Matrix<double> x,
+                       Bempp::TranspositionMode trans) const {
+    Matrix<double> y(centroids.cols(), x.cols());
+    fmm.apply(x, y, trans, 1., 0.);
+    return y;
+  }
+
+  shared_ptr<const Bempp::Grid> grid;
+  shared_ptr<const Octree> octree;
+  Matrix<double> vertices;
+  Matrix<double> centroids;
+};
+}
+
+BOOST_FIXTURE_TEST_SUITE(ChebychevFmmM2l, PlanarFmmFixture)
+
+BOOST_AUTO_TEST_CASE(truncated_far_field_matches_untruncated_far_field) {
+  shared_ptr<const FmmKernel<double>> kernel(new LaplaceKernel<double>());
+  auto truncated = createFmm(kernel);
+  auto untruncated = createFmm(kernel, false);
+
+  // The singular values are truncated below 10^-(order + 1) of the largest.
+  double tolerance = 10 * std::pow(10., -(ORDER + 1));
+  Matrix<double> x = Matrix<double>::Random(centroids.cols(), 2);
+  for (auto trans : {Bempp::NO_TRANSPOSE, Bempp::TRANSPOSE}) {
+    Matrix<double> expected = apply(*untruncated, x, trans);
+    Matrix<double> actual = apply(*truncated, x, trans);
+    BOOST_CHECK_GT((actual - expected).norm(), 0);
+    BOOST_CHECK_LE((actual - expected).norm(), tolerance * expected.norm());
+  }
+}
+
+BOOST_AUTO_TEST_CASE(m2l_operators_are_shared_while_in_use) {
+  shared_ptr<const CountingKernel> kernel(
+      new CountingKernel("counting-laplace-shared"));
+  shared_ptr<const CountingKernel> sameKernel(
+      new CountingKernel("counting-laplace-shared"));
+
+  Matrix<double> x = Matrix<double>::Random(centroids.cols(), 1);
+  {
+    auto first = createFmm(kernel);
+    BOOST_CHECK_GT(kernel->evaluations(), 0);
+
+    // A kernel with the same identifier hits the cache and gives the same
+    // result.
+    auto second = createFmm(sameKernel);
+    BOOST_CHECK_EQUAL(sameKernel->evaluations(), 0);
+    Matrix<double> expected = apply(*first, x, Bempp::NO_TRANSPOSE);
+    Matrix<double> actual = apply(*second, x, Bempp::NO_TRANSPOSE);
+    BOOST_CHECK_SMALL((actual - expected).norm(), 1e-14 * expected.norm());
+
+    // Untruncated operators are cached separately.
+    createFmm(sameKernel, false);
+    BOOST_CHECK_GT(sameKernel->evaluations(), 0);
+  }
+
+  // The cache does not keep the operators of destroyed instances alive.
+  int evaluations = kernel->evaluations();
+  createFmm(kernel);
+  BOOST_CHECK_EQUAL(kernel->evaluations(), 2 * evaluations);
+}
+
+BOOST_AUTO_TEST_CASE(m2l_operators_of_anonymous_kernels_are_not_shared) {
+  shared_ptr<const CountingKernel> kernel(new CountingKernel(""));
+  auto first = createFmm(kernel);
+  int evaluations = kernel->evaluations();
+  BOOST_CHECK_GT(evaluations, 0);
+  auto second = createFmm(kernel);
+  BOOST_CHECK_EQUAL(kernel->evaluations(), 2 * evaluations);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
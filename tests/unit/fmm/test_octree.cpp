@@ -0,0 +1,217 @@
+// Copyright (C) 2011 by the BEM++ Authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "planar_grid.hpp"
+
+#include "fmm/octree.hpp"
+#include "grid/grid.hpp"
+#include "grid/grid_view.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <map>
+#include <numeric>
+#include <random>
+#include <utility>
+#include <vector>
+
+using namespace Fmm;
+
+namespace {
+
+// Elements of the boxes of a level, found by locating the centroid of every
+// element. The elements of each box are ordered by their leaf and then by
+// their index, as in a stable sort by the leaf keys.
+std::map<unsigned long, std::vector<unsigned int>>
+bucketElements(const Octree &octree, const Bempp::Grid &grid,
+               unsigned int level) {
+  Matrix<double> vertices;
+  Matrix<int> corners;
+  Matrix<char> auxData;
+  grid.leafView()->getRawElementData(vertices, corners, auxData);
+
+  std::map<unsigned long, std::vector<std::pair<unsigned long, unsigned int>>>
+      leafs;
+  for (int element = 0; element < corners.cols(); ++element) {
+    Vector<double> centroid = (vertices.col(corners(0, element)) +
+                               vertices.col(corners(1, element)) +
+                               vertices.col(corners(2, element))) /
+                              3;
+    unsigned long leaf = octree.getLeafContainingPoint(
+        {centroid(0), centroid(1), centroid(2)});
+    leafs[leaf >> 3 * (octree.levels() - level)].push_back({leaf, element});
+  }
+
+  std::map<unsigned long, std::vector<unsigned int>> buckets;
+  for (auto &box : leafs) {
+    std::sort(box.second.begin(), box.second.end());
+    for (const auto &leaf : box.second)
+      buckets[box.first].push_back(leaf.second);
+  }
+  return buckets;
+}
+
+void checkRadixSort(std::vector<unsigned long> keys, unsigned int bits) {
+  std::vector<unsigned int> values(keys.size());
+  std::iota(values.begin(), values.end(), 0);
+  std::vector<unsigned int> expected = values;
+  std::stable_sort(expected.begin(), expected.end(),
+                   [&keys](unsigned int i, unsigned int j) {
+                     return keys[i] < keys[j];
+                   });
+
+  std::vector<unsigned long> sortedKeys = keys;
+  Octree::radixSort(sortedKeys, values, bits);
+  std::vector<unsigned long> expectedKeys;
+  for (auto i : expected)
+    expectedKeys.push_back(keys[i]);
+  BOOST_CHECK(values == expected);
+  BOOST_CHECK(sortedKeys == expectedKeys);
+}
+
+// Check that the extended box of every non-empty box contains the corners
+// of its elements.
+void checkExtendedBoxes(const Octree &octree, const Bempp::Grid &grid) {
+  Matrix<double> vertices;
+  Matrix<int> corners;
+  Matrix<char> auxData;
+  grid.leafView()->getRawElementData(vertices, corners, auxData);
+
+  for (unsigned int level = 1; level <= octree.levels(); ++level)
+    for (auto node : octree.getNonEmptyNodes(level)) {
+      Vector<double> lbound, ubound;
+      octree.extendedCubeBounds(node, level, lbound, ubound);
+      std::vector<unsigned int> entities;
+      octree.getCubeEntities(entities, node, level);
+      for (auto element : entities)
+        for (int corner = 0; corner < 3; ++corner) {
+          Vector<double> vertex = vertices.col(corners(corner, element));
+          BOOST_CHECK(((vertex - lbound).array() >= -1e-12).all());
+          BOOST_CHECK(((ubound - vertex).array() >= -1e-12).all());
+        }
+    }
+}
+}
+
+BOOST_AUTO_TEST_SUITE(OctreeSort)
+
+BOOST_AUTO_TEST_CASE(radix_sort_is_stable_with_duplicate_keys) {
+  // More keys than one chunk of the parallel sort, with few distinct keys.
+  std::mt19937 generator(1);
+  std::uniform_int_distribution<unsigned long> key(0, 99);
+  std::vector<unsigned long> keys(200000);
+  for (auto &k : keys)
+    k = key(generator) << 20;
+  checkRadixSort(keys, 27);
+}
+
+BOOST_AUTO_TEST_CASE(radix_sort_handles_trivial_input) {
+  checkRadixSort(std::vector<unsigned long>(), 30);
+  checkRadixSort(std::vector<unsigned long>(1000, 5), 30);
+}
+
+BOOST_AUTO_TEST_CASE(uniform_octree_matches_brute_force_buckets) {
+  auto grid = planarGrid(40);
+  Octree octree(grid, 3);
+  BOOST_REQUIRE_EQUAL(octree.levels(), 3u);
+
+  for (unsigned int level = 1; level <= octree.levels(); ++level) {
+    auto buckets = bucketElements(octree, *grid, level);
+    std::vector<unsigned long> nodes;
+    for (const auto &bucket : buckets)
+      nodes.push_back(bucket.first);
+    BOOST_CHECK(octree.getNonEmptyNodes(level) == nodes);
+
+    for (unsigned long node = 0; node < octree.getNodesPerLevel(level);
+         ++node) {
+      auto bucket = buckets.find(node);
+      bool empty = (bucket == buckets.end());
+      BOOST_CHECK_EQUAL(octree.isEmpty(node, level), empty);
+      BOOST_CHECK_EQUAL(octree.isLeaf(node, level),
+                        !empty && level == octree.levels());
+      std::vector<unsigned int> entities;
+      octree.getCubeEntities(entities, node, level);
+      if (empty)
+        BOOST_CHECK(entities.empty());
+      else
+        BOOST_CHECK(entities == bucket->second);
+      if (level == octree.levels()) {
+        std::vector<unsigned int> leafEntities;
+        octree.getLeafCubeEntities(leafEntities, node);
+        BOOST_CHECK(leafEntities == entities);
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(adaptive_octree_matches_brute_force_buckets) {
+  const int n = 80;
+  auto grid = planarGrid(n, 3);
+  Octree octree(grid, -1, 16);
+
+  std::vector<unsigned int> leafCount(2 * n * n, 0);
+  for (unsigned int level = 1; level <= octree.levels(); ++level) {
+    auto buckets = bucketElements(octree, *grid, level);
+    for (unsigned long node = 0; node < octree.getNodesPerLevel(level);
+         ++node) {
+      // A box exists if it holds elements and its parent was subdivided.
+      auto bucket = buckets.find(node);
+      unsigned long parent = octree.getParent(node);
+      bool exists = bucket != buckets.end() &&
+                    (level == 1 || (!octree.isEmpty(parent, level - 1) &&
+                                    !octree.isLeaf(parent, level - 1)));
+      BOOST_CHECK_EQUAL(octree.isEmpty(node, level), !exists);
+      if (!exists)
+        continue;
+
+      // The elements are sorted by keys below the deepest level, so only
+      // the sets are compared.
+      std::vector<unsigned int> entities;
+      octree.getCubeEntities(entities, node, level);
+      std::vector<unsigned int> expected = bucket->second;
+      std::sort(entities.begin(), entities.end());
+      std::sort(expected.begin(), expected.end());
+      BOOST_CHECK(entities == expected);
+      if (octree.isLeaf(node, level))
+        for (auto element : entities)
+          ++leafCount[element];
+    }
+  }
+
+  // The leafs partition the elements.
+  for (auto count : leafCount)
+    BOOST_CHECK_EQUAL(count, 1u);
+}
+
+BOOST_AUTO_TEST_CASE(extended_boxes_contain_their_elements) {
+  auto grid = planarGrid(40);
+  checkExtendedBoxes(Octree(grid, 3), *grid);
+}
+
+BOOST_AUTO_TEST_CASE(adaptive_extended_boxes_contain_their_elements) {
+  // The sizes of the elements vary by orders of magnitude, and the large
+  // elements come first, so that the boxes near the origin would be sized
+  // by the diameters of large elements if they were looked up by position.
+  auto grid = planarGrid(80, 3, ElementOrder::REVERSED_ROWS);
+  checkExtendedBoxes(Octree(grid, -1, 4), *grid);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,167 @@
+// Copyright (C) 2011 by the BEM++ Authors
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+
+#include "hmat/partition.hpp"
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <random>
+
+using namespace hmat;
+
+namespace {
+
+// Units of random sizes with random costs. Some units have no cost.
+void randomUnits(std::size_t numberOfUnits, std::vector<std::size_t> &starts,
+                 std::vector<double> &costs) {
+  std::mt19937 generator(1);
+  std::uniform_int_distribution<std::size_t> size(1, 20);
+  std::uniform_real_distribution<double> cost(0, 1);
+  starts.assign(1, 0);
+  costs.clear();
+  for (std::size_t unit = 0; unit < numberOfUnits; ++unit) {
+    starts.push_back(starts.back() + size(generator));
+    costs.push_back((unit % 5 == 3) ? 0 : cost(generator));
+  }
+}
+
+// Output ranges of leafs with random clusters, dealt to the processes by
+// their start.
+std::vector<std::vector<IndexRangeType>>
+randomLeafRanges(const std::vector<std::size_t> &offsets) {
+  std::mt19937 generator(2);
+  std::size_t size = offsets.back();
+  std::uniform_int_distribution<std::size_t> index(0, size - 1);
+  std::vector<std::vector<IndexRangeType>> ranges(offsets.size() - 1);
+  for (int leaf = 0; leaf < 500; ++leaf) {
+    std::size_t start = index(generator);
+    std::size_t end = std::min(size, start + 1 + index(generator) / 8);
+    std::size_t owner =
+        std::upper_bound(offsets.begin(), offsets.end(), start) -
+        offsets.begin() - 1;
+    ranges[owner].push_back(IndexRangeType{{start, end}});
+  }
+  return ranges;
+}
+
+void checkPartition(const std::vector<std::size_t> &starts,
+                    const std::vector<double> &costs, std::size_t nproc) {
+  auto offsets = partitionByCost(starts, costs, nproc);
+  BOOST_REQUIRE_EQUAL(offsets.size(), nproc + 1);
+  BOOST_CHECK_EQUAL(offsets.front(), 0u);
+  BOOST_CHECK_EQUAL(offsets.back(), starts.back());
+
+  double totalCost = 0;
+  double maxCost = 0;
+  for (auto cost : costs) {
+    totalCost += cost;
+    maxCost = std::max(maxCost, cost);
+  }
+  for (std::size_t proc = 0; proc < nproc; ++proc) {
+    BOOST_CHECK(offsets[proc] <= offsets[proc + 1]);
+    // Ranges are split at unit boundaries.
+    BOOST_CHECK(std::binary_search(starts.begin(), starts.end(),
+                                   offsets[proc]));
+    // A range exceeds its share by less than one unit.
+    double cost = 0;
+    for (std::size_t unit = 0; unit < costs.size(); ++unit)
+      if (starts[unit] >= offsets[proc] && starts[unit] < offsets[proc + 1])
+        cost += costs[unit];
+    BOOST_CHECK(cost <= totalCost / nproc + maxCost + 1e-12);
+  }
+}
+
+void checkSendRanges(const std::vector<std::size_t> &offsets) {
+  std::size_t nproc = offsets.size() - 1;
+  auto leafRanges = randomLeafRanges(offsets);
+  for (std::size_t rank = 0; rank < nproc; ++rank) {
+    auto sendRanges = partitionSendRanges(offsets, rank, leafRanges[rank]);
+    BOOST_REQUIRE_EQUAL(sendRanges.size(), nproc);
+    for (std::size_t proc = 0; proc < nproc; ++proc) {
+      // Hull of the parts of the leaf ranges in the range of proc.
+      IndexRangeType expected{{0, 0}};
+      if (proc != rank) {
+        for (const auto &range : leafRanges[rank]) {
+          std::size_t start = std::max(range[0], offsets[proc]);
+          std::size_t end = std::min(range[1], offsets[proc + 1]);
+          if (start >= end)
+            continue;
+          if (expected[0] == expected[1])
+            expected = IndexRangeType{{start, end}};
+          expected[0] = std::min(expected[0], start);
+          expected[1] = std::max(expected[1], end);
+        }
+      }
+      BOOST_CHECK(sendRanges[proc] == expected);
+    }
+  }
+}
+}
+
+BOOST_AUTO_TEST_SUITE(Partition)
+
+BOOST_AUTO_TEST_CASE(single_process_owns_everything) {
+  std::vector<std::size_t> starts;
+  std::vector<double> costs;
+  randomUnits(50, starts, costs);
+  auto offsets = partitionByCost(starts, costs, 1);
+  BOOST_REQUIRE_EQUAL(offsets.size(), 2u);
+  BOOST_CHECK_EQUAL(offsets[0], 0u);
+  BOOST_CHECK_EQUAL(offsets[1], starts.back());
+
+  auto sendRanges = partitionSendRanges(
+      offsets, 0, std::vector<IndexRangeType>{{{0, starts.back()}}});
+  BOOST_REQUIRE_EQUAL(sendRanges.size(), 1u);
+  BOOST_CHECK(sendRanges[0][0] == sendRanges[0][1]);
+}
+
+BOOST_AUTO_TEST_CASE(ranges_are_balanced) {
+  std::vector<std::size_t> starts;
+  std::vector<double> costs;
+  randomUnits(50, starts, costs);
+  for (std::size_t nproc : {2, 3, 4, 7})
+    checkPartition(starts, costs, nproc);
+}
+
+BOOST_AUTO_TEST_CASE(more_processes_than_units_leave_empty_ranges) {
+  std::vector<std::size_t> starts;
+  std::vector<double> costs;
+  randomUnits(3, starts, costs);
+  checkPartition(starts, costs, 8);
+}
+
+BOOST_AUTO_TEST_CASE(zero_costs_are_partitioned) {
+  std::vector<std::size_t> starts;
+  std::vector<double> costs;
+  randomUnits(20, starts, costs);
+  costs.assign(costs.size(), 0);
+  checkPartition(starts, costs, 4);
+}
+
+BOOST_AUTO_TEST_CASE(send_ranges_cover_remote_output) {
+  std::vector<std::size_t> starts;
+  std::vector<double> costs;
+  randomUnits(50, starts, costs);
+  for (std::size_t nproc : {1, 2, 4, 7})
+    checkSendRanges(partitionByCost(starts, costs, nproc));
+}
+
+BOOST_AUTO_TEST_SUITE_END()